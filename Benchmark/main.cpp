@@ -0,0 +1,121 @@
+#include <iostream>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "document_base.h"
+#include "rga_document.h"
+#include "pos_helpers.h"
+
+// Compares TextContainer based BaseDocument with RgaDocument on the same multi-user edit trace
+
+enum class EditType { write, newLine, erase, move };
+
+struct Edit {
+	EditType type;
+	int user;
+	char value;
+	int seed; // Picks the cursor position for move
+};
+
+using Clock = std::chrono::steady_clock;
+
+static std::vector<Edit> makeTrace(const int users, const int edits, const unsigned int seed) {
+	std::mt19937 gen{ seed };
+	std::uniform_int_distribution<int> userDist{ 0, users - 1 };
+	std::uniform_int_distribution<int> actionDist{ 0, 99 };
+	std::uniform_int_distribution<int> charDist{ 'a', 'z' };
+	std::uniform_int_distribution<int> seedDist{ 0, 1 << 20 };
+	std::vector<Edit> trace;
+	trace.reserve(edits);
+	for (int i = 0; i < edits; i++) {
+		int action = actionDist(gen);
+		EditType type = action < 70 ? EditType::write : action < 78 ? EditType::newLine : action < 95 ? EditType::erase : EditType::move;
+		trace.push_back(Edit{ type, userDist(gen), static_cast<char>(charDist(gen)), seedDist(gen) });
+	}
+	return trace;
+}
+
+template<typename Doc>
+static void applyEdit(Doc& doc, const Edit& edit) {
+	switch (edit.type) {
+	case EditType::write:
+		doc.write(edit.user, std::string(1, edit.value));
+		break;
+	case EditType::newLine:
+		doc.write(edit.user, "\n");
+		break;
+	case EditType::erase:
+		doc.erase(edit.user, 1);
+		break;
+	case EditType::move: {
+		// Random position which exists in the document
+		COORD endPos = doc.getEndPos();
+		int y = edit.seed % (endPos.Y + 1);
+		int x = edit.seed % (doc.getLine(y).size() + 1);
+		doc.setCursorPos(edit.user, makeCoord(x, y));
+		break;
+	}
+	}
+}
+
+static double elapsedMs(const Clock::time_point& start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+	int users = 8;
+	int edits = 50000;
+	unsigned int seed = 7;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string key{ argv[i] };
+		if (key == "--users") {
+			users = std::stoi(argv[i + 1]);
+		}
+		else if (key == "--edits") {
+			edits = std::stoi(argv[i + 1]);
+		}
+		else if (key == "--seed") {
+			seed = std::stoi(argv[i + 1]);
+		}
+	}
+	auto trace = makeTrace(users, edits, seed);
+	std::cout << "Trace: " << users << " users, " << edits << " edits, seed " << seed << "\n";
+
+	BaseDocument textContainerDoc{ "", users, 0 };
+	for (int i = 0; i < users; i++) {
+		textContainerDoc.addUser();
+	}
+	auto start = Clock::now();
+	for (const auto& edit : trace) {
+		applyEdit(textContainerDoc, edit);
+	}
+	std::cout << "TextContainer local:  " << elapsedMs(start) << " ms\n";
+
+	RgaDocument local{ "", users, 0, 1 };
+	start = Clock::now();
+	for (const auto& edit : trace) {
+		applyEdit(local, edit);
+	}
+	std::cout << "RGA local:            " << elapsedMs(start) << " ms\n";
+
+	RgaDocument remote{ "", users, 0, 2 };
+	auto ops = local.takeOps();
+	start = Clock::now();
+	for (const auto& op : ops) {
+		remote.apply(op);
+	}
+	std::cout << "RGA remote:           " << elapsedMs(start) << " ms (" << ops.size() << " ops)\n";
+
+	size_t tombstones = local.getTombstoneCount();
+	local.acknowledge(2, remote.getClock());
+	start = Clock::now();
+	size_t collected = local.collectGarbage();
+	std::cout << "RGA garbage collect:  " << elapsedMs(start) << " ms (" << collected << " of " << tombstones << " tombstones)\n";
+
+	bool converged = textContainerDoc.getText() == local.getText() && local.getText() == remote.getText();
+	std::cout << "Text size " << local.getText().size() << (converged ? ", engines agree\n" : ", ENGINES DIVERGED\n");
+	return converged ? 0 : 1;
+}
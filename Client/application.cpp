@@ -26,6 +26,9 @@ bool Application::connect(const std::string& ip, const int port) {
 
 bool Application::disconnect() {
     bool disconnected = tcpClient.disconnect();
+    restoring = false;
+    credentials.reset();
+    docFilename.clear();
     if (disconnected) {
         repo.cleanAcCode();
         repo.cleanAuthToken();
@@ -123,6 +126,8 @@ bool Application::checkBufferWasResized() {
 
 bool Application::checkIncomingMessages() {
     int needRender = 0;
+    // Checked before the queue is drained, then every message of the broken connection is applied before it is restored
+    restoring = restoring || tcpClient.isConnectionLost();
     while (true) {
         msg::Buffer msgBuffer = tcpClient.getNextMsg();
         if (msgBuffer.empty()) {
@@ -130,10 +135,57 @@ bool Application::checkIncomingMessages() {
         }
         needRender += repo.processMsg(windowsManager.getTextEditor()->getDocMutable(), msgBuffer);
     }
+    if (restoring) {
+        needRender += restoreConnection();
+    }
     needRender += checkBufferWasResized();
     return needRender;
 }
 
+bool Application::restoreConnection() {
+    auto now = std::chrono::steady_clock::now();
+    if (now < nextRestoreAttempt) {
+        return false;
+    }
+    nextRestoreAttempt = now + restoreInterval;
+    // Updates received before the connection broke are already applied, the session resumes from the version they reached
+    if (!tcpClient.reconnect()) {
+        logger.logError("Cannot reconnect to the server, trying again");
+        return false;
+    }
+    if (!credentials.has_value()) {
+        restoring = false;
+        return false;
+    }
+    // Server may not have noticed the broken connection yet and still hold the old login
+    tcpClient.sendMsg(credentials.value());
+    if (!waitForResponse(msg::Type::login, std::chrono::milliseconds(1), 1500) || !repo.getLastError().empty()) {
+        logger.logError("Cannot log in again, trying again");
+        tcpClient.disconnect();
+        return false;
+    }
+    auto acCode = repo.getAcCode();
+    if (acCode.empty()) {
+        restoring = false;
+        return true;
+    }
+    tcpClient.sendMsg(msg::ConnectJoinDoc{ msg::Type::join, msg::currentVersion, 0, acCode, repo.getDocVersion(), tcpClient.getPresencePort() });
+    bool joined = waitForResponse(msg::Type::join, std::chrono::milliseconds(1), 1500) && repo.getLastError().empty();
+    if (!joined && !docFilename.empty()) {
+        // Session was closed when the last user left, the document is opened again from its saved state
+        tcpClient.sendMsg(msg::ConnectCreateDoc{ msg::Type::load, msg::currentVersion, 0, docFilename, tcpClient.getPresencePort() });
+        joined = waitForResponse(msg::Type::load, std::chrono::milliseconds(1), 1500) && repo.getLastError().empty();
+    }
+    if (!joined) {
+        logger.logError("Cannot rejoin the document session");
+        repo.cleanAcCode();
+        windowsManager.getTextEditor()->clearContent();
+    }
+    logger.logInfo("Connection restored, document version", repo.getDocVersion());
+    restoring = false;
+    return true;
+}
+
 bool Application::waitForResponse(const msg::Type desiredType, const std::chrono::milliseconds& timeout, const int tries) {
     int currTry = 0;
     while (currTry < tries) {
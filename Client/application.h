@@ -23,6 +23,7 @@ public:
 	bool checkIncomingMessages();
 	bool checkBufferWasResized();
 	bool waitForResponse(const msg::Type type, const std::chrono::milliseconds& timeout, const int tries);
+	bool restoreConnection();
 	void render();
 	std::vector<Option> getMainMenuOptions() const;
 private:
@@ -35,4 +36,10 @@ private:
 
 	std::string srvIp;
 	int srvPort;
+	// Broken connection is restored with the same login and the document session is resumed from its last version
+	std::optional<msg::Login> credentials;
+	std::string docFilename; // Loaded or created document, it is loaded again if its session ended meanwhile
+	bool restoring = false;
+	std::chrono::steady_clock::time_point nextRestoreAttempt;
+	std::chrono::milliseconds restoreInterval{ 500 };
 };
@@ -78,10 +78,20 @@ void ApplicationEventHandlers::eventLoginPasswordAccepted(Application& app, cons
     if (!validateConnection(app)) {
         return;
     }
-    app.tcpClient.sendMsg(type, version, checkedWindows[0].window->get()->getDoc().getText(), checkedWindows[1].window->get()->getDoc().getText());
+    auto login = checkedWindows[0].window->get()->getDoc().getText();
+    auto password = checkedWindows[1].window->get()->getDoc().getText();
+    if (type == msg::Type::registration) {
+        app.tcpClient.sendMsg(msg::Register{ type, version, login, password });
+    }
+    else {
+        app.tcpClient.sendMsg(msg::Login{ type, version, login, password });
+    }
     if (!waitForResponseAndProccessIt(app, type)) {
         return;
     }
+    if (type == msg::Type::login) {
+        app.credentials = msg::Login{ type, version, login, password };
+    }
     app.windowsManager.destroyWindow(windows::login::name, app.tcpClient);
     app.windowsManager.destroyWindow(windows::password::name, app.tcpClient);
     app.windowsManager.destroyWindow(windows::mainmenu::name, app.tcpClient);
@@ -91,14 +101,6 @@ void ApplicationEventHandlers::eventLoginPasswordAccepted(Application& app, cons
     app.windowsManager.showWindow<InfoWindow>(
         makeGenericBuilder(screenSize, "Success", left, 0.4, width, 1), pEvent.params[0] + " successful"
     );
-
-    std::string authToken = app.repo.getAuthToken();
-    if (authToken.empty()) {
-        return;
-    }
-    auto textEditor = dynamic_cast<TextEditorWindow*>(app.windowsManager.getTextEditor().get());
-    assert(textEditor != nullptr);
-    textEditor->setAuthToken(authToken);
 }
 
 void ApplicationEventHandlers::eventMainMenuDisconnectChosen(Application& app, const Event& pEvent) {
@@ -126,7 +128,7 @@ void ApplicationEventHandlers::eventMainMenuJoinChosen(Application& app, const E
 
 void ApplicationEventHandlers::eventMainMenuLoadChosen(Application& app, const Event& pEvent) {
     msg::OneByteInt version = 1;
-    app.tcpClient.sendMsg(msg::Type::getDocNames, version, app.repo.getAuthToken());
+    app.tcpClient.sendMsg(msg::ControlMessage{ msg::Type::getDocNames, version, app.repo.getAuthToken() });
     if (!waitForResponseAndProccessIt(app, msg::Type::getDocNames)) {
         app.windowsManager.destroyWindow(pEvent.src, app.tcpClient);
         return;
@@ -180,7 +182,7 @@ void ApplicationEventHandlers::eventLoadItemClicked(Application& app, const Even
     });
 }
 void ApplicationEventHandlers::eventLoadItemAccepted(Application& app, const Event& pEvent) {
-    bool success = joinCreateDocImpl(msg::Type::load, 1, app, pEvent);
+    bool success = joinCreateDocImpl(msg::Type::load, msg::currentVersion, app, pEvent);
     if (success) {
         int width = 26;
         auto screenSize = app.terminal.getScreenSize();
@@ -196,7 +198,7 @@ void ApplicationEventHandlers::eventLoadItemAccepted(Application& app, const Eve
 void ApplicationEventHandlers::eventLoadItemDeleted(Application& app, const Event& pEvent) {
     assert(pEvent.params.size() > 0);
     msg::OneByteInt version = 1;
-    app.tcpClient.sendMsg(msg::Type::delDoc, version, app.repo.getAuthToken(), pEvent.params[0]);
+    app.tcpClient.sendMsg(msg::DeleteDoc{ msg::Type::delDoc, version, app.repo.getAuthToken(), pEvent.params[0] });
     if (!waitForResponseAndProccessIt(app, msg::Type::delDoc)) {
         app.windowsManager.destroyWindow(pEvent.src, app.tcpClient);
         return;
@@ -213,7 +215,7 @@ void ApplicationEventHandlers::eventLoadItemDeleted(Application& app, const Even
 }
 
 void ApplicationEventHandlers::eventCreateDoc(Application& app, const Event& pEvent) {
-    bool success = joinCreateDocImpl(msg::Type::create, 1, app, pEvent);
+    bool success = joinCreateDocImpl(msg::Type::create, msg::currentVersion, app, pEvent);
     if (success) {
         int width = 26;
         auto screenSize = app.terminal.getScreenSize();
@@ -226,7 +228,7 @@ void ApplicationEventHandlers::eventCreateDoc(Application& app, const Event& pEv
 }
 
 void ApplicationEventHandlers::eventJoinDoc(Application& app, const Event& pEvent) {
-    bool success = joinCreateDocImpl(msg::Type::join, 1, app, pEvent);
+    bool success = joinCreateDocImpl(msg::Type::join, msg::currentVersion, app, pEvent);
     if (success) {
         int width = 25;
         auto screenSize = app.terminal.getScreenSize();
@@ -259,12 +261,17 @@ bool ApplicationEventHandlers::joinCreateDocImpl(const msg::Type type, msg::OneB
     if (type != msg::Type::load && !validateTextInputWindow(app, app.windowsManager.findWindow(pEvent.src))) {
         return false;
     }
-    unsigned int socket = 0;
-    app.tcpClient.sendMsg(type, version, socket, params[0]);
+    if (type == msg::Type::join) {
+        app.tcpClient.sendMsg(msg::ConnectJoinDoc{ type, version, 0, params[0], 0, app.tcpClient.getPresencePort() });
+    }
+    else {
+        app.tcpClient.sendMsg(msg::ConnectCreateDoc{ type, version, 0, params[0], app.tcpClient.getPresencePort() });
+    }
     if (!waitForResponseAndProccessIt(app, type)) {
         app.windowsManager.destroyWindow(pEvent.src, app.tcpClient);
         return false;
     }
+    app.docFilename = type != msg::Type::join ? params[0] : "";
     app.windowsManager.destroyLastWindow(app.tcpClient);
     app.windowsManager.destroyWindow(windows::mainmenu::name, app.tcpClient);
     return true;
@@ -36,11 +36,19 @@ ClientSiteDocument::ClientSiteDocument(const std::string& text, const int nCurso
 }
 
 void ClientSiteDocument::findSegments(const std::string& pattern) {
+	if (predicted) {
+		rollbackPrediction();
+		findSegments(pattern);
+		replayPrediction();
+		return;
+	}
 	segments = container.findAll(pattern);
 	chosenSegment = -1;
 }
 
 void ClientSiteDocument::resetSegments() {
+	confirmedSegments.clear();
+	confirmedChosenSegment = -1;
 	segments.clear();
 	chosenSegment = -1;
 }
@@ -53,6 +61,9 @@ COORD ClientSiteDocument::getNextSegmentPos() {
 	if (chosenSegment >= segments.size()) {
 		chosenSegment = 0;
 	}
+	if (predicted) {
+		confirmedChosenSegment = chosenSegment;
+	}
 	return segments[chosenSegment].first;
 }
 
@@ -65,6 +76,7 @@ int ClientSiteDocument::getChosenSegmentIndex() const {
 }
 
 void ClientSiteDocument::clearContent() {
+	discardPredictions();
 	container.clear();
 	for (auto& user : users) {
 		user.cursor.setPosition(COORD{ 0, 0 });
@@ -72,6 +84,156 @@ void ClientSiteDocument::clearContent() {
 	}
 }
 
+bool ClientSiteDocument::setMyCursor(const int index) {
+	if (!validateUserIdx(index)) {
+		return false;
+	}
+	myUserIdx = index;
+	return true;
+}
+
+void ClientSiteDocument::setVersion(const unsigned int newVersion) {
+	version = newVersion;
+}
+
+unsigned int ClientSiteDocument::getVersion() const {
+	return version;
+}
+
+unsigned int ClientSiteDocument::predict(const LocalOp& op) {
+	if (!predicted) {
+		saveConfirmedState();
+		predicted = true;
+	}
+	pending.push_back(PendingOp{ ++lastSeq, op, {} });
+	applyLocal(pending.back());
+	return lastSeq;
+}
+
+bool ClientSiteDocument::reconcile(const bool ownEcho, const std::function<bool(ClientSiteDocument&)>& update) {
+	if (!predicted) {
+		return update(*this);
+	}
+	rollbackPrediction();
+	bool updated = update(*this);
+	if (ownEcho && !pending.empty()) {
+		pending.pop_front();
+	}
+	replayPrediction();
+	return updated;
+}
+
+bool ClientSiteDocument::rejectPrediction(const unsigned int seq) {
+	auto op = std::find_if(pending.begin(), pending.end(), [seq](const PendingOp& op) { return op.seq == seq; });
+	if (op == pending.end()) {
+		return false;
+	}
+	// Ops after the rejected one were applied on top of it, they are replayed without it
+	rollbackPrediction();
+	pending.erase(op);
+	replayPrediction();
+	return true;
+}
+
+void ClientSiteDocument::discardPredictions() {
+	if (predicted) {
+		rollbackPrediction();
+	}
+	pending.clear();
+	lastSeq = 0;
+}
+
+bool ClientSiteDocument::hasPredictions() const {
+	return !pending.empty();
+}
+
+void ClientSiteDocument::applyLocal(PendingOp& pendingOp) {
+	// Mirrors how the server applies the op at the user's cursor
+	pendingOp.edits.clear();
+	std::visit([this, &pendingOp](const auto& msg) {
+		using Msg = std::decay_t<decltype(msg)>;
+		if constexpr (std::is_same_v<Msg, msg::Write>) {
+			COORD from = getCursorPos(myUserIdx);
+			if (auto anchor = getCursorSelectionAnchor(myUserIdx)) {
+				from = (std::min)(from, anchor.value());
+			}
+			std::vector<std::string> erased{ "" };
+			erasedSink = &erased;
+			COORD to = write(myUserIdx, msg.text);
+			erasedSink = nullptr;
+			pendingOp.edits.push_back(Edit{ from, to, std::move(erased) });
+		}
+		else if constexpr (std::is_same_v<Msg, msg::Erase>) {
+			bool selecting = users[myUserIdx].isSelecting();
+			std::vector<std::string> erased;
+			erasedSink = &erased;
+			COORD from = erase(myUserIdx, msg.eraseSize);
+			erasedSink = nullptr;
+			if (!selecting) {
+				// Erasing backwards collects the lines from the cursor up
+				std::reverse(erased.begin(), erased.end());
+			}
+			pendingOp.edits.push_back(Edit{ from, from, std::move(erased) });
+		}
+		else if constexpr (std::is_same_v<Msg, msg::MoveHorizontal>) {
+			msg.side == msg::MoveSide::left ? moveCursorLeft(myUserIdx, msg.withSelect) : moveCursorRight(myUserIdx, msg.withSelect);
+		}
+		else if constexpr (std::is_same_v<Msg, msg::MoveVertical>) {
+			msg.side == msg::MoveSide::up ? moveCursorUp(myUserIdx, msg.clientWidth, msg.withSelect) : moveCursorDown(myUserIdx, msg.clientWidth, msg.withSelect);
+		}
+		else if constexpr (std::is_same_v<Msg, msg::MoveTo>) {
+			setCursorPos(myUserIdx, COORD{ (SHORT)msg.X, (SHORT)msg.Y });
+		}
+		else if constexpr (std::is_same_v<Msg, msg::MoveSelectAll>) {
+			setCursorPos(myUserIdx, getEndPos());
+			setCursorAnchor(myUserIdx, COORD{ 0, 0 });
+		}
+		// Replace, undo and redo depend on server state, they are only shown when echoed
+	}, pendingOp.op);
+}
+
+void ClientSiteDocument::undoEdit(const Edit& edit) {
+	std::vector<std::string> inserted;
+	if (edit.from != edit.to) {
+		container.eraseBetween(edit.from, edit.to, inserted);
+	}
+	if (!edit.removed.empty()) {
+		container.insert(edit.from, edit.removed);
+	}
+}
+
+void ClientSiteDocument::saveConfirmedState() {
+	confirmedUsers = users;
+	confirmedSegments = segments;
+	confirmedChosenSegment = chosenSegment;
+}
+
+void ClientSiteDocument::rollbackPrediction() {
+	for (auto op = pending.rbegin(); op != pending.rend(); ++op) {
+		for (auto edit = op->edits.rbegin(); edit != op->edits.rend(); ++edit) {
+			undoEdit(*edit);
+		}
+	}
+	// Edits shifted cursors and search results in ways they cannot be undone by, these are restored whole
+	users = std::move(confirmedUsers);
+	segments = std::move(confirmedSegments);
+	chosenSegment = confirmedChosenSegment;
+	confirmedUsers.clear();
+	confirmedSegments.clear();
+	predicted = false;
+}
+
+void ClientSiteDocument::replayPrediction() {
+	if (pending.empty()) {
+		return;
+	}
+	saveConfirmedState();
+	predicted = true;
+	for (auto& op : pending) {
+		applyLocal(op);
+	}
+}
+
 void ClientSiteDocument::setSegments(TextContainer::Segments& newSegments) {
 	segments = std::move(newSegments);
 }
@@ -110,6 +272,9 @@ void ClientSiteDocument::afterWriteAction(const int index, const COORD& startPos
 }
 
 void ClientSiteDocument::afterEraseAction(const int index, const COORD& startPos, const COORD& endPos, std::vector<std::string>& erasedText) {
+	if (erasedSink) {
+		*erasedSink = erasedText;
+	}
 	if (segments.empty()) {
 		return;
 	}
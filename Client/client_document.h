@@ -1,8 +1,14 @@
 #pragma once
+#include <deque>
+#include <variant>
+#include <functional>
+
 #include "document_base.h"
+#include "messages.h"
 
 class ClientSiteDocument : public BaseDocument {
 public:
+	using LocalOp = std::variant<msg::Write, msg::Erase, msg::MoveHorizontal, msg::MoveVertical, msg::MoveTo, msg::MoveSelectAll, msg::Replace, msg::ControlMessage>;
 	ClientSiteDocument();
 	ClientSiteDocument(const std::string& text);
 	ClientSiteDocument(const std::string& text, const int cursors, const int myUserIdx);
@@ -15,11 +21,48 @@ public:
 	void setSegments(TextContainer::Segments& newSegments);
 	void insertSegment(const COORD& startPos, const COORD& endPos, const int pos);
 	void clearContent();
+	bool setMyCursor(const int index);
+	void setVersion(const unsigned int newVersion);
+	unsigned int getVersion() const;
+
+	unsigned int predict(const LocalOp& op);
+	bool reconcile(const bool ownEcho, const std::function<bool(ClientSiteDocument&)>& update);
+	bool rejectPrediction(const unsigned int seq);
+	void discardPredictions();
+	bool hasPredictions() const;
 private:
+	// Text between from and to replaced the removed lines, undoing it needs no copy of the document
+	struct Edit {
+		COORD from;
+		COORD to;
+		std::vector<std::string> removed;
+	};
+	struct PendingOp {
+		unsigned int seq;
+		LocalOp op;
+		std::vector<Edit> edits; // Made when the op was last applied
+	};
+	void applyLocal(PendingOp& pendingOp);
+	void undoEdit(const Edit& edit);
+	void saveConfirmedState();
+	void rollbackPrediction();
+	void replayPrediction();
+
 	void moveSegment(std::pair<COORD, COORD>& segment, const COORD& startPos, const COORD& diff) const;
 	void afterWriteAction(const int index, const COORD& startPos, const COORD& endPos, std::vector<std::string>& writtenText) override;
 	void afterEraseAction(const int index, const COORD& startPos, const COORD& endPos, std::vector<std::string>& erasedText) override;
 
 	TextContainer::Segments segments;
 	int chosenSegment = -1;
+	unsigned int version = 0; // Last document version received from the server
+
+	// Prediction: local ops are shown right away and stay pending until the server echoes or rejects them.
+	// Server updates roll the pending ops back through their edits, apply to the acknowledged state and replay them.
+	std::deque<PendingOp> pending;
+	std::vector<User> confirmedUsers; // Cursors and search results of the acknowledged state
+	TextContainer::Segments confirmedSegments;
+	int confirmedChosenSegment = -1;
+	std::vector<std::string>* erasedSink = nullptr; // Collects text erased by the local op being applied
+	bool predicted = false; // Pending ops are applied on top of the acknowledged state
+	unsigned int lastSeq = 0;
 };
\ No newline at end of file
@@ -1,32 +1,38 @@
 #include "repository.h"
+#include "schema.h"
+#include "compression.h"
 #include "pos_helpers.h"
 #include "logging.h"
 
 namespace client {
 	bool Repository::processMsg(ClientSiteDocument& doc, msg::Buffer& buffer) {
+		if (msg::isCompressedFrame(buffer)) {
+			auto rawBuffer = msg::decompressFrame(buffer);
+			if (!rawBuffer) {
+				logger.logError("Malformed compressed message");
+				return false;
+			}
+			return processMsg(doc, *rawBuffer);
+		}
 		msg::Type msgType;
 		msg::parse(buffer, 0, msgType);
+		if (msg::isDocumentUpdate(msgType)) {
+			if (pendingSnapshot) {
+				deferredMsgs.emplace_back(std::move(buffer));
+				return false;
+			}
+			return update(doc, buffer, msgType);
+		}
 
 		switch (msgType) {
-		case msg::Type::write:
-			return write(doc, buffer);
-		case msg::Type::erase:
-			return erase(doc, buffer);
-		case msg::Type::selectAll:
-		case msg::Type::moveHorizontal:
-		case msg::Type::moveVertical:
-		case msg::Type::moveTo:
-			return move(doc, buffer);
 		case msg::Type::load:
 		case msg::Type::create:
 		case msg::Type::join:
 			return sync(doc, buffer);
-		case msg::Type::connect:
-			return connectNewUser(doc, buffer);
-		case msg::Type::disconnect:
-			return disconnectUser(doc, buffer);
-		case msg::Type::replace:
-			return replace(doc, buffer);
+		case msg::Type::snapshotChunk:
+			return snapshotChunk(doc, buffer);
+		case msg::Type::reject:
+			return reject(doc, buffer);
 		case msg::Type::login:
 			return login(doc, buffer);
 		case msg::Type::logout:
@@ -42,38 +48,172 @@ namespace client {
 		return false;
 	}
 
+	bool Repository::update(ClientSiteDocument& doc, msg::Buffer& buffer, const msg::Type type) {
+		if (type == msg::Type::presence) {
+			return presence(doc, buffer);
+		}
+		msg::Type msgType;
+		msg::OneByteInt version, user;
+		msg::parse(buffer, 0, msgType, version, user);
+		bool ownEcho = type != msg::Type::connect && type != msg::Type::disconnect && user == doc.getMyCursor();
+		bool updated = doc.reconcile(ownEcho, [&](ClientSiteDocument& target) {
+			switch (type) {
+			case msg::Type::write:
+				return write(target, buffer);
+			case msg::Type::erase:
+				return erase(target, buffer);
+			case msg::Type::selectAll:
+			case msg::Type::moveHorizontal:
+			case msg::Type::moveVertical:
+			case msg::Type::moveTo:
+				return move(target, buffer);
+			case msg::Type::connect:
+				return connectNewUser(target, buffer);
+			case msg::Type::disconnect:
+				return disconnectUser(target, buffer);
+			case msg::Type::replace:
+				return replace(target, buffer);
+			}
+			return false;
+		});
+		if (!msg::isVersioned(type)) {
+			return updated;
+		}
+		docVersion++;
+		doc.setVersion(docVersion);
+		if (resumedUser >= 0 && docVersion == resumedVersion) {
+			doc.setMyCursor(resumedUser);
+			resumedUser = -1;
+		}
+		if (pendingPresence && pendingPresence->docVersion == docVersion) {
+			auto frame = std::move(*pendingPresence);
+			pendingPresence.reset();
+			applyPresence(doc, frame);
+		}
+		return updated;
+	}
+
 	bool Repository::sync(ClientSiteDocument& doc, msg::Buffer& buffer) {
-		msg::ConnectResponse msg;
-		parse(buffer, 0, msg.type, msg.version, msg.user, lastError, acCode, msg.text, msg.cursorPositions);
+		auto parsed = msg::deserialize<msg::ConnectResponse>(buffer);
+		if (!parsed) {
+			logger.logError("Malformed connect message");
+			return false;
+		}
+		auto& msg = parsed.value();
+		lastError = msg.error;
+		acCode = msg.acCode;
+		pendingSnapshot.reset();
+		deferredMsgs.clear();
 		if (!lastError.empty()) {
 			logger.logDebug(lastError);
 			return false;
 		}
-		assert(msg.cursorPositions.size() == (msg.user + 1) * 2);
-		doc = ClientSiteDocument(msg.text, msg.user + 1, msg.user);
-		for (int i = 1; i < msg.cursorPositions.size(); i += 2) {
-			auto pos = COORD{ static_cast<SHORT>(msg.cursorPositions[i - 1]), static_cast<SHORT>(msg.cursorPositions[i]) };
+		if (msg.replayedOps > 0) {
+			return resume(doc, msg);
+		}
+		if (msg.snapshotSize > 0) {
+			logger.logInfo("Receiving document snapshot", msg.snapshotVersion, "of size", msg.snapshotSize);
+			msg.text.reserve(msg.snapshotSize);
+			pendingSnapshot = std::move(msg);
+			return true;
+		}
+		return applySnapshot(doc, msg);
+	}
+
+	bool Repository::snapshotChunk(ClientSiteDocument& doc, msg::Buffer& buffer) {
+		auto msg = msg::view<msg::SnapshotChunkView>(buffer);
+		if (!msg || !pendingSnapshot || msg->snapshotVersion != pendingSnapshot->snapshotVersion || msg->offset != pendingSnapshot->text.size()) {
+			logger.logError("Unexpected snapshot chunk");
+			return false;
+		}
+		pendingSnapshot->text += msg->text;
+		if (pendingSnapshot->text.size() < pendingSnapshot->snapshotSize) {
+			return false;
+		}
+		auto snapshot = std::move(*pendingSnapshot);
+		pendingSnapshot.reset();
+		applySnapshot(doc, snapshot);
+		auto deferred = std::move(deferredMsgs);
+		deferredMsgs.clear();
+		for (auto& deferredMsg : deferred) {
+			processMsg(doc, deferredMsg);
+		}
+		return true;
+	}
+
+	bool Repository::resume(ClientSiteDocument& doc, const msg::ConnectResponse& msg) {
+		if (docVersion + msg.replayedOps != msg.snapshotVersion) {
+			lastError = "Cannot resume document from version " + std::to_string(docVersion);
+			logger.logError(lastError);
+			return false;
+		}
+		logger.logInfo("Resuming document from version", docVersion, "with", msg.replayedOps, "missed updates");
+		doc.discardPredictions();
+		resumedVersion = msg.snapshotVersion;
+		resumedUser = msg.user;
+		return true;
+	}
+
+	bool Repository::reject(ClientSiteDocument& doc, msg::Buffer& buffer) {
+		auto parsed = msg::deserialize<msg::Reject>(buffer);
+		if (!parsed) {
+			logger.logError("Malformed reject message");
+			return false;
+		}
+		auto& msg = parsed.value();
+		logger.logDebug("Server rejected operation", msg.seq);
+		return doc.rejectPrediction(msg.seq);
+	}
+
+	bool Repository::applySnapshot(ClientSiteDocument& doc, const msg::ConnectResponse& snapshot) {
+		// Joining user is the last one, a resynced one keeps its place
+		int nUsers = snapshot.cursorPositions.size() / 2;
+		assert(snapshot.user < nUsers);
+		docVersion = snapshot.snapshotVersion;
+		resumedUser = -1;
+		presenceSeq = 0;
+		pendingPresence.reset();
+		doc = ClientSiteDocument(snapshot.text, nUsers, snapshot.user);
+		doc.setVersion(docVersion);
+		for (int i = 1; i < snapshot.cursorPositions.size(); i += 2) {
+			auto pos = COORD{ static_cast<SHORT>(snapshot.cursorPositions[i - 1]), static_cast<SHORT>(snapshot.cursorPositions[i]) };
 			doc.setCursorPos(i / 2, pos);
 		}
-		logger.logInfo("Connected to document (nUsers:", msg.user, ", text:" + msg.text + ")");
+		editAnchors.assign(nUsers, COORD{ 0, 0 });
+		for (int i = 1; i < snapshot.editAnchors.size() && i / 2 < editAnchors.size(); i += 2) {
+			editAnchors[i / 2] = makeCoord(snapshot.editAnchors[i - 1], snapshot.editAnchors[i]);
+		}
+		logger.logInfo("Connected to document (nUsers:", snapshot.user, ", text size:", snapshot.text.size(), ")");
 		return true;
 	}
 
 	bool Repository::connectNewUser(ClientSiteDocument& doc, msg::Buffer& buffer) {
 		logger.logInfo("Added new user to document");
+		editAnchors.push_back(COORD{ 0, 0 });
 		return doc.addUser();
 	}
 
 	bool Repository::disconnectUser(ClientSiteDocument& doc, msg::Buffer& buffer) {
-		msg::DisconnectResponse msg;
-		parse(buffer, 1, msg.version, msg.user);
+		auto parsed = msg::deserialize<msg::DisconnectResponse>(buffer);
+		if (!parsed) {
+			logger.logError("Malformed disconnect message");
+			return false;
+		}
+		auto& msg = parsed.value();
 		logger.logInfo("Disconnected user", msg.user);
+		if (msg.user < editAnchors.size()) {
+			editAnchors.erase(editAnchors.cbegin() + msg.user);
+		}
 		return doc.eraseUser(msg.user);
 	}
 
 	bool Repository::replace(ClientSiteDocument& doc, msg::Buffer& buffer) {
-		msg::ReplaceResponse msg;
-		parse(buffer, 1, msg.version, msg.user, msg.text, msg.segments);
+		auto parsed = msg::deserialize<msg::ReplaceResponse>(buffer);
+		if (!parsed) {
+			logger.logError("Malformed replace message");
+			return false;
+		}
+		auto& msg = parsed.value();
 		int myUser = doc.getMyCursor();
 		if (msg.user == myUser) {
 			doc.resetSegments();
@@ -93,34 +233,96 @@ namespace client {
 	}
 
 	bool Repository::write(ClientSiteDocument& doc, msg::Buffer& buffer) {
-		msg::WriteResponse msg;
-		parse(buffer, 1, msg.version, msg.user, msg.text, msg.X, msg.Y);
-		doc.setCursorPos(msg.user, makeCoord(msg.X, msg.Y));
-		doc.write(msg.user, msg.text);
-		logger.logInfo("User", msg.user, "wrote '" + msg.text + "' to document");
+		auto msg = msg::view<msg::WriteResponseView>(buffer, editAnchors);
+		if (!msg) {
+			logger.logError("Malformed write message");
+			return false;
+		}
+		doc.setCursorPos(msg->user, updateEditAnchor(msg->user, makeCoord(msg->X, msg->Y)));
+		doc.write(msg->user, msg->text);
+		logger.logInfo("User", msg->user, "wrote", msg->text, "to document");
 		return true;
 	}
 
 	bool Repository::erase(ClientSiteDocument& doc, msg::Buffer& buffer) {
-		msg::EraseResponse msg;
-		parse(buffer, 1, msg.version, msg.user, msg.eraseSize, msg.X, msg.Y);
-		doc.setCursorPos(msg.user, makeCoord(msg.X, msg.Y));
+		auto parsed = msg::deserialize<msg::EraseResponse>(buffer, editAnchors);
+		if (!parsed) {
+			logger.logError("Malformed erase message");
+			return false;
+		}
+		auto& msg = parsed.value();
+		doc.setCursorPos(msg.user, updateEditAnchor(msg.user, makeCoord(msg.X, msg.Y)));
 		doc.erase(msg.user, msg.eraseSize);
 		logger.logInfo("User", msg.user, "erased", msg.eraseSize, "from document");
 		return true;
 	}
 
+	COORD Repository::updateEditAnchor(const int user, const COORD& editPos) {
+		if (user >= editAnchors.size()) {
+			editAnchors.resize(user + 1, COORD{ 0, 0 });
+		}
+		editAnchors[user] = editPos;
+		return editPos;
+	}
+
 	bool Repository::move(ClientSiteDocument& doc, msg::Buffer& buffer) {
-		msg::MoveResponse msg;
-		parse(buffer, 1, msg.version, msg.user, msg.X, msg.Y, msg.withSelect, msg.anchorX, msg.anchorY);
+		auto parsed = msg::deserialize<msg::MoveResponse>(buffer);
+		if (!parsed) {
+			logger.logError("Malformed move message");
+			return false;
+		}
+		auto& msg = parsed.value();
 		doc.moveTo(msg.user, makeCoord(msg.X, msg.Y), makeCoord(msg.anchorX, msg.anchorY), msg.withSelect);
 		logger.logInfo("User", msg.user, "moved his cursor to", msg.X, ",", msg.Y);
 		return true;
 	}
 
+	bool Repository::presence(ClientSiteDocument& doc, msg::Buffer& buffer) {
+		auto parsed = msg::deserialize<msg::Presence>(buffer);
+		if (!parsed) {
+			logger.logError("Malformed presence message");
+			return false;
+		}
+		auto& msg = parsed.value();
+		if (!msg::sendsDatagramPresence(msg.version)) {
+			return applyPresence(doc, msg);
+		}
+		// Datagrams can be late or reordered: older frames are dropped, frames made at a version
+		// not applied yet wait for it, frames older than the document are stale
+		if (msg.seq <= presenceSeq || msg.docVersion < docVersion) {
+			return false;
+		}
+		presenceSeq = msg.seq;
+		if (msg.docVersion > docVersion) {
+			pendingPresence = std::move(msg);
+			return false;
+		}
+		pendingPresence.reset();
+		return applyPresence(doc, msg);
+	}
+
+	bool Repository::applyPresence(ClientSiteDocument& doc, const msg::Presence& msg) {
+		return doc.reconcile(false, [&](ClientSiteDocument& target) {
+			for (int i = 0; i + msg::presenceStride <= msg.cursors.size(); i += msg::presenceStride) {
+				const unsigned int* cursor = &msg.cursors[i];
+				int user = static_cast<int>(cursor[0]);
+				// Own cursor is already up to date from the move acknowledgements
+				if (user == target.getMyCursor()) {
+					continue;
+				}
+				target.moveTo(user, makeCoord(cursor[1], cursor[2]), makeCoord(cursor[4], cursor[5]), cursor[3]);
+			}
+			return true;
+		});
+	}
+
 	bool Repository::login(ClientSiteDocument& doc, msg::Buffer& buffer) {
-		msg::LoginResponse msg;
-		parse(buffer, 1, msg.version, msg.errMsg, msg.authToken);
+		auto parsed = msg::deserialize<msg::LoginResponse>(buffer);
+		if (!parsed) {
+			logger.logError("Malformed login message");
+			return false;
+		}
+		auto& msg = parsed.value();
 		if (!msg.errMsg.empty()) {
 			logger.logInfo("Error during login:", msg.errMsg);
 			lastError = msg.errMsg;
@@ -131,14 +333,16 @@ namespace client {
 	}
 
 	bool Repository::logout(ClientSiteDocument& doc, msg::Buffer& buffer) {
-		msg::AckResponse msg;
-		parse(buffer, 1, msg.version);
 		return true;
 	}
 
 	bool Repository::registered(ClientSiteDocument& doc, msg::Buffer& buffer) {
-		msg::RegisterResponse msg;
-		parse(buffer, 1, msg.version, msg.errMsg);
+		auto parsed = msg::deserialize<msg::RegisterResponse>(buffer);
+		if (!parsed) {
+			logger.logError("Malformed register message");
+			return false;
+		}
+		auto& msg = parsed.value();
 		if (!msg.errMsg.empty()) {
 			logger.logInfo("Error during login:", msg.errMsg);
 			lastError = msg.errMsg;
@@ -148,9 +352,13 @@ namespace client {
 	}
 
 	bool Repository::getDocNames(msg::Buffer& buffer) {
-		msg::GetDocNamesResponse msg;
-		fetchedDocNames.clear();
-		parse(buffer, 1, msg.version, msg.errMsg, fetchedDocNames);
+		auto parsed = msg::deserialize<msg::GetDocNamesResponse>(buffer);
+		if (!parsed) {
+			logger.logError("Malformed document names message");
+			return false;
+		}
+		auto& msg = parsed.value();
+		fetchedDocNames = std::move(msg.docNames);
 		if (!msg.errMsg.empty()) {
 			logger.logInfo("Error when getting doc names:", msg.errMsg);
 			lastError = msg.errMsg;
@@ -160,8 +368,12 @@ namespace client {
 	}
 
 	bool Repository::deleteDoc(msg::Buffer& buffer) {
-		msg::AckResponse msg;
-		parse(buffer, 1, msg.version, msg.errMsg);
+		auto parsed = msg::deserialize<msg::AckResponse>(buffer);
+		if (!parsed) {
+			logger.logError("Malformed delete document message");
+			return false;
+		}
+		auto& msg = parsed.value();
 		if (!msg.errMsg.empty()) {
 			logger.logInfo("Error when deleting doc:", msg.errMsg);
 			lastError = msg.errMsg;
@@ -185,6 +397,10 @@ namespace client {
 	std::vector<std::string>& Repository::getFetchedDocNames() {
 		return fetchedDocNames;
 	}
+	unsigned int Repository::getDocVersion() const {
+		return docVersion;
+	}
+
 	std::string Repository::getLastError() {
 		std::string err = lastError;
 		lastError.clear();
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <optional>
+
 #include "client_document.h"
 #include "messages.h"
 #include "screen_buffers.h"
@@ -12,14 +14,22 @@ namespace client {
 		std::string getAcCode() const;
 		std::string getAuthToken() const;
 		std::string getLastError();
+		unsigned int getDocVersion() const;
 		void cleanAcCode();
 		void cleanAuthToken();
 		std::vector<std::string>& getFetchedDocNames();
 	private:
+		bool update(ClientSiteDocument& doc, msg::Buffer& buffer, const msg::Type type);
 		bool write(ClientSiteDocument& doc, msg::Buffer& buffer);
 		bool erase(ClientSiteDocument& doc, msg::Buffer& buffer);
 		bool move(ClientSiteDocument& doc, msg::Buffer& buffer);
+		bool presence(ClientSiteDocument& doc, msg::Buffer& buffer);
+		bool applyPresence(ClientSiteDocument& doc, const msg::Presence& msg);
 		bool sync(ClientSiteDocument& doc, msg::Buffer& buffer);
+		bool snapshotChunk(ClientSiteDocument& doc, msg::Buffer& buffer);
+		bool applySnapshot(ClientSiteDocument& doc, const msg::ConnectResponse& snapshot);
+		bool resume(ClientSiteDocument& doc, const msg::ConnectResponse& msg);
+		bool reject(ClientSiteDocument& doc, msg::Buffer& buffer);
 		bool connectNewUser(ClientSiteDocument& doc, msg::Buffer& buffer);
 		bool disconnectUser(ClientSiteDocument& doc, msg::Buffer& buffer);
 		bool replace(ClientSiteDocument& doc, msg::Buffer& buffer);
@@ -28,10 +38,19 @@ namespace client {
 		bool registered(ClientSiteDocument& doc, msg::Buffer& buffer);
 		bool getDocNames(msg::Buffer& buffer);
 		bool deleteDoc(msg::Buffer& buffer);
+		COORD updateEditAnchor(const int user, const COORD& editPos);
 
 		std::string acCode;
 		std::string authToken;
 		std::string lastError;
 		std::vector<std::string> fetchedDocNames;
+		std::vector<COORD> editAnchors;
+		std::optional<msg::ConnectResponse> pendingSnapshot; // Connect response whose text is still streamed
+		std::vector<msg::Buffer> deferredMsgs; // Document updates received before the snapshot was complete
+		unsigned int docVersion = 0; // Number of versioned document updates applied since the document was created
+		unsigned int resumedVersion = 0;
+		int resumedUser = -1; // Own user index after resume, valid once the replayed updates are applied
+		unsigned int presenceSeq = 0; // Last applied presence frame of the session
+		std::optional<msg::Presence> pendingPresence; // Datagram made at a document version not reached yet
 	};
 }
\ No newline at end of file
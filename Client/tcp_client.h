@@ -3,42 +3,64 @@
 #include <Windows.h>
 #include <thread>
 #include <queue>
+#include <unordered_map>
 #include <mutex>
 #include <atomic>
 
 #include "messages.h"
+#include "schema.h"
+#include "compression.h"
 #include "logging.h"
 #include "framer.h"
 
 class TCPClient {
 public:
 	bool connectServer(const std::string& ip, const int port);
+	bool reconnect();
 	bool disconnect();
 	bool isConnected() const;
-	msg::Buffer getNextMsg();
-	template<typename... Args>
-	bool sendMsg(Args&&... args) const {
-		msg::Buffer buffer{128};
-		msg::serializeTo(buffer, 0, args...);
-		msg::Buffer msgWithSize = msg::enrich(buffer);
+	bool isConnectionLost() const;
+	unsigned int getPresencePort() const;
+	msg::Buffer getNextMsg(const msg::OneByteInt stream = 0);
+	// Each stream of the connection is a separate document session, stream 0 is the default one
+	template<msg::Schematized Msg>
+	bool sendMsg(const Msg& message, const msg::OneByteInt stream = 0) const {
+		msg::Buffer buffer = msg::serialize(message);
+		auto compressed = msg::compressFrame(buffer, compressionThreshold);
+		if (!msg::fitsFrame(compressed ? *compressed : buffer)) {
+			client::logger.logError("Message", message.type, "of", buffer.size, "bytes exceeds the frame size limit, it is not sent");
+			return false;
+		}
+		msg::Buffer msgWithSize = msg::enrich(compressed ? *compressed : buffer, stream);
+		std::unique_lock lock{sendLock};
 		int sentBytes = send(client, msgWithSize.get(), msgWithSize.size, 0);
+		lock.unlock();
 		if (sentBytes <= 0) {
 			client::logger.logError(WSAGetLastError(), ": Send error!");
 			return false;
 		}
-		client::logger.logDebug("Send message with args:", args...);
+		client::logger.logDebug("Send message", message.type, "of", msgWithSize.size, "bytes");
 		return true;
-	}	
+	}
 
 private:
 	void recvMsg();
+	bool openPresenceChannel();
+	void recvPresence();
 
 	SOCKET client = INVALID_SOCKET;
+	std::string srvIp;
+	int srvPort = 0;
+	int compressionThreshold = msg::defaultCompressionThreshold;
 	sockaddr_in srvAddress = { 0 };
+	SOCKET presenceSocket = INVALID_SOCKET; // Receives presence frames as datagrams, if the server supports it
+	unsigned int presencePort = 0;
 	
 	std::thread recvThread;
-	std::queue<msg::Buffer> recvQueue;
+	std::thread presenceThread;
+	std::unordered_map<msg::OneByteInt, std::queue<msg::Buffer>> recvQueues;
 	std::mutex recvQueueLock;
+	mutable std::mutex sendLock; // Receiving thread answers heartbeats, its frames must not interleave with the ones of the caller
 	std::atomic_bool connected;
-	Framer framer{4096};
+	std::atomic_bool lost = false; // Server closed the connection or it broke, the socket is closed by reconnect or disconnect
 };
\ No newline at end of file
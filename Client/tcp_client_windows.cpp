@@ -9,6 +9,8 @@ bool TCPClient::connectServer(const std::string& ip, const int port) {
     if (isConnected()) {
         return true;
     }
+    srvIp = ip;
+    srvPort = port;
     client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (client == INVALID_SOCKET) {
         logger.logError(WSAGetLastError(), ": Error when creating socket for server connection!");
@@ -22,22 +24,61 @@ bool TCPClient::connectServer(const std::string& ip, const int port) {
     InetPton(AF_INET, ipStr.c_str(), &srvAddress.sin_addr.s_addr);
     if (connect(client, reinterpret_cast<SOCKADDR*>(&srvAddress), sizeof(srvAddress))) {
         logger.logError(WSAGetLastError(), ": Error when connecting to the server!");
+        closesocket(client);
         return false;
     }
     connected = true;
+    lost = false;
     recvThread = std::thread{ &TCPClient::recvMsg, this };
+    if (openPresenceChannel()) {
+        presenceThread = std::thread{ &TCPClient::recvPresence, this };
+    }
 	return true;
 }
 
+bool TCPClient::openPresenceChannel() {
+    presenceSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (presenceSocket == INVALID_SOCKET) {
+        logger.logError(WSAGetLastError(), ": Error when creating presence socket, presence goes over TCP");
+        return false;
+    }
+    sockaddr_in address = { 0 };
+    address.sin_family = AF_INET;
+    address.sin_port = 0;
+    address.sin_addr.s_addr = INADDR_ANY;
+    int addressSize = sizeof(address);
+    if (bind(presenceSocket, reinterpret_cast<SOCKADDR*>(&address), sizeof(address)) == SOCKET_ERROR ||
+        getsockname(presenceSocket, reinterpret_cast<SOCKADDR*>(&address), &addressSize) == SOCKET_ERROR) {
+        logger.logError(WSAGetLastError(), ": Error when binding presence socket, presence goes over TCP");
+        closesocket(presenceSocket);
+        presenceSocket = INVALID_SOCKET;
+        return false;
+    }
+    presencePort = ntohs(address.sin_port);
+    return true;
+}
+
+bool TCPClient::reconnect() {
+    disconnect();
+    return connectServer(srvIp, srvPort);
+}
+
 bool TCPClient::disconnect() {
     if (!isConnected()) {
         return true;
     }
     connected = false;
+    lost = false;
     closesocket(client);
+    closesocket(presenceSocket);
+    presenceSocket = INVALID_SOCKET;
+    presencePort = 0;
     if (recvThread.joinable()) {
         recvThread.join();
     }
+    if (presenceThread.joinable()) {
+        presenceThread.join();
+    }
     logger.logError("Disconnected from the server");
     return true;
 }
@@ -46,35 +87,92 @@ bool TCPClient::isConnected() const {
     return connected;
 }
 
-msg::Buffer TCPClient::getNextMsg() {
+bool TCPClient::isConnectionLost() const {
+    return lost;
+}
+
+unsigned int TCPClient::getPresencePort() const {
+    return presencePort;
+}
+
+msg::Buffer TCPClient::getNextMsg(const msg::OneByteInt stream) {
     std::scoped_lock lock{recvQueueLock};
+    auto& recvQueue = recvQueues[stream];
     if (recvQueue.empty()) {
         return msg::Buffer{0};
     }
-    msg::Buffer msgBuffer = recvQueue.front();
+    msg::Buffer msgBuffer = std::move(recvQueue.front());
     recvQueue.pop();
     return msgBuffer;
 }
 
 void TCPClient::recvMsg() {
+    // Partial frame of a broken connection is not continued by the next one
+    Framer framer{4096};
     while (connected) {
         msg::Buffer buffer{128};
         buffer.size = recv(client, buffer.get(), buffer.capacity, 0);
         if (buffer.size < 0) {
-            logger.logError(WSAGetLastError(), ": Recv error!");
-            closesocket(client);
+            if (connected) {
+                logger.logError(WSAGetLastError(), ": Recv error!");
+                lost = true;
+            }
             return;
         }
         else if (buffer.size == 0) {
             logger.logError("Got disconnecting message from the server");
-            closesocket(client);
+            lost = true;
             return;
         }
-        auto messages = framer.extractMessages(buffer);
-        std::scoped_lock lock{recvQueueLock};
-        for (auto& msg : messages) {
-            logger.logDebug("Put new message in queue with size", msg.size);
-            recvQueue.push(std::move(msg));
+        std::vector<msg::OneByteInt> streams;
+        auto messages = framer.extractMessages(buffer, streams);
+        std::vector<msg::OneByteInt> heartbeats;
+        {
+            std::scoped_lock lock{recvQueueLock};
+            for (int i = 0; i < messages.size(); i++) {
+                msg::Type type;
+                msg::parse(messages[i], 0, type);
+                if (type == msg::Type::heartbeat) {
+                    heartbeats.push_back(streams[i]);
+                    continue;
+                }
+                logger.logDebug("Put new message in queue", streams[i], "with size", messages[i].size);
+                recvQueues[streams[i]].push(std::move(messages[i]));
+            }
+        }
+        // Server probes a silent connection, it is closed if the answer doesn't come.
+        // Answer is sent without the queue lock, a blocked send must not stall the reader of the queue
+        for (auto stream : heartbeats) {
+            sendMsg(msg::ControlMessage{ msg::Type::heartbeat, msg::currentVersion, "" }, stream);
         }
     }
+}
+
+void TCPClient::recvPresence() {
+    // Each datagram is one framed presence message, it is queued together with the messages of its stream
+    SOCKET udpSocket = presenceSocket;
+    while (connected) {
+        msg::Buffer buffer{8192};
+        sockaddr_in sender = { 0 };
+        int senderSize = sizeof(sender);
+        buffer.size = recvfrom(udpSocket, buffer.get(), buffer.capacity, 0, reinterpret_cast<SOCKADDR*>(&sender), &senderSize);
+        if (buffer.size <= 0) {
+            if (connected) {
+                logger.logError(WSAGetLastError(), ": Presence recv error!");
+            }
+            return;
+        }
+        if (sender.sin_addr.s_addr != srvAddress.sin_addr.s_addr || buffer.size <= 4) {
+            continue;
+        }
+        unsigned int header = 0;
+        msg::parse(buffer, 0, header);
+        if ((header & msg::frameLengthMask) != buffer.size - 4) {
+            continue;
+        }
+        msg::Buffer presence{ buffer.size - 4 };
+        presence.add(&buffer, 4, buffer.size - 4);
+        std::scoped_lock lock{recvQueueLock};
+        recvQueues[static_cast<msg::OneByteInt>(header >> msg::frameStreamShift)].push(std::move(presence));
+    }
 }
\ No newline at end of file
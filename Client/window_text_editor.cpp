@@ -1,6 +1,6 @@
 #include "window_text_editor.h"
 
-constexpr msg::OneByteInt version = 1;
+constexpr msg::OneByteInt version = msg::currentVersion;
 
 TextEditorWindow::TextEditorWindow(const ScrollableScreenBufferBuilder& ssbBuilder) :
     BaseWindow(ssbBuilder) {
@@ -10,49 +10,71 @@ TextEditorWindow::TextEditorWindow(const ScrollableScreenBufferBuilder& ssbBuild
     eventHandlers.try_emplace(windows::text_editor::events::replace, &TextEditorWindow::replace);
 }
 
+template<typename Msg>
+bool TextEditorWindow::sendAndPredict(const TCPClient& client, Msg message) {
+    if constexpr (std::is_same_v<Msg, msg::Write> || std::is_same_v<Msg, msg::Erase>) {
+        // Server rebases the edit from the version and position it was made at
+        COORD pos = doc.getCursorPos(doc.getMyCursor());
+        message.baseVersion = doc.getVersion();
+        message.X = pos.X;
+        message.Y = pos.Y;
+    }
+    if (!client.sendMsg(message)) {
+        return false;
+    }
+    doc.predict(message);
+    return true;
+}
+
 Event TextEditorWindow::processChar(TCPClient& client, const KeyPack& key, const std::string& clipboardData) {
     if (key.keyCode >= 32 && key.keyCode <= 127) {
-        client.sendMsg(msg::Type::write, version, authToken, std::string(1, key.keyCode));
+        sendAndPredict(client, msg::Write{ msg::Type::write, version, "", std::string(1, key.keyCode) });
         return Event{};
     }
     bool actionDone = false;
     switch (key.keyCode) {
     case ENTER:
-        actionDone = client.sendMsg(msg::Type::write, version, authToken, std::string{'\n'});
+        actionDone = sendAndPredict(client, msg::Write{ msg::Type::write, version, "", std::string{'\n'} });
         break;
     case TABULAR:
-        actionDone = client.sendMsg(msg::Type::write, version, authToken, std::string{"    "});
+        actionDone = sendAndPredict(client, msg::Write{ msg::Type::write, version, "", std::string{"    "} });
         break;
     case BACKSPACE:
-        actionDone = client.sendMsg(msg::Type::erase, version, authToken, static_cast<unsigned int>(1));
+        actionDone = sendAndPredict(client, msg::Erase{ msg::Type::erase, version, "", 1 });
         break;
     case ARROW_LEFT:
-        actionDone = client.sendMsg(msg::Type::moveHorizontal, version, authToken, msg::MoveSide::left, key.shiftPressed);
+        actionDone = sendAndPredict(client, msg::MoveHorizontal{ msg::Type::moveHorizontal, version, "", msg::MoveSide::left, key.shiftPressed });
         break;
     case ARROW_RIGHT:
-        actionDone = client.sendMsg(msg::Type::moveHorizontal, version, authToken, msg::MoveSide::right, key.shiftPressed);
+        actionDone = sendAndPredict(client, msg::MoveHorizontal{ msg::Type::moveHorizontal, version, "", msg::MoveSide::right, key.shiftPressed });
         break;
     case ARROW_UP:
-        actionDone = client.sendMsg(msg::Type::moveVertical, version, authToken, msg::MoveSide::up, getDocBufferWidth(), key.shiftPressed);
+        actionDone = sendAndPredict(client, msg::MoveVertical{ msg::Type::moveVertical, version, "", msg::MoveSide::up, getDocBufferWidth(), key.shiftPressed });
         break;
     case ARROW_DOWN:
-        actionDone = client.sendMsg(msg::Type::moveVertical, version, authToken, msg::MoveSide::down, getDocBufferWidth(), key.shiftPressed);
+        actionDone = sendAndPredict(client, msg::MoveVertical{ msg::Type::moveVertical, version, "", msg::MoveSide::down, getDocBufferWidth(), key.shiftPressed });
         break;
     case CTRL_A:
-        actionDone = client.sendMsg(msg::Type::selectAll, version, authToken);
+        actionDone = sendAndPredict(client, msg::MoveSelectAll{ msg::Type::selectAll, version });
         break;
     case CTRL_V:
-        actionDone = client.sendMsg(msg::Type::write, version, authToken, clipboardData);
+        // Big paste goes in several writes, text of one has to fit in a frame
+        for (size_t offset = 0; offset < clipboardData.size(); offset += msg::maxInlineText) {
+            actionDone = sendAndPredict(client, msg::Write{ msg::Type::write, version, "", clipboardData.substr(offset, msg::maxInlineText) });
+            if (!actionDone) {
+                break;
+            }
+        }
         break;
     case CTRL_X:
-        actionDone = client.sendMsg(msg::Type::erase, version, authToken, static_cast<unsigned int>(1));
+        actionDone = sendAndPredict(client, msg::Erase{ msg::Type::erase, version, "", 1 });
         break;
     case CTRL_Z:
         if (key.shiftPressed) {
-            actionDone = client.sendMsg(msg::Type::redo, version, authToken);
+            actionDone = sendAndPredict(client, msg::ControlMessage{ msg::Type::redo, version });
         }
         else {
-            actionDone = client.sendMsg(msg::Type::undo, version, authToken);
+            actionDone = sendAndPredict(client, msg::ControlMessage{ msg::Type::undo, version });
         }
         break;
     }
@@ -67,10 +89,6 @@ void TextEditorWindow::processEvent(const TCPClient& client, const Event& pEvent
     return (this->*it->second)(client, pEvent.params);
 }
 
-void TextEditorWindow::setAuthToken(const std::string& newAuthToken) {
-    authToken = newAuthToken;
-}
-
 void TextEditorWindow::find(const TCPClient& client, const std::vector<std::string>& args) {
     if (args.empty()) {
         return;
@@ -87,16 +105,14 @@ void TextEditorWindow::findNext(const TCPClient& client, const std::vector<std::
     if (pos == COORD{-1, -1}) {
         return;
     }
-    unsigned int X = pos.X;
-    unsigned int Y = pos.Y;
-    client.sendMsg(msg::Type::moveTo, version, authToken, X, Y);
+    sendAndPredict(client, msg::MoveTo{ msg::Type::moveTo, version, "", static_cast<unsigned int>(pos.X), static_cast<unsigned int>(pos.Y) });
 }
 
 void TextEditorWindow::replace(const TCPClient& client, const std::vector<std::string>& args) {
     if (doc.getSegments().empty() || args.empty()) {
         return;
     }
-    client.sendMsg(msg::Type::replace, version, authToken, args[0], doc.getSegments());
+    sendAndPredict(client, msg::Replace{ msg::Type::replace, version, "", args[0], doc.getSegments() });
 }
 
 
@@ -7,7 +7,6 @@ public:
 	TextEditorWindow(const ScrollableScreenBufferBuilder& ssbBuilder);
 	Event processChar(TCPClient& client, const KeyPack& key, const std::string& clipboardData) override;
 	void processEvent(const TCPClient& client, const Event& pEvent) override;
-	void setAuthToken(const std::string& newAuthToken);
 	std::string name() const override {
 		return className;
 	}
@@ -19,7 +18,9 @@ private:
 	void findNext(const TCPClient& client, const std::vector<std::string>& args);
 	void replace(const TCPClient& client, const std::vector<std::string>& args);
 
+	template<typename Msg>
+	bool sendAndPredict(const TCPClient& client, Msg message);
+
 	EventHandlersMap<TextEditorWindow> eventHandlers;
-	std::string authToken;
 };
 
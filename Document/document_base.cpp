@@ -18,7 +18,7 @@ BaseDocument::BaseDocument(const std::string& text, const int nCursors, const in
 	myUserIdx(myUserIdx) {
 }
 
-COORD BaseDocument::write(const int index, const std::string& newText) {
+COORD BaseDocument::write(const int index, const std::string_view newText) {
 	if (!validateUserIdx(index)) {
 		return COORD{ -1, -1 };
 	}
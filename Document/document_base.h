@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <optional>
 #include "text_container.h"
 #include "cursor.h"
@@ -23,7 +24,7 @@ public:
 	BaseDocument(const std::string& text);
 	BaseDocument(const std::string& text, const int cursors, const int myUserIdx);
 
-	COORD write(const int index, const std::string& text);
+	COORD write(const int index, const std::string_view text);
 	COORD erase(const int index, const int eraseSize);
 
 	COORD moveCursorLeft(const int index, const bool withSelect);
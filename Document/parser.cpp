@@ -14,11 +14,11 @@ std::vector<std::string> Parser::parseLineToVector(const std::string& line, cons
 	return parsedLines;
 }
 
-std::vector<std::string> Parser::parseTextToVector(const std::string& text, const char delimiter) {
+std::vector<std::string> Parser::parseTextToVector(const std::string_view text, const char delimiter) {
 	size_t offset = 0;
 	size_t end = text.find(delimiter);
 	std::vector<std::string> parsedLines;
-	if (end == std::string::npos) {
+	if (end == std::string_view::npos) {
 		parsedLines.emplace_back(text);
 		return parsedLines;
 	}
@@ -28,7 +28,7 @@ std::vector<std::string> Parser::parseTextToVector(const std::string& text, cons
 		parsedLines.emplace_back(lineText);
 		offset = end + 1;
 		end = text.find(delimiter, offset);
-	} while (end != std::string::npos);
+	} while (end != std::string_view::npos);
 	std::string lineText{text.cbegin() + offset, text.cend()};
 	parsedLines.emplace_back(lineText);
 	postprocess(parsedLines);
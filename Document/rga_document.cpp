@@ -0,0 +1,243 @@
+#include "rga_document.h"
+#include "pos_helpers.h"
+
+#include <algorithm>
+
+namespace crdt {
+	bool operator==(const Id& id1, const Id& id2) {
+		return id1.clock == id2.clock && id1.replica == id2.replica;
+	}
+
+	bool operator<(const Id& id1, const Id& id2) {
+		return id1.clock < id2.clock || (id1.clock == id2.clock && id1.replica < id2.replica);
+	}
+}
+
+RgaDocument::RgaDocument(const std::string& text, const int nCursors, const int myUserIdx, const unsigned int replica) :
+	BaseDocument(text, nCursors, myUserIdx),
+	replica(replica) {
+	for (int i = 0; i < nCursors; i++) {
+		addUser();
+	}
+	// Initial text has the same ids on every replica
+	std::string initText = container.getText();
+	elements.reserve(initText.size());
+	for (char value : initText) {
+		elements.push_back(Element{ crdt::Id{ ++clock, 0 }, 0, value });
+	}
+}
+
+bool RgaDocument::apply(const crdt::Op& op) {
+	if (auto insert = std::get_if<crdt::Insert>(&op)) {
+		// Replica known from its ops blocks collecting until it acknowledges
+		acknowledged.try_emplace(insert->id.replica, 0);
+		clock = (std::max)(clock, insert->id.clock);
+		return integrate(*insert);
+	}
+	const auto& erase = std::get<crdt::Erase>(op);
+	acknowledged.try_emplace(erase.stamp.replica, 0);
+	clock = (std::max)(clock, erase.stamp.clock);
+	return integrate(erase);
+}
+
+std::vector<crdt::Op> RgaDocument::takeOps() {
+	return std::move(ops);
+}
+
+unsigned int RgaDocument::getClock() const {
+	return clock;
+}
+
+void RgaDocument::acknowledge(const unsigned int replica, const unsigned int appliedClock) {
+	auto& known = acknowledged[replica];
+	known = (std::max)(known, appliedClock);
+}
+
+size_t RgaDocument::collectGarbage() {
+	// Every replica applied all ops up to stableClock and sent its later ops after that, so ops still to come never point at
+	// tombstones erased before it. Ops made concurrently with the erase were acknowledged after, they are integrated already.
+	unsigned int stableClock = clock;
+	for (const auto& [other, appliedClock] : acknowledged) {
+		stableClock = (std::min)(stableClock, appliedClock);
+	}
+	// A tombstone is kept if the next kept element is newer, integration would skip it and place new elements differently.
+	std::vector<bool> collected(elements.size(), false);
+	unsigned int nextClock = 0;
+	for (int i = elements.size() - 1; i >= 0; i--) {
+		const auto& element = elements[i];
+		if (element.erasedAt != 0 && element.erasedAt <= stableClock && nextClock <= stableClock) {
+			collected[i] = true;
+			continue;
+		}
+		nextClock = element.id.clock;
+	}
+	size_t kept = 0;
+	for (int i = 0; i < elements.size(); i++) {
+		if (!collected[i]) {
+			elements[kept++] = elements[i];
+		}
+	}
+	size_t removed = elements.size() - kept;
+	elements.resize(kept);
+	tombstones -= removed;
+	return removed;
+}
+
+size_t RgaDocument::getTombstoneCount() const {
+	return tombstones;
+}
+
+void RgaDocument::afterWriteAction(const int index, const COORD& startPos, const COORD& endPos, std::vector<std::string>& writtenText) {
+	if (writtenText.empty()) {
+		return;
+	}
+	int size = writtenText.size() - 1;
+	for (const auto& line : writtenText) {
+		size += line.size();
+	}
+	int offset = getOffset(endPos) - size;
+	int originIdx = offset > 0 ? findVisible(offset - 1) : -1;
+	crdt::Id origin = originIdx >= 0 ? elements[originIdx].id : crdt::Id{};
+	std::vector<Element> newElements;
+	newElements.reserve(size);
+	for (int i = 0; i < writtenText.size(); i++) {
+		if (i > 0) {
+			newElements.push_back(Element{ nextId(), 0, '\n' });
+		}
+		for (char value : writtenText[i]) {
+			newElements.push_back(Element{ nextId(), 0, value });
+		}
+	}
+	// New ids are bigger than any known id, so integrating them remotely puts them right after origin as well
+	for (const auto& element : newElements) {
+		ops.emplace_back(crdt::Insert{ element.id, origin, element.value });
+		origin = element.id;
+	}
+	elements.insert(elements.begin() + (originIdx + 1), newElements.begin(), newElements.end());
+}
+
+void RgaDocument::afterEraseAction(const int index, const COORD& startPos, const COORD& endPos, std::vector<std::string>& erasedText) {
+	if (erasedText.empty()) {
+		return;
+	}
+	int size = erasedText.size() - 1;
+	for (const auto& line : erasedText) {
+		size += line.size();
+	}
+	int elementIdx = findVisible(getOffset(endPos));
+	for (; size > 0 && elementIdx < elements.size(); elementIdx++) {
+		auto& element = elements[elementIdx];
+		if (element.erasedAt != 0) {
+			continue;
+		}
+		crdt::Id stamp = nextId();
+		element.erasedAt = stamp.clock;
+		ops.emplace_back(crdt::Erase{ element.id, stamp });
+		tombstones++;
+		size--;
+	}
+}
+
+bool RgaDocument::integrate(const crdt::Insert& op) {
+	int originIdx = op.origin == crdt::Id{} ? -1 : findElement(op.origin);
+	if (originIdx == -1 && !(op.origin == crdt::Id{})) {
+		return false;
+	}
+	// Concurrent inserts after the same origin are ordered by descending id, newer ones together with their successors go first
+	int insertIdx = originIdx + 1;
+	while (insertIdx < elements.size() && op.id < elements[insertIdx].id) {
+		insertIdx++;
+	}
+	elements.insert(elements.begin() + insertIdx, Element{ op.id, 0, op.value });
+
+	COORD pos = getPos(countVisible(insertIdx));
+	std::vector<std::string> lines = op.value == '\n' ? std::vector<std::string>{ "", "" } : std::vector<std::string>{ std::string(1, op.value) };
+	COORD endPos = container.insert(pos, lines);
+	moveCursors(pos, endPos - pos);
+	return true;
+}
+
+bool RgaDocument::integrate(const crdt::Erase& op) {
+	int elementIdx = findElement(op.id);
+	if (elementIdx == -1) {
+		// Element could be already collected if it was erased concurrently
+		return false;
+	}
+	auto& element = elements[elementIdx];
+	if (element.erasedAt != 0) {
+		element.erasedAt = (std::min)(element.erasedAt, op.stamp.clock);
+		return false;
+	}
+	int offset = countVisible(elementIdx);
+	element.erasedAt = op.stamp.clock;
+	tombstones++;
+
+	COORD pos = getPos(offset + 1);
+	std::vector<std::string> erasedText;
+	COORD endPos = container.erase(pos, 1, erasedText);
+	moveCursors(pos, endPos - pos);
+	return true;
+}
+
+int RgaDocument::findElement(const crdt::Id& id) const {
+	for (int i = 0; i < elements.size(); i++) {
+		if (elements[i].id == id) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int RgaDocument::findVisible(const int offset) const {
+	int visible = 0;
+	for (int i = 0; i < elements.size(); i++) {
+		if (elements[i].erasedAt != 0) {
+			continue;
+		}
+		if (visible == offset) {
+			return i;
+		}
+		visible++;
+	}
+	return elements.size();
+}
+
+int RgaDocument::countVisible(const int elementIdx) const {
+	return std::count_if(elements.cbegin(), elements.cbegin() + elementIdx, [](const Element& element) {
+		return element.erasedAt == 0;
+	});
+}
+
+int RgaDocument::getOffset(const COORD& pos) const {
+	const auto& lines = container.get();
+	int offset = pos.X;
+	for (int i = 0; i < pos.Y && i < lines.size(); i++) {
+		offset += lines[i].size() + 1;
+	}
+	return offset;
+}
+
+COORD RgaDocument::getPos(const int offset) const {
+	const auto& lines = container.get();
+	int remaining = offset;
+	for (int i = 0; i < lines.size(); i++) {
+		if (remaining <= lines[i].size()) {
+			return makeCoord(remaining, i);
+		}
+		remaining -= lines[i].size() + 1;
+	}
+	return container.getEndPos();
+}
+
+void RgaDocument::moveCursors(COORD startPos, COORD diff) {
+	for (auto& user : users) {
+		moveAffectedCursor(user.cursor, startPos, diff);
+		if (user.selectAnchor.has_value()) {
+			moveAffectedCursor(user.selectAnchor.value(), startPos, diff);
+		}
+	}
+}
+
+crdt::Id RgaDocument::nextId() {
+	return crdt::Id{ ++clock, replica };
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <variant>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include "document_base.h"
+
+namespace crdt {
+	// Lamport timestamp of an element, replica 0 is reserved for the initial text
+	struct Id {
+		unsigned int clock = 0;
+		unsigned int replica = 0;
+	};
+	bool operator==(const Id& id1, const Id& id2);
+	bool operator<(const Id& id1, const Id& id2);
+
+	struct Insert {
+		Id id;
+		Id origin; // Element on the left when inserted, {0, 0} is the beginning of the document
+		char value = 0;
+	};
+
+	struct Erase {
+		Id id;
+		Id stamp;
+	};
+
+	using Op = std::variant<Insert, Erase>;
+}
+
+// Replicated growable array engine. Local edits go through the BaseDocument API and are recorded as ops,
+// ops of other replicas are integrated by id order, so replicas converge without a single ordering point.
+// Ops of one replica have to be applied in the order they were made.
+// Tombstones are collected once they are causally stable: every replica, acknowledged since it joined, applied their erase.
+// Replica sends its clock after its ops, so an insert made before it saw the erase is always integrated before the acknowledgement.
+class RgaDocument : public BaseDocument {
+public:
+	RgaDocument(const std::string& text, const int cursors, const int myUserIdx, const unsigned int replica);
+
+	bool apply(const crdt::Op& op);
+	std::vector<crdt::Op> takeOps();
+	unsigned int getClock() const;
+	void acknowledge(const unsigned int replica, const unsigned int appliedClock);
+	size_t collectGarbage();
+	size_t getTombstoneCount() const;
+protected:
+	void afterWriteAction(const int index, const COORD& startPos, const COORD& endPos, std::vector<std::string>& writtenText) override;
+	void afterEraseAction(const int index, const COORD& startPos, const COORD& endPos, std::vector<std::string>& erasedText) override;
+private:
+	struct Element {
+		crdt::Id id;
+		unsigned int erasedAt = 0; // Clock of the erase, 0 if element is visible
+		char value = 0;
+	};
+	bool integrate(const crdt::Insert& op);
+	bool integrate(const crdt::Erase& op);
+	int findElement(const crdt::Id& id) const;
+	int findVisible(const int offset) const;
+	int countVisible(const int elementIdx) const;
+	int getOffset(const COORD& pos) const;
+	COORD getPos(const int offset) const;
+	void moveCursors(COORD startPos, COORD diff);
+	crdt::Id nextId();
+
+	std::vector<Element> elements;
+	std::vector<crdt::Op> ops; // Local ops not taken yet
+	std::unordered_map<unsigned int, unsigned int> acknowledged; // Other replicas to the clock they applied all ops up to
+	unsigned int replica;
+	unsigned int clock = 0;
+	size_t tombstones = 0;
+};
\ No newline at end of file
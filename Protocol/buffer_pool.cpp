@@ -0,0 +1,73 @@
+#include "buffer_pool.h"
+
+#include <bit>
+
+namespace msg {
+	// Set once the thread's pool is gone, blocks freed afterwards go straight back to the heap
+	thread_local bool poolDestroyed = false;
+
+	void PooledDeleter::operator()(char* block) const {
+		BufferPool::release(block, blockSize);
+	}
+
+	PooledData BufferPool::allocate(const int size) {
+		int blockSize = blockSizeFor(size);
+		if (blockSize <= maxBlockSize && !poolDestroyed) {
+			auto& blocks = local().freeBlocks[classIdx(blockSize)];
+			if (!blocks.empty()) {
+				char* block = blocks.back();
+				blocks.pop_back();
+				return PooledData{ block, PooledDeleter{ blockSize } };
+			}
+		}
+		return PooledData{ new char[blockSize], PooledDeleter{ blockSize } };
+	}
+
+	void BufferPool::release(char* block, const int blockSize) {
+		if (block == nullptr) {
+			return;
+		}
+		if (blockSize <= maxBlockSize && !poolDestroyed) {
+			auto& blocks = local().freeBlocks[classIdx(blockSize)];
+			if (blocks.size() < maxFreeBlocks) {
+				blocks.push_back(block);
+				return;
+			}
+		}
+		delete[] block;
+	}
+
+	BufferPool::BufferPool() {
+		for (auto& blocks : freeBlocks) {
+			blocks.reserve(maxFreeBlocks);
+		}
+	}
+
+	BufferPool::~BufferPool() {
+		poolDestroyed = true;
+		for (auto& blocks : freeBlocks) {
+			for (char* block : blocks) {
+				delete[] block;
+			}
+		}
+	}
+
+	BufferPool& BufferPool::local() {
+		thread_local BufferPool pool;
+		return pool;
+	}
+
+	int BufferPool::blockSizeFor(const int size) {
+		if (size <= minBlockSize) {
+			return minBlockSize;
+		}
+		if (size > maxBlockSize) {
+			return size;
+		}
+		return static_cast<int>(std::bit_ceil(static_cast<unsigned int>(size)));
+	}
+
+	int BufferPool::classIdx(const int blockSize) {
+		return std::countr_zero(static_cast<unsigned int>(blockSize / minBlockSize));
+	}
+}
\ No newline at end of file
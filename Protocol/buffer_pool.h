@@ -0,0 +1,34 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace msg {
+	struct PooledDeleter {
+		void operator()(char* block) const;
+		int blockSize = 0;
+	};
+	using PooledData = std::unique_ptr<char[], PooledDeleter>;
+
+	// Thread local storage for msg::Buffer. Blocks are rounded up to power-of-two size classes
+	// and kept on per-class free lists, so steady-state message traffic doesn't hit the global
+	// allocator. A block may be released on another thread than the one which allocated it.
+	class BufferPool {
+	public:
+		static constexpr int minBlockSize = 64;
+		static constexpr int maxBlockSize = 1 << 20;
+		static constexpr int maxFreeBlocks = 64;
+
+		static PooledData allocate(const int size);
+		static void release(char* block, const int blockSize);
+		BufferPool();
+		~BufferPool();
+	private:
+		static constexpr int nClasses = 15; // 64B ... 1MB
+		static BufferPool& local();
+		static int blockSizeFor(const int size);
+		static int classIdx(const int blockSize);
+
+		std::array<std::vector<char*>, nClasses> freeBlocks;
+	};
+}
\ No newline at end of file
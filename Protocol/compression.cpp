@@ -0,0 +1,139 @@
+#include "compression.h"
+#include "schema.h"
+
+#include <array>
+
+namespace msg {
+	constexpr int headerSize = 2;
+
+	bool isCompressedFrame(const Buffer& frame) {
+		return frame.size >= headerSize && (static_cast<OneByteInt>(frame.get()[1]) & compressedFlag) != 0;
+	}
+
+	std::optional<Buffer> compressFrame(const Buffer& frame, const int threshold) {
+		int payloadSize = frame.size - headerSize;
+		if (payloadSize < threshold || payloadSize <= 0) {
+			return std::nullopt;
+		}
+		auto version = static_cast<OneByteInt>(frame.get()[1]);
+		// Older peers don't know the flag
+		if (!isCompact(version) || (version & compressedFlag) != 0) {
+			return std::nullopt;
+		}
+		Buffer compressed{ frame.size };
+		Type type = static_cast<Type>(frame.get()[0]);
+		OneByteInt flaggedVersion = version | compressedFlag;
+		VarInt rawSize{ static_cast<unsigned int>(payloadSize) };
+		serializeTo(compressed, 0, type, flaggedVersion, rawSize);
+		lz::compress(frame, headerSize, compressed);
+		if (compressed.size >= frame.size) {
+			return std::nullopt;
+		}
+		return compressed;
+	}
+
+	std::optional<Buffer> decompressFrame(const Buffer& frame) {
+		if (!isCompressedFrame(frame)) {
+			return std::nullopt;
+		}
+		unsigned int rawSize = 0;
+		int sizeLen = codec::read(rawSize, frame, headerSize, true);
+		if (sizeLen < 0 || rawSize > maxDecompressedSize) {
+			return std::nullopt;
+		}
+		Buffer raw{ static_cast<int>(rawSize) + headerSize };
+		Type type = static_cast<Type>(frame.get()[0]);
+		OneByteInt version = static_cast<OneByteInt>(frame.get()[1]) & ~compressedFlag;
+		serializeTo(raw, 0, type, version);
+		if (!lz::decompress(frame, headerSize + sizeLen, raw, static_cast<int>(rawSize))) {
+			return std::nullopt;
+		}
+		return raw;
+	}
+
+	namespace lz {
+		constexpr int hashBits = 14;
+
+		static unsigned int hashAt(const char* data) {
+			unsigned int sequence;
+			memcpy(&sequence, data, sizeof(sequence));
+			return (sequence * 2654435761u) >> (32 - hashBits);
+		}
+
+		static void addLiterals(const Buffer& input, const int start, const int end, Buffer& output) {
+			if (end <= start) {
+				return;
+			}
+			VarInt token{ static_cast<unsigned int>(end - start) << 1 };
+			output.add(&token);
+			output.add(&input, start, end - start);
+		}
+
+		void compress(const Buffer& input, const int offset, Buffer& output) {
+			thread_local std::array<int, 1 << hashBits> lastSeen;
+			lastSeen.fill(-1);
+			const char* data = input.get();
+			int pos = offset;
+			int literalStart = offset;
+			while (pos + minMatch <= input.size) {
+				unsigned int hash = hashAt(data + pos);
+				int candidate = lastSeen[hash];
+				lastSeen[hash] = pos;
+				if (candidate < 0 || memcmp(data + candidate, data + pos, minMatch) != 0) {
+					pos++;
+					continue;
+				}
+				int length = minMatch;
+				while (pos + length < input.size && data[candidate + length] == data[pos + length]) {
+					length++;
+				}
+				addLiterals(input, literalStart, pos, output);
+				VarInt token{ (static_cast<unsigned int>(length - minMatch) << 1) | 1 };
+				VarInt distance{ static_cast<unsigned int>(pos - candidate) };
+				serializeTo(output, 0, token, distance);
+				pos += length;
+				literalStart = pos;
+			}
+			addLiterals(input, literalStart, input.size, output);
+		}
+
+		bool decompress(const Buffer& input, const int offset, Buffer& output, const int rawSize) {
+			const int outputStart = output.size;
+			output.reserveIfNeeded(rawSize);
+			int pos = offset;
+			while (pos < input.size) {
+				unsigned int token = 0;
+				int tokenLen = codec::read(token, input, pos, true);
+				if (tokenLen < 0) {
+					return false;
+				}
+				pos += tokenLen;
+				int written = output.size - outputStart;
+				if ((token & 1) == 0) {
+					unsigned int length = token >> 1;
+					if (length > static_cast<unsigned int>(input.size - pos) || length > static_cast<unsigned int>(rawSize - written)) {
+						return false;
+					}
+					output.add(&input, pos, length);
+					pos += length;
+					continue;
+				}
+				unsigned int distance = 0;
+				int distanceLen = codec::read(distance, input, pos, true);
+				unsigned int length = (token >> 1) + minMatch;
+				if (distanceLen < 0 || distance == 0 || distance > static_cast<unsigned int>(written) ||
+					length > static_cast<unsigned int>(rawSize - written)) {
+					return false;
+				}
+				pos += distanceLen;
+				// Byte by byte, a reference may overlap the bytes it produces
+				char* data = output.get();
+				for (unsigned int i = 0; i < length; i++) {
+					data[output.size] = data[output.size - distance];
+					output.size++;
+				}
+			}
+			return output.size - outputStart == rawSize;
+		}
+	}
+}
\ No newline at end of file
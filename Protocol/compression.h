@@ -0,0 +1,26 @@
+#pragma once
+#include <optional>
+
+#include "messages.h"
+
+namespace msg {
+	// Compressed frames keep their type byte and set compressedFlag in the version byte.
+	// The rest of the frame is the raw payload size (varint) followed by the LZ stream.
+	constexpr OneByteInt compressedFlag = 0x80;
+	constexpr int defaultCompressionThreshold = 1024;
+	constexpr int maxDecompressedSize = 1 << 26;
+
+	bool isCompressedFrame(const Buffer& frame);
+	// Empty if the frame is below threshold, can't be compressed for its version, or wouldn't shrink
+	std::optional<Buffer> compressFrame(const Buffer& frame, const int threshold);
+	// Empty if the frame is malformed
+	std::optional<Buffer> decompressFrame(const Buffer& frame);
+
+	// Dependency free LZ77. The stream is a sequence of varint tokens, the low bit selects
+	// a literal run (length, bytes) or a back-reference (length - minMatch, distance).
+	namespace lz {
+		constexpr int minMatch = 4;
+		void compress(const Buffer& input, const int offset, Buffer& output);
+		bool decompress(const Buffer& input, const int offset, Buffer& output, const int rawSize);
+	}
+}
\ No newline at end of file
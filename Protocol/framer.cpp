@@ -12,7 +12,13 @@ Framer::Framer(const int capacity) :
 	msgBuff(capacity) {}
 
 Messages Framer::extractMessages(msg::Buffer& recvBuff) {
+	std::vector<msg::OneByteInt> ignoredStreams;
+	return extractMessages(recvBuff, ignoredStreams);
+}
+
+Messages Framer::extractMessages(msg::Buffer& recvBuff, std::vector<msg::OneByteInt>& messageStreams) {
 	Messages messages;
+	streams.clear();
 	if (state == State::length) {
 		extractLength(0, recvBuff, messages);
 	}
@@ -20,6 +26,7 @@ Messages Framer::extractMessages(msg::Buffer& recvBuff) {
 		extractMsg(0, recvBuff, messages);
 	}
 	saveBuff(recvBuff, _prevBuffs, maxPrevBuffLen);
+	messageStreams = std::move(streams);
 	return messages;
 }
 
@@ -37,7 +44,10 @@ void Framer::extractLength(int head, msg::Buffer& recvBuff, Messages& messages)
 	}
 
 	if (lenBuff.size >= 4) {
-		msg::parse(lenBuff, 0, neededSymbols);
+		unsigned int header = 0;
+		msg::parse(lenBuff, 0, header);
+		neededSymbols = header & msg::frameLengthMask;
+		stream = static_cast<msg::OneByteInt>(header >> msg::frameStreamShift);
 		msgBuff.reserveIfNeeded(neededSymbols);
 		assert(neededSymbols >= 2 && neededSymbols <= msgBuff.capacity);
 		saveBuff(lenBuff, _prevMsgLengths, maxPrevMsgBuffLen);
@@ -62,6 +72,7 @@ void Framer::extractMsg(int head, msg::Buffer& recvBuff, Messages& messages) {
 	if (neededSymbols == 0) {
 		messages.emplace_back(msg::Buffer{msgBuff.size});
 		messages[messages.size() - 1].add(&msgBuff);
+		streams.push_back(stream);
 		saveBuff(msgBuff, _prevMsgs, maxPrevMsgBuffLen);
 		msgBuff.clear();
 		state = State::length;
@@ -9,6 +9,7 @@ class Framer {
 public:
 	Framer(const int capacity);
 	Messages extractMessages(msg::Buffer& recvBuff);
+	Messages extractMessages(msg::Buffer& recvBuff, std::vector<msg::OneByteInt>& streams);
 private:
 	void extractLength(int head, msg::Buffer& recvBuff, Messages& messages);
 	void extractMsg(int head, msg::Buffer& recvBuff, Messages& messages);
@@ -18,6 +19,8 @@ private:
 	msg::Buffer msgBuff;
 	msg::Buffer lenBuff{4};
 	unsigned int neededSymbols = 0;
+	msg::OneByteInt stream = 0; // Stream of the message being extracted
+	std::vector<msg::OneByteInt> streams; // Streams of the messages extracted in the current call
 
 	// debug buffers
 	int maxPrevBuffLen = 5;
@@ -2,12 +2,12 @@
 
 namespace msg {
 	Buffer::Buffer(const int capacity) :
-		data(std::make_unique<char[]>(capacity)),
+		data(BufferPool::allocate(capacity)),
 		size(0),
 		capacity(capacity) {}
 
 	Buffer::Buffer(const Buffer& other) :
-		data(std::make_unique<char[]>(other.capacity)),
+		data(BufferPool::allocate(other.capacity)),
 		size(other.size),
 		capacity(other.capacity) {
 		if (other.size > 0) {
@@ -37,6 +37,13 @@ namespace msg {
 		memcpy(data.get() + size, str->c_str(), str->size() + 1);
 		size += str->size() + 1;
 	}
+	void Buffer::add(const std::string_view* str) {
+		reserveIfNeeded(str->size() + 1);
+		assert(capacity >= size + str->size() + 1 && "Error, buffer size excedeed!");
+		memcpy(data.get() + size, str->data(), str->size());
+		size += str->size();
+		data[size++] = '\0';
+	}
 	void Buffer::add(const Buffer* other) {
 		reserveIfNeeded(other->size);
 		assert(capacity >= size + other->size && "Error, buffer size excedeed!");
@@ -61,6 +68,27 @@ namespace msg {
 		add(&y2);
 	}
 
+	void Buffer::add(const VarInt* val) {
+		reserveIfNeeded(varIntSize(val->value));
+		unsigned int value = val->value;
+		while (value >= 0x80) {
+			data[size++] = static_cast<char>((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+		data[size++] = static_cast<char>(value);
+	}
+	void Buffer::add(const ZigZag* val) {
+		VarInt encoded{ zigZagEncode(val->value) };
+		add(&encoded);
+	}
+	void Buffer::add(const std::vector<VarInt>* arr) {
+		VarInt arrSize{ static_cast<unsigned int>(arr->size()) };
+		add(&arrSize);
+		for (const auto& element : *arr) {
+			add(&element);
+		}
+	}
+
 	void Buffer::replace(const int pos, const unsigned int val) {
 		assert(pos + sizeof(val) <= size);
 		u_long uLongVal = htonl(val);
@@ -72,9 +100,6 @@ namespace msg {
 	}
 
 	void Buffer::clear() {
-		if (size > 0) {
-			memset(data.get(), 0, size);
-		}
 		size = 0;
 	}
 	bool Buffer::empty() const {
@@ -82,7 +107,12 @@ namespace msg {
 	}
 
 	void Buffer::reserve(const int newCapacity) {
-		auto newData = std::make_unique<char[]>(newCapacity);
+		// Size classes leave slack in the block, use it before reallocating
+		if (data && newCapacity <= data.get_deleter().blockSize) {
+			capacity = newCapacity;
+			return;
+		}
+		auto newData = BufferPool::allocate(newCapacity);
 		if (size > 0) {
 			memcpy(newData.get(), data.get(), size);
 		}
@@ -92,8 +122,10 @@ namespace msg {
 	}
 
 	void Buffer::reserveIfNeeded(const int cpsize) {
+		// Grow geometrically so repeated appends stay amortized O(1)
 		if (capacity < size + cpsize) {
-			reserve(size + cpsize + 64);
+			int grown = 2 * capacity;
+			reserve(grown < size + cpsize ? size + cpsize : grown);
 		}
 	}
 
@@ -101,11 +133,18 @@ namespace msg {
 		return other.data == data;
 	}
 
-	Buffer enrich(const Buffer& buffer) {
-		Buffer newBuffer{ buffer.capacity + 4 };
-		serializeTo(newBuffer, 0, static_cast<unsigned int>(buffer.size), buffer);
+	Buffer enrich(const Buffer& buffer, const OneByteInt stream) {
+		if (!fitsFrame(buffer)) {
+			return Buffer{ 0 };
+		}
+		Buffer newBuffer{ buffer.size + 4 };
+		unsigned int header = static_cast<unsigned int>(buffer.size) | (static_cast<unsigned int>(stream) << frameStreamShift);
+		serializeTo(newBuffer, 0, header, buffer);
 		return newBuffer;
 	}
+	void setFrameStream(Buffer& frame, const OneByteInt stream) {
+		frame.get()[0] = static_cast<char>(stream);
+	}
 	int parseObj(std::pair<COORD, COORD>& obj, const Buffer& buffer, const int offset) {
 		unsigned int x1, y1, x2, y2;
 		int pos = parseObj(x1, buffer, offset);
@@ -139,9 +178,39 @@ namespace msg {
 		return sizeof(OneByteInt);
 	}
 
-	constexpr std::array<const char*, 25> typeToStr = { "MASTER NOTIFICATION", "MASTER CLOSE", "REGISTRATION", "LOGIN", "LOGOUT", "CREATE" , "LOAD" ,
+	int parseObj(VarInt& obj, const Buffer& buffer, const int offset) {
+		unsigned int value = 0;
+		int pos = 0;
+		for (int shift = 0; shift < 32; shift += 7) {
+			auto byte = static_cast<OneByteInt>(buffer.get()[offset + pos++]);
+			value |= static_cast<unsigned int>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0) {
+				break;
+			}
+		}
+		obj.value = value;
+		return pos;
+	}
+	int parseObj(ZigZag& obj, const Buffer& buffer, const int offset) {
+		VarInt encoded;
+		int pos = parseObj(encoded, buffer, offset);
+		obj.value = zigZagDecode(encoded.value);
+		return pos;
+	}
+	int parseObj(std::vector<VarInt>& arr, const Buffer& buffer, const int offset) {
+		VarInt arrSize;
+		int pos = parseObj(arrSize, buffer, offset);
+		arr.resize(arrSize.value);
+		for (auto& element : arr) {
+			pos += parseObj(element, buffer, offset + pos);
+		}
+		return pos;
+	}
+
+	constexpr std::array<const char*, 32> typeToStr = { "MASTER NOTIFICATION", "MASTER CLOSE", "REGISTRATION", "LOGIN", "LOGOUT", "CREATE" , "LOAD" ,
 	"JOIN" , "GETFILES", "SAVEFILE", "ERROR", "WRITE", "ERASE", "REPLACE", "MOVEVERTICAL", "MOVEHORIZONTAL", "MOVETO", "SYNC",
-	"CONNECT", "DISCONNECT", "SELECT ALL", "UNDO", "REDO", "GET DOC NAMES", "DELETE DOC"};
+	"CONNECT", "DISCONNECT", "SELECT ALL", "UNDO", "REDO", "GET DOC NAMES", "DELETE DOC", "SNAPSHOT CHUNK", "REJECT", "PRESENCE", "HEARTBEAT",
+	"MASTER DRAIN", "MASTER ADOPT", "MASTER MIGRATE"};
 
 	constexpr std::array<const char*, 4> sideToStr = { "LEFT", "RIGHT", "UP", "DOWN" };
 
@@ -154,4 +223,14 @@ namespace msg {
 		stream << sideToStr[static_cast<int>(side)];
 		return stream;
 	}
+
+	std::ostream& operator<<(std::ostream& stream, const VarInt& val) {
+		stream << val.value;
+		return stream;
+	}
+
+	std::ostream& operator<<(std::ostream& stream, const ZigZag& val) {
+		stream << val.value;
+		return stream;
+	}
 }
\ No newline at end of file
@@ -3,11 +3,14 @@
 #include <memory>
 #include <assert.h>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <sstream>
 #include <type_traits>
 #include <array>
 
+#include "buffer_pool.h"
+
 #pragma comment(lib, "Ws2_32.lib")
 
 
@@ -41,7 +44,15 @@ namespace msg {
 		redo,
 		// CRUD
 		getDocNames,
-		delDoc
+		delDoc,
+		snapshotChunk,
+		reject,
+		presence,
+		heartbeat,
+		// Commands from master to a worker, appended so the values above don't change
+		masterDrain,
+		masterAdopt,
+		masterMigrate
 	};
 
 	enum class MoveSide {
@@ -51,8 +62,114 @@ namespace msg {
 		down
 	};
 
+	// Protocol versions. Starting with sessionAuthVersion modifiers don't carry authToken,
+	// the connection is authenticated once when it is bound to the document session.
+	// From compactVersion on integers are LEB128 varints and edit positions are zig-zag deltas
+	// against the position of the same user's previous write/erase (see editAnchors).
+	// With streamedSnapshotVersion big documents are sent on connect as snapshotChunk messages.
+	// With resumeVersion a rejoining client passes its last document version and gets only the missed updates.
+	// With rejectVersion a failed modifier is answered with a reject carrying its sequence number in the session.
+	// With rebaseVersion write and erase carry the document version and cursor position they were made at.
+	// With presenceVersion cursor moves are not document versions, they are acknowledged only to the moving client
+	// and other clients get the latest cursor of every moved user in periodic presence frames.
+	// With datagramPresenceVersion a connecting client may offer a UDP port, presence frames are then sent there
+	// and carry a sequence number and the document version they were built at.
+	// With heartbeatVersion a client answers server heartbeats on a silent connection, the connection is closed
+	// when nothing comes back.
+	constexpr OneByteInt legacyVersion = 1;
+	constexpr OneByteInt sessionAuthVersion = 2;
+	constexpr OneByteInt compactVersion = 3;
+	constexpr OneByteInt streamedSnapshotVersion = 4;
+	constexpr OneByteInt resumeVersion = 5;
+	constexpr OneByteInt rejectVersion = 6;
+	constexpr OneByteInt rebaseVersion = 7;
+	constexpr OneByteInt presenceVersion = 8;
+	constexpr OneByteInt datagramPresenceVersion = 9;
+	constexpr OneByteInt heartbeatVersion = 10;
+	constexpr OneByteInt currentVersion = heartbeatVersion;
+	constexpr unsigned int snapshotChunkSize = 16 * 1024;
+	inline bool carriesAuthToken(const OneByteInt version) {
+		return version < sessionAuthVersion;
+	}
+	inline bool isCompact(const OneByteInt version) {
+		return version >= compactVersion;
+	}
+	inline bool streamsSnapshot(const OneByteInt version) {
+		return version >= streamedSnapshotVersion;
+	}
+	inline bool supportsResume(const OneByteInt version) {
+		return version >= resumeVersion;
+	}
+	inline bool reportsRejects(const OneByteInt version) {
+		return version >= rejectVersion;
+	}
+	inline bool carriesBaseVersion(const OneByteInt version) {
+		return version >= rebaseVersion;
+	}
+	inline bool receivesPresence(const OneByteInt version) {
+		return version >= presenceVersion;
+	}
+	inline bool sendsDatagramPresence(const OneByteInt version) {
+		return version >= datagramPresenceVersion;
+	}
+	inline bool answersHeartbeats(const OneByteInt version) {
+		return version >= heartbeatVersion;
+	}
+	inline bool isCursorMove(const Type type) {
+		switch (type) {
+		case Type::selectAll:
+		case Type::moveHorizontal:
+		case Type::moveVertical:
+		case Type::moveTo:
+			return true;
+		}
+		return false;
+	}
+	// Messages which change the document state of every client in the session
+	inline bool isDocumentUpdate(const Type type) {
+		switch (type) {
+		case Type::write:
+		case Type::erase:
+		case Type::replace:
+		case Type::connect:
+		case Type::disconnect:
+		case Type::presence:
+			return true;
+		}
+		return isCursorMove(type);
+	}
+	// Document updates counted as document versions, cursor state is latest-wins and is not versioned
+	inline bool isVersioned(const Type type) {
+		return isDocumentUpdate(type) && !isCursorMove(type) && type != Type::presence;
+	}
+
+	struct VarInt {
+		unsigned int value = 0;
+	};
+
+	struct ZigZag {
+		int value = 0;
+	};
+
+	inline unsigned int zigZagEncode(const int value) {
+		return (static_cast<unsigned int>(value) << 1) ^ static_cast<unsigned int>(value >> 31);
+	}
+	inline int zigZagDecode(const unsigned int value) {
+		return static_cast<int>(value >> 1) ^ -static_cast<int>(value & 1);
+	}
+	inline int varIntSize(unsigned int value) {
+		int size = 1;
+		while (value >= 0x80) {
+			value >>= 7;
+			size++;
+		}
+		return size;
+	}
+
 	std::ostream& operator<<(std::ostream& stream, const Type& type);
 	std::ostream& operator<<(std::ostream& stream, const MoveSide side);
+	std::ostream& operator<<(std::ostream& stream, const VarInt& val);
+	std::ostream& operator<<(std::ostream& stream, const ZigZag& val);
 
 
 	class Buffer {
@@ -73,9 +190,13 @@ namespace msg {
 		void add(const Type* type);
 		void add(const MoveSide* type);
 		void add(const std::string* str);
+		void add(const std::string_view* str);
 		void add(const Buffer* other);
 		void add(const Buffer* other, const int start, const int cpsize);
 		void add(const std::pair<COORD, COORD>* val);
+		void add(const VarInt* val);
+		void add(const ZigZag* val);
+		void add(const std::vector<VarInt>* arr);
 		template<typename T>
 		void add(const std::vector<T>* arr) {
 			unsigned int arrSize = arr->size();
@@ -92,11 +213,23 @@ namespace msg {
 		void reserveIfNeeded(const int cpsize);
 		bool operator=(const Buffer& other);
 
-		std::unique_ptr<char[]> data;
+		PooledData data;
 		int size;
 		int capacity;
 	};
-	Buffer enrich(const Buffer& buffer);
+	// Frame header is 4 bytes, the top byte is the stream of the connection and the rest is the payload length.
+	// Stream 0 is the connection itself, other streams carry more document sessions over the same connection.
+	constexpr unsigned int frameLengthMask = 0x00FFFFFF;
+	constexpr int frameStreamShift = 24;
+	// Text carried whole by one message, a write or the document in a connect response without snapshot streaming.
+	// Half of the frame limit, the other fields of the message always fit next to it
+	constexpr unsigned int maxInlineText = (frameLengthMask + 1) / 2;
+	inline bool fitsFrame(const Buffer& payload) {
+		return static_cast<unsigned int>(payload.size) <= frameLengthMask;
+	}
+	// Payload over the frame limit gives an empty buffer, its length would spill into the stream byte
+	Buffer enrich(const Buffer& buffer, const OneByteInt stream = 0);
+	void setFrameStream(Buffer& frame, const OneByteInt stream);
 
 	template<typename T>
 	int parseObj(T& obj, const Buffer& buffer, const int offset) {
@@ -108,16 +241,20 @@ namespace msg {
 	int parseObj(unsigned int& obj, const Buffer& buffer, const int offset); 
 	int parseObj(Type& obj, const Buffer& buffer, const int offset);
 	int parseObj(MoveSide& obj, const Buffer& buffer, const int offset);
+	int parseObj(VarInt& obj, const Buffer& buffer, const int offset);
+	int parseObj(ZigZag& obj, const Buffer& buffer, const int offset);
+	int parseObj(std::vector<VarInt>& arr, const Buffer& buffer, const int offset);
 	template<typename T>
 	int parseObj(std::vector<T>& arr, const Buffer& buffer, const int offset) {
 		unsigned int arrSize;
 		int pos = offset;
 		pos += parseObj(arrSize, buffer, pos);
+		arr.reserve(arr.size() + (std::min)(arrSize, static_cast<unsigned int>(buffer.size)));
 		for (int i = 0; i < arrSize; i++) {
 			arr.push_back(T{});
 			pos += parseObj(arr[arr.size() - 1], buffer, pos);
 		}
-		return pos;
+		return pos - offset;
 	}
 
 	template<typename... Args>
@@ -187,11 +324,16 @@ namespace msg {
 		std::string errMsg;
 	};
 
+	// Server writes the client id into the socket field of connect messages, right after the header
+	constexpr int connectSocketPos = 2;
+	constexpr int connectHeaderSize = connectSocketPos + sizeof(unsigned int);
+
 	struct ConnectCreateDoc {
 		Type type = Type::create;
 		OneByteInt version = 0;
 		unsigned int socket = 0;
 		std::string filename;
+		unsigned int presencePort = 0; // UDP port of the client for presence frames, 0 -> frames are sent over TCP
 	};
 
 	struct ConnectJoinDoc {
@@ -199,6 +341,8 @@ namespace msg {
 		OneByteInt version = 0;
 		unsigned int socket = 0;
 		std::string acCode;
+		unsigned int lastVersion = 0; // If not 0 -> document version the client already has
+		unsigned int presencePort = 0; // UDP port of the client for presence frames, 0 -> frames are sent over TCP
 	};
 
 	struct ConnectResponse {
@@ -209,6 +353,33 @@ namespace msg {
 		std::string acCode; //Access code to document
 		std::string text; // Whole current state of the document
 		std::vector<unsigned int> cursorPositions;
+		std::vector<unsigned int> editAnchors; // Bases for compact position deltas
+		unsigned int snapshotVersion = 0; // Document version the text was taken at
+		unsigned int snapshotSize = 0; // If not 0 -> text is empty and comes in snapshotChunk messages
+		unsigned int replayedOps = 0; // If not 0 -> resumed, client keeps its document and gets missed updates next
+	};
+
+	struct Reject {
+		Type type = Type::reject;
+		OneByteInt version = 0;
+		unsigned int seq = 0; // Which modifier of the client in the session failed, counted from 1
+	};
+
+	struct Presence {
+		Type type = Type::presence;
+		OneByteInt version = 0;
+		std::vector<unsigned int> cursors; // Per user: user, X, Y, withSelect, anchorX, anchorY
+		unsigned int seq = 0; // Frames of the session are numbered from 1, older datagrams are dropped
+		unsigned int docVersion = 0; // Document version the cursors are valid for
+	};
+	constexpr int presenceStride = 6;
+
+	struct SnapshotChunk {
+		Type type = Type::snapshotChunk;
+		OneByteInt version = 0;
+		unsigned int snapshotVersion = 0;
+		unsigned int offset = 0; // Position of the chunk in the whole snapshot text
+		std::string text;
 	};
 
 	struct Disconnect {
@@ -228,6 +399,9 @@ namespace msg {
 		OneByteInt version = 0;
 		std::string authToken;;
 		std::string text;
+		unsigned int baseVersion = 0; // Document version the client saw when it made the edit
+		unsigned int X = 0;
+		unsigned int Y = 0;
 	};
 
 	struct WriteResponse {
@@ -239,11 +413,57 @@ namespace msg {
 		unsigned int Y = 0;
 	};
 
+	// Views decode the same frames as Write/WriteResponse, but their text points into the
+	// decoded buffer instead of owning a copy. Valid only as long as that buffer.
+	struct WriteView {
+		Type type = Type::write;
+		OneByteInt version = 0;
+		std::string_view authToken;
+		std::string_view text;
+		unsigned int baseVersion = 0;
+		unsigned int X = 0;
+		unsigned int Y = 0;
+	};
+
+	struct WriteResponseView {
+		Type type = Type::write;
+		OneByteInt version = 0;
+		OneByteInt user = 0;
+		std::string_view text;
+		unsigned int X = 0;
+		unsigned int Y = 0;
+	};
+
+	struct ConnectResponseView {
+		Type type = Type::connect;
+		OneByteInt version = 0;
+		OneByteInt user = 0;
+		std::string_view error;
+		std::string_view acCode;
+		std::string_view text;
+		std::vector<unsigned int> cursorPositions;
+		std::vector<unsigned int> editAnchors;
+		unsigned int snapshotVersion = 0;
+		unsigned int snapshotSize = 0;
+		unsigned int replayedOps = 0;
+	};
+
+	struct SnapshotChunkView {
+		Type type = Type::snapshotChunk;
+		OneByteInt version = 0;
+		unsigned int snapshotVersion = 0;
+		unsigned int offset = 0;
+		std::string_view text;
+	};
+
 	struct Erase {
 		Type type = Type::erase;
 		OneByteInt version = 0;
 		std::string authToken;
 		unsigned int eraseSize = 0;
+		unsigned int baseVersion = 0;
+		unsigned int X = 0;
+		unsigned int Y = 0;
 	};
 
 	struct EraseResponse {
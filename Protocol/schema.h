@@ -0,0 +1,497 @@
+#pragma once
+#include <optional>
+#include "messages.h"
+
+namespace msg {
+	// Per user bases of compact edit positions, indexed by user idx
+	using EditAnchors = std::vector<COORD>;
+	inline const EditAnchors noEditAnchors;
+
+	// Every message is described once by its Schema<Msg>::Layout - the list of fields following
+	// the common (type, version) header. Size, serialization and parsing are generated from it,
+	// so the encoder and both decoders cannot drift apart.
+	namespace schema {
+		// Plain field, unsigned ints are varints in compact frames
+		template<auto Member>
+		struct Field {};
+
+		// Always 4 bytes, so it can be patched in place (master forwarding the client socket)
+		template<auto Member>
+		struct Fixed {};
+
+		// Absolute position, in compact frames zig-zag delta against editAnchors[msg.user]
+		template<auto MemberX, auto MemberY>
+		struct EditPos {};
+
+		// Inner field is on the wire only if Predicate(msg) holds
+		template<auto Predicate, typename Inner>
+		struct When {};
+
+		template<typename... Fields>
+		struct Layout {};
+
+		template<typename Msg>
+		bool withAuthToken(const Msg& msg) {
+			return carriesAuthToken(msg.version);
+		}
+
+		template<typename Msg>
+		bool withSelection(const Msg& msg) {
+			return !isCompact(msg.version) || msg.withSelect;
+		}
+
+		template<typename Msg>
+		bool withSnapshot(const Msg& msg) {
+			return streamsSnapshot(msg.version);
+		}
+
+		template<typename Msg>
+		bool withResume(const Msg& msg) {
+			return supportsResume(msg.version);
+		}
+
+		template<typename Msg>
+		bool withBase(const Msg& msg) {
+			return carriesBaseVersion(msg.version);
+		}
+
+		template<typename Msg>
+		bool withDatagramPresence(const Msg& msg) {
+			return sendsDatagramPresence(msg.version);
+		}
+
+		template<typename Msg>
+		using AuthToken = When<&withAuthToken<Msg>, Field<&Msg::authToken>>;
+	}
+
+	template<typename Msg>
+	struct Schema;
+
+	template<typename Msg>
+	concept Schematized = requires { typename Schema<Msg>::Layout; };
+
+	namespace codec {
+		inline int sizeOf(const OneByteInt&, const bool) { return 1; }
+		inline int sizeOf(const Type&, const bool) { return 1; }
+		inline int sizeOf(const MoveSide&, const bool) { return 1; }
+		inline int sizeOf(const std::string& value, const bool) {
+			return static_cast<int>(value.size()) + 1;
+		}
+		inline int sizeOf(const std::string_view& value, const bool) {
+			return static_cast<int>(value.size()) + 1;
+		}
+		inline int sizeOf(const unsigned int& value, const bool compact) {
+			return compact ? varIntSize(value) : sizeof(unsigned int);
+		}
+		inline int sizeOf(const SHORT& value, const bool compact) {
+			return sizeOf(static_cast<unsigned int>(value), compact);
+		}
+		inline int sizeOf(const std::pair<COORD, COORD>& value, const bool compact) {
+			return sizeOf(value.first.X, compact) + sizeOf(value.first.Y, compact) +
+				sizeOf(value.second.X, compact) + sizeOf(value.second.Y, compact);
+		}
+		template<typename T>
+		int sizeOf(const std::vector<T>& arr, const bool compact) {
+			int size = sizeOf(static_cast<unsigned int>(arr.size()), compact);
+			for (const auto& element : arr) {
+				size += sizeOf(element, compact);
+			}
+			return size;
+		}
+
+		inline void write(Buffer& buffer, const OneByteInt& value, const bool) { buffer.add(&value); }
+		inline void write(Buffer& buffer, const Type& value, const bool) { buffer.add(&value); }
+		inline void write(Buffer& buffer, const MoveSide& value, const bool) { buffer.add(&value); }
+		inline void write(Buffer& buffer, const std::string& value, const bool) { buffer.add(&value); }
+		inline void write(Buffer& buffer, const std::string_view& value, const bool) { buffer.add(&value); }
+		inline void write(Buffer& buffer, const unsigned int& value, const bool compact) {
+			if (compact) {
+				VarInt varInt{ value };
+				buffer.add(&varInt);
+				return;
+			}
+			buffer.add(&value);
+		}
+		inline void write(Buffer& buffer, const SHORT& value, const bool compact) {
+			write(buffer, static_cast<unsigned int>(value), compact);
+		}
+		inline void write(Buffer& buffer, const std::pair<COORD, COORD>& value, const bool compact) {
+			write(buffer, value.first.X, compact);
+			write(buffer, value.first.Y, compact);
+			write(buffer, value.second.X, compact);
+			write(buffer, value.second.Y, compact);
+		}
+		template<typename T>
+		void write(Buffer& buffer, const std::vector<T>& arr, const bool compact) {
+			write(buffer, static_cast<unsigned int>(arr.size()), compact);
+			for (const auto& element : arr) {
+				write(buffer, element, compact);
+			}
+		}
+
+		// Reads are bounds-checked against Buffer::size, malformed frames yield a negative size
+		constexpr int malformed = -1;
+
+		inline int readByte(OneByteInt& value, const Buffer& buffer, const int offset) {
+			if (offset < 0 || offset >= buffer.size) {
+				return malformed;
+			}
+			value = static_cast<OneByteInt>(buffer.get()[offset]);
+			return 1;
+		}
+		inline int read(OneByteInt& value, const Buffer& buffer, const int offset, const bool) {
+			return readByte(value, buffer, offset);
+		}
+		inline int read(Type& value, const Buffer& buffer, const int offset, const bool) {
+			OneByteInt byte = 0;
+			int size = readByte(byte, buffer, offset);
+			value = static_cast<Type>(byte);
+			return size;
+		}
+		inline int read(MoveSide& value, const Buffer& buffer, const int offset, const bool) {
+			OneByteInt byte = 0;
+			int size = readByte(byte, buffer, offset);
+			value = static_cast<MoveSide>(byte);
+			return size;
+		}
+		inline int read(std::string_view& value, const Buffer& buffer, const int offset, const bool) {
+			if (offset < 0 || offset >= buffer.size) {
+				return malformed;
+			}
+			const char* begin = buffer.get() + offset;
+			const void* end = memchr(begin, '\0', buffer.size - offset);
+			if (end == nullptr) {
+				return malformed;
+			}
+			value = std::string_view{ begin, static_cast<size_t>(static_cast<const char*>(end) - begin) };
+			return static_cast<int>(value.size()) + 1;
+		}
+		inline int read(std::string& value, const Buffer& buffer, const int offset, const bool compact) {
+			std::string_view view;
+			int size = read(view, buffer, offset, compact);
+			if (size >= 0) {
+				value.assign(view);
+			}
+			return size;
+		}
+		inline int read(unsigned int& value, const Buffer& buffer, const int offset, const bool compact) {
+			if (!compact) {
+				if (offset < 0 || offset + static_cast<int>(sizeof(unsigned int)) > buffer.size) {
+					return malformed;
+				}
+				return parseObj(value, buffer, offset);
+			}
+			value = 0;
+			int pos = offset;
+			for (int shift = 0; shift < 32; shift += 7) {
+				OneByteInt byte = 0;
+				if (readByte(byte, buffer, pos++) < 0) {
+					return malformed;
+				}
+				value |= static_cast<unsigned int>(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0) {
+					return pos - offset;
+				}
+			}
+			return malformed;
+		}
+		inline int read(SHORT& value, const Buffer& buffer, const int offset, const bool compact) {
+			unsigned int valueBuff = 0;
+			int size = read(valueBuff, buffer, offset, compact);
+			value = static_cast<SHORT>(valueBuff);
+			return size;
+		}
+		template<typename... Values>
+		int readAll(const Buffer& buffer, const int offset, const bool compact, Values&... values) {
+			int pos = offset;
+			([&] {
+				if (pos < 0) {
+					return;
+				}
+				int size = read(values, buffer, pos, compact);
+				pos = size < 0 ? malformed : pos + size;
+			} (), ...);
+			return pos < 0 ? malformed : pos - offset;
+		}
+		inline int read(std::pair<COORD, COORD>& value, const Buffer& buffer, const int offset, const bool compact) {
+			return readAll(buffer, offset, compact, value.first.X, value.first.Y, value.second.X, value.second.Y);
+		}
+		template<typename T>
+		int read(std::vector<T>& arr, const Buffer& buffer, const int offset, const bool compact) {
+			unsigned int arrSize = 0;
+			int size = read(arrSize, buffer, offset, compact);
+			// Every element takes at least one byte, a larger count cannot be valid
+			if (size < 0 || arrSize > static_cast<unsigned int>(buffer.size - offset - size)) {
+				return malformed;
+			}
+			int pos = offset + size;
+			arr.resize(arrSize);
+			for (auto& element : arr) {
+				size = read(element, buffer, pos, compact);
+				if (size < 0) {
+					return malformed;
+				}
+				pos += size;
+			}
+			return pos - offset;
+		}
+	}
+
+	namespace schema {
+		inline COORD anchorOf(const EditAnchors& editAnchors, const OneByteInt user) {
+			return user < editAnchors.size() ? editAnchors[user] : COORD{ 0, 0 };
+		}
+
+		template<typename Msg, auto Member>
+		int fieldSize(Field<Member>, const Msg& msg, const EditAnchors&) {
+			return codec::sizeOf(msg.*Member, isCompact(msg.version));
+		}
+		template<typename Msg, auto Member>
+		void writeField(Field<Member>, Buffer& buffer, const Msg& msg, const EditAnchors&) {
+			codec::write(buffer, msg.*Member, isCompact(msg.version));
+		}
+		template<typename Msg, auto Member>
+		int readField(Field<Member>, Msg& msg, const Buffer& buffer, const int offset, const EditAnchors&) {
+			return codec::read(msg.*Member, buffer, offset, isCompact(msg.version));
+		}
+
+		template<typename Msg, auto Member>
+		int fieldSize(Fixed<Member>, const Msg& msg, const EditAnchors&) {
+			return codec::sizeOf(msg.*Member, false);
+		}
+		template<typename Msg, auto Member>
+		void writeField(Fixed<Member>, Buffer& buffer, const Msg& msg, const EditAnchors&) {
+			codec::write(buffer, msg.*Member, false);
+		}
+		template<typename Msg, auto Member>
+		int readField(Fixed<Member>, Msg& msg, const Buffer& buffer, const int offset, const EditAnchors&) {
+			return codec::read(msg.*Member, buffer, offset, false);
+		}
+
+		template<typename Msg, auto MemberX, auto MemberY>
+		int fieldSize(EditPos<MemberX, MemberY>, const Msg& msg, const EditAnchors& editAnchors) {
+			if (!isCompact(msg.version)) {
+				return 2 * sizeof(unsigned int);
+			}
+			COORD anchor = anchorOf(editAnchors, msg.user);
+			return varIntSize(zigZagEncode(static_cast<int>(msg.*MemberX) - anchor.X)) +
+				varIntSize(zigZagEncode(static_cast<int>(msg.*MemberY) - anchor.Y));
+		}
+		template<typename Msg, auto MemberX, auto MemberY>
+		void writeField(EditPos<MemberX, MemberY>, Buffer& buffer, const Msg& msg, const EditAnchors& editAnchors) {
+			if (!isCompact(msg.version)) {
+				buffer.add(&(msg.*MemberX));
+				buffer.add(&(msg.*MemberY));
+				return;
+			}
+			COORD anchor = anchorOf(editAnchors, msg.user);
+			ZigZag deltaX{ static_cast<int>(msg.*MemberX) - anchor.X };
+			ZigZag deltaY{ static_cast<int>(msg.*MemberY) - anchor.Y };
+			buffer.add(&deltaX);
+			buffer.add(&deltaY);
+		}
+		template<typename Msg, auto MemberX, auto MemberY>
+		int readField(EditPos<MemberX, MemberY>, Msg& msg, const Buffer& buffer, const int offset, const EditAnchors& editAnchors) {
+			if (!isCompact(msg.version)) {
+				return codec::readAll(buffer, offset, false, msg.*MemberX, msg.*MemberY);
+			}
+			COORD anchor = anchorOf(editAnchors, msg.user);
+			unsigned int deltaX = 0, deltaY = 0;
+			int size = codec::readAll(buffer, offset, true, deltaX, deltaY);
+			msg.*MemberX = static_cast<unsigned int>(anchor.X + zigZagDecode(deltaX));
+			msg.*MemberY = static_cast<unsigned int>(anchor.Y + zigZagDecode(deltaY));
+			return size;
+		}
+
+		template<typename Msg, auto Predicate, typename Inner>
+		int fieldSize(When<Predicate, Inner>, const Msg& msg, const EditAnchors& editAnchors) {
+			return Predicate(msg) ? fieldSize(Inner{}, msg, editAnchors) : 0;
+		}
+		template<typename Msg, auto Predicate, typename Inner>
+		void writeField(When<Predicate, Inner>, Buffer& buffer, const Msg& msg, const EditAnchors& editAnchors) {
+			if (Predicate(msg)) {
+				writeField(Inner{}, buffer, msg, editAnchors);
+			}
+		}
+		template<typename Msg, auto Predicate, typename Inner>
+		int readField(When<Predicate, Inner>, Msg& msg, const Buffer& buffer, const int offset, const EditAnchors& editAnchors) {
+			return Predicate(msg) ? readField(Inner{}, msg, buffer, offset, editAnchors) : 0;
+		}
+
+		template<typename Msg, typename... Fields>
+		int layoutSize(Layout<Fields...>, const Msg& msg, const EditAnchors& editAnchors) {
+			return 2 + (0 + ... + fieldSize(Fields{}, msg, editAnchors));
+		}
+		template<typename Msg, typename... Fields>
+		void layoutWrite(Layout<Fields...>, Buffer& buffer, const Msg& msg, const EditAnchors& editAnchors) {
+			serializeTo(buffer, 0, msg.type, msg.version);
+			(writeField(Fields{}, buffer, msg, editAnchors), ...);
+		}
+		template<typename Msg, typename... Fields>
+		int layoutRead(Layout<Fields...>, Msg& msg, const Buffer& buffer, const EditAnchors& editAnchors) {
+			int pos = codec::readAll(buffer, 0, false, msg.type, msg.version);
+			([&] {
+				if (pos < 0) {
+					return;
+				}
+				int size = readField(Fields{}, msg, buffer, pos, editAnchors);
+				pos = size < 0 ? codec::malformed : pos + size;
+			} (), ...);
+			return pos;
+		}
+	}
+
+	template<Schematized Msg>
+	int encodedSize(const Msg& msg, const EditAnchors& editAnchors = noEditAnchors) {
+		return schema::layoutSize(typename Schema<Msg>::Layout{}, msg, editAnchors);
+	}
+
+	// Exactly one allocation, the buffer is sized up front
+	template<Schematized Msg>
+	Buffer serialize(const Msg& msg, const EditAnchors& editAnchors = noEditAnchors) {
+		Buffer buffer{ encodedSize(msg, editAnchors) };
+		schema::layoutWrite(typename Schema<Msg>::Layout{}, buffer, msg, editAnchors);
+		assert(buffer.size == buffer.capacity && "Error, encoded size mismatch!");
+		return buffer;
+	}
+
+	// Empty if the frame is malformed, fields read before the error are not handed out
+	template<Schematized Msg>
+	std::optional<Msg> deserialize(const Buffer& buffer, const EditAnchors& editAnchors = noEditAnchors) {
+		Msg msg{};
+		if (schema::layoutRead(typename Schema<Msg>::Layout{}, msg, buffer, editAnchors) < 0) {
+			return std::nullopt;
+		}
+		return msg;
+	}
+
+	// Decodes a view message (string_view fields pointing into buffer) without copying its text.
+	// Empty if the frame is malformed. Temporaries are rejected, the view cannot outlive buffer.
+	template<Schematized MsgView>
+	std::optional<MsgView> view(const Buffer& buffer, const EditAnchors& editAnchors = noEditAnchors) {
+		MsgView msg{};
+		if (schema::layoutRead(typename Schema<MsgView>::Layout{}, msg, buffer, editAnchors) < 0) {
+			return std::nullopt;
+		}
+		return msg;
+	}
+	template<Schematized MsgView>
+	std::optional<MsgView> view(const Buffer&& buffer, const EditAnchors& editAnchors = noEditAnchors) = delete;
+
+	template<> struct Schema<AckMsg> {
+		using Layout = schema::Layout<>;
+	};
+	template<> struct Schema<AckResponse> {
+		using Layout = schema::Layout<schema::Field<&AckResponse::errMsg>>;
+	};
+	template<> struct Schema<DeleteDoc> {
+		using Layout = schema::Layout<schema::Field<&DeleteDoc::authToken>, schema::Field<&DeleteDoc::docFilename>>;
+	};
+	template<> struct Schema<GetDocNamesResponse> {
+		using Layout = schema::Layout<schema::Field<&GetDocNamesResponse::errMsg>, schema::Field<&GetDocNamesResponse::docNames>>;
+	};
+	template<> struct Schema<Login> {
+		using Layout = schema::Layout<schema::Field<&Login::login>, schema::Field<&Login::password>>;
+	};
+	template<> struct Schema<LoginResponse> {
+		using Layout = schema::Layout<schema::Field<&LoginResponse::errMsg>, schema::Field<&LoginResponse::authToken>>;
+	};
+	template<> struct Schema<Register> {
+		using Layout = schema::Layout<schema::Field<&Register::login>, schema::Field<&Register::password>>;
+	};
+	template<> struct Schema<RegisterResponse> {
+		using Layout = schema::Layout<schema::Field<&RegisterResponse::errMsg>>;
+	};
+	template<> struct Schema<ConnectCreateDoc> {
+		using Layout = schema::Layout<schema::Fixed<&ConnectCreateDoc::socket>, schema::Field<&ConnectCreateDoc::filename>,
+			schema::When<&schema::withDatagramPresence<ConnectCreateDoc>, schema::Field<&ConnectCreateDoc::presencePort>>>;
+	};
+	template<> struct Schema<ConnectJoinDoc> {
+		using Layout = schema::Layout<schema::Fixed<&ConnectJoinDoc::socket>, schema::Field<&ConnectJoinDoc::acCode>,
+			schema::When<&schema::withResume<ConnectJoinDoc>, schema::Field<&ConnectJoinDoc::lastVersion>>,
+			schema::When<&schema::withDatagramPresence<ConnectJoinDoc>, schema::Field<&ConnectJoinDoc::presencePort>>>;
+	};
+	template<> struct Schema<ConnectResponse> {
+		using Layout = schema::Layout<schema::Field<&ConnectResponse::user>, schema::Field<&ConnectResponse::error>, schema::Field<&ConnectResponse::acCode>,
+			schema::Field<&ConnectResponse::text>, schema::Field<&ConnectResponse::cursorPositions>, schema::Field<&ConnectResponse::editAnchors>,
+			schema::When<&schema::withSnapshot<ConnectResponse>, schema::Field<&ConnectResponse::snapshotVersion>>,
+			schema::When<&schema::withSnapshot<ConnectResponse>, schema::Field<&ConnectResponse::snapshotSize>>,
+			schema::When<&schema::withResume<ConnectResponse>, schema::Field<&ConnectResponse::replayedOps>>>;
+	};
+	template<> struct Schema<ConnectResponseView> {
+		using Layout = schema::Layout<schema::Field<&ConnectResponseView::user>, schema::Field<&ConnectResponseView::error>, schema::Field<&ConnectResponseView::acCode>,
+			schema::Field<&ConnectResponseView::text>, schema::Field<&ConnectResponseView::cursorPositions>, schema::Field<&ConnectResponseView::editAnchors>,
+			schema::When<&schema::withSnapshot<ConnectResponseView>, schema::Field<&ConnectResponseView::snapshotVersion>>,
+			schema::When<&schema::withSnapshot<ConnectResponseView>, schema::Field<&ConnectResponseView::snapshotSize>>,
+			schema::When<&schema::withResume<ConnectResponseView>, schema::Field<&ConnectResponseView::replayedOps>>>;
+	};
+	template<> struct Schema<Reject> {
+		using Layout = schema::Layout<schema::Field<&Reject::seq>>;
+	};
+	template<> struct Schema<Presence> {
+		using Layout = schema::Layout<schema::Field<&Presence::cursors>,
+			schema::When<&schema::withDatagramPresence<Presence>, schema::Field<&Presence::seq>>,
+			schema::When<&schema::withDatagramPresence<Presence>, schema::Field<&Presence::docVersion>>>;
+	};
+	template<> struct Schema<SnapshotChunk> {
+		using Layout = schema::Layout<schema::Field<&SnapshotChunk::snapshotVersion>, schema::Field<&SnapshotChunk::offset>, schema::Field<&SnapshotChunk::text>>;
+	};
+	template<> struct Schema<SnapshotChunkView> {
+		using Layout = schema::Layout<schema::Field<&SnapshotChunkView::snapshotVersion>, schema::Field<&SnapshotChunkView::offset>, schema::Field<&SnapshotChunkView::text>>;
+	};
+	template<> struct Schema<Disconnect> {
+		using Layout = schema::Layout<schema::AuthToken<Disconnect>>;
+	};
+	template<> struct Schema<DisconnectResponse> {
+		using Layout = schema::Layout<schema::Field<&DisconnectResponse::user>>;
+	};
+	template<> struct Schema<Write> {
+		using Layout = schema::Layout<schema::AuthToken<Write>, schema::Field<&Write::text>, schema::When<&schema::withBase<Write>, schema::Field<&Write::baseVersion>>,
+			schema::When<&schema::withBase<Write>, schema::Field<&Write::X>>, schema::When<&schema::withBase<Write>, schema::Field<&Write::Y>>>;
+	};
+	template<> struct Schema<WriteResponse> {
+		using Layout = schema::Layout<schema::Field<&WriteResponse::user>, schema::Field<&WriteResponse::text>, schema::EditPos<&WriteResponse::X, &WriteResponse::Y>>;
+	};
+	template<> struct Schema<WriteView> {
+		using Layout = schema::Layout<schema::AuthToken<WriteView>, schema::Field<&WriteView::text>, schema::When<&schema::withBase<WriteView>, schema::Field<&WriteView::baseVersion>>,
+			schema::When<&schema::withBase<WriteView>, schema::Field<&WriteView::X>>, schema::When<&schema::withBase<WriteView>, schema::Field<&WriteView::Y>>>;
+	};
+	template<> struct Schema<WriteResponseView> {
+		using Layout = schema::Layout<schema::Field<&WriteResponseView::user>, schema::Field<&WriteResponseView::text>, schema::EditPos<&WriteResponseView::X, &WriteResponseView::Y>>;
+	};
+	template<> struct Schema<Erase> {
+		using Layout = schema::Layout<schema::AuthToken<Erase>, schema::Field<&Erase::eraseSize>, schema::When<&schema::withBase<Erase>, schema::Field<&Erase::baseVersion>>,
+			schema::When<&schema::withBase<Erase>, schema::Field<&Erase::X>>, schema::When<&schema::withBase<Erase>, schema::Field<&Erase::Y>>>;
+	};
+	template<> struct Schema<EraseResponse> {
+		using Layout = schema::Layout<schema::Field<&EraseResponse::user>, schema::Field<&EraseResponse::eraseSize>, schema::EditPos<&EraseResponse::X, &EraseResponse::Y>>;
+	};
+	template<> struct Schema<Replace> {
+		using Layout = schema::Layout<schema::AuthToken<Replace>, schema::Field<&Replace::text>, schema::Field<&Replace::segments>>;
+	};
+	template<> struct Schema<ReplaceResponse> {
+		using Layout = schema::Layout<schema::Field<&ReplaceResponse::user>, schema::Field<&ReplaceResponse::text>, schema::Field<&ReplaceResponse::segments>>;
+	};
+	template<> struct Schema<MoveHorizontal> {
+		using Layout = schema::Layout<schema::AuthToken<MoveHorizontal>, schema::Field<&MoveHorizontal::side>, schema::Field<&MoveHorizontal::withSelect>>;
+	};
+	template<> struct Schema<MoveVertical> {
+		using Layout = schema::Layout<schema::AuthToken<MoveVertical>, schema::Field<&MoveVertical::side>, schema::Field<&MoveVertical::clientWidth>, schema::Field<&MoveVertical::withSelect>>;
+	};
+	template<> struct Schema<MoveSelectAll> {
+		using Layout = schema::Layout<schema::AuthToken<MoveSelectAll>>;
+	};
+	template<> struct Schema<MoveTo> {
+		using Layout = schema::Layout<schema::AuthToken<MoveTo>, schema::Field<&MoveTo::X>, schema::Field<&MoveTo::Y>>;
+	};
+	template<> struct Schema<MoveResponse> {
+		using Layout = schema::Layout<schema::Field<&MoveResponse::user>, schema::Field<&MoveResponse::X>, schema::Field<&MoveResponse::Y>, schema::Field<&MoveResponse::withSelect>,
+			schema::When<&schema::withSelection<MoveResponse>, schema::Field<&MoveResponse::anchorX>>, schema::When<&schema::withSelection<MoveResponse>, schema::Field<&MoveResponse::anchorY>>>;
+	};
+	template<> struct Schema<ControlMessage> {
+		using Layout = schema::Layout<schema::AuthToken<ControlMessage>>;
+	};
+	template<> struct Schema<ControlMessageResponse> {
+		using Layout = schema::Layout<schema::Field<&ControlMessageResponse::user>>;
+	};
+}
@@ -46,6 +46,14 @@ std::string Action::getText() const {
 	return container.getText();
 }
 
+size_t Action::getTextSize() const {
+	size_t size = 0;
+	for (const auto& line : container.get()) {
+		size += line.size();
+	}
+	return size;
+}
+
 Timestamp Action::getTimestamp() const {
 	return timestamp;
 }
@@ -47,6 +47,7 @@ public:
 	COORD getStartPos() const;
 	ActionType getType() const;
 	std::string getText() const;
+	size_t getTextSize() const;
 	Timestamp getTimestamp() const;
 	void addRelationship(const Key key);
 protected:
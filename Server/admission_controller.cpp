@@ -0,0 +1,74 @@
+#include "admission_controller.h"
+#include "logging.h"
+
+namespace server {
+	AdmissionController::AdmissionController(const Thresholds& thresholds) :
+		thresholds(thresholds) {}
+
+	bool AdmissionController::admit(const WorkerLoad& load) {
+		bool recentLatency = std::chrono::steady_clock::now() - load.sampledAt <= thresholds.latencyWindow;
+		if (load.queueDepth > thresholds.maxQueueDepth || (recentLatency && load.latency > thresholds.maxLatency)) {
+			return false;
+		}
+		counters.admitted++;
+		return true;
+	}
+
+	bool AdmissionController::defer(const SOCKET client, msg::Buffer&& buffer) {
+		if (deferredRequests.size() >= thresholds.maxDeferred) {
+			return false;
+		}
+		counters.deferred++;
+		deferredRequests.emplace_back(Deferred{ client, std::move(buffer), std::chrono::steady_clock::now() + thresholds.maxDefer });
+		return true;
+	}
+
+	void AdmissionController::retryLater(Deferred&& deferred) {
+		deferredRequests.emplace_back(std::move(deferred));
+	}
+
+	std::vector<AdmissionController::Deferred> AdmissionController::takeDeferred() {
+		auto deferred = std::move(deferredRequests);
+		deferredRequests.clear();
+		return deferred;
+	}
+
+	bool AdmissionController::hasDeferred() const {
+		return !deferredRequests.empty();
+	}
+
+	bool AdmissionController::isExpired(const Deferred& deferred) const {
+		return std::chrono::steady_clock::now() >= deferred.deadline;
+	}
+
+	bool AdmissionController::acceptsConnections(const unsigned int unassigned) const {
+		return unassigned < thresholds.maxUnassigned;
+	}
+
+	void AdmissionController::reject() {
+		counters.rejected++;
+	}
+
+	void AdmissionController::erase(const SOCKET client) {
+		// Buffers can't be assigned, kept requests are moved into a new vector
+		std::vector<Deferred> kept;
+		for (auto& deferred : deferredRequests) {
+			if (deferred.client != client) {
+				kept.emplace_back(std::move(deferred));
+			}
+		}
+		deferredRequests = std::move(kept);
+	}
+
+	std::string AdmissionController::getRetryAfterError() const {
+		return "Server is overloaded, retry after " + std::to_string(thresholds.retryAfter.count()) + " ms";
+	}
+
+	std::chrono::milliseconds AdmissionController::getRetryInterval() const {
+		return std::chrono::milliseconds{ 50 };
+	}
+
+	const AdmissionController::Counters& AdmissionController::getCounters() const {
+		return counters;
+	}
+}
\ No newline at end of file
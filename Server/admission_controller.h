@@ -0,0 +1,60 @@
+#pragma once
+#include <WinSock2.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "messages.h"
+
+namespace server {
+	struct WorkerLoad {
+		unsigned int queueDepth = 0; // Delayed messages and queued outbound frames
+		std::chrono::microseconds latency{ 0 }; // Moving average of message handling time
+		std::chrono::steady_clock::time_point sampledAt; // When latency was last updated
+		double utilization = 0.0; // Share of time spent outside select over the last window
+		std::chrono::steady_clock::time_point utilizationSampledAt;
+	};
+
+	// Decides in master whether new sessions may go to a worker. Requests for an overloaded worker
+	// are deferred for a while and rejected with a retry-after error if the worker doesn't recover.
+	class AdmissionController {
+	public:
+		struct Thresholds {
+			unsigned int maxQueueDepth = 2048;
+			std::chrono::microseconds maxLatency{ 20000 };
+			std::chrono::milliseconds latencyWindow{ 1000 }; // Older latency samples don't count, idle worker is not loaded
+			std::chrono::milliseconds maxDefer{ 500 };
+			std::chrono::milliseconds retryAfter{ 1000 };
+			size_t maxDeferred = 64;
+			unsigned int maxUnassigned = 48; // Connections waiting for a session, accepting pauses above it
+		};
+		struct Counters {
+			unsigned int admitted = 0;
+			unsigned int deferred = 0;
+			unsigned int rejected = 0;
+		};
+		struct Deferred {
+			SOCKET client; // Connection the request came from
+			msg::Buffer buffer;
+			std::chrono::steady_clock::time_point deadline;
+		};
+		AdmissionController(const Thresholds& thresholds);
+
+		bool admit(const WorkerLoad& load);
+		bool defer(const SOCKET client, msg::Buffer&& buffer);
+		void retryLater(Deferred&& deferred);
+		std::vector<Deferred> takeDeferred();
+		bool hasDeferred() const;
+		bool isExpired(const Deferred& deferred) const;
+		bool acceptsConnections(const unsigned int unassigned) const;
+		void reject();
+		void erase(const SOCKET client);
+		std::string getRetryAfterError() const;
+		std::chrono::milliseconds getRetryInterval() const;
+		const Counters& getCounters() const;
+	private:
+		Thresholds thresholds;
+		Counters counters;
+		std::vector<Deferred> deferredRequests;
+	};
+}
\ No newline at end of file
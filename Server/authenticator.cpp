@@ -27,7 +27,13 @@ namespace server {
 	}
 	
 	Response Authenticator::loginUser(const ArgPack& args) {
-		auto msg = Deserializer::parseLogin(args.buffer);
+		auto parsed = Deserializer::parseLogin(args.buffer);
+		if (!parsed) {
+			logger.logError("Malformed login message from", args.client);
+			auto buffer = Serializer::makeLoginResponse(1, "", "Malformed message!");
+			return Response{ buffer, {args.client}, msg::Type::login };
+		}
+		auto& msg = parsed.value();
 		auto userFromDbOpt = db.getUserWithUsername(msg.login);
 		std::string errMsg;
 		if (!userFromDbOpt) {
@@ -54,13 +60,23 @@ namespace server {
 
 	Response Authenticator::logoutUser(const ArgPack& args) {
 		auto msg = Deserializer::parseAck(args.buffer);
-		auto buffer = Serializer::makeAckResponse(msg.type, msg.version);
 		clearUser(args.client);
-		return Response{ buffer, {}, msg.type };
+		if (!msg) {
+			logger.logError("Malformed logout message from", args.client);
+			return Response{ Serializer::makeAckResponse(msg::Type::logout, 1), {}, msg::Type::logout };
+		}
+		auto buffer = Serializer::makeAckResponse(msg->type, msg->version);
+		return Response{ buffer, {}, msg->type };
 	}
 
 	Response Authenticator::registerUser(const ArgPack& args) {
-		auto msg = Deserializer::parseRegister(args.buffer);
+		auto parsed = Deserializer::parseRegister(args.buffer);
+		if (!parsed) {
+			logger.logError("Malformed register message from", args.client);
+			auto buffer = Serializer::makeRegisterResponse(1, "Malformed message!");
+			return Response{ buffer, {args.client}, msg::Type::registration };
+		}
+		auto& msg = parsed.value();
 		DBUser dbUser;
 		dbUser.username = std::move(msg.login);
 		dbUser.password = std::move(msg.password);
@@ -71,8 +87,13 @@ namespace server {
 
 	Response Authenticator::getDocNames(const ArgPack& args) {
 		auto msg = Deserializer::parseControlMessage(args.buffer);
+		if (!msg) {
+			logger.logError("Malformed message from", args.client);
+			auto newBuffer = Serializer::makeGetNamesResponse(1, "Malformed message!", {});
+			return Response{ std::move(newBuffer), { args.client }, msg::Type::error };
+		}
 		auto userData = getUserData(args.client);
-		if (userData.authToken != msg.authToken) {
+		if (userData.authToken != msg->authToken) {
 			logger.logError("Cannot authenticate user", args.client);
 			auto newBuffer = Serializer::makeGetNamesResponse(1, "Cannot authenticate user", {});
 			return Response{ std::move(newBuffer), { args.client }, msg::Type::error };
@@ -84,13 +105,18 @@ namespace server {
 
 	Response Authenticator::delDoc(const ArgPack& args) {
 		auto msg = Deserializer::parseDelDoc(args.buffer);
+		if (!msg) {
+			logger.logError("Malformed message from", args.client);
+			auto newBuffer = Serializer::makeAckResponse(msg::Type::delDoc, 1, "Malformed message!");
+			return Response{ std::move(newBuffer), { args.client }, msg::Type::error };
+		}
 		auto userData = getUserData(args.client);
-		if (userData.authToken != msg.authToken) {
+		if (userData.authToken != msg->authToken) {
 			logger.logError("Cannot authenticate user", args.client);
 			auto newBuffer = Serializer::makeAckResponse(msg::Type::delDoc, 1, "Cannot authenticate user");
 			return Response{ std::move(newBuffer), { args.client }, msg::Type::error };
 		}
-		auto doc = db.getDocWithUsernameAndFilename(userData.username, msg.docFilename);
+		auto doc = db.getDocWithUsernameAndFilename(userData.username, msg->docFilename);
 		if (!doc) {
 			auto newBuffer = Serializer::makeAckResponse(msg::Type::delDoc, 1, db.getLastError());
 			return Response{ std::move(newBuffer), { args.client }, msg::Type::error };
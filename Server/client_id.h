@@ -0,0 +1,24 @@
+#pragma once
+#include <WinSock2.h>
+
+#include "messages.h"
+
+namespace server {
+	// Endpoint of one document session: the connection socket and the stream of the connection.
+	// Stream 0 leaves the socket unchanged, so a connection with a single session is identified by its socket.
+	// Socket values have to fit below the stream bits, the server closes connections whose sockets do not.
+	using ClientId = SOCKET;
+
+	inline ClientId makeClientId(const SOCKET connection, const msg::OneByteInt stream) {
+		return connection | (static_cast<ClientId>(stream) << msg::frameStreamShift);
+	}
+	inline bool fitsClientId(const SOCKET connection) {
+		return connection <= msg::frameLengthMask;
+	}
+	inline SOCKET getConnection(const ClientId client) {
+		return client & msg::frameLengthMask;
+	}
+	inline msg::OneByteInt getStream(const ClientId client) {
+		return static_cast<msg::OneByteInt>(client >> msg::frameStreamShift);
+	}
+}
\ No newline at end of file
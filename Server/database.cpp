@@ -25,10 +25,25 @@ namespace server {
 		id = std::move(row[0]);
 		filename = std::move(row[1]);
 		usernames = Parser::parseLineToVector(row[2], ';');
+		routeKey = row.size() > 3 ? std::move(row[3]) : "";
 	}
 
 	std::vector<std::string> DBDocument::serialize() const {
-		return { id, filename, Parser::parseVectorToText(usernames, ';')};
+		std::vector<std::string> row{ id, filename, Parser::parseVectorToText(usernames, ';') };
+		if (!routeKey.empty()) {
+			row.emplace_back(routeKey);
+		}
+		return row;
+	}
+
+	const std::string& DBDocument::getRouteKey() const {
+		// Documents created before they had a key are placed by their id
+		return routeKey.empty() ? id : routeKey;
+	}
+
+	std::string DBDocument::makeRouteKey(const std::string& creator, const std::string& filename) {
+		// Known to the router before the document gets its id
+		return creator + "/" + filename;
 	}
 
 
@@ -269,15 +284,32 @@ namespace server {
 			setError("Document " + filename + " does not exists in " + username + "'s database");
 			return {};
 		}
-		std::ifstream file{ dbRoot + "\\" + docFromDbOpt.value().id, std::ios::in };
+		auto text = loadDocText(docFromDbOpt.value().id);
+		if (!text) {
+			return {};
+		}
+		ServerSiteDocument doc{ text.value(), 0, 0, docFromDbOpt.value().id, docFromDbOpt.value().filename };
+		return std::make_optional(std::move(doc));
+	}
+
+	std::optional<std::string> Database::loadDocText(const std::string& id) {
+		std::ifstream file{ dbRoot + "\\" + id, std::ios::in };
 		if (!file) {
-			setError("Error! Cannot document " + docFromDbOpt.value().id);
+			setError("Error! Cannot document " + id);
 			return {};
 		}
 		std::stringstream ss;
 		ss << file.rdbuf();
-		ServerSiteDocument doc{ ss.str(), 0, 0, docFromDbOpt.value().id, docFromDbOpt.value().filename };
-		return std::make_optional(std::move(doc));
+		return ss.str();
+	}
+
+	std::optional<std::filesystem::file_time_type> Database::getDocWriteTime(const std::string& id) {
+		std::error_code errCode;
+		auto writeTime = std::filesystem::last_write_time(dbRoot + "\\" + id, errCode);
+		if (errCode.value()) {
+			return {};
+		}
+		return writeTime;
 	}
 
 	bool Database::saveDoc(const std::string& id, const std::string& newText) {
@@ -290,6 +322,58 @@ namespace server {
 		return true;
 	}
 
+	bool Database::saveDocChunk(const std::string& id, std::string_view chunk, const bool first, const bool last) {
+		// Chunks go to a temporary file, the document on disk stays whole until the last one replaces it
+		std::string path = dbRoot + "\\" + id;
+		std::string tmpPath = path + ".saving";
+		{
+			std::ofstream file{ tmpPath, first ? std::ios::out : std::ios::app };
+			if (!file || !(file << chunk)) {
+				setError("Error! Cannot document " + id);
+				std::error_code errCode;
+				std::filesystem::remove(tmpPath, errCode);
+				return false;
+			}
+		}
+		if (!last) {
+			return true;
+		}
+		std::error_code errCode;
+		std::filesystem::rename(tmpPath, path, errCode);
+		if (errCode.value()) {
+			setError("Error! Cannot replace document " + id + " with its saved text");
+			std::filesystem::remove(tmpPath, errCode);
+			return false;
+		}
+		return true;
+	}
+
+	bool Database::saveDocHistory(const std::string& id, const std::string& history) {
+		std::ofstream file{ dbRoot + "\\" + id + ".history", std::ios::out | std::ios::binary };
+		if (!file) {
+			setError("Error! Cannot save history of document " + id);
+			return false;
+		}
+		file << history;
+		return true;
+	}
+
+	std::string Database::takeDocHistory(const std::string& id) {
+		// History is kept only while its document is hibernated
+		std::string path = dbRoot + "\\" + id + ".history";
+		std::stringstream ss;
+		{
+			std::ifstream file{ path, std::ios::in | std::ios::binary };
+			if (!file) {
+				return {};
+			}
+			ss << file.rdbuf();
+		}
+		std::error_code errCode;
+		std::filesystem::remove(path, errCode);
+		return ss.str();
+	}
+
 	void Database::setError(const std::string& error) {
 		lastError = error;
 		logger.logError(error);
@@ -30,16 +30,20 @@ namespace server {
 	class DBDocument {
 	public:
 		DBDocument() = default;
-		DBDocument(const std::string& id, const std::string& filename, const std::vector<std::string>& usernames) :
+		DBDocument(const std::string& id, const std::string& filename, const std::vector<std::string>& usernames, const std::string& routeKey = "") :
 			id(id),
 			filename(filename),
-			usernames(usernames) {}
+			usernames(usernames),
+			routeKey(routeKey) {}
 		void parseRow(std::vector<std::string>& row);
 		std::vector<std::string> serialize() const;
+		const std::string& getRouteKey() const;
+		static std::string makeRouteKey(const std::string& creator, const std::string& filename);
 
 		std::string id;
 		std::string filename;
 		std::vector<std::string> usernames;
+		std::string routeKey; // Router places the document by it, fixed when the document is created
 		static const std::string dbName;
 		static const std::string objName;
 	};
@@ -67,7 +71,12 @@ namespace server {
 		bool unlinkUserAndDoc(const DBUser& user, const DBDocument& doc);
 
 		std::optional<ServerSiteDocument> loadDoc(const std::string& username, const std::string& filename);
+		std::optional<std::string> loadDocText(const std::string& id);
+		std::optional<std::filesystem::file_time_type> getDocWriteTime(const std::string& id);
 		bool saveDoc(const std::string& id, const std::string& newText);
+		bool saveDocChunk(const std::string& id, std::string_view chunk, const bool first, const bool last);
+		bool saveDocHistory(const std::string& id, const std::string& history);
+		std::string takeDocHistory(const std::string& id);
 		
 		std::string getLastError();
 	private:
@@ -1,78 +1,51 @@
 #include "deserializer.h"
+#include "schema.h"
 
-msg::AckMsg Deserializer::parseAck(const msg::Buffer& buffer) {
-	msg::AckMsg msg;
-	msg::parse(buffer, 0, msg.type, msg.version);
-	return msg;
+std::optional<msg::AckMsg> Deserializer::parseAck(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::AckMsg>(buffer);
 }
-msg::DeleteDoc Deserializer::parseDelDoc(const msg::Buffer& buffer) {
-	msg::DeleteDoc msg;
-	msg::parse(buffer, 0, msg.type, msg.version, msg.authToken, msg.docFilename);
-	return msg;
+std::optional<msg::DeleteDoc> Deserializer::parseDelDoc(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::DeleteDoc>(buffer);
 }
-msg::Login Deserializer::parseLogin(const msg::Buffer& buffer) {
-	msg::Login msg;
-	msg::parse(buffer, 0, msg.type, msg.version, msg.login, msg.password);
-	return msg;
+std::optional<msg::Login> Deserializer::parseLogin(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::Login>(buffer);
 }
-msg::Register Deserializer::parseRegister(const msg::Buffer& buffer) {
-	msg::Register msg;
-	msg::parse(buffer, 0, msg.type, msg.version, msg.login, msg.password);
-	return msg;
+std::optional<msg::Register> Deserializer::parseRegister(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::Register>(buffer);
 }
-msg::ConnectCreateDoc Deserializer::parseConnectCreateDoc(const msg::Buffer& buffer) {
-	msg::ConnectCreateDoc msg;
-	msg::parse(buffer, 0, msg.type, msg.version, msg.socket, msg.filename);
-	return msg;
+std::optional<msg::ConnectCreateDoc> Deserializer::parseConnectCreateDoc(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::ConnectCreateDoc>(buffer);
 }
-msg::ConnectJoinDoc Deserializer::parseConnectJoinDoc(const msg::Buffer& buffer) {
-	msg::ConnectJoinDoc msg;
-	msg::parse(buffer, 0, msg.type, msg.version, msg.socket, msg.acCode);
-	return msg;
+std::optional<msg::ConnectJoinDoc> Deserializer::parseConnectJoinDoc(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::ConnectJoinDoc>(buffer);
 }
-msg::Disconnect Deserializer::parseDisconnect(const msg::Buffer& buffer) {
-	msg::Disconnect msg;
-	msg::parse(buffer, 0, msg.type, msg.version, msg.authToken);
-	return msg;
+std::optional<msg::Disconnect> Deserializer::parseDisconnect(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::Disconnect>(buffer);
 }
-msg::Write Deserializer::parseWrite(const msg::Buffer& buffer) {
-	auto msg = msg::Write{};
-	msg::parse(buffer, 0, msg.type, msg.version, msg.authToken, msg.text);
-	return msg;
+std::optional<msg::Write> Deserializer::parseWrite(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::Write>(buffer);
 }
-msg::Erase Deserializer::parseErase(const msg::Buffer& buffer) {
-	auto msg = msg::Erase{};
-	msg::parse(buffer, 0, msg.type, msg.version, msg.authToken, msg.eraseSize);
-	return msg;
+std::optional<msg::WriteView> Deserializer::parseWriteView(const msg::Buffer& buffer) {
+	return msg::view<msg::WriteView>(buffer);
 }
-msg::MoveHorizontal Deserializer::parseMoveHorizontal(const msg::Buffer& buffer) {
-	auto msg = msg::MoveHorizontal{};
-	msg::parse(buffer, 0, msg.type, msg.version, msg.authToken, msg.side, msg.withSelect);
-	return msg;
+std::optional<msg::Erase> Deserializer::parseErase(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::Erase>(buffer);
 }
-msg::MoveVertical Deserializer::parseMoveVertical(const msg::Buffer& buffer) {
-	auto msg = msg::MoveVertical{};
-	msg::parse(buffer, 0, msg.type, msg.version, msg.authToken, msg.side, msg.clientWidth, msg.withSelect);
-	return msg;
+std::optional<msg::MoveHorizontal> Deserializer::parseMoveHorizontal(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::MoveHorizontal>(buffer);
 }
-msg::MoveTo Deserializer::parseMoveTo(const msg::Buffer& buffer) {
-	auto msg = msg::MoveTo{};
-	msg::parse(buffer, 0, msg.type, msg.version, msg.authToken, msg.X, msg.Y);
-	return msg;
+std::optional<msg::MoveVertical> Deserializer::parseMoveVertical(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::MoveVertical>(buffer);
 }
-msg::MoveSelectAll Deserializer::parseMoveSelectAll(const msg::Buffer& buffer) {
-	auto msg = msg::MoveSelectAll{};
-	msg::parse(buffer, 0, msg.type, msg.version, msg.authToken);
-	return msg;
+std::optional<msg::MoveTo> Deserializer::parseMoveTo(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::MoveTo>(buffer);
 }
-msg::ControlMessage Deserializer::parseControlMessage(const msg::Buffer& buffer) {
-	auto msg = msg::ControlMessage{};
-	msg::parse(buffer, 0, msg.type, msg.version, msg.authToken);
-	return msg;
+std::optional<msg::MoveSelectAll> Deserializer::parseMoveSelectAll(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::MoveSelectAll>(buffer);
 }
-
-msg::Replace Deserializer::parseReplaceMessage(const msg::Buffer& buffer) {
-	auto msg = msg::Replace{};
-	msg::parse(buffer, 0, msg.type, msg.version, msg.authToken, msg.text, msg.segments);
-	return msg;
+std::optional<msg::ControlMessage> Deserializer::parseControlMessage(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::ControlMessage>(buffer);
+}
+std::optional<msg::Replace> Deserializer::parseReplaceMessage(const msg::Buffer& buffer) {
+	return msg::deserialize<msg::Replace>(buffer);
 }
\ No newline at end of file
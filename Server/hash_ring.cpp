@@ -0,0 +1,61 @@
+#include <algorithm>
+
+#include "hash_ring.h"
+
+namespace server {
+	HashRing::HashRing(const int virtualNodes) :
+		virtualNodes(virtualNodes) {}
+
+	void HashRing::add(const std::string& backend) {
+		if (contains(backend)) {
+			return;
+		}
+		backends.push_back(backend);
+		for (int i = 0; i < virtualNodes; i++) {
+			points.emplace(hash(backend + "#" + std::to_string(i)), backend);
+		}
+	}
+
+	void HashRing::remove(const std::string& backend) {
+		auto it = std::find(backends.begin(), backends.end(), backend);
+		if (it == backends.end()) {
+			return;
+		}
+		backends.erase(it);
+		std::erase_if(points, [&backend](const auto& point) { return point.second == backend; });
+	}
+
+	bool HashRing::contains(const std::string& backend) const {
+		return std::find(backends.cbegin(), backends.cend(), backend) != backends.cend();
+	}
+
+	std::optional<std::string> HashRing::owner(const std::string& key) const {
+		if (points.empty()) {
+			return {};
+		}
+		auto point = points.lower_bound(hash(key));
+		return point != points.cend() ? point->second : points.cbegin()->second;
+	}
+
+	std::vector<std::string> HashRing::getBackends() const {
+		return backends;
+	}
+
+	size_t HashRing::size() const {
+		return backends.size();
+	}
+
+	uint64_t HashRing::hash(const std::string& key) {
+		// FNV-1a, stable between processes and runs unlike std::hash
+		uint64_t value = 14695981039346656037ull;
+		for (unsigned char symbol : key) {
+			value ^= symbol;
+			value *= 1099511628211ull;
+		}
+		// Final mix spreads similar keys like "backend#1", "backend#2" over the whole ring
+		value ^= value >> 33;
+		value *= 0xff51afd7ed558ccdull;
+		value ^= value >> 33;
+		return value;
+	}
+}
\ No newline at end of file
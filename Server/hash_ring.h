@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace server {
+	// Consistent hashing of document ids onto backend servers. Every backend owns many virtual points on the ring,
+	// a key belongs to the first point clockwise from its hash. Adding or removing a backend moves only its share of keys.
+	class HashRing {
+	public:
+		HashRing(const int virtualNodes = 64);
+
+		void add(const std::string& backend);
+		void remove(const std::string& backend);
+		bool contains(const std::string& backend) const;
+		std::optional<std::string> owner(const std::string& key) const;
+		std::vector<std::string> getBackends() const;
+		size_t size() const;
+	private:
+		static uint64_t hash(const std::string& key);
+
+		int virtualNodes;
+		std::map<uint64_t, std::string> points;
+		std::vector<std::string> backends;
+	};
+}
\ No newline at end of file
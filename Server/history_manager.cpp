@@ -89,4 +89,44 @@ namespace history {
 		ActionPtr action = std::make_unique<EraseAction>(startPos, endPos, text, target, &eraseRegistry);
 		push(index, action);
 	}
+
+	void HistoryManager::restoreAction(const int index, const ActionType type, const COORD& startPos, const COORD& endPos, TextContainer& text, const Timestamp timestamp, TextContainer* target) {
+		if (index < 0 || index >= histories.size()) {
+			return;
+		}
+		// Restored action is already up to date with the text, it neither affects others nor merges
+		ActionPtr action;
+		if (type == ActionType::write) {
+			action = std::make_unique<WriteAction>(startPos, text, target, timestamp, &eraseRegistry);
+		}
+		else {
+			action = std::make_unique<EraseAction>(startPos, endPos, text, target, timestamp, &eraseRegistry);
+		}
+		histories[index].pushToUndo(action);
+	}
+
+	const std::vector<ActionPtr>& HistoryManager::getUndoActions(const int index) const {
+		return histories[index].getUndoActions();
+	}
+
+	size_t HistoryManager::getMemoryUsage() const {
+		size_t usage = 0;
+		for (const auto& history : histories) {
+			for (const auto* actions : { &history.getUndoActions(), &history.getRedoActions() }) {
+				for (const auto& action : *actions) {
+					usage += sizeof(EraseAction) + action->getTextSize();
+				}
+			}
+		}
+		return usage;
+	}
+
+	void HistoryManager::clear() {
+		size_t count = histories.size();
+		histories.clear();
+		eraseRegistry = Storage<ActionPtr>{};
+		for (size_t i = 0; i < count; i++) {
+			addHistory();
+		}
+	}
 }
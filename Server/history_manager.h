@@ -29,6 +29,10 @@ namespace history {
 
 		void pushWriteAction(const int index, const COORD& startPos, std::vector<std::string>& text, TextContainer* target);
 		void pushEraseAction(const int index, const COORD& startPos, const COORD& endPos, std::vector<std::string>& text, TextContainer* target);
+		void restoreAction(const int index, const ActionType type, const COORD& startPos, const COORD& endPos, TextContainer& text, const Timestamp timestamp, TextContainer* target);
+		const std::vector<ActionPtr>& getUndoActions(const int index) const;
+		size_t getMemoryUsage() const;
+		void clear();
 	private:
 		void affect(const int index, ActionPtr& action);
 		void push(const int index, ActionPtr& action);
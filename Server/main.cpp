@@ -1,20 +1,52 @@
 #include <WinSock2.h>
 #include <iostream>
+#include <thread>
+#include <algorithm>
 
 #include "server.h"
+#include "router.h"
 #include "args.h"
 
 #pragma comment(lib, "Ws2_32.lib")
 
 static constexpr const char* port = "port";
 static constexpr const char* ip = "ip";
+static constexpr const char* compression = "compression";
+static constexpr const char* msgRate = "msgrate";
+static constexpr const char* byteRate = "byterate";
+static constexpr const char* sessionMsgRate = "sessionmsgrate";
+static constexpr const char* sessionByteRate = "sessionbyterate";
+static constexpr const char* maxLatency = "maxlatency";
+static constexpr const char* maxQueue = "maxqueue";
+static constexpr const char* memoryBudget = "memorybudget";
+static constexpr const char* workers = "workers";
+static constexpr const char* minWorkers = "minworkers";
+static constexpr const char* maxWorkers = "maxworkers";
+static constexpr const char* backends = "backends";
+static constexpr const char* router = "router";
 
 int main(int argc, char* argv[]) {
+	int cores = (std::max)(static_cast<int>(std::thread::hardware_concurrency()), 1);
 	Args::ArgsMap argsConfig{
 		{ ip, Args::Arg{ Args::Type::string, "IP of the server" } },
 		{ port, Args::Arg{ Args::Type::integer, 8081, "Port of the server"} },
+		{ compression, Args::Arg{ Args::Type::integer, int{ msg::defaultCompressionThreshold }, "Payload size in bytes above which responses are compressed"} },
+		{ msgRate, Args::Arg{ Args::Type::integer, 200, "Messages per second per connection, 0 disables the limit"} },
+		{ byteRate, Args::Arg{ Args::Type::integer, 256 * 1024, "Bytes per second per connection, 0 disables the limit"} },
+		{ sessionMsgRate, Args::Arg{ Args::Type::integer, 1000, "Messages per second per document session, 0 disables the limit"} },
+		{ sessionByteRate, Args::Arg{ Args::Type::integer, 1024 * 1024, "Bytes per second per document session, 0 disables the limit"} },
+		{ maxLatency, Args::Arg{ Args::Type::integer, 20, "Message handling latency in ms above which a worker takes no new sessions"} },
+		{ maxQueue, Args::Arg{ Args::Type::integer, 2048, "Queued messages above which a worker takes no new sessions"} },
+		{ memoryBudget, Args::Arg{ Args::Type::integer, 256, "Megabytes of open documents per worker above which idle ones are hibernated to disk"} },
+		{ workers, Args::Arg{ Args::Type::integer, int{ cores }, "Worker threads started with the server, defaults to the number of cores"} },
+		{ minWorkers, Args::Arg{ Args::Type::integer, 1, "Idle workers are retired down to this many"} },
+		{ maxWorkers, Args::Arg{ Args::Type::integer, cores * 2, "Busy pool grows up to this many workers"} },
+		{ backends, Args::Arg{ Args::Type::string, "File with ip:port of a backend server per line, reread when it changes"} },
+	};
+	Args::Commands commands{
+		Args::Command{router, "Runs as router sending sessions to backend servers sharing the database", { ip, port, backends }},
+		Args::Command{"help", "Prints all arguments and commands"}
 	};
-	Args::Commands commands{Args::Command{"help", "Prints all arguments and commands"}};
 	Args args{std::move(argsConfig), std::move(commands)};
 	auto errMsg = args.parse(argc, argv);
 	if (!args.isValid()) {
@@ -35,8 +67,34 @@ int main(int argc, char* argv[]) {
 		return wsaError;
 	}
 
-	Server server{ args.get<std::string>(ip) , args.get<int>(port) };
-	if (!server.open(4)) {
+	if (args.getCommand() == router) {
+		Router routerServer{ args.get<std::string>(ip), args.get<int>(port), args.get<std::string>(backends) };
+		if (!routerServer.open()) {
+			std::cout << " Error when opening router\n";
+			WSACleanup();
+			return -1;
+		}
+		routerServer.start();
+		routerServer.close();
+		WSACleanup();
+		return 0;
+	}
+
+	server::RateLimiter::Limits rateLimits;
+	rateLimits.connectionMessages = args.get<int>(msgRate);
+	rateLimits.connectionBytes = args.get<int>(byteRate);
+	rateLimits.sessionMessages = args.get<int>(sessionMsgRate);
+	rateLimits.sessionBytes = args.get<int>(sessionByteRate);
+	server::AdmissionController::Thresholds admissionThresholds;
+	admissionThresholds.maxLatency = std::chrono::milliseconds{ args.get<int>(maxLatency) };
+	admissionThresholds.maxQueueDepth = args.get<int>(maxQueue);
+	size_t workerMemoryBudget = static_cast<size_t>(args.get<int>(memoryBudget)) * 1024 * 1024;
+	server::PoolScaler::Thresholds poolThresholds;
+	poolThresholds.minWorkers = (std::max)(args.get<int>(minWorkers), 1);
+	poolThresholds.maxWorkers = (std::max)(args.get<int>(maxWorkers), static_cast<int>(poolThresholds.minWorkers));
+	int nWorkers = std::clamp(args.get<int>(workers), static_cast<int>(poolThresholds.minWorkers), static_cast<int>(poolThresholds.maxWorkers));
+	Server server{ args.get<std::string>(ip) , args.get<int>(port), args.get<int>(compression), rateLimits, admissionThresholds, workerMemoryBudget, poolThresholds };
+	if (!server.open(nWorkers)) {
 		std::cout << " Error when opening server\n";
 		return -1;
 	}
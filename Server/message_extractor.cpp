@@ -4,11 +4,17 @@
 constexpr int defaultBuffSize = 128;
 
 std::vector<msg::Buffer> MessageExtractor::extractMessages(const SOCKET client) {
+    std::vector<msg::OneByteInt> ignoredStreams;
+    return extractMessages(client, ignoredStreams);
+}
+
+std::vector<msg::Buffer> MessageExtractor::extractMessages(const SOCKET client, std::vector<msg::OneByteInt>& streams) {
+    streams.clear();
     msg::Buffer recvBuff{defaultBuffSize};
     recvBuff.size = recv(client, recvBuff.get(), recvBuff.capacity, 0);
     if (recvBuff.size > 0) {
         auto [it, newOne] = clientFramerMap.try_emplace(client, Framer{ defaultBuffSize });
-        auto msgBuffers = it->second.extractMessages(recvBuff);
+        auto msgBuffers = it->second.extractMessages(recvBuff, streams);
         if (!msgBuffers.empty()) {
             server::logger.logDebug("Received", msgBuffers.size(), "messages from client", client);
         }
@@ -18,4 +24,20 @@ std::vector<msg::Buffer> MessageExtractor::extractMessages(const SOCKET client)
 }
 void MessageExtractor::reset(const SOCKET client) {
 	clientFramerMap.erase(client);
+}
+
+std::optional<Framer> MessageExtractor::take(const SOCKET client) {
+    // Partial message received so far moves with the connection to another worker
+    auto framer = clientFramerMap.find(client);
+    if (framer == clientFramerMap.end()) {
+        return {};
+    }
+    std::optional<Framer> taken{ std::move(framer->second) };
+    clientFramerMap.erase(framer);
+    return taken;
+}
+
+void MessageExtractor::adopt(const SOCKET client, Framer&& framer) {
+    clientFramerMap.erase(client);
+    clientFramerMap.emplace(client, std::move(framer));
 }
\ No newline at end of file
@@ -1,12 +1,16 @@
 #pragma once
 #include <unordered_map>
+#include <optional>
 
 #include "framer.h"
 
 class MessageExtractor {
 public:
 	std::vector<msg::Buffer> extractMessages(const SOCKET client);
+	std::vector<msg::Buffer> extractMessages(const SOCKET client, std::vector<msg::OneByteInt>& streams);
 	void reset(const SOCKET client);
+	std::optional<Framer> take(const SOCKET client);
+	void adopt(const SOCKET client, Framer&& framer);
 private:
 	std::unordered_map<SOCKET, Framer> clientFramerMap;
 };
\ No newline at end of file
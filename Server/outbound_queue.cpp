@@ -0,0 +1,117 @@
+#include "outbound_queue.h"
+#include "logging.h"
+
+namespace server {
+	OutboundQueue::OutboundQueue(const SOCKET connection, const Watermarks& watermarks, Send sendFn) :
+		connection(connection),
+		watermarks(watermarks),
+		sendFn(std::move(sendFn)) {}
+
+	bool OutboundQueue::push(const msg::Buffer& frame, const bool droppable) {
+		if (broken || (overflowed && droppable)) {
+			return false;
+		}
+		int offset = 0;
+		if (frames.empty()) {
+			// Fast clients take the frame right away and nothing is copied
+			offset = sendSome(frame, 0);
+			if (offset < 0) {
+				return false;
+			}
+			if (offset == frame.size) {
+				return true;
+			}
+		}
+		frames.emplace_back(Frame{ msg::Buffer{ frame }, droppable });
+		if (frames.size() == 1) {
+			headOffset = offset;
+		}
+		if (droppable) {
+			droppableBytes += frame.size - offset;
+			droppableFrames++;
+		}
+		if (droppableBytes > watermarks.highBytes || droppableFrames > watermarks.highFrames) {
+			overflow();
+			return !droppable;
+		}
+		return true;
+	}
+
+	bool OutboundQueue::flush() {
+		while (!frames.empty()) {
+			auto& head = frames.front();
+			int offset = sendSome(head.buffer, headOffset);
+			if (offset < 0) {
+				return false;
+			}
+			if (head.droppable) {
+				droppableBytes -= offset - headOffset;
+			}
+			headOffset = offset;
+			if (headOffset < head.buffer.size) {
+				return true;
+			}
+			if (head.droppable) {
+				droppableFrames--;
+			}
+			headOffset = 0;
+			frames.pop_front();
+		}
+		return true;
+	}
+
+	bool OutboundQueue::empty() const {
+		return frames.empty();
+	}
+
+	size_t OutboundQueue::size() const {
+		return frames.size();
+	}
+
+	bool OutboundQueue::needsResync() const {
+		return overflowed && !broken && frames.empty();
+	}
+
+	void OutboundQueue::resynced() {
+		overflowed = false;
+	}
+
+	int OutboundQueue::sendSome(const msg::Buffer& frame, int offset) {
+		while (offset < frame.size) {
+			const char* data = frame.get() + offset;
+			int sendBytes = sendFn ? sendFn(data, frame.size - offset) : send(connection, data, frame.size - offset, 0);
+			if (sendBytes != SOCKET_ERROR) {
+				offset += sendBytes;
+				continue;
+			}
+			if (WSAGetLastError() == WSAEWOULDBLOCK) {
+				return offset;
+			}
+			logger.logError(WSAGetLastError(), ": Error on sending data to", connection, ", dropping", frames.size(), "queued frames");
+			broken = true;
+			frames.clear();
+			headOffset = 0;
+			droppableBytes = droppableFrames = 0;
+			return -1;
+		}
+		return offset;
+	}
+
+	void OutboundQueue::overflow() {
+		logger.logInfo("Slow client", connection, "exceeded outbound watermark, dropping", droppableFrames, "updates until resync");
+		// Frame which is partially sent has to be finished, otherwise the client loses framing
+		std::deque<Frame> kept;
+		for (int i = 0; i < frames.size(); i++) {
+			if (!frames[i].droppable || (i == 0 && headOffset > 0)) {
+				kept.emplace_back(std::move(frames[i]));
+			}
+		}
+		frames.swap(kept);
+		droppableBytes = droppableFrames = 0;
+		if (headOffset > 0 && frames.front().droppable) {
+			droppableBytes = frames.front().buffer.size - headOffset;
+			droppableFrames = 1;
+		}
+		overflowed = true;
+	}
+}
\ No newline at end of file
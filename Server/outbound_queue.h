@@ -0,0 +1,46 @@
+#pragma once
+#include <WinSock2.h>
+#include <deque>
+#include <functional>
+
+#include "messages.h"
+
+namespace server {
+	// Frames of one non-blocking connection which its socket buffer did not accept yet.
+	// Document updates over the high watermarks are dropped and the connection is marked for resync,
+	// once the queue drains the connection gets a fresh snapshot of its documents.
+	class OutboundQueue {
+	public:
+		struct Watermarks {
+			size_t highBytes = 1024 * 1024;
+			size_t highFrames = 4096;
+		};
+		// Same contract as send on a non-blocking socket, SOCKET_ERROR with WSAEWOULDBLOCK if nothing fits
+		using Send = std::function<int(const char* data, const int size)>;
+		OutboundQueue(const SOCKET connection, const Watermarks& watermarks, Send sendFn = {});
+
+		bool push(const msg::Buffer& frame, const bool droppable);
+		bool flush();
+		bool empty() const;
+		size_t size() const;
+		bool needsResync() const;
+		void resynced();
+	private:
+		struct Frame {
+			msg::Buffer buffer;
+			bool droppable;
+		};
+		int sendSome(const msg::Buffer& frame, int offset);
+		void overflow();
+
+		SOCKET connection;
+		Watermarks watermarks;
+		Send sendFn; // Sends straight to the connection if empty
+		std::deque<Frame> frames;
+		int headOffset = 0; // Bytes of the first frame already sent
+		size_t droppableBytes = 0;
+		size_t droppableFrames = 0;
+		bool overflowed = false; // Document updates are dropped until the connection is resynced
+		bool broken = false;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <numeric>
+
+#include "pool_scaler.h"
+
+namespace server {
+	PoolScaler::PoolScaler(const Thresholds& thresholds) :
+		thresholds(thresholds) {}
+
+	PoolScaler::Decision PoolScaler::decide(const std::vector<WorkerLoad>& loads, const Clock::time_point now) {
+		if (loads.size() < thresholds.minWorkers) {
+			return Decision::grow;
+		}
+		if (loads.empty()) {
+			return Decision::keep;
+		}
+		double sum = std::accumulate(loads.cbegin(), loads.cend(), 0.0, [this, now](double sum, const WorkerLoad& load) { return sum + getUtilization(load, now); });
+		size_t workers = loads.size();
+		double average = sum / workers;
+		bool high = average > thresholds.growUtilization && workers < thresholds.maxWorkers;
+		// Retiring a worker spreads its load over the rest, they must not end up over the grow threshold
+		bool low = average < thresholds.shrinkUtilization && workers > thresholds.minWorkers && sum / (workers - 1) <= thresholds.growUtilization;
+		highSince = high ? highSince.value_or(now) : std::optional<Clock::time_point>{};
+		lowSince = low ? lowSince.value_or(now) : std::optional<Clock::time_point>{};
+		if (lastChange.has_value() && now - *lastChange < thresholds.cooldown) {
+			return Decision::keep;
+		}
+		if (highSince.has_value() && now - *highSince >= thresholds.sustain) {
+			return Decision::grow;
+		}
+		if (lowSince.has_value() && now - *lowSince >= thresholds.sustain) {
+			return Decision::shrink;
+		}
+		return Decision::keep;
+	}
+
+	size_t PoolScaler::selectRetired(const std::vector<WorkerLoad>& loads, const Clock::time_point now) const {
+		auto retired = std::min_element(loads.cbegin(), loads.cend(), [this, now](const WorkerLoad& load1, const WorkerLoad& load2) {
+			return getUtilization(load1, now) < getUtilization(load2, now);
+		});
+		return std::distance(loads.cbegin(), retired);
+	}
+
+	void PoolScaler::changed(const Clock::time_point now) {
+		lastChange = now;
+		highSince.reset();
+		lowSince.reset();
+	}
+
+	double PoolScaler::getUtilization(const WorkerLoad& load, const Clock::time_point now) const {
+		// Worker updates its sample when it wakes up, an old one means it waits in select
+		return now - load.utilizationSampledAt > thresholds.utilizationWindow ? 0.0 : load.utilization;
+	}
+
+	const PoolScaler::Thresholds& PoolScaler::getThresholds() const {
+		return thresholds;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+#include <chrono>
+#include <optional>
+#include <vector>
+
+#include "admission_controller.h"
+
+namespace server {
+	// Decides in master when the worker pool grows or shrinks. Average utilization above growUtilization for a while
+	// adds a worker, below shrinkUtilization retires the least used one. The pool changes at most once per cooldown.
+	class PoolScaler {
+	public:
+		using Clock = std::chrono::steady_clock;
+		enum class Decision {
+			keep,
+			grow,
+			shrink
+		};
+		struct Thresholds {
+			size_t minWorkers = 1;
+			size_t maxWorkers = 8;
+			double growUtilization = 0.75;
+			double shrinkUtilization = 0.25;
+			std::chrono::seconds sustain{ 30 }; // Utilization has to stay over or under a threshold this long
+			std::chrono::seconds cooldown{ 60 };
+			std::chrono::milliseconds utilizationWindow{ 2000 }; // Older samples don't count, worker blocked in select is idle
+		};
+		PoolScaler(const Thresholds& thresholds);
+
+		Decision decide(const std::vector<WorkerLoad>& loads, const Clock::time_point now);
+		size_t selectRetired(const std::vector<WorkerLoad>& loads, const Clock::time_point now) const;
+		void changed(const Clock::time_point now);
+		double getUtilization(const WorkerLoad& load, const Clock::time_point now) const;
+		const Thresholds& getThresholds() const;
+	private:
+		Thresholds thresholds;
+		std::optional<Clock::time_point> highSince;
+		std::optional<Clock::time_point> lowSince;
+		std::optional<Clock::time_point> lastChange;
+	};
+}
\ No newline at end of file
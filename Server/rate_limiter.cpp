@@ -0,0 +1,168 @@
+#include <algorithm>
+
+#include "rate_limiter.h"
+#include "client_id.h"
+#include "logging.h"
+
+namespace server {
+	TokenBucket::TokenBucket(const double rate, const double capacity) :
+		rate(rate),
+		capacity(capacity),
+		tokens(capacity),
+		lastRefill(Clock::now()) {}
+
+	bool TokenBucket::canTake(const double amount, const Clock::time_point now) {
+		if (rate <= 0) {
+			return true;
+		}
+		if (now > lastRefill) {
+			tokens = (std::min)(capacity, tokens + std::chrono::duration<double>(now - lastRefill).count() * rate);
+			lastRefill = now;
+		}
+		return tokens >= amount || tokens >= capacity;
+	}
+
+	void TokenBucket::take(const double amount) {
+		if (rate > 0) {
+			tokens -= amount;
+		}
+	}
+
+	bool TokenBucket::isFull() const {
+		return rate <= 0 || tokens >= capacity;
+	}
+
+	RateLimiter::RateLimiter(const Limits& limits) :
+		limits(limits) {}
+
+	bool RateLimiter::admit(const SOCKET client, const std::string& session, const msg::Buffer& buffer) {
+		SOCKET connection = getConnection(client);
+		// Messages waiting in front keep their order
+		auto delayed = delayedMsgs.find(connection);
+		if (delayed != delayedMsgs.end() && !delayed->second.empty()) {
+			return false;
+		}
+		return tryTake(connection, session, buffer.size);
+	}
+
+	void RateLimiter::delay(const SOCKET client, const std::string& session, msg::Buffer&& buffer) {
+		auto& delayed = delayedMsgs[getConnection(client)];
+		msg::Type type;
+		msg::parse(buffer, 0, type);
+		if (type == msg::Type::moveTo && !delayed.empty()) {
+			// Jumps are absolute, only the last one of a series waiting behind each other matters
+			auto& last = delayed.back();
+			msg::Type lastType;
+			msg::parse(last.buffer, 0, lastType);
+			if (last.client == client && !last.rejected && lastType == msg::Type::moveTo) {
+				last.rejected = true;
+				counters.coalesced++;
+			}
+		}
+		if (delayed.size() >= limits.maxDelayed) {
+			logger.logDebug("Rejecting message from", client, ", too many delayed messages");
+			delayed.emplace_back(Delayed{ client, session, std::move(buffer), true });
+			counters.rejected++;
+			return;
+		}
+		delayed.emplace_back(Delayed{ client, session, std::move(buffer) });
+		counters.delayed++;
+	}
+
+	std::vector<RateLimiter::Delayed> RateLimiter::takeReady() {
+		std::vector<Delayed> ready;
+		for (auto it = delayedMsgs.begin(); it != delayedMsgs.end();) {
+			auto& [connection, delayed] = *it;
+			while (!delayed.empty() && (delayed.front().rejected || tryTake(connection, delayed.front().session, delayed.front().buffer.size))) {
+				ready.emplace_back(std::move(delayed.front()));
+				delayed.pop_front();
+			}
+			it = delayed.empty() ? delayedMsgs.erase(it) : std::next(it);
+		}
+		return ready;
+	}
+
+	bool RateLimiter::hasDelayed() const {
+		return !delayedMsgs.empty();
+	}
+
+	size_t RateLimiter::getDelayedCount() const {
+		size_t count = 0;
+		for (const auto& [connection, delayed] : delayedMsgs) {
+			count += delayed.size();
+		}
+		return count;
+	}
+
+	bool RateLimiter::isSaturated(const SOCKET connection) const {
+		auto delayed = delayedMsgs.find(connection);
+		// Reading pauses at half of maxDelayed, so messages already received in one batch still fit
+		return delayed != delayedMsgs.end() && delayed->second.size() >= limits.maxDelayed / 2;
+	}
+
+	std::chrono::milliseconds RateLimiter::getRetryInterval() const {
+		return std::chrono::milliseconds{ 10 };
+	}
+
+	const RateLimiter::Counters& RateLimiter::getCounters() const {
+		return counters;
+	}
+
+	void RateLimiter::erase(const SOCKET connection) {
+		delayedMsgs.erase(connection);
+		connectionBuckets.erase(connection);
+	}
+
+	std::deque<RateLimiter::Delayed> RateLimiter::takeConnection(const SOCKET connection) {
+		// Delayed messages move with the connection to another worker, its buckets start full there
+		std::deque<Delayed> taken;
+		if (auto delayed = delayedMsgs.find(connection); delayed != delayedMsgs.end()) {
+			taken = std::move(delayed->second);
+		}
+		erase(connection);
+		return taken;
+	}
+
+	void RateLimiter::adoptConnection(const SOCKET connection, std::deque<Delayed>&& delayed) {
+		if (!delayed.empty()) {
+			delayedMsgs.emplace(connection, std::move(delayed));
+		}
+	}
+
+	void RateLimiter::collectIdleBuckets() {
+		auto now = TokenBucket::Clock::now();
+		// Full bucket is the same as a new one, so idle sessions can be forgotten
+		std::erase_if(sessionBuckets, [now](auto& session) {
+			auto& [messages, bytes] = session.second;
+			messages.canTake(0, now); // Refills
+			bytes.canTake(0, now);
+			return messages.isFull() && bytes.isFull();
+		});
+	}
+
+	bool RateLimiter::tryTake(const SOCKET connection, const std::string& session, const int size) {
+		auto now = TokenBucket::Clock::now();
+		auto& connectionBucket = connectionBuckets.try_emplace(connection, makeBuckets(limits.connectionMessages, limits.connectionBytes)).first->second;
+		if (!connectionBucket.messages.canTake(1, now) || !connectionBucket.bytes.canTake(size, now)) {
+			return false;
+		}
+		Buckets* sessionBucket = nullptr;
+		if (!session.empty()) {
+			sessionBucket = &sessionBuckets.try_emplace(session, makeBuckets(limits.sessionMessages, limits.sessionBytes)).first->second;
+			if (!sessionBucket->messages.canTake(1, now) || !sessionBucket->bytes.canTake(size, now)) {
+				return false;
+			}
+		}
+		connectionBucket.messages.take(1);
+		connectionBucket.bytes.take(size);
+		if (sessionBucket != nullptr) {
+			sessionBucket->messages.take(1);
+			sessionBucket->bytes.take(size);
+		}
+		return true;
+	}
+
+	RateLimiter::Buckets RateLimiter::makeBuckets(const double messages, const double bytes) const {
+		return Buckets{ TokenBucket{ messages, messages * limits.burstSeconds }, TokenBucket{ bytes, bytes * limits.burstSeconds } };
+	}
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+#include <WinSock2.h>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "messages.h"
+
+namespace server {
+	class TokenBucket {
+	public:
+		using Clock = std::chrono::steady_clock;
+		TokenBucket(const double rate, const double capacity);
+
+		// Bucket which is full lets any amount through and goes into debt, so messages bigger than capacity are not stuck
+		bool canTake(const double amount, const Clock::time_point now);
+		void take(const double amount);
+		bool isFull() const;
+	private:
+		double rate; // Tokens per second, 0 means unlimited
+		double capacity;
+		double tokens;
+		Clock::time_point lastRefill;
+	};
+
+	// Message and byte rate limits per connection and per session. Messages over the limit are delayed in order,
+	// cursor jumps waiting behind each other are coalesced and messages over maxDelayed are rejected.
+	class RateLimiter {
+	public:
+		struct Limits {
+			double connectionMessages = 200; // Per second
+			double connectionBytes = 256 * 1024;
+			double sessionMessages = 1000;
+			double sessionBytes = 1024 * 1024;
+			double burstSeconds = 1.0; // Bucket capacity in seconds of its rate
+			size_t maxDelayed = 256; // Per connection, reading from the connection pauses at half of it
+		};
+		struct Counters {
+			unsigned int delayed = 0;
+			unsigned int coalesced = 0;
+			unsigned int rejected = 0;
+		};
+		struct Delayed {
+			SOCKET client;
+			std::string session;
+			msg::Buffer buffer;
+			bool rejected = false; // Rejected messages are answered in order with the rest
+		};
+		RateLimiter(const Limits& limits);
+
+		bool admit(const SOCKET client, const std::string& session, const msg::Buffer& buffer);
+		void delay(const SOCKET client, const std::string& session, msg::Buffer&& buffer);
+		std::vector<Delayed> takeReady();
+		bool hasDelayed() const;
+		size_t getDelayedCount() const;
+		bool isSaturated(const SOCKET connection) const;
+		std::chrono::milliseconds getRetryInterval() const;
+		const Counters& getCounters() const;
+		void erase(const SOCKET connection);
+		std::deque<Delayed> takeConnection(const SOCKET connection);
+		void adoptConnection(const SOCKET connection, std::deque<Delayed>&& delayed);
+		void collectIdleBuckets();
+	private:
+		struct Buckets {
+			TokenBucket messages;
+			TokenBucket bytes;
+		};
+		bool tryTake(const SOCKET connection, const std::string& session, const int size);
+		Buckets makeBuckets(const double messages, const double bytes) const;
+
+		Limits limits;
+		Counters counters;
+		std::unordered_map<SOCKET, Buckets> connectionBuckets;
+		std::unordered_map<std::string, Buckets> sessionBuckets;
+		std::unordered_map<SOCKET, std::deque<Delayed>> delayedMsgs; // Keyed by connection
+	};
+}
\ No newline at end of file
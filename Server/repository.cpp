@@ -1,12 +1,15 @@
 #include <thread>
+#include <numeric>
 
 #include "serializer.h"
 #include "deserializer.h"
 #include "repository.h"
 #include "logging.h"
 #include "engine.h"
+#include "compression.h"
 
 namespace server {
+	static constexpr const char* tooBigDocumentError = "Document is too big for this client version, update the client!";
 
 	Repository::Repository(server::Authenticator* auth) :
 		auth(auth) {}
@@ -14,22 +17,48 @@ namespace server {
 	Repository::Repository(Repository&& other) :
 		clientToUserData(std::move(other.clientToUserData)),
 		acCodeToDocMap(std::move(other.acCodeToDocMap)),
+		snapshotTransfers(std::move(other.snapshotTransfers)),
+		pendingReplays(std::move(other.pendingReplays)),
+		editedSessions(std::move(other.editedSessions)),
+		replaceJobs(std::move(other.replaceJobs)),
+		saveJobs(std::move(other.saveJobs)),
+		memoryCheck(other.memoryCheck),
+		closedDocs(std::move(other.closedDocs)),
+		closedDocsBytes(other.closedDocsBytes),
+		movedCursorSessions(std::move(other.movedCursorSessions)),
+		datagramPresenceVersions(std::move(other.datagramPresenceVersions)),
+		presenceFrames(std::move(other.presenceFrames)),
+		presenceInterval(other.presenceInterval),
+		lastPresenceFlush(other.lastPresenceFlush),
 		auth(other.auth),
-		savingDocInterval(std::move(other.savingDocInterval)),
 		db(std::move(other.db)),
 		acCodesLock(),
 		acCodeSet(std::move(other.acCodeSet)),
 		userFileCombinedLock(),
-		userFileCombinedSet(std::move(other.userFileCombinedSet)) {}
+		userFileCombinedSet(std::move(other.userFileCombinedSet)),
+		closedUserFileSet(std::move(other.closedUserFileSet)) {}
 
 	Repository& Repository::operator=(Repository&& other) {
 		clientToUserData = std::move(other.clientToUserData);
 		acCodeToDocMap = std::move(other.acCodeToDocMap);
+		snapshotTransfers = std::move(other.snapshotTransfers);
+		pendingReplays = std::move(other.pendingReplays);
+		editedSessions = std::move(other.editedSessions);
+		replaceJobs = std::move(other.replaceJobs);
+		saveJobs = std::move(other.saveJobs);
+		memoryCheck = other.memoryCheck;
+		closedDocs = std::move(other.closedDocs);
+		closedDocsBytes = other.closedDocsBytes;
+		movedCursorSessions = std::move(other.movedCursorSessions);
+		datagramPresenceVersions = std::move(other.datagramPresenceVersions);
+		presenceFrames = std::move(other.presenceFrames);
+		presenceInterval = other.presenceInterval;
+		lastPresenceFlush = other.lastPresenceFlush;
 		auth = auth;
-		savingDocInterval = std::move(other.savingDocInterval);
 		db = std::move(other.db);
 		acCodeSet = std::move(other.acCodeSet);
 		userFileCombinedSet = std::move(other.userFileCombinedSet);
+		closedUserFileSet = std::move(other.closedUserFileSet);
 		return *this;
 	}
 
@@ -49,30 +78,111 @@ namespace server {
 			return masterClose(buffer);
 		}
 
-		std::string authToken;
-		msg::parse(buffer, pos, authToken);
-		if (authenticateUser) {
-			auto it = clientToUserData.find(client);
-			if (it == clientToUserData.cend() || it->second.authToken != authToken) {
-				logger.logError("Cannot authenticate user", client);
-				return Response{ std::move(buffer), {}, msg::Type::error };
-			}
+		if (authenticateUser && !authenticate(client, buffer, version, pos)) {
+			logger.logError("Cannot authenticate user", client);
+			return Response{ std::move(buffer), {}, msg::Type::error };
 		}
 
 		auto doc = findDoc(client);
 		if (doc == nullptr) {
-			if (type == msg::Type::disconnect) {
+			if (type == msg::Type::disconnect && getStream(client) == 0) {
 				auth->clearUser(client);
 			}
 			logger.logDebug("Document for client", client, "not found");
 			return Response{ std::move(buffer), {}, msg::Type::error };
 		}
+		const auto& acCode = clientToUserData[client].acCode;
+		if (!msg::isCursorMove(type)) {
+			// Clients have to see moved cursors before an update shifts their indices or positions
+			flushPresence(acCode, *doc);
+		}
 		ArgPack argPack{ client, buffer, doc };
+		if (type == msg::Type::replace && startReplace(argPack)) {
+			// Applied in steps, the response comes from stepReplaces
+			return Response{ std::move(buffer), {}, msg::Type::replace };
+		}
 		auto response = processImpl(type, argPack);
-		if (type != msg::Type::disconnect && std::chrono::system_clock::now() > doc->getLastSaveTimestamp() + savingDocInterval) {
-			saveDocInDb(*doc);
+		if (type == msg::Type::disconnect) {
+			return response;
+		}
+		return finishOp(client, version, *doc, std::move(response));
+	}
+
+	Response Repository::finishOp(const SOCKET client, const msg::OneByteInt version, ServerSiteDocument& doc, Response&& response) {
+		const auto& acCode = clientToUserData[client].acCode;
+		if (msg::isCursorMove(response.msgType)) {
+			// Only the moving client is acknowledged right away, the rest get the latest cursor in a presence frame
+			doc.markCursorMoved(doc.findUser(client));
+			movedCursorSessions.insert(acCode);
+			response.destinations = { client };
+		}
+		else if (msg::isVersioned(response.msgType)) {
+			const auto& op = doc.recordOp(response.buffer);
+			editedSessions.insert(acCode);
+			encodePerVersion(response, op, version);
+		}
+		unsigned int seq = ++clientToUserData[client].opSeq;
+		if (response.msgType == msg::Type::error && msg::reportsRejects(version)) {
+			return Response{ Serializer::makeRejectResponse(version, seq), { client }, msg::Type::reject };
+		}
+		return std::move(response);
+	}
+
+	void Repository::encodePerVersion(Response& response, const ServerSiteDocument::LoggedOp& op, const msg::OneByteInt version) {
+		// Every client gets the update in the encoding of the protocol version it connected with
+		std::map<msg::OneByteInt, std::vector<SOCKET>> otherVersions;
+		std::erase_if(response.destinations, [this, version, &otherVersions](const SOCKET client) {
+			auto clientVersion = getVersion(client);
+			if (clientVersion == version) {
+				return false;
+			}
+			otherVersions[clientVersion].push_back(client);
+			return true;
+		});
+		for (auto& [clientVersion, destinations] : otherVersions) {
+			response.variants.emplace_back(Response{ Serializer::makeUpdateFor(clientVersion, op), std::move(destinations), response.msgType });
+		}
+	}
+
+	Response Repository::reject(const SOCKET client, msg::Buffer& buffer) {
+		auto userData = clientToUserData.find(client);
+		if (userData == clientToUserData.end()) {
+			return Response{ std::move(buffer), {}, msg::Type::error };
+		}
+		msg::Type type;
+		msg::OneByteInt version;
+		msg::parse(buffer, 0, type, version);
+		version &= ~msg::compressedFlag;
+		// Rejected message takes its sequence number as if it was processed
+		unsigned int seq = ++userData->second.opSeq;
+		if (msg::reportsRejects(version)) {
+			return Response{ Serializer::makeRejectResponse(version, seq), { client }, msg::Type::reject };
 		}
-		return response;
+		return Response{ std::move(buffer), {}, msg::Type::error };
+	}
+
+	msg::OneByteInt Repository::getVersion(const SOCKET client) const {
+		auto userData = clientToUserData.find(client);
+		return userData != clientToUserData.cend() ? userData->second.version : 0;
+	}
+
+	std::string Repository::getAcCode(const SOCKET client) const {
+		auto userData = clientToUserData.find(client);
+		return userData != clientToUserData.cend() ? userData->second.acCode : "";
+	}
+
+	bool Repository::authenticate(const SOCKET client, const msg::Buffer& buffer, const msg::OneByteInt version, const int tokenPos) const {
+		// Connection was authenticated by master before it was bound to the session
+		auto it = clientToUserData.find(client);
+		if (it == clientToUserData.cend()) {
+			return false;
+		}
+		if (!msg::carriesAuthToken(version)) {
+			return true;
+		}
+		std::string authToken;
+		msg::parse(buffer, tokenPos, authToken);
+		return it->second.authToken == authToken;
 	}
 
 	Response Repository::processImpl(const msg::Type type, const ArgPack& argPack) {
@@ -107,12 +217,38 @@ namespace server {
 			return nullptr;
 		}
 		auto docIt = acCodeToDocMap.find(userData->second.acCode);
-		if (docIt == acCodeToDocMap.cend()) {
+		if (docIt == acCodeToDocMap.cend() || !useSession(docIt->first, docIt->second)) {
 			return {};
 		}
 		return &docIt->second;
 	}
 
+	bool Repository::useSession(const std::string& acCode, ServerSiteDocument& doc) {
+		doc.setLastUse(memoryCheck);
+		if (!doc.isHibernated()) {
+			return true;
+		}
+		completeSave(doc.getId()); // Text saved on hibernation may be still queued
+		auto text = db.loadDocText(doc.getId());
+		if (!text) {
+			logger.logError("Cannot rehydrate session", acCode);
+			return false;
+		}
+		doc.rehydrate(text.value(), db.takeDocHistory(doc.getId()));
+		logger.logDebug("Rehydrated session", acCode);
+		return true;
+	}
+
+	std::vector<SOCKET> Repository::getStreamClients(const SOCKET connection) const {
+		std::vector<SOCKET> clients;
+		for (const auto& [client, userData] : clientToUserData) {
+			if (client != connection && getConnection(client) == connection) {
+				clients.push_back(client);
+			}
+		}
+		return clients;
+	}
+
 	bool Repository::acCodeExists(const std::string& acCode) {
 		std::lock_guard lock{acCodesLock};
 		return std::find(acCodeSet.cbegin(), acCodeSet.cend(), acCode) != acCodeSet.cend();
@@ -120,7 +256,26 @@ namespace server {
 	bool Repository::userFileExists(const std::string& username, const std::string& filename) {
 		std::lock_guard lock{userFileCombinedLock};
 		auto key = username + "-" + filename;
-		return std::find(userFileCombinedSet.cbegin(), userFileCombinedSet.cend(), key) != userFileCombinedSet.cend();
+		return std::find(userFileCombinedSet.cbegin(), userFileCombinedSet.cend(), key) != userFileCombinedSet.cend() || closedUserFileSet.contains(key);
+	}
+
+	Response Repository::rejectMalformed(const ArgPack& argPack) const {
+		msg::Type type;
+		msg::parse(argPack.buffer, 0, type);
+		logger.logError("Malformed", type, "message from", argPack.client);
+		// Turned into a reject for clients which track their pending ops
+		return Response{ std::move(argPack.buffer), {}, msg::Type::error };
+	}
+
+	Response Repository::rejectMalformedConnect(msg::Buffer& buffer) const {
+		// Socket field is written by the worker, the rest of the frame comes from the client
+		msg::Type type;
+		msg::OneByteInt version;
+		unsigned int client;
+		msg::parse(buffer, 0, type, version, client);
+		logger.logError("Malformed", type, "message from", client);
+		auto newBuffer = Serializer::makeConnectResponseWithError(type, "Malformed message!", 1);
+		return Response{ std::move(newBuffer), { client }, type };
 	}
 
 	Response Repository::masterClose(msg::Buffer& buffer) const {
@@ -129,44 +284,74 @@ namespace server {
 	}
 
 	Response Repository::createDoc(msg::Buffer& buffer) {
-		auto msg = Deserializer::parseConnectCreateDoc(buffer);
+		auto parsed = Deserializer::parseConnectCreateDoc(buffer);
+		if (!parsed) {
+			return rejectMalformedConnect(buffer);
+		}
+		auto& msg = parsed.value();
 		auto id = random::Engine::get().getRandomString(12);
-		auto userAuthData = auth->getUserData(msg.socket);
+		auto userAuthData = auth->getUserData(getConnection(msg.socket));
 		assert(!userAuthData.authToken.empty());
-		DBDocument dbDoc(id, msg.filename, { auth->getUserData(msg.socket).username });
+		DBDocument dbDoc(id, msg.filename, { userAuthData.username }, DBDocument::makeRouteKey(userAuthData.username, msg.filename));
 		if (!db.addDocAndLink(dbDoc)) {
 			auto newBuffer = Serializer::makeConnectResponseWithError(msg.type, db.getLastError(), 1);
 			return Response{ std::move(newBuffer), { msg.socket }, msg::Type::create };
 		}
 		auto session = createNewSession(userAuthData.username, ServerSiteDocument("", 0, 0, id, msg.filename));
-		addClientToSession(msg.socket, userAuthData, session);
+		addClientToSession(msg.socket, userAuthData, session, msg.version, msg.presencePort);
 		auto& [acCode, doc] = *session;
-		auto newBuffer = Serializer::makeConnectResponse(msg.type, doc, msg.version, 0, acCode);
+		auto newBuffer = makeConnectResponse(msg.type, msg.version, msg.socket, 0, acCode, doc);
 		return Response{ std::move(newBuffer), doc.getConnectedClients(), msg::Type::create };
 	}
 
 	Response Repository::loadDoc(msg::Buffer& buffer) {
-		auto msg = Deserializer::parseConnectCreateDoc(buffer);
-		auto userAuthData = auth->getUserData(msg.socket);
+		auto parsed = Deserializer::parseConnectCreateDoc(buffer);
+		if (!parsed) {
+			return rejectMalformedConnect(buffer);
+		}
+		auto& msg = parsed.value();
+		auto userAuthData = auth->getUserData(getConnection(msg.socket));
 		assert(!userAuthData.authToken.empty());
-		auto docIt = db.loadDoc(userAuthData.username, msg.filename);
-		if (!docIt) {
-			auto newBuffer = Serializer::makeConnectResponseWithError(msg.type, db.getLastError(), 1);
-			return Response{ std::move(newBuffer), { msg.socket }, msg::Type::load };
+		auto dbDoc = db.getDocWithUsernameAndFilename(userAuthData.username, msg.filename);
+		auto session = dbDoc ? getSessionWithDocId(dbDoc.value().id) : acCodeToDocMap.end();
+		if (session == acCodeToDocMap.end()) {
+			if (auto closed = dbDoc ? takeClosedDoc(dbDoc.value().id) : std::nullopt) {
+				session = reopenSession(userAuthData.username, std::move(closed.value()));
+			}
 		}
-		auto session = getSessionWithDocId(docIt.value().getId());
 		if (session == acCodeToDocMap.end()) {
+			if (dbDoc) {
+				completeSave(dbDoc.value().id); // Document may be still written after its session was closed
+			}
+			auto docIt = db.loadDoc(userAuthData.username, msg.filename);
+			if (!docIt) {
+				auto newBuffer = Serializer::makeConnectResponseWithError(msg.type, db.getLastError(), 1);
+				return Response{ std::move(newBuffer), { msg.socket }, msg::Type::load };
+			}
 			session = createNewSession(userAuthData.username, docIt.value());
 		}
-		addClientToSession(msg.socket, userAuthData, session);
+		if (!fitsConnectResponse(msg.version, session->second)) {
+			if (session->second.getConnectedClients().empty()) {
+				// Session was opened only for this client
+				auto acCode = session->first;
+				deleteSession(userAuthData.username, acCode, session->second);
+			}
+			auto newBuffer = Serializer::makeConnectResponseWithError(msg.type, tooBigDocumentError, 1);
+			return Response{ std::move(newBuffer), { msg.socket }, msg::Type::load };
+		}
+		addClientToSession(msg.socket, userAuthData, session, msg.version, msg.presencePort);
 		auto& [acCode, doc] = *session;
 		auto userIdx = doc.findUser(msg.socket);
-		auto newBuffer = Serializer::makeConnectResponse(msg.type, doc, msg.version, userIdx, acCode);
+		auto newBuffer = makeConnectResponse(msg.type, msg.version, msg.socket, userIdx, acCode, doc);
 		return Response{ std::move(newBuffer), doc.getConnectedClients(), msg::Type::load };
 	}
 
 	Response Repository::joinDoc(msg::Buffer& buffer) {
-		auto msg = Deserializer::parseConnectJoinDoc(buffer);
+		auto parsed = Deserializer::parseConnectJoinDoc(buffer);
+		if (!parsed) {
+			return rejectMalformedConnect(buffer);
+		}
+		auto& msg = parsed.value();
 		auto session = getSessionWithAcCode(msg.acCode);
 		if (session == acCodeToDocMap.end()) {
 			std::string errMsg = "Incorrect access code!";
@@ -174,7 +359,11 @@ namespace server {
 			return Response{ std::move(newBuffer), { msg.socket }, msg::Type::join };
 		}
 		auto& [acCode, doc] = *session;
-		auto userAuthData = auth->getUserData(msg.socket);
+		if (!fitsConnectResponse(msg.version, doc)) {
+			auto newBuffer = Serializer::makeConnectResponseWithError(msg.type, tooBigDocumentError, 1);
+			return Response{ std::move(newBuffer), { msg.socket }, msg::Type::join };
+		}
+		auto userAuthData = auth->getUserData(getConnection(msg.socket));
 		assert(!userAuthData.authToken.empty());
 		DBUser userdb(userAuthData.username, "", {});
 		DBDocument docdb(doc.getId(), "", {});
@@ -182,14 +371,18 @@ namespace server {
 			auto newBuffer = Serializer::makeConnectResponseWithError(msg.type, db.getLastError(), 1);
 			return Response{ std::move(newBuffer), { msg.socket }, msg::Type::join };
 		}
-		addClientToSession(msg.socket, userAuthData, session);
+		addClientToSession(msg.socket, userAuthData, session, msg.version, msg.presencePort);
 		int userIdx = doc.getCursorNum() - 1;
-		auto newBuffer = Serializer::makeConnectResponse(msg.type, doc, msg.version, userIdx, acCode);
+		auto newBuffer = makeConnectResponse(msg.type, msg.version, msg.socket, userIdx, acCode, doc, msg.lastVersion);
 		return Response{ std::move(newBuffer), doc.getConnectedClients(), msg::Type::join };
 	}
 
 	Response Repository::disconnectUserFromDoc(const ArgPack& argPack) {
-		auto msg = Deserializer::parseDisconnect(argPack.buffer);
+		auto parsed = Deserializer::parseDisconnect(argPack.buffer);
+		if (!parsed) {
+			return rejectMalformed(argPack);
+		}
+		auto& msg = parsed.value();
 		auto& doc = *argPack.doc;
 		int userIdx = doc.findUser(argPack.client);
 		if (userIdx < 0) {
@@ -197,15 +390,207 @@ namespace server {
 			return Response{ std::move(argPack.buffer), {}, msg::Type::error };
 		}
 		saveDocInDb(doc);
-		eraseClientFromSession(doc, argPack.client);
 		auto newBuffer = Serializer::makeDisconnectResponse(userIdx, msg);
-		return Response{ std::move(newBuffer), doc.getConnectedClients(), msg::Type::disconnect };
+		doc.recordOp(newBuffer);
+		// Session of the last user is closed together with the document
+		auto destinations = doc.getConnectedClients();
+		std::erase(destinations, argPack.client);
+		eraseClientFromSession(doc, argPack.client);
+		return Response{ std::move(newBuffer), std::move(destinations), msg::Type::disconnect };
+	}
+
+	bool Repository::fitsConnectResponse(const msg::OneByteInt version, const ServerSiteDocument& doc) const {
+		// Clients without snapshot streaming get the whole text in the connect response, it has to fit in one frame
+		return msg::streamsSnapshot(version) || doc.getTextSnapshot()->size() <= msg::maxInlineText;
+	}
+
+	msg::Buffer Repository::makeConnectResponse(const msg::Type type, const msg::OneByteInt version, const SOCKET client, const int userIdx, const std::string& acCode, ServerSiteDocument& doc, const unsigned int lastVersion) {
+		if (msg::supportsResume(version) && lastVersion > 0 && doc.hasOpsSince(lastVersion)) {
+			logger.logDebug("Client", client, "resumes document from version", lastVersion);
+			pendingReplays.emplace_back(Replay{ client, acCode, lastVersion });
+			// Cursor moves are not in the op log, send every cursor in the next presence frame
+			doc.markAllCursorsMoved();
+			movedCursorSessions.insert(acCode);
+			return Serializer::makeResumeResponse(type, doc, version, userIdx, acCode, doc.getVersion() - lastVersion);
+		}
+		auto text = doc.getTextSnapshot();
+		if (!msg::streamsSnapshot(version) || text->size() <= msg::snapshotChunkSize) {
+			return Serializer::makeConnectResponse(type, doc, version, userIdx, acCode);
+		}
+		snapshotTransfers.emplace_back(SnapshotTransfer{ client, version, doc.getVersion(), std::move(text) });
+		return Serializer::makeConnectResponse(type, doc, version, userIdx, acCode, true);
+	}
+
+	std::vector<Response> Repository::takeReplays() {
+		std::vector<Response> responses;
+		for (const auto& replay : pendingReplays) {
+			auto session = acCodeToDocMap.find(replay.acCode);
+			if (session == acCodeToDocMap.end()) {
+				continue;
+			}
+			auto version = getVersion(replay.client);
+			for (auto& op : session->second.getOpsSince(replay.sinceVersion)) {
+				msg::Type type;
+				msg::parse(op.buffer, 0, type);
+				responses.emplace_back(Response{ Serializer::makeUpdateFor(version, op), { replay.client }, type });
+			}
+		}
+		pendingReplays.clear();
+		return responses;
+	}
+
+	Response Repository::resync(const SOCKET client) {
+		auto doc = findDoc(client);
+		if (doc == nullptr) {
+			return Response{ msg::Buffer{ 0 }, {}, msg::Type::error };
+		}
+		// Client missed updates, its document is replaced with the current one
+		std::erase_if(snapshotTransfers, [client](const SnapshotTransfer& transfer) { return transfer.client == client; });
+		std::erase_if(pendingReplays, [client](const Replay& replay) { return replay.client == client; });
+		auto& userData = clientToUserData[client];
+		// Client drops its unacknowledged modifiers with the old document, rejects count from its next one
+		userData.opSeq = 0;
+		logger.logDebug("Resyncing client", client, "with document version", doc->getVersion());
+		if (!fitsConnectResponse(userData.version, *doc)) {
+			return Response{ Serializer::makeConnectResponseWithError(msg::Type::join, tooBigDocumentError, 1), { client }, msg::Type::join };
+		}
+		auto newBuffer = makeConnectResponse(msg::Type::join, userData.version, client, doc->findUser(client), userData.acCode, *doc);
+		return Response{ std::move(newBuffer), { client }, msg::Type::join };
+	}
+
+	std::vector<Response> Repository::nextSnapshotChunks() {
+		std::vector<Response> responses;
+		for (auto transfer = snapshotTransfers.begin(); transfer != snapshotTransfers.end();) {
+			auto chunk = std::string_view{ *transfer->text }.substr(transfer->offset, msg::snapshotChunkSize);
+			auto newBuffer = Serializer::makeSnapshotChunk(transfer->version, transfer->snapshotVersion, transfer->offset, chunk);
+			responses.emplace_back(Response{ std::move(newBuffer), { transfer->client }, msg::Type::snapshotChunk });
+			transfer->offset += static_cast<unsigned int>(chunk.size());
+			if (transfer->offset >= transfer->text->size()) {
+				transfer = snapshotTransfers.erase(transfer);
+				continue;
+			}
+			transfer++;
+		}
+		return responses;
+	}
+
+	bool Repository::hasPendingSnapshots() const {
+		return !snapshotTransfers.empty();
+	}
+
+	std::vector<Response> Repository::takePresenceFrames() {
+		return std::move(presenceFrames);
+	}
+
+	std::vector<Response> Repository::nextPresenceFrames() {
+		auto now = std::chrono::steady_clock::now();
+		if (!hasPendingPresence() || now < lastPresenceFlush + presenceInterval) {
+			return {};
+		}
+		lastPresenceFlush = now;
+		// Datagram made before a later update is dropped by clients which applied the update first,
+		// so the cursors are sent once more at the current version
+		std::set<std::string> resentSessions;
+		for (auto it = datagramPresenceVersions.begin(); it != datagramPresenceVersions.end();) {
+			auto session = acCodeToDocMap.find(it->first);
+			if (session != acCodeToDocMap.end() && session->second.getVersion() == it->second) {
+				it++;
+				continue;
+			}
+			if (session != acCodeToDocMap.end() && !movedCursorSessions.contains(it->first)) {
+				session->second.markAllCursorsMoved();
+				movedCursorSessions.insert(it->first);
+				resentSessions.insert(it->first);
+			}
+			it = datagramPresenceVersions.erase(it);
+		}
+		auto sessions = std::move(movedCursorSessions);
+		for (const auto& acCode : sessions) {
+			if (isReplacing(acCode)) {
+				// Cursors of a half replaced document are sent when the replace is done
+				movedCursorSessions.insert(acCode);
+				continue;
+			}
+			auto session = acCodeToDocMap.find(acCode);
+			if (session != acCodeToDocMap.end()) {
+				flushPresence(acCode, session->second);
+			}
+		}
+		for (const auto& acCode : resentSessions) {
+			datagramPresenceVersions.erase(acCode);
+		}
+		return std::move(presenceFrames);
+	}
+
+	bool Repository::hasPendingPresence() const {
+		if (!movedCursorSessions.empty()) {
+			return true;
+		}
+		return std::any_of(datagramPresenceVersions.cbegin(), datagramPresenceVersions.cend(), [this](const auto& frameVersion) {
+			auto session = acCodeToDocMap.find(frameVersion.first);
+			return session == acCodeToDocMap.cend() || session->second.getVersion() != frameVersion.second;
+		});
+	}
+
+	std::chrono::milliseconds Repository::getPresenceInterval() const {
+		return presenceInterval;
+	}
+
+	unsigned int Repository::getPresencePort(const SOCKET client) const {
+		auto userData = clientToUserData.find(client);
+		return userData != clientToUserData.cend() ? userData->second.presencePort : 0;
+	}
+
+	bool Repository::hasDatagramPresence(ServerSiteDocument& doc) const {
+		const auto& clients = doc.getConnectedClients();
+		return std::any_of(clients.cbegin(), clients.cend(), [this](const SOCKET client) { return getPresencePort(client) != 0; });
+	}
+
+	void Repository::flushPresence(const std::string& acCode, ServerSiteDocument& doc) {
+		movedCursorSessions.erase(acCode);
+		if (!doc.hasMovedCursors()) {
+			return;
+		}
+		auto users = doc.takeMovedCursors();
+		if (hasDatagramPresence(doc)) {
+			// Datagrams can be lost, each one is a full snapshot so the next one repairs it
+			users.resize(doc.getCursorNum());
+			std::iota(users.begin(), users.end(), 0);
+			datagramPresenceVersions[acCode] = doc.getVersion();
+		}
+		auto seq = doc.nextPresenceSeq();
+		const auto& connectedClients = doc.getConnectedClients();
+		std::map<msg::OneByteInt, std::vector<SOCKET>> versionClients;
+		for (const auto client : connectedClients) {
+			versionClients[getVersion(client)].push_back(client);
+		}
+		for (auto& [version, clients] : versionClients) {
+			if (msg::receivesPresence(version)) {
+				auto newBuffer = Serializer::makePresenceResponse(version, doc, users, seq);
+				presenceFrames.emplace_back(Response{ std::move(newBuffer), std::move(clients), msg::Type::presence });
+				continue;
+			}
+			// Older clients get a move response per moved cursor, their own move was already acknowledged
+			for (int userIdx : users) {
+				auto destinations = clients;
+				if (userIdx < connectedClients.size()) {
+					std::erase(destinations, connectedClients[userIdx]);
+				}
+				if (!destinations.empty()) {
+					auto newBuffer = Serializer::makeCursorResponse(version, doc, userIdx);
+					presenceFrames.emplace_back(Response{ std::move(newBuffer), std::move(destinations), msg::Type::moveTo });
+				}
+			}
+		}
 	}
 
 	void Repository::eraseClientFromSession(ServerSiteDocument& doc, const SOCKET client) {
+		std::erase_if(snapshotTransfers, [client](const SnapshotTransfer& transfer) { return transfer.client == client; });
 		int userIdx = doc.findUser(client);
-		doc.eraseUser(userIdx);
 		doc.eraseClient(client);
+		if (!doc.getConnectedClients().empty()) {
+			doc.eraseUser(userIdx);
+		}
 		auto userDataIt = clientToUserData.find(client);
 		std::string erasedAcCode, erasedUsername;
 		if (userDataIt != clientToUserData.cend()) {
@@ -215,71 +600,475 @@ namespace server {
 			std::lock_guard lock{userFileCombinedLock};
 			userFileCombinedSet.erase(erasedUsername + "-" + doc.getFilename());
 		}
-		auth->clearUser(client);
-		if (doc.getCursorNum() == 0) {
+		// Connection stays logged in while it is used by other streams
+		if (getStream(client) == 0) {
+			auth->clearUser(client);
+		}
+		if (doc.getConnectedClients().empty()) {
 			deleteSession(erasedUsername, erasedAcCode, doc);
 		}
 	}
 
 	void Repository::deleteSession(const std::string& username, const std::string& acCode, ServerSiteDocument& doc) {
-		std::scoped_lock lock{acCodesLock, userFileCombinedLock};
-		acCodeSet.erase(acCode);
-		userFileCombinedSet.erase(username + "-" + doc.getFilename());
+		{
+			std::scoped_lock lock{acCodesLock, userFileCombinedLock};
+			acCodeSet.erase(acCode);
+			userFileCombinedSet.erase(username + "-" + doc.getFilename());
+		}
 		auto acCodeToDocIt = acCodeToDocMap.find(acCode);
 		if (acCodeToDocIt != acCodeToDocMap.cend()) {
-			acCodeToDocMap.erase(acCodeToDocIt);
+			cacheClosedDoc(acCodeToDocMap.extract(acCodeToDocIt), username);
+		}
+	}
+
+	void Repository::cacheClosedDoc(SessionNode&& node, const std::string& username) {
+		// Last user stays in the document, whoever reopens it gets back the cursor and undo history
+		auto& doc = node.mapped();
+		size_t usage = doc.getMemoryUsage();
+		collectClosedDocs();
+		if (usage > closedDocsMaxBytes) {
+			return;
+		}
+		while (closedDocsBytes + usage > closedDocsMaxBytes) {
+			dropClosedDoc(closedDocs.begin());
 		}
+		saveDocInDb(doc); // Closed document is valid while its file has the write time of this save
+		auto userFile = username + "-" + doc.getFilename();
+		closedDocs.emplace_back(ClosedDoc{ std::move(node), std::chrono::steady_clock::now(), usage, userFile });
+		closedDocsBytes += usage;
+		std::lock_guard lock{userFileCombinedLock};
+		closedUserFileSet.insert(std::move(userFile));
+	}
+
+	void Repository::dropClosedDoc(std::list<ClosedDoc>::iterator closed) {
+		closedDocsBytes -= closed->usage;
+		{
+			std::lock_guard lock{userFileCombinedLock};
+			closedUserFileSet.erase(closed->userFile);
+		}
+		closedDocs.erase(closed);
+	}
+
+	std::optional<SessionNode> Repository::takeClosedDoc(const std::string& id) {
+		collectClosedDocs();
+		auto closed = std::find_if(closedDocs.begin(), closedDocs.end(), [&id](const ClosedDoc& closed) { return closed.node.mapped().getId() == id; });
+		if (closed == closedDocs.end()) {
+			return {};
+		}
+		// Document whose own save is still queued was not written by anyone else, the file time is known once the save is done
+		bool savePending = std::any_of(saveJobs.cbegin(), saveJobs.cend(), [&id](const SaveJob& job) { return job.docId == id; });
+		bool unchanged = savePending || (closed->fileTime.has_value() && closed->fileTime == db.getDocWriteTime(id));
+		auto node = std::move(closed->node);
+		dropClosedDoc(closed);
+		if (!unchanged) {
+			logger.logDebug("Document", id, "changed on disk after it was closed, loading it again");
+			return {};
+		}
+		return node;
+	}
+
+	SessionIt Repository::reopenSession(const std::string& username, SessionNode&& node) {
+		auto acCode = random::Engine::get().getRandomString(6);
+		node.key() = acCode;
+		auto session = acCodeToDocMap.insert(std::move(node)).position;
+		session->second.setLastUse(memoryCheck);
+		logger.logDebug("Reopened closed document", session->second.getId());
+		std::scoped_lock lock{acCodesLock, userFileCombinedLock};
+		acCodeSet.insert(acCode);
+		userFileCombinedSet.insert(username + "-" + session->second.getFilename());
+		return session;
+	}
+
+	void Repository::collectClosedDocs() {
+		auto expired = std::chrono::steady_clock::now() - closedDocTtl;
+		while (!closedDocs.empty() && closedDocs.front().closedAt < expired) {
+			dropClosedDoc(closedDocs.begin());
+		}
+	}
+
+	Repository::Handoff Repository::handOff(const std::set<std::string>& acCodes) {
+		// Chunked saves are written first, the new worker may save the same documents meanwhile
+		completeSaves();
+		Handoff handoff;
+		for (const auto& acCode : acCodes) {
+			auto session = acCodeToDocMap.find(acCode);
+			if (session != acCodeToDocMap.end()) {
+				handOffSession(session, handoff);
+			}
+		}
+		return handoff;
+	}
+
+	Repository::Handoff Repository::handOffAll() {
+		std::set<std::string> acCodes;
+		for (const auto& [acCode, doc] : acCodeToDocMap) {
+			acCodes.insert(acCode);
+		}
+		auto handoff = handOff(acCodes);
+		handoff.closedDocs = std::move(closedDocs);
+		closedDocs.clear();
+		closedDocsBytes = 0;
+		std::lock_guard lock{userFileCombinedLock};
+		closedUserFileSet.clear();
+		return handoff;
+	}
+
+	std::set<std::string> Repository::getLinkedSessions(const std::string& acCode) {
+		// Streams of one connection can be in different sessions, such sessions move between workers together
+		std::set<std::string> sessions{ acCode };
+		std::vector<std::string> pending{ acCode };
+		while (!pending.empty()) {
+			auto session = acCodeToDocMap.find(pending.back());
+			pending.pop_back();
+			if (session == acCodeToDocMap.end()) {
+				continue;
+			}
+			for (auto client : session->second.getConnectedClients()) {
+				for (const auto& [other, userData] : clientToUserData) {
+					if (getConnection(other) == getConnection(client) && sessions.insert(userData.acCode).second) {
+						pending.push_back(userData.acCode);
+					}
+				}
+			}
+		}
+		return sessions;
+	}
+
+	void Repository::handOffSession(SessionIt session, Handoff& handoff) {
+		auto& [acCode, doc] = *session;
+		const auto& clients = doc.getConnectedClients();
+		auto belongs = [&clients](const SOCKET client) { return std::find(clients.cbegin(), clients.cend(), client) != clients.cend(); };
+		for (auto& transfer : snapshotTransfers) {
+			if (belongs(transfer.client)) {
+				handoff.snapshotTransfers.emplace_back(std::move(transfer));
+			}
+		}
+		std::erase_if(snapshotTransfers, [&belongs](const SnapshotTransfer& transfer) { return belongs(transfer.client); });
+		for (auto& replay : pendingReplays) {
+			if (replay.acCode == acCode) {
+				handoff.pendingReplays.emplace_back(std::move(replay));
+			}
+		}
+		std::erase_if(pendingReplays, [&acCode](const Replay& replay) { return replay.acCode == acCode; });
+		if (editedSessions.erase(acCode) > 0) {
+			handoff.editedSessions.insert(acCode);
+		}
+		if (movedCursorSessions.erase(acCode) > 0) {
+			handoff.movedCursorSessions.insert(acCode);
+		}
+		if (auto presenceVersion = datagramPresenceVersions.extract(acCode)) {
+			handoff.datagramPresenceVersions.insert(std::move(presenceVersion));
+		}
+		{
+			std::scoped_lock lock{acCodesLock, userFileCombinedLock};
+			acCodeSet.erase(acCode);
+			for (auto client : clients) {
+				auto userData = clientToUserData.find(client);
+				if (userData == clientToUserData.end()) {
+					continue;
+				}
+				userFileCombinedSet.erase(userData->second.username + "-" + doc.getFilename());
+				handoff.clients.insert(clientToUserData.extract(userData));
+			}
+		}
+		handoff.sessions.emplace_back(acCodeToDocMap.extract(session));
+	}
+
+	void Repository::adopt(Handoff&& handoff) {
+		std::vector<std::string> userFiles;
+		for (auto& [client, userData] : handoff.clients) {
+			auto session = std::find_if(handoff.sessions.cbegin(), handoff.sessions.cend(), [&userData](const SessionNode& node) { return node.key() == userData.acCode; });
+			if (session != handoff.sessions.cend()) {
+				userFiles.emplace_back(userData.username + "-" + session->mapped().getFilename());
+			}
+		}
+		std::vector<std::string> acCodes;
+		for (auto& node : handoff.sessions) {
+			acCodes.push_back(node.key());
+			auto session = acCodeToDocMap.insert(std::move(node)).position;
+			session->second.setLastUse(memoryCheck);
+		}
+		clientToUserData.merge(handoff.clients);
+		std::move(handoff.snapshotTransfers.begin(), handoff.snapshotTransfers.end(), std::back_inserter(snapshotTransfers));
+		std::move(handoff.pendingReplays.begin(), handoff.pendingReplays.end(), std::back_inserter(pendingReplays));
+		editedSessions.merge(handoff.editedSessions);
+		movedCursorSessions.merge(handoff.movedCursorSessions);
+		datagramPresenceVersions.merge(handoff.datagramPresenceVersions);
+		for (const auto& closed : handoff.closedDocs) {
+			closedDocsBytes += closed.usage;
+		}
+		std::scoped_lock lock{acCodesLock, userFileCombinedLock};
+		for (const auto& closed : handoff.closedDocs) {
+			closedUserFileSet.insert(closed.userFile);
+		}
+		closedDocs.splice(closedDocs.end(), handoff.closedDocs);
+		acCodeSet.insert(acCodes.begin(), acCodes.end());
+		userFileCombinedSet.insert(userFiles.begin(), userFiles.end());
+	}
+
+	void Repository::saveDocInDb(ServerSiteDocument& doc) {
+		// Text is written in chunks by stepSaves, the snapshot stays valid when the document is edited meanwhile
+		doc.setNowAsLastSaveTimestamp();
+		std::erase_if(saveJobs, [&doc](const SaveJob& job) { return job.docId == doc.getId(); });
+		saveJobs.emplace_back(SaveJob{ doc.getId(), doc.getTextSnapshot() });
+	}
+
+	std::set<std::string> Repository::takeEditedSessions() {
+		return std::move(editedSessions);
+	}
+
+	bool Repository::saveSession(const std::string& acCode) {
+		auto session = acCodeToDocMap.find(acCode);
+		if (session == acCodeToDocMap.end()) {
+			return false;
+		}
+		if (session->second.isHibernated()) {
+			return true; // Saved when it was hibernated
+		}
+		saveDocInDb(session->second);
+		return true;
+	}
+
+	void Repository::stepSaves() {
+		for (auto job = saveJobs.begin(); job != saveJobs.end();) {
+			if (writeSaveChunk(*job)) {
+				job = saveJobs.erase(job);
+				continue;
+			}
+			job++;
+		}
+	}
+
+	void Repository::completeSaves() {
+		while (!saveJobs.empty()) {
+			stepSaves();
+		}
+	}
+
+	void Repository::completeSave(const std::string& docId) {
+		auto job = std::find_if(saveJobs.begin(), saveJobs.end(), [&docId](const SaveJob& job) { return job.docId == docId; });
+		if (job == saveJobs.end()) {
+			return;
+		}
+		while (!writeSaveChunk(*job)) {}
+		saveJobs.erase(job);
+	}
+
+	bool Repository::writeSaveChunk(SaveJob& job) {
+		auto chunk = std::string_view{ *job.text }.substr(job.offset, saveChunkSize);
+		bool first = job.offset == 0;
+		job.offset += chunk.size();
+		bool saved = db.saveDocChunk(job.docId, chunk, first, job.offset >= job.text->size());
+		if (saved && job.offset < job.text->size()) {
+			return false;
+		}
+		for (auto& closed : closedDocs) {
+			if (saved && closed.node.mapped().getId() == job.docId) {
+				closed.fileTime = db.getDocWriteTime(job.docId);
+			}
+		}
+		return true;
+	}
+
+	bool Repository::startReplace(const ArgPack& argPack) {
+		auto msg = Deserializer::parseReplaceMessage(argPack.buffer);
+		// Malformed replace is refused by the regular handler
+		if (!msg || msg->segments.size() <= replaceChunkSegments || argPack.doc->findUser(argPack.client) < 0) {
+			return false;
+		}
+		replaceJobs.emplace_back(ReplaceJob{ argPack.client, std::move(msg.value()) });
+		return true;
+	}
+
+	std::vector<Response> Repository::stepReplaces() {
+		std::vector<Response> responses;
+		for (auto job = replaceJobs.begin(); job != replaceJobs.end();) {
+			auto doc = findDoc(job->client);
+			int userIdx = doc != nullptr ? doc->findUser(job->client) : -1;
+			if (userIdx < 0) {
+				job = replaceJobs.erase(job);
+				continue;
+			}
+			// Segments go from the last one, so positions of the rest stay valid
+			auto& segments = job->msg.segments;
+			size_t stepEnd = (std::min)(job->applied + replaceChunkSegments, segments.size());
+			for (; job->applied < stepEnd; job->applied++) {
+				const auto& segment = segments[segments.size() - 1 - job->applied];
+				if (!doc->setCursorPos(userIdx, segment.first) || !doc->setCursorAnchor(userIdx, segment.second)) {
+					logger.logError("Replace failed with one segment");
+					continue;
+				}
+				doc->erase(userIdx, 1);
+				doc->write(userIdx, job->msg.text);
+			}
+			if (job->applied < segments.size()) {
+				job++;
+				continue;
+			}
+			auto newBuffer = Serializer::makeReplaceResponse(userIdx, job->msg);
+			responses.emplace_back(finishOp(job->client, job->msg.version, *doc, Response{ std::move(newBuffer), doc->getConnectedClients(), msg::Type::replace }));
+			job = replaceJobs.erase(job);
+		}
+		return responses;
 	}
 
-	bool Repository::saveDocInDb(const ServerSiteDocument& doc) {
-		return db.saveDoc(doc.getId(), doc.getText());
+	std::vector<Response> Repository::completeReplaces() {
+		std::vector<Response> responses;
+		while (!replaceJobs.empty()) {
+			for (auto& response : stepReplaces()) {
+				responses.emplace_back(std::move(response));
+			}
+		}
+		return responses;
+	}
+
+	bool Repository::isReplacing(const std::string& acCode) const {
+		// Requests without a session yet may join any of them, they wait for every replace
+		return std::any_of(replaceJobs.cbegin(), replaceJobs.cend(), [this, &acCode](const ReplaceJob& job) {
+			return acCode.empty() || getAcCode(job.client) == acCode;
+		});
+	}
+
+	bool Repository::hasBulkSteps() const {
+		return !replaceJobs.empty() || !saveJobs.empty();
+	}
+
+	size_t Repository::hibernateSessions(const size_t memoryBudget, const unsigned int idleChecks) {
+		// Sessions idle for idleChecks calls are hibernated, then least recently used ones until the rest fits the budget
+		std::vector<std::pair<SessionIt, size_t>> candidates;
+		size_t usage = 0;
+		for (auto session = acCodeToDocMap.begin(); session != acCodeToDocMap.end(); session++) {
+			auto& [acCode, doc] = *session;
+			if (doc.isHibernated()) {
+				continue;
+			}
+			size_t docUsage = doc.getMemoryUsage();
+			usage += docUsage;
+			// Session used since the previous call is in use, hibernating it would only make it come back
+			if (doc.getLastUse() < memoryCheck && canHibernate(acCode)) {
+				candidates.emplace_back(session, docUsage);
+			}
+		}
+		std::sort(candidates.begin(), candidates.end(), [](const auto& first, const auto& second) {
+			auto firstUse = first.first->second.getLastUse();
+			auto secondUse = second.first->second.getLastUse();
+			return firstUse < secondUse || (firstUse == secondUse && first.second > second.second);
+		});
+		size_t hibernated = 0;
+		for (auto& [session, docUsage] : candidates) {
+			auto& [acCode, doc] = *session;
+			if (memoryCheck - doc.getLastUse() < idleChecks && usage <= memoryBudget) {
+				break;
+			}
+			saveDocInDb(doc);
+			if (!db.saveDocHistory(doc.getId(), doc.hibernate(hibernatedHistoryDepth))) {
+				logger.logError("Undo history of session", acCode, "is lost on hibernation");
+			}
+			usage -= docUsage;
+			hibernated++;
+		}
+		if (hibernated > 0) {
+			logger.logInfo("Hibernated", hibernated, "sessions, remaining ones take", usage / 1024, "KB");
+		}
+		memoryCheck++;
+		return hibernated;
+	}
+
+	bool Repository::canHibernate(const std::string& acCode) const {
+		// Pending work reads the text or op log of the session
+		if (isReplacing(acCode) || movedCursorSessions.contains(acCode)) {
+			return false;
+		}
+		return std::none_of(pendingReplays.cbegin(), pendingReplays.cend(), [&acCode](const Replay& replay) { return replay.acCode == acCode; });
 	}
 
 	SessionIt Repository::getSessionWithDocId(const std::string& id) {
 		for (auto it = acCodeToDocMap.begin(); it != acCodeToDocMap.end(); it++) {
 			if (it->second.getId() == id) {
-				return it;
+				return useSession(it->first, it->second) ? it : acCodeToDocMap.end();
 			}
 		}
 		return acCodeToDocMap.end();
 	}
 
 	SessionIt Repository::getSessionWithAcCode(const std::string& acCode) {
-		return acCodeToDocMap.find(acCode);
+		auto session = acCodeToDocMap.find(acCode);
+		if (session == acCodeToDocMap.end() || !useSession(session->first, session->second)) {
+			return acCodeToDocMap.end();
+		}
+		return session;
 	}
 
 	Response Repository::write(const ArgPack& argPack) {
-		auto msg = Deserializer::parseWrite(argPack.buffer);
+		auto msg = Deserializer::parseWriteView(argPack.buffer);
 		auto& doc = *argPack.doc;
+		if (!msg) {
+			return rejectMalformed(argPack);
+		}
 		int userIdx = doc.findUser(argPack.client);
 		if (userIdx < 0) {
-			logger.logDebug(msg.type, "command failed. User not found error");
+			logger.logDebug(msg->type, "command failed. User not found error");
+			return Response{ std::move(argPack.buffer), {}, msg::Type::error };
+		}
+		if (msg->text.size() > msg::maxInlineText) {
+			// Update with the text would not fit in a frame for the other clients
+			logger.logError("Write of", msg->text.size(), "letters from", argPack.client, "exceeds the message size limit");
+			return Response{ std::move(argPack.buffer), {}, msg::Type::error };
+		}
+		if (msg::carriesBaseVersion(msg->version) && !rebaseCursor(doc, userIdx, msg->baseVersion, makeCoord(msg->X, msg->Y))) {
 			return Response{ std::move(argPack.buffer), {}, msg::Type::error };
 		}
 		COORD startPos = doc.getCursorPos(userIdx);
-		doc.write(userIdx, msg.text);
-		logger.logInfo("User", userIdx, "wrote", msg.text.size(), "letters");
-		auto newBuffer = Serializer::makeWriteResponse(startPos, userIdx, msg);
+		doc.write(userIdx, msg->text);
+		logger.logInfo("User", userIdx, "wrote", msg->text.size(), "letters");
+		auto newBuffer = Serializer::makeWriteResponse(startPos, doc.getEditAnchors(), userIdx, *msg);
 		return Response{ std::move(newBuffer), doc.getConnectedClients(), msg::Type::write };
 	}
 
 	Response Repository::erase(const ArgPack& argPack) {
-		auto msg = Deserializer::parseErase(argPack.buffer);
+		auto parsed = Deserializer::parseErase(argPack.buffer);
+		if (!parsed) {
+			return rejectMalformed(argPack);
+		}
+		auto& msg = parsed.value();
 		auto& doc = *argPack.doc;
 		int userIdx = doc.findUser(argPack.client);
 		if (userIdx < 0) {
 			logger.logDebug(msg.type, "command failed. User not found error");
 			return Response{ std::move(argPack.buffer), {}, msg::Type::error };
 		}
+		if (msg::carriesBaseVersion(msg.version) && !rebaseCursor(doc, userIdx, msg.baseVersion, makeCoord(msg.X, msg.Y))) {
+			return Response{ std::move(argPack.buffer), {}, msg::Type::error };
+		}
 		COORD startPos = doc.getCursorPos(userIdx);
 		doc.erase(userIdx, msg.eraseSize);
 		logger.logInfo("User", userIdx, "erased", msg.eraseSize, "letters from document");
-		auto newBuffer = Serializer::makeEraseResponse(startPos, userIdx, msg);
+		auto newBuffer = Serializer::makeEraseResponse(startPos, doc.getEditAnchors(), userIdx, msg);
 		return Response{ std::move(newBuffer), doc.getConnectedClients(), msg::Type::erase };
 	}
 
+	bool Repository::rebaseCursor(ServerSiteDocument& doc, const int userIdx, const unsigned int baseVersion, const COORD& pos) {
+		auto rebasedPos = doc.rebase(userIdx, baseVersion, pos);
+		if (!rebasedPos) {
+			logger.logDebug("Cannot rebase edit from version", baseVersion, "on version", doc.getVersion());
+			return false;
+		}
+		if (*rebasedPos == doc.getCursorPos(userIdx)) {
+			return true;
+		}
+		if (!doc.setCursorPos(userIdx, *rebasedPos)) {
+			logger.logDebug("Rebased position is out of document");
+			return false;
+		}
+		return true;
+	}
+
 	Response Repository::moveHorizontal(const ArgPack& argPack) {
-		auto msg = Deserializer::parseMoveHorizontal(argPack.buffer);
+		auto parsed = Deserializer::parseMoveHorizontal(argPack.buffer);
+		if (!parsed) {
+			return rejectMalformed(argPack);
+		}
+		auto& msg = parsed.value();
 		auto& doc = *argPack.doc;
 		int userIdx = doc.findUser(argPack.client);
 		if (userIdx < 0) {
@@ -303,7 +1092,11 @@ namespace server {
 	}
 
 	Response Repository::moveVertical(const ArgPack& argPack) {
-		auto msg = Deserializer::parseMoveVertical(argPack.buffer);
+		auto parsed = Deserializer::parseMoveVertical(argPack.buffer);
+		if (!parsed) {
+			return rejectMalformed(argPack);
+		}
+		auto& msg = parsed.value();
 		auto& doc = *argPack.doc;
 		int userIdx = doc.findUser(argPack.client);
 		if (userIdx < 0) {
@@ -327,7 +1120,11 @@ namespace server {
 	}
 
 	Response Repository::moveTo(const ArgPack& argPack) {
-		auto msg = Deserializer::parseMoveTo(argPack.buffer);
+		auto parsed = Deserializer::parseMoveTo(argPack.buffer);
+		if (!parsed) {
+			return rejectMalformed(argPack);
+		}
+		auto& msg = parsed.value();
 		auto& doc = *argPack.doc;
 		int userIdx = doc.findUser(argPack.client);
 		if (userIdx < 0) {
@@ -340,7 +1137,11 @@ namespace server {
 	}
 
 	Response Repository::moveSelectAll(const ArgPack& argPack) {
-		auto msg = Deserializer::parseMoveSelectAll(argPack.buffer);
+		auto parsed = Deserializer::parseMoveSelectAll(argPack.buffer);
+		if (!parsed) {
+			return rejectMalformed(argPack);
+		}
+		auto& msg = parsed.value();
 		auto& doc = *argPack.doc;
 		int userIdx = doc.findUser(argPack.client);
 		if (userIdx < 0) {
@@ -355,7 +1156,11 @@ namespace server {
 	}
 
 	Response Repository::undoRedo(const ArgPack& argPack) {
-		auto msg = Deserializer::parseControlMessage(argPack.buffer);
+		auto parsed = Deserializer::parseControlMessage(argPack.buffer);
+		if (!parsed) {
+			return rejectMalformed(argPack);
+		}
+		auto& msg = parsed.value();
 		auto& doc = *argPack.doc;
 		int userIdx = doc.findUser(argPack.client);
 		if (userIdx < 0) {
@@ -364,13 +1169,13 @@ namespace server {
 		}
 		auto undoReturn = msg.type == msg::Type::undo ? doc.undo(userIdx) : doc.redo(userIdx);
 		if (undoReturn.type == ActionType::write) {
-			msg::Write newMsg{ msg::Type::write, msg.version, "", undoReturn.text };
-			auto newBuffer = Serializer::makeWriteResponse(undoReturn.startPos, userIdx, newMsg);
+			msg::WriteView newMsg{ msg::Type::write, msg.version, "", undoReturn.text };
+			auto newBuffer = Serializer::makeWriteResponse(undoReturn.startPos, doc.getEditAnchors(), userIdx, newMsg);
 			return Response{ std::move(newBuffer), doc.getConnectedClients(), msg::Type::write };
 		}
 		else if (undoReturn.type == ActionType::erase) {
 			msg::Erase newMsg{ msg::Type::erase, msg.version, "", undoReturn.text.size() };
-			auto newBuffer = Serializer::makeEraseResponse(undoReturn.startPos, userIdx, newMsg);
+			auto newBuffer = Serializer::makeEraseResponse(undoReturn.startPos, doc.getEditAnchors(), userIdx, newMsg);
 			return Response{ std::move(newBuffer), doc.getConnectedClients(), msg::Type::erase };
 		}
 		logger.logDebug(msg.type, "returned noop action. Nothing changed.");
@@ -378,7 +1183,11 @@ namespace server {
 	}
 
 	Response Repository::replace(const ArgPack& argPack) {
-		auto msg = Deserializer::parseReplaceMessage(argPack.buffer);
+		auto parsed = Deserializer::parseReplaceMessage(argPack.buffer);
+		if (!parsed) {
+			return rejectMalformed(argPack);
+		}
+		auto& msg = parsed.value();
 		auto& doc = *argPack.doc;
 		int userIdx = doc.findUser(argPack.client);
 		if (userIdx < 0) {
@@ -397,13 +1206,16 @@ namespace server {
 		return Response{ std::move(newBuffer), doc.getConnectedClients(), msg::Type::replace };
 	}
 
-	bool Repository::addClientToSession(const SOCKET client, Authenticator::UserData& userAuthData, SessionIt session) {
+	bool Repository::addClientToSession(const SOCKET client, Authenticator::UserData& userAuthData, SessionIt session, const msg::OneByteInt version, const unsigned int presencePort) {
 		auto& [acCode, doc] = *session;
 		doc.addClient(client);
-		doc.addUser();
+		if (doc.getCursorNum() < doc.getConnectedClients().size()) {
+			doc.addUser(); // Otherwise the client takes over the user left in a reopened document
+		}
+		doc.recordOp(Serializer::makeUserConnectedResponse());
 		std::lock_guard lock{userFileCombinedLock};
 		userFileCombinedSet.insert(userAuthData.username + "-" + doc.getFilename());
-		clientToUserData.emplace(client, ClientUserData{ std::move(acCode), std::move(userAuthData.username), std::move(userAuthData.authToken) });
+		clientToUserData.emplace(client, ClientUserData{ std::move(acCode), std::move(userAuthData.username), std::move(userAuthData.authToken), 0, presencePort, version });
 		logger.logDebug("User", client, "added to session (docId", doc.getId() + ")");
 		return true;
 	}
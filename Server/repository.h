@@ -5,12 +5,15 @@
 #include <mutex>
 #include <vector>
 #include <set>
+#include <map>
+#include <list>
 #include <concepts>
 
 #include "engine.h"
 #include "messages.h"
 #include "server_document.h"
 #include "response.h"
+#include "client_id.h"
 #include "authenticator.h"
 #include "database.h"
 #include "logging.h"
@@ -20,6 +23,7 @@ namespace server {
 	concept ServerSiteDocumentType = std::is_same<ServerSiteDocument&, T>::value || std::is_same<ServerSiteDocument, T>::value;
 
 	using SessionIt = std::unordered_map<std::string, ServerSiteDocument>::iterator;
+	using SessionNode = std::unordered_map<std::string, ServerSiteDocument>::node_type;
 	class Repository {
 	public:
 		Repository(server::Authenticator* auth);
@@ -30,8 +34,37 @@ namespace server {
 		Repository& operator=(Repository&&);
 
 		Response process(SOCKET client, msg::Buffer& buffer, bool authenticateUser = true);
+		Response reject(const SOCKET client, msg::Buffer& buffer);
+		std::string getAcCode(const SOCKET client) const;
+		msg::OneByteInt getVersion(const SOCKET client) const;
 		bool acCodeExists(const std::string& acCode);
 		bool userFileExists(const std::string& username, const std::string& filename);
+		std::vector<SOCKET> getStreamClients(const SOCKET connection) const;
+		std::vector<Response> takeReplays();
+		Response resync(const SOCKET client);
+		std::vector<Response> nextSnapshotChunks();
+		bool hasPendingSnapshots() const;
+		std::vector<Response> takePresenceFrames();
+		std::vector<Response> nextPresenceFrames();
+		bool hasPendingPresence() const;
+		unsigned int getPresencePort(const SOCKET client) const;
+		std::chrono::milliseconds getPresenceInterval() const;
+		std::vector<Response> stepReplaces();
+		std::vector<Response> completeReplaces();
+		bool isReplacing(const std::string& acCode) const;
+		std::set<std::string> takeEditedSessions();
+		bool saveSession(const std::string& acCode);
+		void stepSaves();
+		void completeSaves();
+		void completeSave(const std::string& docId);
+		bool hasBulkSteps() const;
+		size_t hibernateSessions(const size_t memoryBudget, const unsigned int idleChecks);
+		void collectClosedDocs();
+		struct Handoff;
+		Handoff handOff(const std::set<std::string>& acCodes);
+		Handoff handOffAll();
+		std::set<std::string> getLinkedSessions(const std::string& acCode);
+		void adopt(Handoff&& handoff);
 	private:
 		struct ArgPack {
 			SOCKET client;
@@ -42,13 +75,69 @@ namespace server {
 			std::string acCode;
 			std::string username;
 			std::string authToken;
+			unsigned int opSeq = 0; // Modifiers received in the current session
+			unsigned int presencePort = 0; // UDP port for presence frames, 0 if they go over the connection
+			msg::OneByteInt version = msg::legacyVersion; // Protocol version the client connected with
 		};
+		struct SnapshotTransfer {
+			SOCKET client;
+			msg::OneByteInt version;
+			unsigned int snapshotVersion;
+			ServerSiteDocument::TextSnapshot text; // Stays valid when the document is edited mid-transfer
+			unsigned int offset = 0; // Bytes already sent
+		};
+		struct Replay {
+			SOCKET client;
+			std::string acCode;
+			unsigned int sinceVersion;
+		};
+		struct ReplaceJob {
+			SOCKET client;
+			msg::Replace msg;
+			size_t applied = 0; // Segments already applied, from the last one
+		};
+		struct SaveJob {
+			std::string docId;
+			ServerSiteDocument::TextSnapshot text;
+			size_t offset = 0; // Bytes already written
+		};
+		struct ClosedDoc {
+			SessionNode node; // Document keeps its address, undo history points into its text
+			std::chrono::steady_clock::time_point closedAt;
+			size_t usage;
+			std::string userFile; // Routes the next load by its last user back to this worker
+			std::optional<std::filesystem::file_time_type> fileTime; // Set when its last save is written, file changed if it differs
+		};
+	public:
+		// Sessions with their clients and pending work, moved to another worker. Documents move as map nodes,
+		// so they keep their address and hibernated ones stay hibernated
+		struct Handoff {
+			std::vector<SessionNode> sessions;
+			std::unordered_map<SOCKET, ClientUserData> clients;
+			std::vector<SnapshotTransfer> snapshotTransfers;
+			std::vector<Replay> pendingReplays;
+			std::set<std::string> editedSessions; // Including ones with an autosave armed in the old worker
+			std::set<std::string> movedCursorSessions;
+			std::unordered_map<std::string, unsigned int> datagramPresenceVersions;
+			std::list<ClosedDoc> closedDocs;
+		};
+	private:
+		bool authenticate(const SOCKET client, const msg::Buffer& buffer, const msg::OneByteInt version, const int tokenPos) const;
 		ServerSiteDocument* findDoc(SOCKET client);
+		bool useSession(const std::string& acCode, ServerSiteDocument& doc);
+		bool canHibernate(const std::string& acCode) const;
 		Response processImpl(const msg::Type type, const ArgPack& argPack);
+		Response finishOp(const SOCKET client, const msg::OneByteInt version, ServerSiteDocument& doc, Response&& response);
+		void encodePerVersion(Response& response, const ServerSiteDocument::LoggedOp& op, const msg::OneByteInt version);
+		bool writeSaveChunk(SaveJob& job);
+		bool fitsConnectResponse(const msg::OneByteInt version, const ServerSiteDocument& doc) const;
+		bool startReplace(const ArgPack& argPack);
 		Response createDoc(msg::Buffer& buffer);
 		Response loadDoc(msg::Buffer& buffer);
 		Response joinDoc(msg::Buffer& buffer);
 		Response masterClose(msg::Buffer& buffer) const;
+		Response rejectMalformed(const ArgPack& argPack) const;
+		Response rejectMalformedConnect(msg::Buffer& buffer) const;
 		Response disconnectUserFromDoc(const ArgPack& argPack);
 		Response write(const ArgPack& argPack);
 		Response erase(const ArgPack& argPack);
@@ -58,7 +147,10 @@ namespace server {
 		Response moveSelectAll(const ArgPack& argPack);
 		Response undoRedo(const ArgPack& argPack);
 		Response replace(const ArgPack& argPack);
-		bool saveDocInDb(const ServerSiteDocument& doc);
+		void flushPresence(const std::string& acCode, ServerSiteDocument& doc);
+		bool rebaseCursor(ServerSiteDocument& doc, const int userIdx, const unsigned int baseVersion, const COORD& pos);
+		msg::Buffer makeConnectResponse(const msg::Type type, const msg::OneByteInt version, const SOCKET client, const int userIdx, const std::string& acCode, ServerSiteDocument& doc, const unsigned int lastVersion = 0);
+		void saveDocInDb(ServerSiteDocument& doc);
 		SessionIt getSessionWithDocId(const std::string& id);
 		SessionIt getSessionWithAcCode(const std::string& acCode);
 
@@ -66,6 +158,7 @@ namespace server {
 		SessionIt createNewSession(const std::string& username, T&& doc) {
 			auto acCode = random::Engine::get().getRandomString(6);
 			auto session = acCodeToDocMap.emplace(acCode, std::move(doc));
+			session.first->second.setLastUse(memoryCheck);
 			logger.logDebug("Created new session!");
 			std::scoped_lock lock{acCodesLock, userFileCombinedLock};
 			acCodeSet.insert(acCode);
@@ -73,15 +166,46 @@ namespace server {
 			return session.first;
 		}
 		void deleteSession(const std::string& username, const std::string& acCode, ServerSiteDocument& doc);
+		void cacheClosedDoc(SessionNode&& node, const std::string& username);
+		void dropClosedDoc(std::list<ClosedDoc>::iterator closed);
+		std::optional<SessionNode> takeClosedDoc(const std::string& id);
+		SessionIt reopenSession(const std::string& username, SessionNode&& node);
+		void handOffSession(SessionIt session, Handoff& handoff);
 		void eraseClientFromSession(ServerSiteDocument& doc, const SOCKET client);
-		bool addClientToSession(const SOCKET client, Authenticator::UserData& userAuthData, SessionIt session);
+		bool addClientToSession(const SOCKET client, Authenticator::UserData& userAuthData, SessionIt session, const msg::OneByteInt version, const unsigned int presencePort);
+		bool hasDatagramPresence(ServerSiteDocument& doc) const;
 
-		std::unordered_map<SOCKET, ClientUserData> clientToUserData;
+		std::unordered_map<SOCKET, ClientUserData> clientToUserData; // Keyed by ClientId, one entry per stream of a connection
 		std::unordered_map<std::string, ServerSiteDocument> acCodeToDocMap;
+		std::vector<SnapshotTransfer> snapshotTransfers;
+		std::vector<Replay> pendingReplays;
+		std::set<std::string> editedSessions; // Sessions edited since the last take, worker arms their autosave
+
+		// Bulk work done in steps between interactive messages
+		std::vector<ReplaceJob> replaceJobs; // Sessions with a job are busy, their messages wait in worker
+		std::vector<SaveJob> saveJobs;
+		size_t replaceChunkSegments = 64;
+		size_t saveChunkSize = 256 * 1024;
+
+		// Hibernation, sessions not used for a while keep only a stub in acCodeToDocMap
+		unsigned int memoryCheck = 1; // Counts hibernateSessions calls, sessions remember the one they were last used in
+		size_t hibernatedHistoryDepth = 64; // Undo actions per user kept on disk
+
+		// Recently closed documents, reopening one skips reading and parsing its file
+		std::list<ClosedDoc> closedDocs; // Oldest first
+		size_t closedDocsBytes = 0;
+		size_t closedDocsMaxBytes = 64 * 1024 * 1024;
+		std::chrono::seconds closedDocTtl{ 120 };
+
+		// Presence, moved cursors are broadcast in batches at most once per presenceInterval
+		std::set<std::string> movedCursorSessions;
+		std::unordered_map<std::string, unsigned int> datagramPresenceVersions; // Document version of the last datagram frame with moves
+		std::vector<Response> presenceFrames; // Flushed ahead of a document update, sent before its response
+		std::chrono::milliseconds presenceInterval{ 33 }; // ~30 frames per second
+		std::chrono::steady_clock::time_point lastPresenceFlush;
 
 		// Authentication
 		Authenticator* auth;
-		std::chrono::seconds savingDocInterval{ 300 }; //5min 
 		Database db{};
 
 
@@ -89,5 +213,6 @@ namespace server {
 		std::set<std::string> acCodeSet;
 		std::mutex userFileCombinedLock;
 		std::set<std::string> userFileCombinedSet;
+		std::set<std::string> closedUserFileSet; // Guarded by userFileCombinedLock
 	};
 }
\ No newline at end of file
@@ -8,5 +8,6 @@ namespace server {
 		msg::Buffer buffer;
 		std::vector<SOCKET> destinations;
 		msg::Type msgType;
+		std::vector<Response> variants; // Same update encoded for destinations on other protocol versions
 	};
 }
\ No newline at end of file
@@ -0,0 +1,612 @@
+// Router selects every client and backend connection in one call, the default of 64 sockets would fit only ~30 clients.
+// Its fd_set is local to this file, the header keeps sockets in a set of its own.
+#define FD_SETSIZE 1024
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <thread>
+
+#include "router.h"
+#include "logging.h"
+#include "client_id.h"
+#include "deserializer.h"
+#include "serializer.h"
+#include "compression.h"
+
+using namespace server;
+
+static std::optional<sockaddr_in> makeBackendAddress(const std::string& backend) {
+	auto separator = backend.rfind(':');
+	if (separator == std::string::npos || separator == 0 || separator + 1 == backend.size()) {
+		return {};
+	}
+	auto portStr = backend.substr(separator + 1);
+	if (!std::all_of(portStr.cbegin(), portStr.cend(), [](unsigned char symbol) { return std::isdigit(symbol); }) || portStr.size() > 5) {
+		return {};
+	}
+	sockaddr_in address = { 0 };
+	address.sin_family = AF_INET;
+	address.sin_port = htons(std::stoi(portStr));
+	std::string ip = backend.substr(0, separator);
+	std::wstring ipStr{ ip.begin(), ip.end() };
+	if (InetPton(AF_INET, ipStr.c_str(), &address.sin_addr.s_addr) != 1) {
+		return {};
+	}
+	return address;
+}
+
+static bool isConnectMsg(const msg::Type type) {
+	return type == msg::Type::create || type == msg::Type::load || type == msg::Type::join;
+}
+
+Router::Router(std::string ip, const int port, std::string backendsFile) :
+	ip(ip),
+	port(port),
+	backendsFile(backendsFile) {
+	listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listenSocket == INVALID_SOCKET) {
+		logger.logError(WSAGetLastError(), ": Error when creating listening socket");
+		return;
+	}
+	listenSocketAddress.sin_family = AF_INET;
+	listenSocketAddress.sin_port = htons(port);
+	std::wstring ipStr{ ip.begin(), ip.end() };
+	InetPton(AF_INET, ipStr.c_str(), &listenSocketAddress.sin_addr.s_addr);
+	if (bind(listenSocket, reinterpret_cast<SOCKADDR*>(&listenSocketAddress), sizeof(listenSocketAddress)) == SOCKET_ERROR) {
+		logger.logError(WSAGetLastError(), ": Error when binding listening socket");
+	}
+}
+
+bool Router::open() {
+	reloadBackends();
+	if (!backendsWriteTime.has_value()) {
+		logger.logError("Cannot read backends from", backendsFile);
+		return false;
+	}
+	if (listen(listenSocket, SOMAXCONN)) {
+		logger.logError(WSAGetLastError(), ": Error when starting listening");
+		return false;
+	}
+	logger.logInfo("Router opened for listening with", ring.size(), "backends.");
+	state = State::opened;
+	return true;
+}
+
+void Router::start() {
+	addSocket(listenSocket);
+	while (state == State::opened) {
+		FD_SET ready = { 0 }, writable = { 0 }, failed = { 0 };
+		for (const auto socket : sockets) {
+			FD_SET(socket, &ready);
+		}
+		// Backend connects complete as writable and fail as exceptions
+		for (const auto socket : connectingBackends) {
+			FD_SET(socket, &writable);
+			FD_SET(socket, &failed);
+		}
+		// Queued frames wait until their socket buffer takes them
+		for (const auto& [socket, queue] : outboundQueues) {
+			if (!queue.empty()) {
+				FD_SET(socket, &writable);
+			}
+		}
+		// Router wakes up at least every housekeeping interval to pick up changes of the backends file
+		timeval tick{ 0, static_cast<long>(std::chrono::microseconds(housekeepingInterval).count()) };
+		int selectCount = select(0, &ready, &writable, &failed, &tick);
+		if (selectCount > 0) {
+			completeBackendConnects(writable, failed);
+			flushOutbound(writable);
+		}
+		for (int i = 0; selectCount > 0 && i < ready.fd_count; i++) {
+			SOCKET socket = ready.fd_array[i];
+			// Backend connections are closed together with their client, it could happen earlier in this iteration
+			if (!sockets.contains(socket) || acceptConnection(socket)) {
+				continue;
+			}
+			auto backend = backendToClient.find(socket);
+			bool fromBackend = backend != backendToClient.end();
+			SOCKET client = fromBackend ? backend->second : socket;
+			std::vector<msg::OneByteInt> streams;
+			auto msgs = extractor.extractMessages(socket, streams);
+			for (int j = 0; j < msgs.size() && sockets.contains(socket); j++) {
+				auto& buffer = msgs[j];
+				if (buffer.size <= 0) {
+					if (buffer.size < 0) {
+						logger.logError(WSAGetLastError(), ": Error on receiving data from", socket, "! Closing connection");
+					}
+					if (fromBackend) {
+						closeBackend(client, socket);
+					}
+					else {
+						closeConnection(client);
+					}
+					break;
+				}
+				msg::OneByteInt stream = j < streams.size() ? streams[j] : 0;
+				if (fromBackend) {
+					processBackendMsg(client, socket, buffer, stream);
+				}
+				else {
+					processClientMsg(client, buffer, stream);
+				}
+			}
+		}
+		closeStalled();
+		reloadBackends();
+	}
+	state = State::closed;
+}
+
+bool Router::close() {
+	logger.logDebug("Got signal for close. Closing router...");
+	state = State::closing;
+	for (int attempt = 0; state != State::closed && attempt < 10; attempt++) {
+		std::this_thread::sleep_for(housekeepingInterval);
+	}
+	while (!connections.empty()) {
+		closeConnection(connections.begin()->first);
+	}
+	closesocket(listenSocket);
+	return true;
+}
+
+bool Router::acceptConnection(const SOCKET client) {
+	if (client != listenSocket) {
+		return false;
+	}
+	SOCKET newConnection = accept(listenSocket, nullptr, nullptr);
+	if (newConnection == INVALID_SOCKET) {
+		logger.logError(WSAGetLastError(), ": Error when accepting new connection");
+		return true;
+	}
+	if (!addSocket(newConnection)) {
+		closesocket(newConnection);
+		return true;
+	}
+	connections.emplace(newConnection, Connection{});
+	return true;
+}
+
+bool Router::addSocket(const SOCKET socket) {
+	if (sockets.size() >= FD_SETSIZE) {
+		logger.logError("Cannot select more than", FD_SETSIZE, "sockets, refusing connection", socket);
+		return false;
+	}
+	sockets.insert(socket);
+	return true;
+}
+
+void Router::processClientMsg(const SOCKET client, msg::Buffer& buffer, const msg::OneByteInt stream) {
+	msg::Type type;
+	msg::OneByteInt version;
+	msg::parse(buffer, 0, type, version);
+	auto& connection = connections[client];
+	switch (type) {
+	case msg::Type::login:
+	case msg::Type::logout:
+	case msg::Type::registration:
+	case msg::Type::getDocNames:
+	case msg::Type::delDoc: {
+		if (type == msg::Type::logout) {
+			closeBackends(client);
+			connection.login.reset();
+		}
+		auto login = type == msg::Type::login ? Deserializer::parseLogin(buffer) : std::nullopt;
+		auto response = auth.process(client, buffer);
+		// Backends get the same credentials when the client opens its first session on them
+		if (login.has_value() && !connection.login.has_value() && !auth.getAuthToken(client).empty()) {
+			connection.login = std::move(login);
+		}
+		for (const auto& dst : response.destinations) {
+			sendFrame(getConnection(dst), response.buffer, stream);
+		}
+		return;
+	}
+	case msg::Type::create:
+	case msg::Type::load:
+	case msg::Type::join:
+		routeSession(client, buffer, stream);
+		return;
+	case msg::Type::heartbeat:
+		return; // Router answers heartbeats of backends itself, clients are not asked
+	case msg::Type::disconnect:
+		forward(client, buffer, stream);
+		leaveSession(connection, stream);
+		return;
+	}
+	forward(client, buffer, stream);
+}
+
+void Router::processBackendMsg(const SOCKET client, const SOCKET backend, msg::Buffer& buffer, const msg::OneByteInt stream) {
+	auto& backends = connections[client].backends;
+	auto backendIt = std::find_if(backends.begin(), backends.end(), [backend](const auto& entry) { return entry.second.socket == backend; });
+	if (backendIt == backends.end()) {
+		return;
+	}
+	msg::Type type;
+	msg::parse(buffer, 0, type);
+	if (type == msg::Type::heartbeat) {
+		sendFrame(backend, Serializer::makeHeartbeat(msg::currentVersion), stream);
+		return;
+	}
+	if (backendIt->second.authToken.empty() && type == msg::Type::login) {
+		completeLogin(client, backendIt->second, buffer);
+		return;
+	}
+	if (isConnectMsg(type)) {
+		completeConnect(client, buffer, stream);
+	}
+	// Client which falls behind on updates is closed, it resumes its sessions from the backend after reconnecting
+	sendFrame(client, buffer, stream, msg::isDocumentUpdate(type));
+}
+
+void Router::routeSession(const SOCKET client, msg::Buffer& frame, const msg::OneByteInt stream) {
+	// Router parses the connect frame to pick the backend, a compressed one is opened first and forwarded raw
+	auto rawBuffer = msg::decompressFrame(frame);
+	if (!rawBuffer && msg::isCompressedFrame(frame)) {
+		logger.logError("Malformed compressed message from", client);
+		return;
+	}
+	auto& buffer = rawBuffer ? rawBuffer.value() : frame;
+	msg::Type type;
+	msg::OneByteInt version;
+	msg::parse(buffer, 0, type, version);
+	auto& connection = connections[client];
+	if (!connection.login.has_value()) {
+		sendFrame(client, Serializer::makeConnectResponseWithError(type, "User is not logged in!", version), stream);
+		return;
+	}
+	// Stream may be reused for another document
+	leaveSession(connection, stream);
+	Stream route;
+	auto backend = selectBackend(client, buffer, route);
+	auto backendConnection = backend.has_value() ? connectBackend(client, backend.value()) : nullptr;
+	if (backendConnection == nullptr) {
+		sendFrame(client, Serializer::makeConnectResponseWithError(type, "No server is available, try again later!", version), stream);
+		return;
+	}
+	route.backend = backend.value();
+	connection.streams.emplace(stream, std::move(route));
+	sendToBackend(client, *backendConnection, buffer, stream);
+}
+
+std::optional<std::string> Router::selectBackend(const SOCKET client, const msg::Buffer& buffer, Stream& route) {
+	msg::Type type;
+	msg::parse(buffer, 0, type);
+	if (type == msg::Type::join) {
+		auto msg = Deserializer::parseConnectJoinDoc(buffer);
+		// Malformed frame or unknown session, the backend answers with an error
+		auto session = msg ? sessions.find(msg->acCode) : sessions.end();
+		if (session != sessions.end()) {
+			route.docId = session->second.docId;
+			return session->second.backend;
+		}
+		return ring.owner(msg ? msg->acCode : "");
+	}
+	auto parsed = Deserializer::parseConnectCreateDoc(buffer);
+	if (!parsed) {
+		// Backend answers the malformed frame with an error
+		return ring.owner("");
+	}
+	auto& msg = parsed.value();
+	auto username = auth.getUserData(client).username;
+	route.filename = msg.filename;
+	if (type == msg::Type::load) {
+		if (auto dbDoc = db.getDocWithUsernameAndFilename(username, msg.filename)) {
+			route.docId = dbDoc.value().id;
+			auto live = liveDocs.find(route.docId);
+			if (live != liveDocs.end()) {
+				return sessions[live->second].backend;
+			}
+			return ring.owner(dbDoc.value().getRouteKey());
+		}
+	}
+	// New document gets its id on the backend, which stores this key with it for the later loads
+	return ring.owner(DBDocument::makeRouteKey(username, msg.filename));
+}
+
+void Router::forward(const SOCKET client, msg::Buffer& buffer, const msg::OneByteInt stream) {
+	auto& connection = connections[client];
+	auto route = connection.streams.find(stream);
+	if (route == connection.streams.end()) {
+		logger.logDebug("Session of", client, "on stream", static_cast<int>(stream), "not found");
+		return;
+	}
+	auto backend = connection.backends.find(route->second.backend);
+	if (backend != connection.backends.end()) {
+		sendToBackend(client, backend->second, buffer, stream);
+	}
+}
+
+void Router::sendToBackend(const SOCKET client, BackendConnection& backend, msg::Buffer& buffer, const msg::OneByteInt stream) {
+	if (backend.authToken.empty()) {
+		backend.pending.push_back(std::move(buffer));
+		backend.pendingStreams.push_back(stream);
+		return;
+	}
+	msg::Type type;
+	msg::OneByteInt version;
+	int pos = msg::parse(buffer, 0, type, version);
+	if (msg::carriesAuthToken(version) && !isConnectMsg(type)) {
+		// Older clients sign modifiers with the token of the router, the backend issued its own one of the same length
+		std::string authToken;
+		msg::parse(buffer, pos, authToken);
+		if (authToken != auth.getAuthToken(client) || authToken.size() != backend.authToken.size()) {
+			logger.logError("Cannot authenticate user", client);
+			return;
+		}
+		memcpy(buffer.get() + pos, backend.authToken.data(), backend.authToken.size());
+	}
+	sendFrame(backend.socket, buffer, stream);
+}
+
+Router::BackendConnection* Router::connectBackend(const SOCKET client, const std::string& backend) {
+	auto& connection = connections[client];
+	auto existing = connection.backends.find(backend);
+	if (existing != connection.backends.end()) {
+		return &existing->second;
+	}
+	auto address = makeBackendAddress(backend);
+	SOCKET socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (socket == INVALID_SOCKET) {
+		logger.logError(WSAGetLastError(), ": Error when creating socket for backend", backend);
+		return nullptr;
+	}
+	// Connect must not stall other clients, messages wait in pending until it completes and the backend answers the login
+	u_long nonBlocking = 1;
+	if (!address.has_value() || ioctlsocket(socket, FIONBIO, &nonBlocking) == SOCKET_ERROR ||
+		(connect(socket, reinterpret_cast<SOCKADDR*>(&address.value()), sizeof(address.value())) == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK)) {
+		logger.logError(WSAGetLastError(), ": Error when connecting to backend", backend);
+		closesocket(socket);
+		return nullptr;
+	}
+	if (!addSocket(socket)) {
+		closesocket(socket);
+		return nullptr;
+	}
+	auto [inserted, newOne] = connection.backends.emplace(backend, BackendConnection{ socket });
+	backendToClient.emplace(socket, client);
+	connectingBackends.insert(socket);
+	logger.logDebug("Connection", client, "is connecting to backend", backend);
+	return &inserted->second;
+}
+
+void Router::completeBackendConnects(const FD_SET& connected, const FD_SET& failed) {
+	for (int i = 0; i < failed.fd_count; i++) {
+		auto client = backendToClient.find(failed.fd_array[i]);
+		if (client != backendToClient.end()) {
+			logger.logError("Cannot connect backend", failed.fd_array[i], "for connection", client->second);
+			closeBackend(client->second, failed.fd_array[i]);
+		}
+	}
+	for (int i = 0; i < connected.fd_count; i++) {
+		SOCKET socket = connected.fd_array[i];
+		auto client = backendToClient.find(socket);
+		if (!connectingBackends.erase(socket) || client == backendToClient.end()) {
+			continue; // Failed or closed earlier in this iteration
+		}
+		auto& connection = connections[client->second];
+		// Backend authenticates the connection on its own, it gets the login of the client
+		sendFrame(socket, msg::serialize(connection.login.value()), 0);
+		logger.logDebug("Connection", client->second, "has been connected to backend", socket);
+	}
+}
+
+void Router::completeLogin(const SOCKET client, BackendConnection& backend, const msg::Buffer& buffer) {
+	auto response = msg::deserialize<msg::LoginResponse>(buffer);
+	if (!response || !response->errMsg.empty() || response->authToken.empty()) {
+		logger.logError("Backend refused login of", client, ":", response ? response->errMsg : "malformed response");
+		closeBackend(client, backend.socket);
+		return;
+	}
+	backend.authToken = std::move(response->authToken);
+	auto pending = std::move(backend.pending);
+	auto pendingStreams = std::move(backend.pendingStreams);
+	for (int i = 0; i < pending.size(); i++) {
+		sendToBackend(client, backend, pending[i], pendingStreams[i]);
+	}
+}
+
+void Router::completeConnect(const SOCKET client, const msg::Buffer& buffer, const msg::OneByteInt stream) {
+	auto& connection = connections[client];
+	auto route = connection.streams.find(stream);
+	// Connect messages also announce other users joining the session, only the answer to this stream completes it
+	if (route == connection.streams.end() || !route->second.acCode.empty()) {
+		return;
+	}
+	auto decompressed = msg::decompressFrame(buffer);
+	auto parsed = msg::deserialize<msg::ConnectResponse>(decompressed.has_value() ? decompressed.value() : buffer);
+	if (!parsed || !parsed->error.empty()) {
+		connection.streams.erase(route);
+		return;
+	}
+	auto& response = parsed.value();
+	auto& session = sessions[response.acCode];
+	if (session.clients == 0) {
+		session.backend = route->second.backend;
+		session.docId = route->second.docId;
+		if (session.docId.empty() && !route->second.filename.empty()) {
+			auto dbDoc = db.getDocWithUsernameAndFilename(auth.getUserData(client).username, route->second.filename);
+			session.docId = dbDoc.has_value() ? dbDoc.value().id : "";
+		}
+		if (!session.docId.empty()) {
+			liveDocs[session.docId] = response.acCode;
+		}
+	}
+	session.clients++;
+	route->second.acCode = std::move(response.acCode);
+	route->second.docId = session.docId;
+}
+
+void Router::leaveSession(Connection& connection, const msg::OneByteInt stream) {
+	auto route = connection.streams.find(stream);
+	if (route == connection.streams.end()) {
+		return;
+	}
+	auto session = sessions.find(route->second.acCode);
+	if (session != sessions.end() && --session->second.clients <= 0) {
+		// Document is no longer pinned, its next session goes where the ring says
+		auto live = liveDocs.find(session->second.docId);
+		if (live != liveDocs.end() && live->second == session->first) {
+			liveDocs.erase(live);
+		}
+		sessions.erase(session);
+	}
+	connection.streams.erase(route);
+}
+
+void Router::closeBackend(const SOCKET client, const SOCKET backend) {
+	auto& connection = connections[client];
+	auto backendIt = std::find_if(connection.backends.begin(), connection.backends.end(), [backend](const auto& entry) { return entry.second.socket == backend; });
+	if (backendIt == connection.backends.end()) {
+		return;
+	}
+	auto name = backendIt->first;
+	releaseBackend(backendIt->second);
+	connection.backends.erase(backendIt);
+	// Only sessions of the dropped backend fail, the ones on other backends keep going
+	std::vector<msg::OneByteInt> failedStreams;
+	for (const auto& [stream, route] : connection.streams) {
+		if (route.backend == name) {
+			failedStreams.push_back(stream);
+		}
+	}
+	if (!failedStreams.empty() && failedStreams.size() == connection.streams.size()) {
+		// Nothing else uses the connection, the client resumes its sessions after reconnecting
+		closeConnection(client);
+		return;
+	}
+	for (auto stream : failedStreams) {
+		leaveSession(connection, stream);
+		sendFrame(client, Serializer::makeConnectResponseWithError(msg::Type::join, "Server of the document is unavailable, join it again!", 1), stream);
+	}
+}
+
+void Router::closeBackends(const SOCKET client) {
+	auto& connection = connections[client];
+	for (auto& [name, backend] : connection.backends) {
+		releaseBackend(backend);
+	}
+	connection.backends.clear();
+	while (!connection.streams.empty()) {
+		leaveSession(connection, connection.streams.begin()->first);
+	}
+}
+
+void Router::releaseBackend(const BackendConnection& backend) {
+	closesocket(backend.socket);
+	sockets.erase(backend.socket);
+	outboundQueues.erase(backend.socket);
+	stalledSockets.erase(backend.socket);
+	connectingBackends.erase(backend.socket);
+	backendToClient.erase(backend.socket);
+	extractor.reset(backend.socket);
+}
+
+void Router::closeConnection(const SOCKET client) {
+	logger.logDebug("Closing connection with", client);
+	closeBackends(client);
+	connections.erase(client);
+	closesocket(client);
+	sockets.erase(client);
+	outboundQueues.erase(client);
+	stalledSockets.erase(client);
+	extractor.reset(client);
+	msg::Buffer buffer{ 8 };
+	msg::serializeTo(buffer, 0, msg::Type::logout, static_cast<msg::OneByteInt>(1));
+	auth.process(client, buffer);
+}
+
+void Router::closeStalled() {
+	auto stalled = std::move(stalledSockets);
+	stalledSockets.clear();
+	for (const auto socket : stalled) {
+		if (!sockets.contains(socket)) {
+			continue;
+		}
+		auto backend = backendToClient.find(socket);
+		if (backend != backendToClient.end()) {
+			logger.logError("Backend connection", socket, "does not keep up, closing it");
+			closeBackend(backend->second, socket);
+			continue;
+		}
+		logger.logError("Connection", socket, "does not keep up, closing it");
+		closeConnection(socket);
+	}
+}
+
+void Router::reloadBackends() {
+	auto now = std::chrono::steady_clock::now();
+	if (now - backendsCheckedAt < backendsCheckInterval) {
+		return;
+	}
+	backendsCheckedAt = now;
+	std::error_code errCode;
+	auto writeTime = std::filesystem::last_write_time(backendsFile, errCode);
+	if (errCode || writeTime == backendsWriteTime) {
+		return;
+	}
+	std::ifstream file{ backendsFile };
+	if (!file.is_open()) {
+		return;
+	}
+	backendsWriteTime = writeTime;
+	// One ip:port per line, lines starting with # are skipped
+	std::vector<std::string> backends;
+	std::string line;
+	while (std::getline(file, line)) {
+		std::erase_if(line, [](unsigned char symbol) { return std::isspace(symbol); });
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		if (!makeBackendAddress(line).has_value()) {
+			logger.logError("Skipping backend with invalid address", line);
+			continue;
+		}
+		backends.push_back(line);
+	}
+	// Live sessions of a removed backend stay on it until they end
+	for (const auto& backend : ring.getBackends()) {
+		if (std::find(backends.cbegin(), backends.cend(), backend) == backends.cend()) {
+			ring.remove(backend);
+			logger.logInfo("Backend", backend, "removed from the ring");
+		}
+	}
+	for (const auto& backend : backends) {
+		if (!ring.contains(backend)) {
+			ring.add(backend);
+			logger.logInfo("Backend", backend, "added to the ring");
+		}
+	}
+}
+
+void Router::sendFrame(const SOCKET socket, const msg::Buffer& buffer, const msg::OneByteInt stream, const bool droppable) {
+	msg::Buffer frame = msg::enrich(buffer, stream);
+	if (frame.empty()) {
+		logger.logError("Message to", socket, "exceeds the frame size limit, it is not sent");
+		return;
+	}
+	auto [queue, newOne] = outboundQueues.try_emplace(socket, socket, outboundWatermarks);
+	if (newOne) {
+		// One slow client or backend must not block routing of the others
+		u_long nonBlocking = 1;
+		if (ioctlsocket(socket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+			logger.logError(WSAGetLastError(), ": Error on switching", socket, "to non-blocking mode");
+		}
+	}
+	// Router cannot resync a client itself, one that lost an update or stopped reading is closed
+	if (!queue->second.push(frame, droppable) || queue->second.size() > outboundWatermarks.highFrames) {
+		stalledSockets.insert(socket);
+	}
+}
+
+void Router::flushOutbound(const FD_SET& writable) {
+	for (int i = 0; i < writable.fd_count; i++) {
+		auto queue = outboundQueues.find(writable.fd_array[i]);
+		if (queue != outboundQueues.end() && !queue->second.flush()) {
+			stalledSockets.insert(queue->first);
+		}
+	}
+}
\ No newline at end of file
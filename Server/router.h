@@ -0,0 +1,99 @@
+#pragma once
+#include <WinSock2.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <optional>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+
+#include "messages.h"
+#include "message_extractor.h"
+#include "authenticator.h"
+#include "database.h"
+#include "hash_ring.h"
+#include "outbound_queue.h"
+
+// Front of several server processes sharing one database. Clients log in at the router, their sessions go to the backend
+// owning the document on the hash ring. Live documents stay on their backend, so collaborators always meet on the same one.
+class Router {
+public:
+	Router(std::string ip, const int port, std::string backendsFile);
+
+	bool open();
+	void start();
+	bool close();
+private:
+	enum class State {opened, closing, closed};
+	// Connection of one client to one backend, logged in with the client's credentials
+	struct BackendConnection {
+		SOCKET socket;
+		std::string authToken; // Empty until the backend answers the login
+		std::vector<msg::Buffer> pending; // Messages waiting for the login
+		std::vector<msg::OneByteInt> pendingStreams;
+	};
+	struct Stream {
+		std::string backend;
+		std::string acCode; // Empty until the backend answers the connect message
+		std::string filename;
+		std::string docId;
+	};
+	struct Connection {
+		std::optional<msg::Login> login;
+		std::unordered_map<std::string, BackendConnection> backends;
+		std::unordered_map<msg::OneByteInt, Stream> streams;
+	};
+	struct Session {
+		std::string backend;
+		std::string docId;
+		int clients = 0;
+	};
+	bool acceptConnection(const SOCKET client);
+	bool addSocket(const SOCKET socket);
+	void processClientMsg(const SOCKET client, msg::Buffer& buffer, const msg::OneByteInt stream);
+	void processBackendMsg(const SOCKET client, const SOCKET backend, msg::Buffer& buffer, const msg::OneByteInt stream);
+	void routeSession(const SOCKET client, msg::Buffer& buffer, const msg::OneByteInt stream);
+	std::optional<std::string> selectBackend(const SOCKET client, const msg::Buffer& buffer, Stream& route);
+	void forward(const SOCKET client, msg::Buffer& buffer, const msg::OneByteInt stream);
+	void sendToBackend(const SOCKET client, BackendConnection& backend, msg::Buffer& buffer, const msg::OneByteInt stream);
+	BackendConnection* connectBackend(const SOCKET client, const std::string& backend);
+	void completeBackendConnects(const FD_SET& connected, const FD_SET& failed);
+	void completeLogin(const SOCKET client, BackendConnection& backend, const msg::Buffer& buffer);
+	void completeConnect(const SOCKET client, const msg::Buffer& buffer, const msg::OneByteInt stream);
+	void leaveSession(Connection& connection, const msg::OneByteInt stream);
+	void closeBackend(const SOCKET client, const SOCKET backend);
+	void closeBackends(const SOCKET client);
+	void releaseBackend(const BackendConnection& backend);
+	void closeConnection(const SOCKET client);
+	void closeStalled();
+	void reloadBackends();
+	void sendFrame(const SOCKET socket, const msg::Buffer& buffer, const msg::OneByteInt stream, const bool droppable = false);
+	void flushOutbound(const FD_SET& writable);
+
+	std::atomic<State> state = State::closed;
+	const std::string ip;
+	const int port;
+	const std::string backendsFile;
+	SOCKET listenSocket = INVALID_SOCKET;
+	sockaddr_in listenSocketAddress = { 0 };
+	std::unordered_set<SOCKET> sockets; // Listen socket, clients and their backend connections, all selected at once
+
+	std::unordered_map<SOCKET, Connection> connections;
+	std::unordered_map<SOCKET, SOCKET> backendToClient;
+	std::unordered_set<SOCKET> connectingBackends; // Connect is non-blocking, the login is sent once it completes
+	std::unordered_map<SOCKET, server::OutboundQueue> outboundQueues; // Every socket is non-blocking, what it doesn't take waits here
+	server::OutboundQueue::Watermarks outboundWatermarks;
+	std::unordered_set<SOCKET> stalledSockets; // Dropped frames or don't read, closed at the end of the loop iteration
+	std::unordered_map<std::string, Session> sessions; // By access code
+	std::unordered_map<std::string, std::string> liveDocs; // Document id to access code of its session
+	server::HashRing ring;
+	std::optional<std::filesystem::file_time_type> backendsWriteTime;
+	std::chrono::steady_clock::time_point backendsCheckedAt;
+	std::chrono::milliseconds housekeepingInterval{ 100 };
+	std::chrono::milliseconds backendsCheckInterval{ 1000 };
+	MessageExtractor extractor;
+	server::Authenticator auth;
+	server::Database db{};
+};
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include <set>
+
+#include "scheduler.h"
+#include "client_id.h"
+
+namespace server {
+	Scheduler::Scheduler(const Budget& budget) :
+		budget(budget) {}
+
+	Scheduler::Priority Scheduler::classify(const msg::Buffer& buffer) const {
+		if (buffer.size <= 0) {
+			return Priority::interactive;
+		}
+		msg::Type type;
+		msg::parse(buffer, 0, type);
+		// Session requests read documents from db and build snapshots
+		if (type == msg::Type::create || type == msg::Type::load || type == msg::Type::join) {
+			return Priority::bulk;
+		}
+		return buffer.size > budget.bulkMessageBytes ? Priority::bulk : Priority::interactive;
+	}
+
+	void Scheduler::push(const SOCKET client, const std::string& session, msg::Buffer&& buffer, const bool sessionBusy, const bool rejected) {
+		auto queued = queuedBulk.find(session);
+		bool behindBulk = sessionBusy || (queued != queuedBulk.end() && queued->second > 0);
+		if (!behindBulk && classify(buffer) == Priority::interactive) {
+			interactiveTasks.emplace_back(Task{ client, session, std::move(buffer), rejected });
+			counters.interactive++;
+			return;
+		}
+		bulkTasks.emplace_back(Task{ client, session, std::move(buffer), rejected });
+		queuedBulk[session]++;
+		counters.bulk++;
+	}
+
+	std::deque<Scheduler::Task> Scheduler::takeInteractive() {
+		return std::move(interactiveTasks);
+	}
+
+	std::optional<Scheduler::Task> Scheduler::takeBulk(const BusyCheck& isBusy) {
+		// Task of a busy session blocks the tasks of that session behind it, other sessions go on
+		std::set<std::string> blockedSessions;
+		for (auto task = bulkTasks.begin(); task != bulkTasks.end(); task++) {
+			if (blockedSessions.contains(task->session)) {
+				continue;
+			}
+			if (isBusy(task->session)) {
+				blockedSessions.insert(task->session);
+				continue;
+			}
+			auto queued = queuedBulk.find(task->session);
+			if (--queued->second == 0) {
+				queuedBulk.erase(queued);
+			}
+			std::optional<Task> next{ std::move(*task) };
+			bulkTasks.erase(task);
+			return next;
+		}
+		return {};
+	}
+
+	std::vector<Scheduler::Task> Scheduler::takeConnection(const SOCKET connection) {
+		std::vector<Task> tasks;
+		std::deque<Task> otherInteractive;
+		for (auto& task : interactiveTasks) {
+			if (getConnection(task.client) == connection) {
+				tasks.emplace_back(std::move(task));
+				continue;
+			}
+			otherInteractive.emplace_back(std::move(task));
+		}
+		interactiveTasks = std::move(otherInteractive);
+		for (auto task = bulkTasks.begin(); task != bulkTasks.end();) {
+			if (getConnection(task->client) != connection) {
+				task++;
+				continue;
+			}
+			auto queued = queuedBulk.find(task->session);
+			if (--queued->second == 0) {
+				queuedBulk.erase(queued);
+			}
+			tasks.emplace_back(std::move(*task));
+			task = bulkTasks.erase(task);
+		}
+		return tasks;
+	}
+
+	bool Scheduler::hasBulk() const {
+		return !bulkTasks.empty();
+	}
+
+	size_t Scheduler::size() const {
+		return interactiveTasks.size() + bulkTasks.size();
+	}
+
+	std::chrono::microseconds Scheduler::getBulkSlice() const {
+		return budget.bulkSlice;
+	}
+
+	const Scheduler::Counters& Scheduler::getCounters() const {
+		return counters;
+	}
+}
\ No newline at end of file
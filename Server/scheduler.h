@@ -0,0 +1,56 @@
+#pragma once
+#include <WinSock2.h>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "messages.h"
+
+namespace server {
+	// Cooperative scheduling of worker messages in two classes. Interactive messages (keystrokes, cursor moves)
+	// run first, bulk ones (big pastes and replaces, session requests) run afterwards in time slices.
+	// Messages of one session keep their order, everything behind a bulk message waits with it.
+	class Scheduler {
+	public:
+		enum class Priority {
+			interactive,
+			bulk
+		};
+		struct Budget {
+			std::chrono::microseconds bulkSlice{ 2000 }; // Bulk work per worker iteration
+			int bulkMessageBytes = 2048; // Bigger messages are bulk
+		};
+		struct Counters {
+			unsigned int interactive = 0;
+			unsigned int bulk = 0;
+		};
+		struct Task {
+			SOCKET client;
+			std::string session;
+			msg::Buffer buffer;
+			bool rejected = false; // Rejected by rate limiter, answered in order with the rest
+		};
+		using BusyCheck = std::function<bool(const std::string& session)>;
+		Scheduler(const Budget& budget);
+
+		Priority classify(const msg::Buffer& buffer) const;
+		void push(const SOCKET client, const std::string& session, msg::Buffer&& buffer, const bool sessionBusy, const bool rejected = false);
+		std::deque<Task> takeInteractive();
+		std::optional<Task> takeBulk(const BusyCheck& isBusy);
+		std::vector<Task> takeConnection(const SOCKET connection);
+		bool hasBulk() const;
+		size_t size() const;
+		std::chrono::microseconds getBulkSlice() const;
+		const Counters& getCounters() const;
+	private:
+		Budget budget;
+		Counters counters;
+		std::deque<Task> interactiveTasks;
+		std::list<Task> bulkTasks;
+		std::unordered_map<std::string, unsigned int> queuedBulk; // Bulk tasks per session
+	};
+}
\ No newline at end of file
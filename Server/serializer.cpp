@@ -1,80 +1,91 @@
 #include "serializer.h"
 
 msg::Buffer Serializer::makeAckResponse(const msg::Type& type, const msg::OneByteInt version, const std::string& errMsg) {
-	int size = errMsg.size() + 6;
-	msg::Buffer buffer{size};
-	msg::serializeTo(buffer, 0, type, version, errMsg);
-	return buffer;
+	return msg::serialize(msg::AckResponse{ type, version, errMsg });
 }
 
 msg::Buffer Serializer::makeGetNamesResponse(const msg::OneByteInt version, const std::string& errMsg, const std::vector<std::string>& docNames) {
-	int size = errMsg.size();
-	for (const auto& name : docNames) {
-		size += name.size();
-	}
-	msg::Buffer buffer{size + 10};
-	msg::serializeTo(buffer, 0, msg::Type::getDocNames, version, errMsg, docNames);
-	return buffer;
+	return msg::serialize(msg::GetDocNamesResponse{ msg::Type::getDocNames, version, errMsg, docNames });
 }
 
 msg::Buffer Serializer::makeLoginResponse(const msg::OneByteInt version, const std::string& authToken, const std::string& errMsg) {
-	msg::Buffer buffer{static_cast<int>(authToken.size() + errMsg.size() + 5)};
-	msg::serializeTo(buffer, 0, msg::Type::login, version, errMsg, authToken);
-	return buffer;
+	return msg::serialize(msg::LoginResponse{ msg::Type::login, version, errMsg, authToken });
 }
 
 msg::Buffer Serializer::makeRegisterResponse(const msg::OneByteInt version, const std::string& errMsg) {
-	msg::Buffer buffer{static_cast<int>(errMsg.size() + 5)};
-	msg::serializeTo(buffer, 0, msg::Type::registration, version, errMsg);
-	return buffer;
+	return msg::serialize(msg::RegisterResponse{ msg::Type::registration, version, errMsg });
 }
 
-msg::Buffer Serializer::makeConnectResponse(const msg::Type& type, const ServerSiteDocument& doc, const msg::OneByteInt version, const int userIdx, const std::string& acCode) {
-	std::vector<unsigned int> cursorPositions;
-	for (const auto& cursorPos : doc.getCursorPositions()) {
-		cursorPositions.push_back(static_cast<unsigned int>(cursorPos.X));
-		cursorPositions.push_back(static_cast<unsigned int>(cursorPos.Y));
+static std::vector<unsigned int> flattenCoords(const std::vector<COORD>& coords) {
+	std::vector<unsigned int> values;
+	values.reserve(coords.size() * 2);
+	for (const auto& pos : coords) {
+		values.push_back(static_cast<unsigned int>(pos.X));
+		values.push_back(static_cast<unsigned int>(pos.Y));
 	}
-	std::string docText = doc.getText();
-	msg::Buffer buffer{static_cast<int>(30 + docText.size() + 8 * cursorPositions.size() + acCode.size())};
-	auto userBuff = static_cast<msg::OneByteInt>(userIdx);
-	std::string errMsg;
-	msg::serializeTo(buffer, 0, type, version, userBuff, errMsg, acCode, docText, cursorPositions);
-	return buffer;
+	return values;
+}
+
+msg::Buffer Serializer::makeConnectResponse(const msg::Type& type, const ServerSiteDocument& doc, const msg::OneByteInt version, const int userIdx, const std::string& acCode, const bool streamText) {
+	auto text = doc.getTextSnapshot();
+	msg::ConnectResponseView response{ type, version, static_cast<msg::OneByteInt>(userIdx), "", acCode, streamText ? std::string_view{} : std::string_view{ *text },
+		flattenCoords(doc.getCursorPositions()), flattenCoords(doc.getEditAnchors()), doc.getVersion(), streamText ? static_cast<unsigned int>(text->size()) : 0 };
+	return msg::serialize(response);
+}
+
+msg::Buffer Serializer::makeResumeResponse(const msg::Type& type, const ServerSiteDocument& doc, const msg::OneByteInt version, const int userIdx, const std::string& acCode, const unsigned int replayedOps) {
+	return msg::serialize(msg::ConnectResponse{ type, version, static_cast<msg::OneByteInt>(userIdx), "", acCode, "", {}, {}, doc.getVersion(), 0, replayedOps });
 }
 
 msg::Buffer Serializer::makeConnectResponseWithError(const msg::Type& type, const std::string& errorMsg, const msg::OneByteInt version) {
-	msg::Buffer buffer{static_cast<int>(30 + errorMsg.size())};
-	msg::OneByteInt userBuff = 0;
-	std::string acCode, docText;
-	std::vector<unsigned int> cursorPositions;
-	msg::serializeTo(buffer, 0, type, version, userBuff, errorMsg, acCode, docText, cursorPositions);
+	return msg::serialize(msg::ConnectResponse{ type, version, 0, errorMsg });
+}
+
+msg::Buffer Serializer::makeSnapshotChunk(const msg::OneByteInt version, const unsigned int snapshotVersion, const unsigned int offset, const std::string_view text) {
+	return msg::serialize(msg::SnapshotChunkView{ msg::Type::snapshotChunk, version, snapshotVersion, offset, text });
+}
+
+msg::Buffer Serializer::makeUserConnectedResponse() {
+	msg::Buffer buffer{2};
+	msg::serializeTo(buffer, 0, msg::Type::connect, static_cast<msg::OneByteInt>(1));
 	return buffer;
 }
 
+msg::Buffer Serializer::makeRejectResponse(const msg::OneByteInt version, const unsigned int seq) {
+	return msg::serialize(msg::Reject{ msg::Type::reject, version, seq });
+}
+
+msg::Buffer Serializer::makeHeartbeat(const msg::OneByteInt version) {
+	return msg::serialize(msg::ControlMessage{ msg::Type::heartbeat, version, "" });
+}
+
+msg::Buffer Serializer::makePresenceResponse(const msg::OneByteInt version, const ServerSiteDocument& doc, const std::vector<int>& users, const unsigned int seq) {
+	msg::Presence response{ msg::Type::presence, version, {}, seq, doc.getVersion() };
+	response.cursors.reserve(users.size() * msg::presenceStride);
+	for (int userIdx : users) {
+		auto cursorPos = doc.getCursorPos(userIdx);
+		auto anchor = doc.getCursorSelectionAnchor(userIdx);
+		response.cursors.insert(response.cursors.end(), { static_cast<unsigned int>(userIdx),
+			static_cast<unsigned int>(cursorPos.X), static_cast<unsigned int>(cursorPos.Y), anchor.has_value(),
+			static_cast<unsigned int>(anchor.value_or(COORD{ 0, 0 }).X), static_cast<unsigned int>(anchor.value_or(COORD{ 0, 0 }).Y) });
+	}
+	return msg::serialize(response);
+}
+
 msg::Buffer Serializer::makeDisconnectResponse(const int userIdx, const msg::Disconnect& msg) {
-	msg::Buffer buffer{30};
-	auto userBuff = static_cast<msg::OneByteInt>(userIdx);
-	msg::serializeTo(buffer, 0, msg::Type::disconnect, msg.version, userBuff);
-	return buffer;
+	return msg::serialize(msg::DisconnectResponse{ msg::Type::disconnect, msg.version, static_cast<msg::OneByteInt>(userIdx) });
 }
 
-msg::Buffer Serializer::makeWriteResponse(const COORD& startPos, const int userIdx, const msg::Write& msg) {
-	msg::Buffer buffer{static_cast<int>(30 + msg.text.size())};
-	unsigned int cursorX = startPos.X;
-	unsigned int cursorY = startPos.Y;
-	auto userBuff = static_cast<msg::OneByteInt>(userIdx);
-	msg::serializeTo(buffer, 0, msg.type, msg.version, userBuff, msg.text, cursorX, cursorY);
-	return buffer;
+msg::Buffer Serializer::makeWriteResponse(const COORD& startPos, const msg::EditAnchors& editAnchors, const int userIdx, const msg::WriteView& msg) {
+	msg::WriteResponseView response{ msg.type, msg.version, static_cast<msg::OneByteInt>(userIdx), msg.text,
+		static_cast<unsigned int>(startPos.X), static_cast<unsigned int>(startPos.Y) };
+	return msg::serialize(response, editAnchors);
 }
 
-msg::Buffer Serializer::makeEraseResponse(const COORD& startPos, const int userIdx, const msg::Erase& msg) {
-	msg::Buffer buffer{30};
-	unsigned int cursorX = startPos.X;
-	unsigned int cursorY = startPos.Y;
-	auto userBuff = static_cast<msg::OneByteInt>(userIdx);
-	msg::serializeTo(buffer, 0, msg.type, msg.version, userBuff, msg.eraseSize, cursorX, cursorY);
-	return buffer;
+msg::Buffer Serializer::makeEraseResponse(const COORD& startPos, const msg::EditAnchors& editAnchors, const int userIdx, const msg::Erase& msg) {
+	msg::EraseResponse response{ msg.type, msg.version, static_cast<msg::OneByteInt>(userIdx), msg.eraseSize,
+		static_cast<unsigned int>(startPos.X), static_cast<unsigned int>(startPos.Y) };
+	return msg::serialize(response, editAnchors);
 }
 
 msg::Buffer Serializer::makeMoveResponse(const ServerSiteDocument& doc, const int userIdx, const msg::MoveHorizontal& msg) {
@@ -93,23 +104,47 @@ msg::Buffer Serializer::makeMoveResponse(const ServerSiteDocument& doc, const in
 	return makeMoveResponseImpl(doc, msg.type, msg.version, userIdx, true);
 }
 
+msg::Buffer Serializer::makeCursorResponse(const msg::OneByteInt version, const ServerSiteDocument& doc, const int userIdx) {
+	return makeMoveResponseImpl(doc, msg::Type::moveTo, version, userIdx, doc.getCursorSelectionAnchor(userIdx).has_value());
+}
+
 msg::Buffer Serializer::makeMoveResponseImpl(const ServerSiteDocument& doc, const msg::Type type, const msg::OneByteInt version, const int userIdx, const bool withSelect) {
-	msg::Buffer buffer{30};
-	auto userBuff = static_cast<msg::OneByteInt>(userIdx);
 	auto cursorPos = doc.getCursorPos(userIdx);
-	unsigned int cursorX = cursorPos.X;
-	unsigned int cursorY = cursorPos.Y;
-	auto anchor = doc.getCursorSelectionAnchor(userIdx);
-	unsigned int anchorX = anchor.value_or(COORD{ 0, 0 }).X;
-	unsigned int anchorY = anchor.value_or(COORD{ 0, 0 }).Y;
-	msg::serializeTo(buffer, 0, type, version, userBuff, cursorX, cursorY, withSelect, anchorX, anchorY);
-	return buffer;
+	auto anchor = doc.getCursorSelectionAnchor(userIdx).value_or(COORD{ 0, 0 });
+	msg::MoveResponse response{ type, version, static_cast<msg::OneByteInt>(userIdx),
+		static_cast<unsigned int>(cursorPos.X), static_cast<unsigned int>(cursorPos.Y), withSelect,
+		static_cast<unsigned int>(anchor.X), static_cast<unsigned int>(anchor.Y) };
+	return msg::serialize(response);
 }
 
 msg::Buffer Serializer::makeReplaceResponse(const int userIdx, const msg::Replace& msg) {
-	int bufferSize = 16 * msg.segments.size() + msg.text.size() + 10;
-	msg::Buffer buffer{ bufferSize };
-	auto userBuff = static_cast<msg::OneByteInt>(userIdx);
-	msg::serializeTo(buffer, 0, msg::Type::replace, msg.version, userBuff, msg.text, msg.segments);
-	return buffer;
+	return msg::serialize(msg::ReplaceResponse{ msg::Type::replace, msg.version, static_cast<msg::OneByteInt>(userIdx), msg.text, msg.segments });
+}
+
+msg::Buffer Serializer::makeUpdateFor(const msg::OneByteInt version, const ServerSiteDocument::LoggedOp& op) {
+	// Document update re-encoded for a client of another protocol version, only its own user's anchor is read
+	msg::Type type;
+	msg::OneByteInt opVersion, user;
+	msg::parse(op.buffer, 0, type, opVersion, user);
+	msg::EditAnchors editAnchors(user + 1, op.editBase);
+	if (type == msg::Type::write) {
+		auto response = msg::view<msg::WriteResponseView>(op.buffer, editAnchors);
+		assert(response.has_value() && "Error, malformed logged update!");
+		response->version = version;
+		return msg::serialize(*response, editAnchors);
+	}
+	if (type == msg::Type::erase) {
+		auto response = msg::deserialize<msg::EraseResponse>(op.buffer, editAnchors);
+		assert(response.has_value() && "Error, malformed logged update!");
+		response->version = version;
+		return msg::serialize(*response, editAnchors);
+	}
+	if (type == msg::Type::replace) {
+		auto response = msg::deserialize<msg::ReplaceResponse>(op.buffer);
+		assert(response.has_value() && "Error, malformed logged update!");
+		response->version = version;
+		return msg::serialize(*response);
+	}
+	// Rest of the updates is encoded the same in every version
+	return op.buffer;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include "messages.h"
 #include "server_document.h"
+#include "schema.h"
 
 class Serializer {
 public:
@@ -8,16 +9,24 @@ public:
 	static msg::Buffer makeGetNamesResponse(const msg::OneByteInt version, const std::string& errMsg, const std::vector<std::string>& docNames);
 	static msg::Buffer makeLoginResponse(const msg::OneByteInt version, const std::string& authToken, const std::string& errMsg);
 	static msg::Buffer makeRegisterResponse(const msg::OneByteInt version, const std::string& errMsg);
-	static msg::Buffer makeConnectResponse(const msg::Type& type, const ServerSiteDocument& doc, const msg::OneByteInt version, const int userIdx, const std::string& acCode);
+	static msg::Buffer makeConnectResponse(const msg::Type& type, const ServerSiteDocument& doc, const msg::OneByteInt version, const int userIdx, const std::string& acCode, const bool streamText = false);
+	static msg::Buffer makeResumeResponse(const msg::Type& type, const ServerSiteDocument& doc, const msg::OneByteInt version, const int userIdx, const std::string& acCode, const unsigned int replayedOps);
 	static msg::Buffer makeConnectResponseWithError(const msg::Type& type, const std::string& errorMsg, const msg::OneByteInt version);
+	static msg::Buffer makeSnapshotChunk(const msg::OneByteInt version, const unsigned int snapshotVersion, const unsigned int offset, const std::string_view text);
+	static msg::Buffer makeUserConnectedResponse();
+	static msg::Buffer makeRejectResponse(const msg::OneByteInt version, const unsigned int seq);
+	static msg::Buffer makeHeartbeat(const msg::OneByteInt version);
+	static msg::Buffer makePresenceResponse(const msg::OneByteInt version, const ServerSiteDocument& doc, const std::vector<int>& users, const unsigned int seq);
 	static msg::Buffer makeDisconnectResponse(const int userIdx, const msg::Disconnect& msg);
-	static msg::Buffer makeWriteResponse(const COORD& startPos, const int userIdx, const msg::Write& msg);
-	static msg::Buffer makeEraseResponse(const COORD& startPos, const int userIdx, const msg::Erase& msg);
+	static msg::Buffer makeWriteResponse(const COORD& startPos, const msg::EditAnchors& editAnchors, const int userIdx, const msg::WriteView& msg);
+	static msg::Buffer makeEraseResponse(const COORD& startPos, const msg::EditAnchors& editAnchors, const int userIdx, const msg::Erase& msg);
 	static msg::Buffer makeMoveResponse(const ServerSiteDocument& doc, const int userIdx, const msg::MoveHorizontal& msg);
 	static msg::Buffer makeMoveResponse(const ServerSiteDocument& doc, const int userIdx, const msg::MoveVertical& msg);
 	static msg::Buffer makeMoveResponse(const ServerSiteDocument& doc, const int userIdx, const msg::MoveTo& msg);
 	static msg::Buffer makeMoveResponse(const ServerSiteDocument& doc, const int userIdx, const msg::MoveSelectAll& msg);
+	static msg::Buffer makeCursorResponse(const msg::OneByteInt version, const ServerSiteDocument& doc, const int userIdx);
 	static msg::Buffer makeReplaceResponse(const int userIdx, const msg::Replace& msg);
+	static msg::Buffer makeUpdateFor(const msg::OneByteInt version, const ServerSiteDocument::LoggedOp& op);
 private:
 	static msg::Buffer makeMoveResponseImpl(const ServerSiteDocument& doc, const msg::Type type, const msg::OneByteInt version, const int userIdx, const bool withSelect);
 };
\ No newline at end of file
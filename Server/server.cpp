@@ -3,17 +3,25 @@
 #include "server.h"
 #include "logging.h"
 #include "deserializer.h"
+#include "serializer.h"
+#include "compression.h"
 
 using namespace server;
 
 constexpr int msgBufferSize = 6;
-constexpr char closeType = static_cast<char>(msg::Type::masterClose);
 constexpr char version = 1;
-constexpr char closeMsgBuffer[msgBufferSize] = { 0, 0, 0, 2, closeType, version }; // (0002 = length)
 
-Server::Server(std::string ip, const int port) :
+Server::Server(std::string ip, const int port, const int compressionThreshold, const server::RateLimiter::Limits& rateLimits,
+	const server::AdmissionController::Thresholds& admissionThresholds, const size_t workerMemoryBudget, const server::PoolScaler::Thresholds& poolThresholds,
+	const server::SessionBalancer::Thresholds& balancerThresholds) :
 	ip(ip),
-	port(port) {
+	port(port),
+	compressionThreshold(compressionThreshold),
+	rateLimits(rateLimits),
+	workerMemoryBudget(workerMemoryBudget),
+	admission(admissionThresholds),
+	scaler(poolThresholds),
+	balancer(balancerThresholds) {
 	listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 	if (listenSocket == INVALID_SOCKET) {
 		logger.logError(WSAGetLastError(), ": Error when creating listening socket");
@@ -47,47 +55,59 @@ bool Server::open(const int nWorkers) {
 }
 
 void Server::start() {
-	FD_ZERO(&unassignedConns);
+	// Connections accepted while workers were connecting are already in unassignedConns
 	FD_SET(listenSocket, &unassignedConns);
 	logger.logDebug("Listening for connections...");
 	while (state == State::opened) {
 		FD_SET conns = unassignedConns;
-		int selectCount = select(0, &conns, nullptr, nullptr, nullptr);
+		// Under overload new connections wait in the listen backlog
+		if (!admission.acceptsConnections(unassignedConns.fd_count - 1)) {
+			FD_CLR(listenSocket, &conns);
+		}
+		// Master wakes up at least every housekeeping interval to size the worker pool
+		auto wait = admission.hasDeferred() ? (std::min)(admission.getRetryInterval(), housekeepingInterval) : housekeepingInterval;
+		timeval tick{ 0, static_cast<long>(std::chrono::microseconds(wait).count()) };
+		int selectCount = select(0, &conns, nullptr, nullptr, &tick);
 		for (int i = 0; i < selectCount; i++) {
 			SOCKET client = conns.fd_array[i];
 			if (acceptConnection(client)) {
 				continue;
 			}
-			auto msgs = extractor.extractMessages(client);
-			for (auto& buffer : msgs) {
+			std::vector<msg::OneByteInt> streams;
+			auto msgs = extractor.extractMessages(client, streams);
+			for (int j = 0; j < msgs.size(); j++) {
+				msg::OneByteInt stream = j < streams.size() ? streams[j] : 0;
+				// Master patches and parses connect frames, a compressed one is opened first and forwarded raw
+				auto rawBuffer = msg::decompressFrame(msgs[j]);
+				if (!rawBuffer && msg::isCompressedFrame(msgs[j])) {
+					logger.logError("Malformed compressed message from", client);
+					continue;
+				}
+				auto& buffer = rawBuffer ? rawBuffer.value() : msgs[j];
 				msg::Type type;
 				msg::OneByteInt version;
 				msg::parse(buffer, 0, type, version);
-				if (type == msg::Type::create) {
-					buffer.replace(2, client);
-					int worker = selectWorker();
-					forwardConnection(client, buffer, worker);
-				}
-				else if (type == msg::Type::load) {
-					auto msg = Deserializer::parseConnectCreateDoc(buffer);
-					auto userData = auth.getUserData(client);
-					buffer.replace(2, client);
-					int worker = selectWorkerWithUsernameAndFilename(userData.username, msg.filename);
-					forwardConnection(client, buffer, worker);
-				}
-				else if (type == msg::Type::join) {
-					std::string accessCode;
-					buffer.replace(2, client);
-					msg::parse(buffer, 6, accessCode);
-					int worker = selectWorkerWithAcCode(accessCode);
-					forwardConnection(client, buffer, worker);
+				if (type == msg::Type::create || type == msg::Type::load || type == msg::Type::join) {
+					if (buffer.size < msg::connectHeaderSize) {
+						logger.logError("Malformed", type, "message from", client);
+						continue;
+					}
+					// Accepted sockets fit below the stream bits, so the client id is not truncated
+					buffer.replace(msg::connectSocketPos, static_cast<unsigned int>(makeClientId(client, stream)));
+					admitSession(client, buffer);
 				}
 				else {
 					auto response = processMsg(client, buffer);
+					// Authentication is per connection, the answer goes back on the stream it was asked on
+					for (auto& dst : response.destinations) {
+						dst = makeClientId(dst, stream);
+					}
 					sendResponses(response);
 				}
 			}
 		}
+		retryDeferredSessions();
+		scalePool();
 	}
 	state = State::closed;
 }
@@ -102,15 +122,25 @@ bool Server::acceptConnection(const SOCKET client) {
 		closesocket(newConnection);
 		return false;
 	}
-	FD_SET(newConnection, &unassignedConns);
+	addUnassignedConnection(newConnection);
 	return true;
 }
 
+void Server::addUnassignedConnection(const SOCKET connection) {
+	// Client ids keep the stream above the socket bits and are sent as 32-bit values, bigger handles would collide
+	if (!fitsClientId(connection)) {
+		logger.logError("Socket", connection, "does not fit in a client id, closing connection");
+		closesocket(connection);
+		return;
+	}
+	FD_SET(connection, &unassignedConns);
+}
+
 bool Server::forwardConnection(const SOCKET client, const msg::Buffer& buffer, const int worker) {
-	auto id = workers[worker].thread.get_id();
+	auto id = workers[worker]->thread.get_id();
 	{
-		std::scoped_lock lock{workers[worker].connSetLock};
-		FD_SET(client, &workers[worker].connections);
+		std::scoped_lock lock{workers[worker]->connSetLock};
+		FD_SET(client, &workers[worker]->connections);
 	}
 	auto bufferWithSize = msg::enrich(buffer);
 	int sendBytes = send(notifiers[worker], bufferWithSize.get(), bufferWithSize.size, 0);
@@ -124,6 +154,63 @@ bool Server::forwardConnection(const SOCKET client, const msg::Buffer& buffer, c
 	return true;
 }
 
+void Server::admitSession(const SOCKET client, msg::Buffer& buffer) {
+	int worker = selectSessionWorker(client, buffer);
+	// Sessions being handed over are in neither worker, routing waits until they are adopted
+	if (!transfer.has_value() && admission.admit(workers[worker]->getLoad())) {
+		forwardConnection(client, buffer, worker);
+		return;
+	}
+	logger.logDebug("Worker", worker, "is overloaded or retiring, deferring session of", client);
+	if (!admission.defer(client, std::move(buffer))) {
+		rejectSession(buffer);
+	}
+}
+
+void Server::retryDeferredSessions() {
+	for (auto& deferred : admission.takeDeferred()) {
+		int worker = selectSessionWorker(deferred.client, deferred.buffer);
+		if (!transfer.has_value() && admission.admit(workers[worker]->getLoad())) {
+			forwardConnection(deferred.client, deferred.buffer, worker);
+		}
+		else if (admission.isExpired(deferred)) {
+			rejectSession(deferred.buffer);
+		}
+		else {
+			admission.retryLater(std::move(deferred));
+		}
+	}
+}
+
+void Server::rejectSession(const msg::Buffer& buffer) {
+	msg::Type type;
+	msg::OneByteInt version;
+	unsigned int client;
+	msg::parse(buffer, 0, type, version, client);
+	logger.logInfo("Rejecting", type, "from", client, ":", admission.getRetryAfterError());
+	admission.reject();
+	server::Response response{ Serializer::makeConnectResponseWithError(type, admission.getRetryAfterError(), version), { client }, type };
+	sendResponses(response);
+}
+
+int Server::selectSessionWorker(const SOCKET client, const msg::Buffer& buffer) {
+	msg::Type type;
+	msg::parse(buffer, 0, type);
+	// Malformed frame goes to any worker, which refuses it
+	if (type == msg::Type::load) {
+		if (auto msg = Deserializer::parseConnectCreateDoc(buffer)) {
+			auto userData = auth.getUserData(client);
+			return selectWorkerWithUsernameAndFilename(userData.username, msg->filename);
+		}
+	}
+	if (type == msg::Type::join) {
+		if (auto msg = Deserializer::parseConnectJoinDoc(buffer)) {
+			return selectWorkerWithAcCode(msg->acCode);
+		}
+	}
+	return selectWorker();
+}
+
 bool Server::close() {
 	logger.logDebug("Got signal for close. Closing server...");
 	state = State::closing;
@@ -143,6 +230,15 @@ bool Server::close() {
 		logger.logError(WSAGetLastError(), ": Error when notifying server for closing!");
 		success = false;
 	}
+	// Master loop stops within a housekeeping interval, then a transfer in progress is finished,
+	// so the handed over sessions are saved by their new worker
+	for (int attempt = 0; state != State::closed && attempt < 10; attempt++) {
+		std::this_thread::sleep_for(housekeepingInterval);
+	}
+	for (int attempt = 0; transfer.has_value() && attempt < 100; attempt++) {
+		continueTransfer();
+		std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+	}
 	if (int closed = closeWorkers(); closed < workers.size()) {
 		logger.logError(WSAGetLastError(), ": Error when closing workers. Closed only", closed, "/", workers.size(), "|", workers.size() - closed, "dangling workers are present!");
 		success = false;
@@ -155,9 +251,12 @@ int Server::selectWorker() {
 	unsigned int leastConns = INT_MAX;
 	int leastConnsWorker = 0;
 	for (int i = 0; i < workers.size(); i++) {
-		std::scoped_lock lock{workers[i].connSetLock};
-		if (workers[i].connections.fd_count < leastConns) {
-			leastConns = workers[i].connections.fd_count;
+		if (isRetiring(i)) {
+			continue;
+		}
+		std::scoped_lock lock{workers[i]->connSetLock};
+		if (workers[i]->connections.fd_count < leastConns) {
+			leastConns = workers[i]->connections.fd_count;
 			leastConnsWorker = i;
 		}
 	}
@@ -166,7 +265,7 @@ int Server::selectWorker() {
 
 int Server::selectWorkerWithAcCode(const std::string& acCode) {
 	for (int i = 0; i < workers.size(); i++) {
-		if (workers[i].acCodeExistsInRepo(acCode)) {
+		if (workers[i]->acCodeExistsInRepo(acCode)) {
 			return i;
 		}
 	}
@@ -175,7 +274,7 @@ int Server::selectWorkerWithAcCode(const std::string& acCode) {
 
 int Server::selectWorkerWithUsernameAndFilename(const std::string& username, const std::string& filename) {
 	for (int i = 0; i < workers.size(); i++) {
-		if (workers[i].userFileExistsInRepo(username, filename)) {
+		if (workers[i]->userFileExistsInRepo(username, filename)) {
 			return i;
 		}
 	}
@@ -185,48 +284,187 @@ int Server::selectWorkerWithUsernameAndFilename(const std::string& username, con
 int Server::closeWorkers() {
 	int closed = 0;
 	for (int i = workers.size() - 1; i >= 0; i--) {
-		auto id = workers[i].thread.get_id();
-		int sendBytes = send(notifiers[i], closeMsgBuffer, msgBufferSize, 0);
-		if (sendBytes < 0) {
-			logger.logError(WSAGetLastError(), ": Error when notifying thread", id, "for close");
+		if (!notifyWorker(i, msg::Type::masterClose)) {
 			continue;
 		}
-		if (workers[i].thread.joinable()) {
-			workers[i].thread.join();
+		if (workers[i]->thread.joinable()) {
+			workers[i]->thread.join();
 		}
 		closed++;
 	}
 	return closed;
 }
 
+bool Server::notifyWorker(const size_t worker, const msg::Type type) {
+	const char msgBuffer[msgBufferSize] = { 0, 0, 0, 2, static_cast<char>(type), version }; // (0002 = length)
+	int sendBytes = send(notifiers[worker], msgBuffer, msgBufferSize, 0);
+	if (sendBytes < 0) {
+		logger.logError(WSAGetLastError(), ": Error when notifying thread", workers[worker]->thread.get_id(), "with", type);
+		return false;
+	}
+	return true;
+}
+
 void Server::initWorkers(const int nWorkers) {
 	workers.reserve(nWorkers);
 	notifiers.reserve(nWorkers);
-	FD_SET set;
-	FD_ZERO(&set);
-	FD_SET(listenSocket, &set);
 	for (int i = 0; i < nWorkers; i++) {
-		Worker worker{ip, port, &auth};
-		int socketCount = select(0, &set, nullptr, nullptr, nullptr);
-		auto notifySocket = accept(listenSocket, nullptr, nullptr);
-		if (notifySocket == INVALID_SOCKET) {
-			closesocket(notifySocket);
-			logger.logError(WSAGetLastError(), ": Error on opening notify socket to thread", worker.thread.get_id());
+		addWorker();
+	}
+	logger.logDebug("Created", workers.size(), "threads");
+}
+
+bool Server::addWorker() {
+	auto worker = std::make_unique<Worker>(ip, port, &auth, compressionThreshold, rateLimits, workerMemoryBudget);
+	// Worker connects to master from its own thread, its connection waits in the listen backlog
+	if (worker->thread.joinable()) {
+		worker->thread.join();
+	}
+	sockaddr_in workerAddress = { 0 };
+	int addressSize = sizeof(workerAddress);
+	if (worker->masterListener == INVALID_SOCKET || getsockname(worker->masterListener, reinterpret_cast<SOCKADDR*>(&workerAddress), &addressSize) == SOCKET_ERROR) {
+		logger.logError(WSAGetLastError(), ": Error on connecting new worker to master");
+		closesocket(worker->masterListener);
+		return false;
+	}
+	auto notifySocket = acceptNotifier(workerAddress);
+	if (notifySocket == INVALID_SOCKET) {
+		logger.logError(WSAGetLastError(), ": Error on opening notify socket to new worker");
+		closesocket(worker->masterListener);
+		return false;
+	}
+	worker->start();
+	workers.push_back(std::move(worker));
+	notifiers.push_back(notifySocket);
+	return true;
+}
+
+SOCKET Server::acceptNotifier(const sockaddr_in& workerAddress) {
+	// Clients may be in the backlog before the worker, they are accepted as usual
+	for (int attempt = 0; attempt < 50; attempt++) {
+		FD_SET set;
+		FD_ZERO(&set);
+		FD_SET(listenSocket, &set);
+		timeval wait{ 0, 100000 };
+		if (select(0, &set, nullptr, nullptr, &wait) <= 0) {
 			continue;
 		}
-		if (worker.thread.joinable()) {
-			worker.thread.join();
+		SOCKET connection = accept(listenSocket, nullptr, nullptr);
+		if (connection == INVALID_SOCKET) {
+			continue;
+		}
+		sockaddr_in peerAddress = { 0 };
+		int addressSize = sizeof(peerAddress);
+		getpeername(connection, reinterpret_cast<SOCKADDR*>(&peerAddress), &addressSize);
+		if (peerAddress.sin_port == workerAddress.sin_port && peerAddress.sin_addr.s_addr == workerAddress.sin_addr.s_addr) {
+			return connection;
 		}
-		workers.push_back(std::move(worker));
-		notifiers.push_back(notifySocket);
+		addUnassignedConnection(connection);
+	}
+	return INVALID_SOCKET;
+}
+
+void Server::scalePool() {
+	if (transfer.has_value()) {
+		continueTransfer();
+		return;
+	}
+	auto now = std::chrono::steady_clock::now();
+	std::vector<server::WorkerLoad> loads;
+	for (const auto& worker : workers) {
+		loads.push_back(worker->getLoad());
+	}
+	switch (scaler.decide(loads, now)) {
+	case PoolScaler::Decision::grow:
+		if (addWorker()) {
+			logger.logInfo("Added worker, the pool has", workers.size(), "workers");
+		}
+		scaler.changed(now);
+		break;
+	case PoolScaler::Decision::shrink:
+		beginRetirement(scaler.selectRetired(loads, now));
+		scaler.changed(now);
+		break;
+	case PoolScaler::Decision::keep:
+		rebalanceSessions(loads, now);
+		break;
 	}
-	logger.logDebug("Created", workers.size(), "threads");
+}
+
+void Server::rebalanceSessions(const std::vector<server::WorkerLoad>& loads, const std::chrono::steady_clock::time_point now) {
+	std::vector<SessionBalancer::WorkerSessions> workerSessions;
+	for (int i = 0; i < workers.size(); i++) {
+		workerSessions.emplace_back(SessionBalancer::WorkerSessions{ scaler.getUtilization(loads[i], now), workers[i]->getSessionRates() });
+	}
+	if (auto migration = balancer.decide(workerSessions, now)) {
+		beginMigration(*migration);
+		balancer.migrated(now);
+	}
+}
+
+void Server::beginRetirement(const size_t worker) {
+	if (!notifyWorker(worker, msg::Type::masterDrain)) {
+		return;
+	}
+	logger.logInfo("Retiring worker", worker, "of", workers.size());
+	transfer = Transfer{ worker, 0, true };
+	transfer->target = selectWorker();
+}
+
+void Server::beginMigration(const SessionBalancer::Migration& migration) {
+	workers[migration.source]->requestMigration(migration.acCode);
+	if (!notifyWorker(migration.source, msg::Type::masterMigrate)) {
+		return;
+	}
+	logger.logInfo("Migrating session", migration.acCode, "from worker", migration.source, "to worker", migration.target);
+	transfer = Transfer{ migration.source, migration.target, false };
+}
+
+void Server::continueTransfer() {
+	// Source leaves its handoff and a drained one ends its thread, the handoff is removed from the source once adopted
+	auto& source = workers[transfer->source];
+	auto& target = workers[transfer->target];
+	if (!transfer->handedOver) {
+		if (transfer->retire && !source->isDrained()) {
+			return;
+		}
+		if (transfer->retire && source->thread.joinable()) {
+			source->thread.join();
+		}
+		auto handoff = source->takeHandoff();
+		if (!handoff.has_value()) {
+			return;
+		}
+		target->adopt(std::move(*handoff));
+		notifyWorker(transfer->target, msg::Type::masterAdopt);
+		transfer->handedOver = true;
+		return;
+	}
+	if (target->isAdopting()) {
+		return;
+	}
+	if (transfer->retire) {
+		closesocket(notifiers[transfer->source]);
+		workers.erase(workers.begin() + transfer->source);
+		notifiers.erase(notifiers.begin() + transfer->source);
+		logger.logInfo("Worker retired, the pool has", workers.size(), "workers");
+	}
+	transfer.reset();
+}
+
+bool Server::isRetiring(const size_t worker) const {
+	return transfer.has_value() && transfer->retire && transfer->source == worker;
 }
 
 void Server::sendResponses(server::Response& response) const {
 	msg::Buffer msgWithSize = msg::enrich(response.buffer);
+	if (msgWithSize.empty()) {
+		logger.logError("Message of type", response.msgType, "exceeds the frame size limit, it is not sent");
+		return;
+	}
 	for (const auto& dst : response.destinations) {
-		int sendBytes = send(dst, msgWithSize.get(), msgWithSize.size, 0);
+		msg::setFrameStream(msgWithSize, getStream(dst));
+		int sendBytes = send(getConnection(dst), msgWithSize.get(), msgWithSize.size, 0);
 		if (sendBytes <= 0) {
 			logger.logError("Error on sending data to", dst);
 		}
@@ -250,5 +488,6 @@ server::Response Server::shutdownConnection(const SOCKET client, msg::Buffer& bu
 	buffer.clear();
 	msg::serializeTo(buffer, 0, msg::Type::logout, static_cast<msg::OneByteInt>(1));
 	FD_CLR(client, &unassignedConns);
+	admission.erase(client);
 	return auth.process(client, buffer);
 }
\ No newline at end of file
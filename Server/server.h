@@ -5,14 +5,19 @@
 #include <unordered_map>
 #include <memory>
 #include <atomic>
+#include <optional>
 
 #include "worker.h"
 #include "repository.h"
 #include "authenticator.h"
+#include "pool_scaler.h"
+#include "session_balancer.h"
 
 class Server {
 public:
-	Server(std::string ip, const int port);
+	Server(std::string ip, const int port, const int compressionThreshold = msg::defaultCompressionThreshold, const server::RateLimiter::Limits& rateLimits = {},
+		const server::AdmissionController::Thresholds& admissionThresholds = {}, const size_t workerMemoryBudget = 256 * 1024 * 1024,
+		const server::PoolScaler::Thresholds& poolThresholds = {}, const server::SessionBalancer::Thresholds& balancerThresholds = {});
 
 	bool open(const int nWorkers);
 	void start();
@@ -20,12 +25,33 @@ public:
 private:
 	friend class SyncTester;
 	enum class State {opened, closing, closed};
+	// Sessions moving from one worker to another, the whole worker when it is retired
+	struct Transfer {
+		size_t source;
+		size_t target;
+		bool retire;
+		bool handedOver = false; // Handoff of the source is passed to the target
+	};
 	bool forwardConnection(const SOCKET client, const msg::Buffer& buffer, const int worker);
+	void admitSession(const SOCKET client, msg::Buffer& buffer);
+	void retryDeferredSessions();
+	void rejectSession(const msg::Buffer& buffer);
+	int selectSessionWorker(const SOCKET client, const msg::Buffer& buffer);
 	bool acceptConnection(const SOCKET client);
+	void addUnassignedConnection(const SOCKET connection);
 	int selectWorker();
 	int selectWorkerWithAcCode(const std::string& acCode);
 	int selectWorkerWithUsernameAndFilename(const std::string& username, const std::string& filename);
 	void initWorkers(const int nWorkers);
+	bool addWorker();
+	SOCKET acceptNotifier(const sockaddr_in& workerAddress);
+	bool notifyWorker(const size_t worker, const msg::Type type);
+	void scalePool();
+	void rebalanceSessions(const std::vector<server::WorkerLoad>& loads, const std::chrono::steady_clock::time_point now);
+	void beginRetirement(const size_t worker);
+	void beginMigration(const server::SessionBalancer::Migration& migration);
+	void continueTransfer();
+	bool isRetiring(const size_t worker) const;
 	int closeWorkers();
 	void sendResponses(server::Response& response) const;
 	server::Response processMsg(const SOCKET client, msg::Buffer& buffer);
@@ -34,12 +60,20 @@ private:
 	std::atomic<State> state = State::closed;
 	const std::string ip;
 	const int port;
+	const int compressionThreshold;
+	const server::RateLimiter::Limits rateLimits;
+	const size_t workerMemoryBudget;
 	SOCKET listenSocket = INVALID_SOCKET;
 	sockaddr_in listenSocketAddress = { 0 };
 	FD_SET unassignedConns = { 0 };
 
-	std::vector<Worker> workers;
+	std::vector<std::unique_ptr<Worker>> workers; // Workers keep their address, their threads use it
 	std::vector<SOCKET> notifiers;
+	std::optional<Transfer> transfer; // One at a time, session requests wait meanwhile
+	std::chrono::milliseconds housekeepingInterval{ 100 };
 	MessageExtractor extractor;
 	server::Authenticator auth;
+	server::AdmissionController admission;
+	server::PoolScaler scaler;
+	server::SessionBalancer balancer;
 };
\ No newline at end of file
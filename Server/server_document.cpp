@@ -1,5 +1,13 @@
 #include "server_document.h"
 #include "pos_helpers.h"
+#include "parser.h"
+#include "schema.h"
+
+#include <algorithm>
+#include <sstream>
+
+constexpr size_t opLogCapacity = 1024;
+constexpr size_t opLogMaxBytes = 4 * 1024 * 1024;
 
 ServerSiteDocument::ServerSiteDocument() :
 	BaseDocument(),
@@ -48,10 +56,141 @@ std::vector<SOCKET>& ServerSiteDocument::getConnectedClients() {
 
 bool ServerSiteDocument::addUser() {
 	users.emplace_back(User());
+	editAnchors.push_back(COORD{ 0, 0 });
+	movedCursors.push_back(false);
 	historyManager.addHistory();
 	return true;
 }
 
+const std::vector<COORD>& ServerSiteDocument::getEditAnchors() const {
+	return editAnchors;
+}
+
+bool ServerSiteDocument::markCursorMoved(const int index) {
+	if (!validateUserIdx(index)) {
+		return false;
+	}
+	movedCursors[index] = true;
+	return true;
+}
+
+void ServerSiteDocument::markAllCursorsMoved() {
+	std::fill(movedCursors.begin(), movedCursors.end(), true);
+}
+
+bool ServerSiteDocument::hasMovedCursors() const {
+	return std::find(movedCursors.cbegin(), movedCursors.cend(), true) != movedCursors.cend();
+}
+
+std::vector<int> ServerSiteDocument::takeMovedCursors() {
+	std::vector<int> moved;
+	for (int i = 0; i < movedCursors.size(); i++) {
+		if (movedCursors[i]) {
+			moved.push_back(i);
+			movedCursors[i] = false;
+		}
+	}
+	return moved;
+}
+
+unsigned int ServerSiteDocument::nextPresenceSeq() {
+	return ++presenceSeq;
+}
+
+unsigned int ServerSiteDocument::getVersion() const {
+	return version;
+}
+
+const ServerSiteDocument::LoggedOp& ServerSiteDocument::recordOp(const msg::Buffer& buffer) {
+	version++;
+	opLog.push_back(LoggedOp{ buffer, moveEditAnchor(buffer) });
+	opLogBytes += buffer.size;
+	while (opLog.size() > opLogCapacity || (opLogBytes > opLogMaxBytes && opLog.size() > 1)) {
+		opLogBytes -= opLog.front().buffer.size;
+		opLog.pop_front();
+	}
+	while (!edits.empty() && edits.front().version + opLog.size() <= version) {
+		edits.pop_front();
+	}
+	return opLog.back();
+}
+
+COORD ServerSiteDocument::moveEditAnchor(const msg::Buffer& update) {
+	// Anchors move with every write and erase update, the same way clients move theirs when they apply it
+	msg::Type type;
+	msg::parse(update, 0, type);
+	int user = -1;
+	COORD editPos{ 0, 0 };
+	if (type == msg::Type::write) {
+		auto response = msg::view<msg::WriteResponseView>(update, editAnchors);
+		user = response ? response->user : -1;
+		editPos = response ? makeCoord(response->X, response->Y) : editPos;
+	}
+	else if (type == msg::Type::erase) {
+		auto response = msg::deserialize<msg::EraseResponse>(update, editAnchors);
+		user = response ? response->user : -1;
+		editPos = response ? makeCoord(response->X, response->Y) : editPos;
+	}
+	if (!validateUserIdx(user)) {
+		return COORD{ 0, 0 };
+	}
+	return std::exchange(editAnchors[user], editPos);
+}
+
+bool ServerSiteDocument::hasOpsSince(const unsigned int sinceVersion) const {
+	return sinceVersion <= version && version - sinceVersion <= opLog.size();
+}
+
+std::vector<ServerSiteDocument::LoggedOp> ServerSiteDocument::getOpsSince(const unsigned int sinceVersion) const {
+	if (!hasOpsSince(sinceVersion)) {
+		return {};
+	}
+	return std::vector<LoggedOp>(opLog.cend() - (version - sinceVersion), opLog.cend());
+}
+
+std::optional<COORD> ServerSiteDocument::rebase(const int index, const unsigned int baseVersion, COORD pos) const {
+	if (!hasOpsSince(baseVersion)) {
+		return {};
+	}
+	// Own edits were already visible to the client, only concurrent ones move the position. The position also includes
+	// own edits applied after a concurrent one, so that edit is moved past them before it moves the position.
+	for (auto edit = edits.cbegin(); edit != edits.cend(); edit++) {
+		if (edit->version <= baseVersion || edit->user == index) {
+			continue;
+		}
+		AppliedEdit concurrent = *edit;
+		for (auto own = std::next(edit); own != edits.cend(); own++) {
+			if (own->user == index) {
+				concurrent = transformEdit(concurrent, *own);
+			}
+		}
+		pos = transformPos(pos, concurrent);
+	}
+	return pos;
+}
+
+ServerSiteDocument::TextSnapshot ServerSiteDocument::getTextSnapshot() const {
+	if (textSnapshot) {
+		return textSnapshot;
+	}
+	const auto& lines = container.get();
+	size_t size = lines.empty() ? 0 : lines.size() - 1;
+	for (const auto& line : lines) {
+		size += line.size();
+	}
+	// One exact-size allocation, line separators are prefilled and lines copied in between
+	auto text = std::make_shared<std::string>(size, '\n');
+	auto pos = text->begin();
+	for (const auto& line : lines) {
+		pos = std::copy(line.cbegin(), line.cend(), pos);
+		if (pos != text->end()) {
+			pos++;
+		}
+	}
+	textSnapshot = std::move(text);
+	return textSnapshot;
+}
+
 bool ServerSiteDocument::addClient(SOCKET client) {
 	connectedClients.push_back(client);
 	return true;
@@ -62,7 +201,12 @@ bool ServerSiteDocument::eraseUser(const int index) {
 		return false;
 	}
 	historyManager.removeHistory(index);
+	for (auto& edit : edits) {
+		edit.user = edit.user == index ? -1 : edit.user > index ? edit.user - 1 : edit.user;
+	}
 	users.erase(users.cbegin() + index);
+	editAnchors.erase(editAnchors.cbegin() + index);
+	movedCursors.erase(movedCursors.cbegin() + index);
 	if (myUserIdx > index) {
 		myUserIdx--;
 	}
@@ -86,6 +230,8 @@ UndoReturn ServerSiteDocument::undo(const int index) {
 	if (ret.type == ActionType::noop) {
 		return ret;
 	}
+	textSnapshot.reset();
+	recordEdit(index, ret.startPos, ret.endPos);
 	users[index].cursor.setPosition(ret.startPos);
 	COORD diff = ret.endPos - ret.startPos;
 	moveAffectedCursors(users[index], diff);
@@ -97,6 +243,10 @@ UndoReturn ServerSiteDocument::redo(const int index) {
 		return { ActionType::noop };
 	}
 	auto ret = historyManager.redo(index);
+	textSnapshot.reset();
+	if (ret.type != ActionType::noop) {
+		recordEdit(index, ret.startPos, ret.endPos);
+	}
 	users[index].cursor.setPosition(ret.startPos);
 	COORD diff = ret.endPos - ret.startPos;
 	moveAffectedCursors(users[index], diff);
@@ -104,13 +254,29 @@ UndoReturn ServerSiteDocument::redo(const int index) {
 }
 
 void ServerSiteDocument::afterWriteAction(const int index, const COORD& startPos, const COORD& endPos, std::vector<std::string>& writtenText) {
+	textSnapshot.reset();
+	if (!writtenText.empty()) {
+		// startPos is the cursor before selected text was erased, the text was inserted right before endPos
+		COORD insertPos = endPos - COORD{ static_cast<SHORT>(writtenText.back().size()), static_cast<SHORT>(writtenText.size() - 1) };
+		if (writtenText.size() > 1) {
+			insertPos.X = static_cast<SHORT>(container.get()[insertPos.Y].size() - writtenText.front().size());
+		}
+		recordEdit(index, insertPos, endPos);
+	}
 	historyManager.pushWriteAction(index, startPos, writtenText, &container);
 }
 
 void ServerSiteDocument::afterEraseAction(const int index, const COORD& startPos, const COORD& endPos, std::vector<std::string>& erasedText) {
+	textSnapshot.reset();
+	recordEdit(index, startPos, endPos);
 	historyManager.pushEraseAction(index, startPos, endPos, erasedText, &container);
 }
 
+void ServerSiteDocument::recordEdit(const int index, const COORD& startPos, const COORD& endPos) {
+	// Edits are made before the op is recorded, so they belong to the next version
+	edits.push_back(AppliedEdit{ version + 1, index, startPos, endPos });
+}
+
 ServerSiteDocument::Timestamp ServerSiteDocument::getLastSaveTimestamp() const {
 	return lastSaveTimestamp;
 }
@@ -122,3 +288,97 @@ void ServerSiteDocument::setNowAsLastSaveTimestamp() {
 std::string ServerSiteDocument::getId() const {
 	return id;
 }
+
+
+std::string ServerSiteDocument::hibernate(const size_t historyDepth) {
+	// Only the last historyDepth undo actions of each user are kept, redo and actions made by undo are dropped
+	std::ostringstream history;
+	history << version << ' ' << users.size() << '\n';
+	for (int i = 0; i < users.size(); i++) {
+		std::vector<const Action*> kept;
+		const auto& actions = historyManager.getUndoActions(i);
+		for (auto action = actions.crbegin(); action != actions.crend() && kept.size() < historyDepth; action++) {
+			if (!(*action)->isChild()) {
+				kept.push_back(action->get());
+			}
+		}
+		history << kept.size() << '\n';
+		for (auto action = kept.crbegin(); action != kept.crend(); action++) {
+			COORD startPos = (*action)->getStartPos();
+			COORD endPos = (*action)->getEndPos();
+			std::string text = (*action)->getText();
+			history << static_cast<int>((*action)->getType()) << ' ' << startPos.X << ' ' << startPos.Y << ' ' << endPos.X << ' ' << endPos.Y << ' '
+				<< (*action)->getTimestamp().time_since_epoch().count() << ' ' << text.size() << '\n' << text;
+		}
+	}
+	historyManager.clear();
+	container = TextContainer{};
+	textSnapshot.reset();
+	std::deque<LoggedOp>{}.swap(opLog);
+	opLogBytes = 0;
+	std::deque<AppliedEdit>{}.swap(edits);
+	hibernated = true;
+	return history.str();
+}
+
+void ServerSiteDocument::rehydrate(const std::string& text, const std::string& history) {
+	container = TextContainer{ text };
+	for (auto& user : users) {
+		user.cursor.setPosition(container.validatePos(user.cursor.position()));
+		if (user.selectAnchor.has_value()) {
+			user.selectAnchor.value().setPosition(container.validatePos(user.selectAnchor.value().position()));
+		}
+	}
+	hibernated = false;
+
+	// History is an optimization, it is restored only when it matches the document
+	std::istringstream stream{ history };
+	unsigned int historyVersion = 0;
+	size_t historyUsers = 0;
+	if (!(stream >> historyVersion >> historyUsers) || historyVersion != version || historyUsers != users.size()) {
+		return;
+	}
+	for (int i = 0; i < historyUsers; i++) {
+		size_t count = 0;
+		stream >> count;
+		for (size_t j = 0; j < count && stream; j++) {
+			int type = 0;
+			COORD startPos, endPos;
+			Timestamp::rep ticks = 0;
+			size_t size = 0;
+			stream >> type >> startPos.X >> startPos.Y >> endPos.X >> endPos.Y >> ticks >> size;
+			stream.get();
+			std::string actionText(size, '\0');
+			if (!stream.read(actionText.data(), size)) {
+				return;
+			}
+			auto lines = Parser::parseTextToVector(actionText);
+			TextContainer actionContainer{ lines };
+			historyManager.restoreAction(i, static_cast<ActionType>(type), startPos, endPos, actionContainer, Timestamp{ Timestamp::duration{ ticks } }, &container);
+		}
+	}
+}
+
+bool ServerSiteDocument::isHibernated() const {
+	return hibernated;
+}
+
+size_t ServerSiteDocument::getMemoryUsage() const {
+	// Estimate of what hibernation releases, users and clients are not counted
+	size_t usage = opLogBytes + edits.size() * sizeof(AppliedEdit) + historyManager.getMemoryUsage();
+	for (const auto& line : container.get()) {
+		usage += sizeof(std::string) + line.capacity();
+	}
+	if (textSnapshot) {
+		usage += textSnapshot->size();
+	}
+	return usage;
+}
+
+void ServerSiteDocument::setLastUse(const unsigned int check) {
+	lastUse = check;
+}
+
+unsigned int ServerSiteDocument::getLastUse() const {
+	return lastUse;
+}
\ No newline at end of file
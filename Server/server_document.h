@@ -1,11 +1,20 @@
 #pragma once
 #include "document_base.h"
 #include "history_manager.h"
+#include "messages.h"
+#include "transform.h"
 #include <Winsock2.h>
+#include <deque>
+#include <memory>
 
 class ServerSiteDocument : public BaseDocument {
 public:
 	using Timestamp = std::chrono::time_point<std::chrono::system_clock>;
+	using TextSnapshot = std::shared_ptr<const std::string>;
+	struct LoggedOp {
+		msg::Buffer buffer; // In the encoding of the client which made it
+		COORD editBase; // Edit anchor of its user before the update, compact positions are deltas against it
+	};
 	ServerSiteDocument();
 	ServerSiteDocument(const std::string& text);
 	ServerSiteDocument(const std::string& text, const int cursors, const int myUserIdx, const std::string& id, const std::string& docName = "filename.txt");
@@ -19,16 +28,46 @@ public:
 	bool eraseUser(const int index) override;
 	bool eraseClient(SOCKET client);
 	int findUser(SOCKET client) const;
+	const std::vector<COORD>& getEditAnchors() const;
+	bool markCursorMoved(const int index);
+	void markAllCursorsMoved();
+	bool hasMovedCursors() const;
+	std::vector<int> takeMovedCursors();
+	unsigned int nextPresenceSeq();
+	unsigned int getVersion() const;
+	TextSnapshot getTextSnapshot() const;
+	const LoggedOp& recordOp(const msg::Buffer& buffer);
+	bool hasOpsSince(const unsigned int sinceVersion) const;
+	std::vector<LoggedOp> getOpsSince(const unsigned int sinceVersion) const;
+	std::optional<COORD> rebase(const int index, const unsigned int baseVersion, COORD pos) const;
 	std::vector<SOCKET>& getConnectedClients();
 	Timestamp getLastSaveTimestamp() const;
 	void setNowAsLastSaveTimestamp();
 	std::string getId() const;
+	std::string hibernate(const size_t historyDepth);
+	void rehydrate(const std::string& text, const std::string& history);
+	bool isHibernated() const;
+	size_t getMemoryUsage() const;
+	void setLastUse(const unsigned int check);
+	unsigned int getLastUse() const;
 private:
 	void afterWriteAction(const int index, const COORD& startPos, const COORD& endPos, std::vector<std::string>& writtenText) override;
 	void afterEraseAction(const int index, const COORD& startPos, const COORD& endPos, std::vector<std::string>& erasedText) override;
+	void recordEdit(const int index, const COORD& startPos, const COORD& endPos);
+	COORD moveEditAnchor(const msg::Buffer& update);
 
 	history::HistoryManager historyManager;
 	std::vector<SOCKET> connectedClients;
+	std::vector<COORD> editAnchors;
+	std::vector<bool> movedCursors; // Users whose cursor moved since the last presence frame
+	unsigned int presenceSeq = 0;
+	unsigned int version = 0;
+	mutable TextSnapshot textSnapshot; // Serialized text, dropped on every edit and rebuilt when needed
+	std::deque<LoggedOp> opLog; // Ring of the most recent document updates, last one is the current version
+	size_t opLogBytes = 0;
+	std::deque<AppliedEdit> edits; // Text edits of the versions still in opLog, used to rebase late ops
 	Timestamp lastSaveTimestamp;
+	bool hibernated = false; // Text and history are on disk, users and clients stay so the session keeps working
+	unsigned int lastUse = 0; // Memory check during which the session was used last
 	const std::string id;
 };
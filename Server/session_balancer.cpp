@@ -0,0 +1,48 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "session_balancer.h"
+
+namespace server {
+	SessionBalancer::SessionBalancer(const Thresholds& thresholds) :
+		thresholds(thresholds) {}
+
+	std::optional<SessionBalancer::Migration> SessionBalancer::decide(const std::vector<WorkerSessions>& workers, const Clock::time_point now) {
+		auto byUtilization = [](const WorkerSessions& first, const WorkerSessions& second) { return first.utilization < second.utilization; };
+		auto [cool, hot] = std::minmax_element(workers.cbegin(), workers.cend(), byUtilization);
+		double gap = workers.size() < 2 ? 0.0 : hot->utilization - cool->utilization;
+		bool imbalanced = workers.size() >= 2 && hot->utilization >= thresholds.hotUtilization && gap >= thresholds.minImbalance;
+		imbalancedSince = imbalanced ? imbalancedSince.value_or(now) : std::optional<Clock::time_point>{};
+		if (!imbalanced || now - *imbalancedSince < thresholds.sustain) {
+			return {};
+		}
+		if (lastMigration.has_value() && now - *lastMigration < thresholds.cooldown) {
+			return {};
+		}
+		double totalRate = std::accumulate(hot->sessions.cbegin(), hot->sessions.cend(), 0.0, [](double sum, const SessionRate& session) { return sum + session.messageRate; });
+		if (totalRate <= 0.0) {
+			return {};
+		}
+		// Best move leaves both workers at the same utilization, a session taking the whole gap or more only swaps them
+		const SessionRate* best = nullptr;
+		double bestDistance = gap / 2;
+		for (const auto& session : hot->sessions) {
+			double share = hot->utilization * session.messageRate / totalRate;
+			double distance = std::abs(share - gap / 2);
+			if (share > 0.0 && share < gap && distance < bestDistance) {
+				best = &session;
+				bestDistance = distance;
+			}
+		}
+		if (best == nullptr) {
+			return {};
+		}
+		return Migration{ static_cast<size_t>(std::distance(workers.cbegin(), hot)), static_cast<size_t>(std::distance(workers.cbegin(), cool)), best->acCode };
+	}
+
+	void SessionBalancer::migrated(const Clock::time_point now) {
+		lastMigration = now;
+		imbalancedSince.reset();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace server {
+	struct SessionRate {
+		std::string acCode;
+		double messageRate; // Messages per second over the last utilization window
+	};
+
+	// Decides in master when a session moves from the busiest worker to the least busy one. Worker utilization
+	// is split between its sessions by their message rates, the session which evens out both workers best is moved.
+	class SessionBalancer {
+	public:
+		using Clock = std::chrono::steady_clock;
+		struct Thresholds {
+			double hotUtilization = 0.7; // Busiest worker has to be over it
+			double minImbalance = 0.3; // Utilization difference between the busiest and the least busy worker
+			std::chrono::seconds sustain{ 10 };
+			std::chrono::seconds cooldown{ 30 }; // Moved session shows on its new worker within one window
+		};
+		struct WorkerSessions {
+			double utilization;
+			std::vector<SessionRate> sessions;
+		};
+		struct Migration {
+			size_t source;
+			size_t target;
+			std::string acCode;
+		};
+		SessionBalancer(const Thresholds& thresholds);
+
+		std::optional<Migration> decide(const std::vector<WorkerSessions>& workers, const Clock::time_point now);
+		void migrated(const Clock::time_point now);
+	private:
+		Thresholds thresholds;
+		std::optional<Clock::time_point> imbalancedSince;
+		std::optional<Clock::time_point> lastMigration;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,143 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace server {
+	using TimerId = unsigned long long;
+
+	// Hierarchical timer wheel with O(1) schedule and cancel. Level 0 slots are one tick wide, every next level
+	// is slotCount times coarser, its timers are moved down a level when the lower one completes a round.
+	// Time moves only in advance, which the owner calls once per event loop iteration.
+	template <typename Event>
+	class TimerWheel {
+	public:
+		using Clock = std::chrono::steady_clock;
+		struct Expired {
+			TimerId id;
+			Event event;
+		};
+		TimerWheel(const Clock::duration tick = std::chrono::milliseconds(100), const Clock::time_point start = Clock::now()) :
+			tick(tick),
+			start(start) {}
+
+		TimerId schedule(const Clock::duration delay, Event event) {
+			// Rounded up, a timer never fires early
+			unsigned long long ticks = (std::max)(1ll, static_cast<long long>((delay + tick - Clock::duration{ 1 }) / tick));
+			TimerId id = ++lastId;
+			auto timer = timers.emplace(id, Timer{ current + ticks, 0, 0, {}, std::move(event) }).first;
+			place(id, timer->second);
+			return id;
+		}
+
+		bool cancel(const TimerId id) {
+			auto timer = timers.find(id);
+			if (timer == timers.end()) {
+				return false;
+			}
+			wheel[timer->second.level][timer->second.slot].erase(timer->second.position);
+			timers.erase(timer);
+			return true;
+		}
+
+		std::vector<Expired> advance(const Clock::time_point now) {
+			std::vector<Expired> expired;
+			unsigned long long target = now > start ? static_cast<unsigned long long>((now - start) / tick) : 0;
+			while (current < target) {
+				if (timers.empty()) {
+					current = target;
+					break;
+				}
+				current++;
+				cascade();
+				auto& due = wheel[0][current & slotMask];
+				for (auto id : due) {
+					auto timer = timers.find(id);
+					expired.emplace_back(Expired{ id, std::move(timer->second.event) });
+					timers.erase(timer);
+				}
+				due.clear();
+			}
+			return expired;
+		}
+
+		// Time until the next tick with a due timer or with timers to move down, nothing if there are no timers
+		std::optional<Clock::duration> untilNext(const Clock::time_point now) const {
+			if (timers.empty()) {
+				return {};
+			}
+			unsigned long long ticks = slotCount - (current & slotMask);
+			for (unsigned long long i = 1; i < ticks; i++) {
+				if (!wheel[0][(current + i) & slotMask].empty()) {
+					ticks = i;
+					break;
+				}
+			}
+			Clock::time_point deadline = start + tick * static_cast<Clock::rep>(current + ticks);
+			return deadline > now ? deadline - now : Clock::duration{ 0 };
+		}
+
+		unsigned long long getTick() const {
+			return current;
+		}
+
+		Clock::duration getTickDuration() const {
+			return tick;
+		}
+
+		size_t size() const {
+			return timers.size();
+		}
+	private:
+		static constexpr int slotBits = 6;
+		static constexpr unsigned long long slotCount = 1ull << slotBits;
+		static constexpr unsigned long long slotMask = slotCount - 1;
+		static constexpr int levelCount = 4; // 100 ms ticks cover ~19 days, later timers wait in the last level
+
+		struct Timer {
+			unsigned long long expiry; // Tick the timer fires at
+			int level;
+			int slot;
+			typename std::list<TimerId>::iterator position;
+			Event event;
+		};
+
+		void place(const TimerId id, Timer& timer) {
+			unsigned long long delta = timer.expiry > current ? timer.expiry - current : 0;
+			int level = 0;
+			while (level < levelCount - 1 && delta >= (1ull << (slotBits * (level + 1)))) {
+				level++;
+			}
+			unsigned long long expiry = (std::min)(timer.expiry, current + (1ull << (slotBits * levelCount)) - 1);
+			timer.level = level;
+			timer.slot = static_cast<int>((expiry >> (slotBits * level)) & slotMask);
+			auto& slot = wheel[level][timer.slot];
+			timer.position = slot.insert(slot.end(), id);
+		}
+
+		void cascade() {
+			// Higher levels go first, their timers may land in a lower level slot which is moved down right after
+			int topLevel = 0;
+			while (topLevel < levelCount - 1 && (current & ((1ull << (slotBits * (topLevel + 1))) - 1)) == 0) {
+				topLevel++;
+			}
+			for (int level = topLevel; level > 0; level--) {
+				auto ids = std::move(wheel[level][(current >> (slotBits * level)) & slotMask]);
+				wheel[level][(current >> (slotBits * level)) & slotMask].clear();
+				for (auto id : ids) {
+					place(id, timers.find(id)->second);
+				}
+			}
+		}
+
+		Clock::duration tick;
+		Clock::time_point start;
+		unsigned long long current = 0; // Ticks since start
+		TimerId lastId = 0;
+		std::array<std::array<std::list<TimerId>, slotCount>, levelCount> wheel;
+		std::unordered_map<TimerId, Timer> timers;
+	};
+}
\ No newline at end of file
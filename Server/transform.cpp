@@ -0,0 +1,33 @@
+#include "transform.h"
+
+COORD transformPos(const COORD& pos, const AppliedEdit& edit) {
+	// Same rules as WriteAction::move/EraseAction::move, positions inside erased range collapse to its start
+	if (edit.endPos < edit.startPos && edit.endPos < pos && pos <= edit.startPos) {
+		return edit.endPos;
+	}
+	COORD diff = edit.endPos - edit.startPos;
+	if (pos.Y == edit.startPos.Y && pos.X >= edit.startPos.X) {
+		return pos + diff;
+	}
+	else if (pos.Y > edit.startPos.Y) {
+		return pos + COORD{ 0, diff.Y };
+	}
+	return pos;
+}
+
+
+AppliedEdit transformEdit(const AppliedEdit& edit, const AppliedEdit& against) {
+	AppliedEdit moved = edit;
+	if (edit.endPos < edit.startPos) {
+		// Erased range keeps its ends, both of them are moved
+		moved.startPos = transformPos(edit.startPos, against);
+		moved.endPos = transformPos(edit.endPos, against);
+		return moved;
+	}
+	// Written text keeps its shape, only the last line of multiline text starts at column 0
+	moved.startPos = transformPos(edit.startPos, against);
+	moved.endPos = edit.endPos.Y == edit.startPos.Y ?
+		makeCoord(moved.startPos.X + edit.endPos.X - edit.startPos.X, moved.startPos.Y) :
+		makeCoord(edit.endPos.X, moved.startPos.Y + edit.endPos.Y - edit.startPos.Y);
+	return moved;
+}
\ No newline at end of file
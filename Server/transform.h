@@ -0,0 +1,14 @@
+#pragma once
+#include "pos_helpers.h"
+
+// Text edit applied to the server document at given version. For write endPos is the end of inserted text,
+// for erase startPos is the right end of erased range and endPos the left one.
+struct AppliedEdit {
+	unsigned int version;
+	int user;
+	COORD startPos;
+	COORD endPos;
+};
+
+COORD transformPos(const COORD& pos, const AppliedEdit& edit);
+AppliedEdit transformEdit(const AppliedEdit& edit, const AppliedEdit& against);
@@ -1,38 +1,30 @@
 #include <WS2tcpip.h>
 #include <iostream>
+#include <algorithm>
 
 #include "worker.h"
+#include "serializer.h"
 #include "logging.h"
 
 using namespace server;
 
 constexpr int defaultBuffSize = 128;
 
-Worker::Worker(const std::string& ip, const int port, server::Authenticator* auth):
-    repo(auth) {
+Worker::Worker(const std::string& ip, const int port, server::Authenticator* auth, const int compressionThreshold, const server::RateLimiter::Limits& rateLimits, const size_t memoryBudget):
+    compressionThreshold(compressionThreshold),
+    repo(auth),
+    limiter(rateLimits),
+    memoryBudget(memoryBudget) {
     std::scoped_lock lock{connSetLock};
     FD_ZERO(&connections);
+    openPresenceSocket(ip);
 	thread = std::thread{ &Worker::connectToMaster, this, ip, port };
 }
 
-Worker::Worker(Worker&& worker) noexcept :
-    connSetLock(),
-    masterListener(std::move(worker.masterListener)),
-    connections(std::move(worker.connections)),
-    masterAddress(std::move(worker.masterAddress)),
-    repo(std::move(worker.repo)) {
+void Worker::start() {
     thread = std::thread{ &Worker::handleConnections, this };
 }
 
-Worker& Worker::operator=(Worker&& worker) noexcept {
-    masterListener = std::move(worker.masterListener);
-    connections = std::move(worker.connections);
-    masterAddress = std::move(worker.masterAddress);
-    thread = std::move(worker.thread);
-    repo = std::move(worker.repo);
-    return *this;
-}
-
 bool Worker::connectToMaster(const std::string& ip, const int port) {
     // Create a communication pipe to master
     SOCKET masterListenerSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
@@ -57,7 +49,30 @@ bool Worker::connectToMaster(const std::string& ip, const int port) {
     return true;
 }
 
+bool Worker::openPresenceSocket(const std::string& ip) {
+    SOCKET udpSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (udpSocket == INVALID_SOCKET) {
+        logger.logError(WSAGetLastError(), ": Error on creating presence socket, presence goes over TCP");
+        return false;
+    }
+    sockaddr_in address = { 0 };
+    address.sin_family = AF_INET;
+    address.sin_port = 0;
+    std::wstring ipStr{ip.begin(), ip.end()};
+    InetPton(AF_INET, ipStr.c_str(), &address.sin_addr.s_addr);
+    if (bind(udpSocket, reinterpret_cast<SOCKADDR*>(&address), sizeof(address)) == SOCKET_ERROR) {
+        logger.logError(WSAGetLastError(), ": Error on binding presence socket, presence goes over TCP");
+        closesocket(udpSocket);
+        return false;
+    }
+    presenceSocket = udpSocket;
+    return true;
+}
+
 void Worker::handleConnections() {
+    loopTime = utilizationWindowStart = std::chrono::steady_clock::now();
+    timers.schedule(cleanupInterval, Housekeeping{ Housekeeping::Kind::cleanup });
+    timers.schedule(memoryCheckInterval, Housekeeping{ Housekeeping::Kind::memoryCheck });
     while (opened) {
         FD_SET listenConnections;
         {
@@ -67,25 +82,475 @@ void Worker::handleConnections() {
         if (listenConnections.fd_count == 0) {
             continue;
         }
-        int socketCount = select(0, &listenConnections, nullptr, nullptr, nullptr);
-        for (int i = 0; i < socketCount; i++) {
+        // While snapshots are streamed don't block, each iteration sends one chunk per transfer.
+        // Moved cursors wait at most one presence interval for the next presence frame
+        timeval noWait{ 0, 0 };
+        timeval presenceWait{ 0, static_cast<long>(std::chrono::microseconds(repo.getPresenceInterval()).count()) };
+        timeval retryWait{ 0, static_cast<long>(std::chrono::microseconds(limiter.getRetryInterval()).count()) };
+        bool hasBulkWork = repo.hasPendingSnapshots() || repo.hasBulkSteps() || scheduler.hasBulk();
+        timeval* timeout = hasBulkWork ? &noWait : limiter.hasDelayed() ? &retryWait : repo.hasPendingPresence() ? &presenceWait : nullptr;
+        timeval timerWait;
+        auto selectStart = std::chrono::steady_clock::now();
+        sampleLatency(selectStart);
+        if (auto untilTimer = timers.untilNext(selectStart)) {
+            long long micros = std::chrono::duration_cast<std::chrono::microseconds>(*untilTimer).count();
+            if (timeout == nullptr || micros < timeout->tv_sec * 1000000ll + timeout->tv_usec) {
+                timerWait = { static_cast<long>(micros / 1000000), static_cast<long>(micros % 1000000) };
+                timeout = &timerWait;
+            }
+        }
+        // Connections with too many delayed messages are not read, TCP pushes back on the client
+        for (int i = listenConnections.fd_count - 1; i >= 0; i--) {
+            if (limiter.isSaturated(listenConnections.fd_array[i])) {
+                FD_CLR(listenConnections.fd_array[i], &listenConnections);
+            }
+        }
+        // Connections with queued frames are watched until their socket buffer takes them
+        FD_SET writeConnections;
+        FD_ZERO(&writeConnections);
+        for (const auto& [connection, queue] : outboundQueues) {
+            if (!queue.empty()) {
+                FD_SET(connection, &writeConnections);
+            }
+        }
+        int socketCount = select(0, &listenConnections, &writeConnections, nullptr, timeout);
+        loopTime = std::chrono::steady_clock::now();
+        idleTime += loopTime - selectStart;
+        handedOffConnections.clear();
+        if (socketCount > 0) {
+            flushOutbound(writeConnections);
+        }
+        runTimers();
+        for (int i = 0; i < socketCount && i < listenConnections.fd_count && !drained; i++) {
             SOCKET client = listenConnections.fd_array[i];
-            auto msgBuffers = extractor.extractMessages(client);
-            for (auto& msgBuffer : msgBuffers) {
-                server::Response response = processMsg(client, msgBuffer);
-                if (response.msgType == msg::Type::create || response.msgType == msg::Type::join) {
-                    syncClientState(response);
+            if (handedOffConnections.contains(client)) {
+                continue; // Migrated to another worker, which reads it from now on
+            }
+            std::vector<msg::OneByteInt> streams;
+            auto msgBuffers = extractor.extractMessages(client, streams);
+            for (int j = 0; j < msgBuffers.size(); j++) {
+                auto& msgBuffer = msgBuffers[j];
+                // Messages from master carry the client id in their socket field
+                SOCKET sender = client == masterListener ? client : makeClientId(client, j < streams.size() ? streams[j] : 0);
+                if (msgBuffer.size <= 0) {
+                    closeConnection(sender, msgBuffer);
+                    continue;
+                }
+                if (client == masterListener) {
+                    msg::Type type;
+                    msg::parse(msgBuffer, 0, type);
+                    if (type == msg::Type::masterDrain) {
+                        drain();
+                        break;
+                    }
+                    if (type == msg::Type::masterAdopt) {
+                        adoptHandoffs();
+                        continue;
+                    }
+                    if (type == msg::Type::masterMigrate) {
+                        migrateSessions();
+                        continue;
+                    }
+                    // Session requests from master are bulk, master close is handled right away
+                    if (scheduler.classify(msgBuffer) == Scheduler::Priority::bulk) {
+                        scheduler.push(sender, "", std::move(msgBuffer), repo.isReplacing(""));
+                        continue;
+                    }
+                    handleMessage(sender, msgBuffer);
+                    continue;
+                }
+                markActivity(client);
+                msg::Type type;
+                msg::parse(msgBuffer, 0, type);
+                if (type == msg::Type::heartbeat) {
+                    continue; // Answer to a heartbeat, it only shows the connection is alive
+                }
+                auto session = repo.getAcCode(sender);
+                if (!session.empty()) {
+                    sessionMessages[session]++;
                 }
-                else if (response.msgType == msg::Type::masterClose) {
-                    opened = false;
+                if (!limiter.admit(sender, session, msgBuffer)) {
+                    limiter.delay(sender, session, std::move(msgBuffer));
+                    continue;
                 }
-                sendResponses(response);
+                scheduler.push(sender, session, std::move(msgBuffer), repo.isReplacing(session));
             }
         }
+        if (drained) {
+            break;
+        }
+        for (auto& delayed : limiter.takeReady()) {
+            scheduler.push(delayed.client, delayed.session, std::move(delayed.buffer), repo.isReplacing(delayed.session), delayed.rejected);
+        }
+        for (auto& task : scheduler.takeInteractive()) {
+            runTask(task);
+        }
+        runBulkSlice();
+        for (auto& response : repo.nextSnapshotChunks()) {
+            sendResponses(response);
+        }
+        for (auto& frame : repo.nextPresenceFrames()) {
+            sendPresence(frame);
+        }
+        resyncDrainedConnections();
+        armAutosaves();
+        publishLoad();
     }
     close();
 }
 
+void Worker::handleMessage(const SOCKET client, msg::Buffer& buffer) {
+    batchMessages++;
+    server::Response response = processMsg(client, buffer);
+    if (response.msgType == msg::Type::create || response.msgType == msg::Type::load || response.msgType == msg::Type::join) {
+        markActivity(getConnection(response.destinations.back()));
+        syncClientState(response);
+    }
+    else if (response.msgType == msg::Type::masterClose) {
+        opened = false;
+    }
+    for (auto& frame : repo.takePresenceFrames()) {
+        sendPresence(frame);
+    }
+    sendResponses(response);
+}
+
+void Worker::sampleLatency(const std::chrono::steady_clock::time_point batchEnd) {
+    // Clock is not read per message, messages of one loop iteration get the average time of the iteration since select returned
+    if (batchMessages == 0) {
+        return;
+    }
+    long long latency = std::chrono::duration_cast<std::chrono::microseconds>(batchEnd - loopTime).count() / batchMessages;
+    latencyMicros = (latencyMicros * 7 + latency) / 8;
+    latencySampledAt = batchEnd.time_since_epoch().count();
+    batchMessages = 0;
+}
+
+void Worker::runTask(Scheduler::Task& task) {
+    if (task.rejected) {
+        auto response = repo.reject(task.client, task.buffer);
+        sendResponses(response);
+        return;
+    }
+    handleMessage(task.client, task.buffer);
+}
+
+void Worker::runBulkSlice() {
+    // Bulk work yields once its slice is used up, so interactive messages wait at most about one slice
+    auto isBusy = [this](const std::string& session) { return repo.isReplacing(session); };
+    auto deadline = std::chrono::steady_clock::now() + scheduler.getBulkSlice();
+    do {
+        repo.stepSaves();
+        for (auto& response : repo.stepReplaces()) {
+            sendResponses(response);
+        }
+        auto task = scheduler.takeBulk(isBusy);
+        if (task) {
+            runTask(*task);
+        }
+        else if (!repo.hasBulkSteps()) {
+            break;
+        }
+    } while (std::chrono::steady_clock::now() < deadline);
+}
+
+void Worker::closeConnection(const SOCKET connection, msg::Buffer& buffer) {
+    // Queued messages of a closing connection are processed before it is shut down
+    for (auto& response : repo.completeReplaces()) {
+        sendResponses(response);
+    }
+    for (auto& task : scheduler.takeConnection(connection)) {
+        runTask(task);
+    }
+    handleMessage(connection, buffer);
+}
+
+void Worker::runTimers() {
+    for (auto& [id, event] : timers.advance(loopTime)) {
+        switch (event.kind) {
+        case Housekeeping::Kind::autosave:
+            autosaves.erase(event.acCode);
+            repo.saveSession(event.acCode);
+            break;
+        case Housekeeping::Kind::idleCheck:
+            checkIdle(event.connection);
+            break;
+        case Housekeeping::Kind::cleanup:
+            limiter.collectIdleBuckets();
+            repo.collectClosedDocs();
+            timers.schedule(cleanupInterval, Housekeeping{ Housekeeping::Kind::cleanup });
+            break;
+        case Housekeeping::Kind::memoryCheck:
+            repo.hibernateSessions(memoryBudget, static_cast<unsigned int>(hibernateAfter / memoryCheckInterval));
+            timers.schedule(memoryCheckInterval, Housekeeping{ Housekeeping::Kind::memoryCheck });
+            break;
+        }
+    }
+}
+
+void Worker::armAutosaves() {
+    // Every edit postpones the save, until the first unsaved edit is autosaveMaxDelay old
+    for (const auto& acCode : repo.takeEditedSessions()) {
+        auto [autosave, newOne] = autosaves.try_emplace(acCode, Autosave{ 0, loopTime });
+        if (!newOne) {
+            if (loopTime - autosave->second.dirtySince >= autosaveMaxDelay) {
+                continue;
+            }
+            timers.cancel(autosave->second.timer);
+        }
+        autosave->second.timer = timers.schedule(autosaveDelay, Housekeeping{ Housekeeping::Kind::autosave, INVALID_SOCKET, acCode });
+    }
+}
+
+void Worker::markActivity(const SOCKET connection) {
+    auto [entry, newOne] = liveness.try_emplace(connection, Liveness{ 0, loopTime });
+    entry->second.lastActivity = loopTime;
+    if (newOne) {
+        entry->second.timer = timers.schedule(heartbeatInterval, Housekeeping{ Housekeeping::Kind::idleCheck, connection });
+    }
+}
+
+void Worker::checkIdle(const SOCKET connection) {
+    auto entry = liveness.find(connection);
+    if (entry == liveness.end()) {
+        return;
+    }
+    auto clients = repo.getStreamClients(connection);
+    clients.push_back(connection);
+    bool answersHeartbeats = std::any_of(clients.cbegin(), clients.cend(), [this](const SOCKET client) { return msg::answersHeartbeats(repo.getVersion(client)); });
+    bool inSession = std::any_of(clients.cbegin(), clients.cend(), [this](const SOCKET client) { return repo.getVersion(client) != 0; });
+    auto silent = loopTime - entry->second.lastActivity;
+    // Older clients in a session stay connected, silence is all they can show when only reading
+    if (silent >= idleTimeout && (answersHeartbeats || !inSession)) {
+        logger.logInfo("Closing connection", connection, "idle for", std::chrono::duration_cast<std::chrono::seconds>(silent).count(), "s");
+        liveness.erase(entry);
+        msg::Buffer closeBuffer{ 0 };
+        closeConnection(connection, closeBuffer);
+        return;
+    }
+    if (silent >= heartbeatInterval && answersHeartbeats) {
+        msg::Buffer heartbeat = makeFrame(Serializer::makeHeartbeat(msg::currentVersion));
+        sendFrame(connection, heartbeat, false);
+    }
+    auto nextCheck = silent >= heartbeatInterval ? heartbeatInterval : heartbeatInterval - silent;
+    entry->second.timer = timers.schedule(nextCheck, Housekeeping{ Housekeeping::Kind::idleCheck, connection });
+}
+
+void Worker::publishLoad() {
+    size_t depth = limiter.getDelayedCount() + scheduler.size();
+    for (const auto& [connection, queue] : outboundQueues) {
+        depth += queue.size();
+    }
+    queueDepth = static_cast<unsigned int>(depth);
+    publishUtilization();
+}
+
+void Worker::publishUtilization() {
+    // Time outside select is spent on messages and housekeeping, master sizes the pool by it
+    auto window = loopTime - utilizationWindowStart;
+    if (window < utilizationWindow) {
+        return;
+    }
+    auto busy = window - (std::min)(idleTime, window);
+    utilizationPermille = static_cast<unsigned int>(busy * 1000 / window);
+    utilizationSampledAt = loopTime.time_since_epoch().count();
+    std::vector<SessionRate> rates;
+    double seconds = std::chrono::duration<double>(window).count();
+    for (const auto& [acCode, messages] : sessionMessages) {
+        rates.emplace_back(SessionRate{ acCode, messages / seconds });
+    }
+    sessionMessages.clear();
+    {
+        std::scoped_lock lock{sessionRatesLock};
+        sessionRates = std::move(rates);
+    }
+    utilizationWindowStart = loopTime;
+    idleTime = std::chrono::steady_clock::duration{ 0 };
+}
+
+std::vector<server::SessionRate> Worker::getSessionRates() const {
+    std::scoped_lock lock{sessionRatesLock};
+    return sessionRates;
+}
+
+server::WorkerLoad Worker::getLoad() const {
+    using Clock = std::chrono::steady_clock;
+    return server::WorkerLoad{ queueDepth, std::chrono::microseconds{ latencyMicros }, Clock::time_point{ Clock::duration{ latencySampledAt } },
+        utilizationPermille / 1000.0, Clock::time_point{ Clock::duration{ utilizationSampledAt } } };
+}
+
+bool Worker::isDrained() const {
+    return drained;
+}
+
+void Worker::requestMigration(const std::string& acCode) {
+    std::scoped_lock lock{handoffLock};
+    migrations.push_back(acCode);
+}
+
+std::optional<Worker::Handoff> Worker::takeHandoff() {
+    std::scoped_lock lock{handoffLock};
+    return std::exchange(handoff, std::nullopt);
+}
+
+void Worker::adopt(Handoff&& handoff) {
+    std::scoped_lock lock{adoptionsLock};
+    adoptions.emplace_back(std::move(handoff));
+    pendingAdoptions++;
+}
+
+bool Worker::isAdopting() const {
+    return pendingAdoptions > 0;
+}
+
+void Worker::drain() {
+    prepareHandoff();
+    Handoff drainedHandoff;
+    drainedHandoff.repo = repo.handOffAll();
+    std::set<SOCKET> moved;
+    {
+        std::scoped_lock lock{connSetLock};
+        for (int i = 0; i < connections.fd_count; i++) {
+            if (connections.fd_array[i] != masterListener) {
+                moved.insert(connections.fd_array[i]);
+            }
+        }
+    }
+    handOffConnections(moved, drainedHandoff);
+    logger.logInfo("Drained", drainedHandoff.repo.sessions.size(), "sessions and", drainedHandoff.connections.size(), "connections");
+    {
+        std::scoped_lock lock{handoffLock};
+        handoff = std::move(drainedHandoff);
+    }
+    drained = true;
+    opened = false;
+}
+
+void Worker::migrateSessions() {
+    std::vector<std::string> requested;
+    {
+        std::scoped_lock lock{handoffLock};
+        requested = std::move(migrations);
+        migrations.clear();
+    }
+    prepareHandoff();
+    std::set<std::string> sessions;
+    for (const auto& acCode : requested) {
+        sessions.merge(repo.getLinkedSessions(acCode));
+    }
+    // Session which closed meanwhile gives an empty handoff, master waits for one either way
+    Handoff migrated;
+    migrated.repo = repo.handOff(sessions);
+    std::set<SOCKET> moved;
+    for (const auto& [client, userData] : migrated.repo.clients) {
+        moved.insert(getConnection(client));
+    }
+    handOffConnections(moved, migrated);
+    // Moved sessions don't count here anymore, master would try to move them again
+    std::erase_if(sessionMessages, [&sessions](const auto& messages) { return sessions.contains(messages.first); });
+    {
+        std::scoped_lock lock{sessionRatesLock};
+        std::erase_if(sessionRates, [&sessions](const SessionRate& rate) { return sessions.contains(rate.acCode); });
+    }
+    logger.logInfo("Migrating", migrated.repo.sessions.size(), "sessions and", migrated.connections.size(), "connections");
+    std::scoped_lock lock{handoffLock};
+    handoff = std::move(migrated);
+}
+
+void Worker::prepareHandoff() {
+    // Session requests master forwarded before are opened first, their sessions may move as well
+    for (auto& task : scheduler.takeConnection(masterListener)) {
+        runTask(task);
+    }
+    for (auto& response : repo.completeReplaces()) {
+        sendResponses(response);
+    }
+    for (auto& frame : repo.takePresenceFrames()) {
+        sendPresence(frame);
+    }
+}
+
+void Worker::handOffConnections(const std::set<SOCKET>& moved, Handoff& handoff) {
+    // Connections are not read here anymore, what their clients send meanwhile waits in the socket
+    {
+        std::scoped_lock lock{connSetLock};
+        for (auto connection : moved) {
+            FD_CLR(connection, &connections);
+        }
+    }
+    for (const auto& node : handoff.repo.sessions) {
+        if (auto autosave = autosaves.find(node.key()); autosave != autosaves.end()) {
+            timers.cancel(autosave->second.timer);
+            handoff.repo.editedSessions.insert(node.key());
+            autosaves.erase(autosave);
+        }
+    }
+    for (auto connection : moved) {
+        handedOffConnections.insert(connection);
+        handoff.connections.push_back(connection);
+        if (auto queue = outboundQueues.extract(connection)) {
+            handoff.outboundQueues.insert(std::move(queue));
+        }
+        if (auto framer = extractor.take(connection)) {
+            handoff.framers.emplace(connection, std::move(*framer));
+        }
+        for (auto& task : scheduler.takeConnection(connection)) {
+            handoff.tasks.emplace_back(std::move(task));
+        }
+        handoff.delayed.emplace(connection, limiter.takeConnection(connection));
+        if (auto entry = liveness.find(connection); entry != liveness.end()) {
+            timers.cancel(entry->second.timer);
+            handoff.lastActivity.emplace(connection, entry->second.lastActivity);
+            liveness.erase(entry);
+        }
+    }
+    for (auto address = presenceAddresses.begin(); address != presenceAddresses.end();) {
+        if (!moved.contains(getConnection(address->first))) {
+            address++;
+            continue;
+        }
+        handoff.presenceAddresses.emplace(*address);
+        address = presenceAddresses.erase(address);
+    }
+}
+
+void Worker::adoptHandoffs() {
+    std::vector<Handoff> handoffs;
+    {
+        std::scoped_lock lock{adoptionsLock};
+        handoffs = std::move(adoptions);
+        adoptions.clear();
+    }
+    for (auto& adopted : handoffs) {
+        size_t sessions = adopted.repo.sessions.size();
+        repo.adopt(std::move(adopted.repo));
+        outboundQueues.merge(adopted.outboundQueues);
+        presenceAddresses.merge(adopted.presenceAddresses);
+        for (auto& [connection, framer] : adopted.framers) {
+            extractor.adopt(connection, std::move(framer));
+        }
+        // Queued messages go before anything the connections send from now on
+        for (auto& task : adopted.tasks) {
+            scheduler.push(task.client, task.session, std::move(task.buffer), repo.isReplacing(task.session), task.rejected);
+        }
+        for (auto& [connection, delayed] : adopted.delayed) {
+            limiter.adoptConnection(connection, std::move(delayed));
+        }
+        for (const auto& [connection, lastActivity] : adopted.lastActivity) {
+            auto timer = timers.schedule(heartbeatInterval, Housekeeping{ Housekeeping::Kind::idleCheck, connection });
+            liveness.insert_or_assign(connection, Liveness{ timer, lastActivity });
+        }
+        {
+            std::scoped_lock lock{connSetLock};
+            for (auto connection : adopted.connections) {
+                FD_SET(connection, &connections);
+            }
+        }
+        logger.logInfo("Adopted", sessions, "sessions and", adopted.connections.size(), "connections");
+    }
+    pendingAdoptions -= static_cast<unsigned int>(handoffs.size());
+}
+
 bool Worker::acCodeExistsInRepo(const std::string& acCode) {
     return repo.acCodeExists(acCode);
 }
@@ -95,51 +560,191 @@ bool Worker::userFileExistsInRepo(const std::string& username, const std::string
 }
 
 void Worker::close() {
+    const auto& throttled = limiter.getCounters();
+    logger.logInfo("Throttled messages: delayed", throttled.delayed, "coalesced", throttled.coalesced, "rejected", throttled.rejected);
+    for (const auto& [acCode, autosave] : autosaves) {
+        repo.saveSession(acCode);
+    }
+    const auto& scheduled = scheduler.getCounters();
+    logger.logInfo("Scheduled messages: interactive", scheduled.interactive, "bulk", scheduled.bulk);
+    repo.completeSaves();
     std::scoped_lock lock{connSetLock};
     for (int i = 0; i < connections.fd_count; i++) {
         closesocket(connections.fd_array[i]);
     }
     closesocket(masterListener);
+    closesocket(presenceSocket);
 }
 
 server::Response Worker::processMsg(const SOCKET client, msg::Buffer& buffer) {
+    if (msg::isCompressedFrame(buffer)) {
+        auto rawBuffer = msg::decompressFrame(buffer);
+        if (!rawBuffer) {
+            logger.logError("Malformed compressed message from", client);
+            return server::Response{ std::move(buffer), {}, msg::Type::error };
+        }
+        // Socket field of a compressed connect frame is inside the compressed payload
+        return processMsg(client, *rawBuffer);
+    }
+    if (buffer.size > 0 && client != masterListener) {
+        // Further sessions of an already bound connection are opened directly on its worker
+        msg::Type type;
+        msg::parse(buffer, 0, type);
+        if (type == msg::Type::create || type == msg::Type::load || type == msg::Type::join) {
+            if (buffer.size < msg::connectHeaderSize) {
+                logger.logError("Malformed", type, "message from", client);
+                return server::Response{ std::move(buffer), {}, msg::Type::error };
+            }
+            buffer.replace(msg::connectSocketPos, static_cast<unsigned int>(client));
+        }
+    }
     if (buffer.size > 0) {
         return repo.process(client, buffer);
     }
     if (buffer.size < 0) {
+        if (WSAGetLastError() == WSAEWOULDBLOCK) {
+            return server::Response{ std::move(buffer), {}, msg::Type::error };
+        }
         logger.logError(WSAGetLastError(), ": Error on receiving data from", client, "! Closing connection");
     }
     return shutdownConnection(client, buffer);
 }
 
-void Worker::syncClientState(server::Response& response) const {
+void Worker::syncClientState(server::Response& response) {
     SOCKET lastConnectedClient = response.destinations[response.destinations.size() - 1];
-    msg::Buffer msgWithSize = msg::enrich(response.buffer);
-    int sendBytes = send(lastConnectedClient, msgWithSize.get(), msgWithSize.size, 0);
-    if (sendBytes <= 0) {
-        logger.logError("Error on sending data to", lastConnectedClient);
+    msg::Buffer msgWithSize = makeFrame(response.buffer);
+    sendFrame(lastConnectedClient, msgWithSize, false);
+    for (auto& replay : repo.takeReplays()) {
+        sendResponses(replay);
     }
     response.destinations.pop_back();
     response.buffer.clear();
     msg::serializeTo(response.buffer, 0, msg::Type::connect, static_cast<msg::OneByteInt>(1));
 }
 
-void Worker::sendResponses(server::Response& response) const {
-    msg::Buffer msgWithSize = msg::enrich(response.buffer);
+void Worker::sendResponses(server::Response& response) {
+    for (auto& variant : response.variants) {
+        sendResponses(variant);
+    }
+    if (response.destinations.empty()) {
+        return;
+    }
+    msg::Buffer msgWithSize = makeFrame(response.buffer);
+    // Document updates can be dropped for slow clients, they are resynced with a snapshot instead
+    bool droppable = msg::isDocumentUpdate(response.msgType);
     for (const auto& dst : response.destinations) {
-        int sendBytes = send(dst, msgWithSize.get(), msgWithSize.size, 0);
+        sendFrame(dst, msgWithSize, droppable);
+    }
+}
+
+void Worker::sendFrame(const SOCKET client, msg::Buffer& frame, const bool droppable) {
+    if (frame.empty()) {
+        logger.logError("Message to", client, "exceeds the frame size limit, it is not sent");
+        return;
+    }
+    SOCKET connection = getConnection(client);
+    auto [queue, newOne] = outboundQueues.try_emplace(connection, connection, outboundWatermarks);
+    if (newOne) {
+        // Stalled client must not block the worker, what the socket doesn't take is queued
+        u_long nonBlocking = 1;
+        if (ioctlsocket(connection, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+            logger.logError(WSAGetLastError(), ": Error on switching", connection, "to non-blocking mode");
+        }
+    }
+    msg::setFrameStream(frame, getStream(client));
+    queue->second.push(frame, droppable);
+}
+
+void Worker::flushOutbound(const FD_SET& writable) {
+    for (int i = 0; i < writable.fd_count; i++) {
+        auto queue = outboundQueues.find(writable.fd_array[i]);
+        if (queue != outboundQueues.end()) {
+            queue->second.flush();
+        }
+    }
+}
+
+void Worker::resyncDrainedConnections() {
+    for (auto& [connection, queue] : outboundQueues) {
+        if (!queue.needsResync()) {
+            continue;
+        }
+        auto clients = repo.getStreamClients(connection);
+        clients.push_back(connection);
+        if (std::any_of(clients.cbegin(), clients.cend(), [this](const SOCKET client) { return repo.isReplacing(repo.getAcCode(client)); })) {
+            continue; // Half replaced document is not sent, resync waits for the replace
+        }
+        queue.resynced();
+        for (auto client : clients) {
+            auto response = repo.resync(client);
+            sendResponses(response);
+        }
+    }
+}
+
+void Worker::sendPresence(server::Response& response) {
+    // Clients which offered a UDP port get the frame as one datagram, the rest over their connection
+    auto tcpDestinations = std::move(response.destinations);
+    response.destinations.clear();
+    for (const auto& dst : tcpDestinations) {
+        unsigned int port = repo.getPresencePort(dst);
+        if (port == 0 || presenceSocket == INVALID_SOCKET) {
+            response.destinations.push_back(dst);
+            continue;
+        }
+        auto address = presenceAddresses.find(dst);
+        if (address == presenceAddresses.end()) {
+            sockaddr_in peerAddress = { 0 };
+            int addressSize = sizeof(peerAddress);
+            if (getpeername(getConnection(dst), reinterpret_cast<SOCKADDR*>(&peerAddress), &addressSize) == SOCKET_ERROR) {
+                response.destinations.push_back(dst);
+                continue;
+            }
+            address = presenceAddresses.emplace(dst, peerAddress).first;
+        }
+        address->second.sin_port = htons(static_cast<u_short>(port)); // Port is offered again on every join
+        msg::Buffer datagram = msg::enrich(response.buffer, getStream(dst));
+        int sendBytes = sendto(presenceSocket, datagram.get(), datagram.size, 0, reinterpret_cast<SOCKADDR*>(&address->second), sizeof(address->second));
         if (sendBytes <= 0) {
-            logger.logError("Error on sending data to", dst);
+            logger.logError(WSAGetLastError(), ": Error on sending presence datagram to", dst);
         }
     }
+    if (!response.destinations.empty()) {
+        sendResponses(response);
+    }
+}
+
+msg::Buffer Worker::makeFrame(const msg::Buffer& buffer) const {
+    auto compressed = msg::compressFrame(buffer, compressionThreshold);
+    return msg::enrich(compressed ? *compressed : buffer);
 }
 
 server::Response Worker::shutdownConnection(const SOCKET client, msg::Buffer& buffer) {
+    // Replaces in progress are finished, their documents are already partly changed
+    for (auto& response : repo.completeReplaces()) {
+        sendResponses(response);
+    }
     closesocket(client);
     shutdown(client, SD_SEND);
     logger.logDebug("Closing connection with", client);
+    // Sessions on other streams of the connection are left before the one on stream 0
+    for (auto streamClient : repo.getStreamClients(client)) {
+        msg::Buffer disconnectBuffer{ 2 };
+        msg::serializeTo(disconnectBuffer, 0, msg::Type::disconnect, msg::currentVersion);
+        presenceAddresses.erase(streamClient);
+        auto response = repo.process(streamClient, disconnectBuffer, false);
+        sendResponses(response);
+    }
     buffer.clear();
-    msg::serializeTo(buffer, 0, msg::Type::disconnect, static_cast<msg::OneByteInt>(1), "");
+    msg::serializeTo(buffer, 0, msg::Type::disconnect, msg::currentVersion);
+    presenceAddresses.erase(client);
+    outboundQueues.erase(client);
+    limiter.erase(client);
+    extractor.reset(client);
+    if (auto entry = liveness.find(client); entry != liveness.end()) {
+        timers.cancel(entry->second.timer);
+        liveness.erase(entry);
+    }
     std::scoped_lock lock{connSetLock};
     FD_CLR(client, &connections);
     return repo.process(client, buffer, false);
@@ -3,39 +3,154 @@
 #include <thread>
 #include <mutex>
 #include <set>
+#include <unordered_map>
+#include <atomic>
+#include <optional>
+#include <deque>
 
 #include "messages.h"
+#include "compression.h"
 #include "repository.h"
 #include "message_extractor.h"
+#include "outbound_queue.h"
+#include "rate_limiter.h"
+#include "scheduler.h"
+#include "timer_wheel.h"
+#include "admission_controller.h"
+#include "session_balancer.h"
 #include "authenticator.h"
 
 class Worker {
 public:
 	friend class Server;
-	Worker(const std::string& ip, const int port, server::Authenticator* auth);
-	Worker(Worker&& worker) noexcept;
-	Worker& operator=(Worker&& worker) noexcept;
+	// Everything a drained worker passes to another one, its sessions go on there without their clients noticing
+	struct Handoff {
+		server::Repository::Handoff repo;
+		std::vector<SOCKET> connections;
+		std::unordered_map<SOCKET, server::OutboundQueue> outboundQueues;
+		std::unordered_map<SOCKET, sockaddr_in> presenceAddresses;
+		std::unordered_map<SOCKET, Framer> framers;
+		std::vector<server::Scheduler::Task> tasks;
+		std::unordered_map<SOCKET, std::deque<server::RateLimiter::Delayed>> delayed;
+		std::unordered_map<SOCKET, std::chrono::steady_clock::time_point> lastActivity;
+	};
+	Worker(const std::string& ip, const int port, server::Authenticator* auth, const int compressionThreshold, const server::RateLimiter::Limits& rateLimits, const size_t memoryBudget);
 	Worker(const Worker&) = delete;
 	Worker& operator=(const Worker&) = delete;
+	void start();
 	bool acCodeExistsInRepo(const std::string& acCode);
 	bool userFileExistsInRepo(const std::string& username, const std::string& filename);
+	server::WorkerLoad getLoad() const;
+	std::vector<server::SessionRate> getSessionRates() const;
+	bool isDrained() const;
+	void requestMigration(const std::string& acCode);
+	std::optional<Handoff> takeHandoff();
+	void adopt(Handoff&& handoff);
+	bool isAdopting() const;
 private:
 	void close();
+	void drain();
+	void migrateSessions();
+	void prepareHandoff();
+	void handOffConnections(const std::set<SOCKET>& moved, Handoff& handoff);
+	void adoptHandoffs();
 	bool connectToMaster(const std::string& ip, const int port);
+	bool openPresenceSocket(const std::string& ip);
 	void handleConnections();
+	void handleMessage(const SOCKET client, msg::Buffer& buffer);
+	void sampleLatency(const std::chrono::steady_clock::time_point batchEnd);
+	void runTask(server::Scheduler::Task& task);
+	void runBulkSlice();
+	void closeConnection(const SOCKET connection, msg::Buffer& buffer);
+	void runTimers();
+	void armAutosaves();
+	void markActivity(const SOCKET connection);
+	void checkIdle(const SOCKET connection);
 	server::Response shutdownConnection(SOCKET client, msg::Buffer& buffer);
 	server::Response processMsg(SOCKET client, msg::Buffer& buffer);
-	void sendResponses(server::Response& response) const;
-	void syncClientState(server::Response& response) const;
+	void sendResponses(server::Response& response);
+	void sendPresence(server::Response& response);
+	void sendFrame(const SOCKET client, msg::Buffer& frame, const bool droppable);
+	void flushOutbound(const FD_SET& writable);
+	void resyncDrainedConnections();
+	void publishLoad();
+	void publishUtilization();
+	msg::Buffer makeFrame(const msg::Buffer& buffer) const;
+	void syncClientState(server::Response& response);
 	
+	struct Housekeeping {
+		enum class Kind {
+			autosave,
+			idleCheck,
+			cleanup,
+			memoryCheck
+		};
+		Kind kind;
+		SOCKET connection = INVALID_SOCKET;
+		std::string acCode;
+	};
+	struct Autosave {
+		server::TimerId timer;
+		std::chrono::steady_clock::time_point dirtySince; // First edit which is not saved yet
+	};
+	struct Liveness {
+		server::TimerId timer;
+		std::chrono::steady_clock::time_point lastActivity;
+	};
+
 	bool opened = true;
 	std::mutex connSetLock;
 	FD_SET connections;
 
+	int compressionThreshold;
 	sockaddr_in masterAddress = { 0 };
 	SOCKET masterListener = INVALID_SOCKET;
+	SOCKET presenceSocket = INVALID_SOCKET; // Sends presence frames to clients which offered a UDP port
+	std::unordered_map<SOCKET, sockaddr_in> presenceAddresses; // Keyed by ClientId
+	std::unordered_map<SOCKET, server::OutboundQueue> outboundQueues; // Keyed by connection
+	server::OutboundQueue::Watermarks outboundWatermarks;
 	std::thread thread;
 
 	server::Repository repo;
+	server::RateLimiter limiter;
+	server::Scheduler scheduler{ server::Scheduler::Budget{} };
+
+	// Housekeeping timers, the clock is read once per loop iteration
+	server::TimerWheel<Housekeeping> timers;
+	std::chrono::steady_clock::time_point loopTime;
+	std::unordered_map<std::string, Autosave> autosaves; // Keyed by acCode
+	std::unordered_map<SOCKET, Liveness> liveness; // Keyed by connection
+	std::chrono::seconds autosaveDelay{ 5 }; // Session is saved when edits stop for this long,
+	std::chrono::seconds autosaveMaxDelay{ 300 }; // but at the latest this long after its first unsaved edit
+	std::chrono::seconds heartbeatInterval{ 30 }; // Silent connections are probed, if their clients answer heartbeats
+	std::chrono::seconds idleTimeout{ 120 };
+	std::chrono::seconds cleanupInterval{ 60 };
+	size_t memoryBudget; // Bytes of session text and history, least recently used sessions are hibernated above it
+	std::chrono::seconds memoryCheckInterval{ 10 };
+	std::chrono::seconds hibernateAfter{ 600 }; // Sessions unused this long are hibernated even under the budget
+
+	// Load read by master for admission control and pool sizing
+	std::atomic<unsigned int> queueDepth = 0;
+	std::atomic<long long> latencyMicros = 0; // Moving average of message handling time, sampled once per loop iteration
+	unsigned int batchMessages = 0; // Handled since loopTime
+	std::atomic<long long> latencySampledAt = 0; // steady_clock ticks
+	std::atomic<unsigned int> utilizationPermille = 0;
+	std::atomic<long long> utilizationSampledAt = 0; // steady_clock ticks
+	std::chrono::steady_clock::time_point utilizationWindowStart;
+	std::chrono::steady_clock::duration idleTime{ 0 }; // Spent in select since the window start
+	std::chrono::milliseconds utilizationWindow{ 1000 };
+	std::unordered_map<std::string, unsigned int> sessionMessages; // Keyed by acCode, counted over the utilization window
+	mutable std::mutex sessionRatesLock;
+	std::vector<server::SessionRate> sessionRates;
+
+	// Retiring or migrating, worker leaves a handoff for master, which passes it to an adopting worker
+	std::atomic<bool> drained = false;
+	std::mutex handoffLock;
+	std::optional<Handoff> handoff;
+	std::vector<std::string> migrations; // Sessions master asked to move, taken on its masterMigrate message
+	std::set<SOCKET> handedOffConnections; // Moved in the current iteration, they are still in its select result
+	std::mutex adoptionsLock;
+	std::vector<Handoff> adoptions; // Given by master, taken on its masterAdopt message
+	std::atomic<unsigned int> pendingAdoptions = 0;
 	MessageExtractor extractor;
 };
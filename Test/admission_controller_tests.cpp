@@ -0,0 +1,39 @@
+#include "pch.h"
+#include "admission_controller.h"
+
+server::WorkerLoad makeLoad(const unsigned int queueDepth, const std::chrono::microseconds latency) {
+	return server::WorkerLoad{ queueDepth, latency, std::chrono::steady_clock::now() };
+}
+
+TEST(AdmissionControllerTests, AdmitsBelowThresholdsTest) {
+	server::AdmissionController::Thresholds thresholds;
+	server::AdmissionController admission{ thresholds };
+	EXPECT_TRUE(admission.admit(makeLoad(thresholds.maxQueueDepth, thresholds.maxLatency)));
+	EXPECT_FALSE(admission.admit(makeLoad(thresholds.maxQueueDepth + 1, std::chrono::microseconds{ 0 })));
+	EXPECT_FALSE(admission.admit(makeLoad(0, thresholds.maxLatency + std::chrono::microseconds{ 1 })));
+	EXPECT_EQ(admission.getCounters().admitted, 1);
+}
+
+TEST(AdmissionControllerTests, StaleLatencyIsIgnoredTest) {
+	server::AdmissionController::Thresholds thresholds;
+	server::AdmissionController admission{ thresholds };
+	server::WorkerLoad idle{ 0, thresholds.maxLatency * 10, std::chrono::steady_clock::now() - thresholds.latencyWindow * 2 };
+	EXPECT_TRUE(admission.admit(idle));
+}
+
+TEST(AdmissionControllerTests, DeferredRequestsAreBoundedAndErasedWithConnectionTest) {
+	server::AdmissionController::Thresholds thresholds;
+	thresholds.maxDeferred = 2;
+	server::AdmissionController admission{ thresholds };
+	EXPECT_TRUE(admission.defer(1, msg::Buffer{ 8 }));
+	EXPECT_TRUE(admission.defer(2, msg::Buffer{ 8 }));
+	EXPECT_FALSE(admission.defer(3, msg::Buffer{ 8 }));
+	admission.erase(1);
+	auto deferred = admission.takeDeferred();
+	ASSERT_EQ(deferred.size(), 1);
+	EXPECT_EQ(deferred[0].client, 2);
+	EXPECT_FALSE(admission.isExpired(deferred[0]));
+	EXPECT_FALSE(admission.hasDeferred());
+	admission.retryLater(std::move(deferred[0]));
+	EXPECT_TRUE(admission.hasDeferred());
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "pch.h"
+#include "messages.h"
+#include "schema.h"
+#include "compression.h"
+
+static std::string makeDocumentText(const int nLines) {
+	std::string text;
+	for (int i = 0; i < nLines; i++) {
+		text += "line " + std::to_string(i) + ": the quick brown fox jumps over the lazy dog\n";
+	}
+	return text;
+}
+
+TEST(CompressionTests, ConnectResponseRoundTripTest) {
+	msg::ConnectResponse msg{ msg::Type::join, msg::compactVersion, 0, "", "code", makeDocumentText(500), { 1, 2 }, { 0, 0 } };
+	auto frame = msg::serialize(msg);
+	auto compressed = msg::compressFrame(frame, msg::defaultCompressionThreshold);
+	ASSERT_TRUE(compressed.has_value());
+	EXPECT_TRUE(msg::isCompressedFrame(*compressed));
+	EXPECT_LT(compressed->size * 4, frame.size);
+
+	auto raw = msg::decompressFrame(*compressed);
+	ASSERT_TRUE(raw.has_value());
+	EXPECT_FALSE(msg::isCompressedFrame(*raw));
+	ASSERT_EQ(raw->size, frame.size);
+	EXPECT_EQ(memcmp(raw->get(), frame.get(), frame.size), 0);
+	auto parsed = msg::deserialize<msg::ConnectResponse>(*raw).value();
+	EXPECT_EQ(parsed.text, msg.text);
+	EXPECT_EQ(parsed.version, msg::compactVersion);
+}
+
+TEST(CompressionTests, OverlappingReferenceTest) {
+	msg::Write msg{ msg::Type::write, msg::compactVersion, "", std::string(5000, 'a') };
+	auto frame = msg::serialize(msg);
+	auto compressed = msg::compressFrame(frame, 16);
+	ASSERT_TRUE(compressed.has_value());
+	EXPECT_LT(compressed->size, 32);
+	auto raw = msg::decompressFrame(*compressed);
+	ASSERT_TRUE(raw.has_value());
+	EXPECT_EQ(msg::deserialize<msg::Write>(*raw).value().text, msg.text);
+}
+
+TEST(CompressionTests, SkipsSmallAndLegacyFramesTest) {
+	auto text = makeDocumentText(100);
+	auto small = msg::serialize(msg::Write{ msg::Type::write, msg::compactVersion, "", "abc" });
+	EXPECT_FALSE(msg::compressFrame(small, msg::defaultCompressionThreshold).has_value());
+	auto legacy = msg::serialize(msg::Write{ msg::Type::write, msg::legacyVersion, "token", text });
+	EXPECT_FALSE(msg::compressFrame(legacy, msg::defaultCompressionThreshold).has_value());
+	auto compact = msg::serialize(msg::Write{ msg::Type::write, msg::compactVersion, "", text });
+	EXPECT_TRUE(msg::compressFrame(compact, msg::defaultCompressionThreshold).has_value());
+}
+
+TEST(CompressionTests, IncompressibleFrameIsLeftAloneTest) {
+	std::string noise;
+	unsigned int state = 12345;
+	for (int i = 0; i < 4096; i++) {
+		state = state * 1103515245 + 12345;
+		noise.push_back(static_cast<char>(1 + (state >> 16) % 255));
+	}
+	auto frame = msg::serialize(msg::Write{ msg::Type::write, msg::compactVersion, "", noise });
+	EXPECT_FALSE(msg::compressFrame(frame, msg::defaultCompressionThreshold).has_value());
+}
+
+TEST(CompressionTests, MalformedStreamIsRejectedTest) {
+	msg::Buffer frame{16};
+	msg::OneByteInt version = msg::compactVersion | msg::compressedFlag;
+	// Back-reference before any output was produced
+	msg::serializeTo(frame, 0, msg::Type::write, version, msg::VarInt{ 8 }, msg::VarInt{ 1 }, msg::VarInt{ 3 });
+	EXPECT_FALSE(msg::decompressFrame(frame).has_value());
+
+	msg::Buffer truncated{16};
+	msg::serializeTo(truncated, 0, msg::Type::write, version, msg::VarInt{ 8 }, msg::VarInt{ 8 << 1 }, std::string{ "abc" });
+	EXPECT_FALSE(msg::decompressFrame(truncated).has_value());
+}
\ No newline at end of file
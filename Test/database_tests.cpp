@@ -171,6 +171,21 @@ TEST(DatabaseTests, DocumentSerializationEmptyUsers) {
 	EXPECT_EQ(row, expected);
 }
 
+TEST(DatabaseTests, DocumentRouteKeyRoundTrip) {
+	server::DBDocument doc("id1", "filename.txt", { "user2", "user1" }, server::DBDocument::makeRouteKey("user1", "filename.txt"));
+	auto row = doc.serialize();
+	server::DBDocument parsed;
+	parsed.parseRow(row);
+	EXPECT_EQ(parsed.getRouteKey(), "user1/filename.txt");
+}
+
+TEST(DatabaseTests, DocumentWithoutRouteKeyIsRoutedById) {
+	std::vector<std::string> row = { "id1", "filename.txt", "user1;user2" };
+	server::DBDocument doc;
+	doc.parseRow(row);
+	EXPECT_EQ(doc.getRouteKey(), "id1");
+}
+
 TEST(DatabaseTests, ReadUserDbTest) {
 	auto db = prepareUserDb();
 	for (const auto& expectedUser : dbInitialUsers) {
@@ -373,3 +388,15 @@ TEST(DatabaseTests, AddDocAndLinkTest) {
 	prepareUserDb();
 	prepareDocDb();
 }
+
+TEST(DatabaseTests, ChunkedSaveKeepsOldTextUntilLastChunkTest) {
+	Database db{ testDbRoot };
+	ASSERT_TRUE(db.saveDoc("chunked", "old text"));
+	ASSERT_TRUE(db.saveDocChunk("chunked", "new ", true, false));
+	EXPECT_EQ(db.loadDocText("chunked"), "old text");
+
+	ASSERT_TRUE(db.saveDocChunk("chunked", "text", false, true));
+	EXPECT_EQ(db.loadDocText("chunked"), "new text");
+	EXPECT_FALSE(std::filesystem::exists(testDbRoot + std::string{ "\\chunked.saving" }));
+	std::filesystem::remove(testDbRoot + std::string{ "\\chunked" });
+}
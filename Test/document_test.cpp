@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "server_document.h"
 #include "client_document.h"
+#include "rga_document.h"
 #include "pos_helpers.h"
 
 bool testSegments(const TextContainer::Segments& actual, const TextContainer::Segments& expected) {
@@ -592,4 +593,239 @@ TEST(DocumentTests, SegmentsAffectEraseBetweenTest) {
 	doc.setCursorAnchor(0, COORD{ 5, 0 });
 	doc.erase(0, 1);
 	testSegments(doc.getSegments(), {});
+}
+
+TEST(DocumentTests, OpLogReplaysMissedVersionsTest) {
+	ServerSiteDocument doc;
+	for (unsigned int i = 0; i < 5; i++) {
+		msg::Buffer op{8};
+		msg::serializeTo(op, 0, msg::Type::write, msg::currentVersion, i);
+		doc.recordOp(op);
+	}
+	EXPECT_EQ(doc.getVersion(), 5);
+	EXPECT_TRUE(doc.hasOpsSince(5));
+	EXPECT_FALSE(doc.hasOpsSince(6));
+	auto ops = doc.getOpsSince(3);
+	ASSERT_EQ(ops.size(), 2);
+	unsigned int value;
+	msg::parse(ops[0].buffer, 2, value);
+	EXPECT_EQ(value, 3);
+}
+
+TEST(DocumentTests, OpLogDropsOldestVersionsTest) {
+	ServerSiteDocument doc;
+	msg::Buffer op{8};
+	msg::serializeTo(op, 0, msg::Type::write, msg::currentVersion, 0u);
+	for (int i = 0; i < 2000; i++) {
+		doc.recordOp(op);
+	}
+	EXPECT_EQ(doc.getVersion(), 2000);
+	EXPECT_TRUE(doc.hasOpsSince(1500));
+	EXPECT_FALSE(doc.hasOpsSince(10));
+	EXPECT_TRUE(doc.getOpsSince(10).empty());
+}
+
+TEST(DocumentTests, TextSnapshotIsSharedUntilEditTest) {
+	ServerSiteDocument doc{ "first line\nsecond line\n" };
+	auto snapshot = doc.getTextSnapshot();
+	EXPECT_EQ(*snapshot, doc.getText());
+	EXPECT_EQ(doc.getTextSnapshot().get(), snapshot.get());
+
+	doc.write(0, "new ");
+	auto newSnapshot = doc.getTextSnapshot();
+	EXPECT_NE(newSnapshot.get(), snapshot.get());
+	EXPECT_EQ(*newSnapshot, doc.getText());
+	EXPECT_EQ(*snapshot, "first line\nsecond line\n");
+}
+
+TEST(DocumentTests, HibernatedDocumentRestoresTextCursorsAndUndoTest) {
+	ServerSiteDocument control{ "abc\ndef", 2, 0, "" };
+	ServerSiteDocument doc{ "abc\ndef", 2, 0, "" };
+	for (auto* edited : { &control, &doc }) {
+		edited->setCursorPos(0, COORD{ 1, 0 });
+		edited->write(0, "XY\nZ");
+		edited->setCursorPos(1, COORD{ 3, 2 });
+		edited->erase(1, 2);
+	}
+	std::string text = doc.getText();
+	size_t usage = doc.getMemoryUsage();
+	auto history = doc.hibernate(64);
+	EXPECT_TRUE(doc.isHibernated());
+	EXPECT_LT(doc.getMemoryUsage(), usage);
+	EXPECT_EQ(doc.getCursorPos(1), control.getCursorPos(1));
+
+	doc.rehydrate(text, history);
+	EXPECT_FALSE(doc.isHibernated());
+	EXPECT_EQ(doc.getText(), control.getText());
+	EXPECT_EQ(doc.getCursorPos(0), control.getCursorPos(0));
+	for (int user : { 1, 0, 0 }) {
+		doc.undo(user);
+		control.undo(user);
+		EXPECT_EQ(doc.getText(), control.getText());
+	}
+}
+
+TEST(DocumentTests, PredictionReconcilesWithServerEchoTest) {
+	ClientSiteDocument doc{ "abc", 2, 0 };
+	doc.setCursorPos(0, COORD{ 3, 0 });
+	doc.predict(msg::Write{ msg::Type::write, msg::currentVersion, "", "d" });
+	doc.predict(msg::Write{ msg::Type::write, msg::currentVersion, "", "e" });
+	EXPECT_EQ(doc.getText(), "abcde");
+	EXPECT_TRUE(doc.hasPredictions());
+
+	// Other user writes at the beginning before our ops reach the server
+	doc.reconcile(false, [](ClientSiteDocument& confirmed) {
+		confirmed.write(1, "X");
+		return true;
+	});
+	EXPECT_EQ(doc.getText(), "Xabcde");
+	EXPECT_EQ(doc.getCursorPos(0), (COORD{ 6, 0 }));
+
+	doc.reconcile(true, [](ClientSiteDocument& confirmed) {
+		confirmed.write(0, "d");
+		return true;
+	});
+	EXPECT_EQ(doc.getText(), "Xabcde");
+	EXPECT_TRUE(doc.rejectPrediction(2));
+	EXPECT_EQ(doc.getText(), "Xabcd");
+	EXPECT_FALSE(doc.hasPredictions());
+	EXPECT_FALSE(doc.rejectPrediction(2));
+}
+
+TEST(DocumentTests, PredictionRollsBackMultilineEditsExactlyTest) {
+	ClientSiteDocument doc{ "ab\ncd\nef", 2, 0 };
+	doc.setCursorPos(0, COORD{ 1, 2 });
+	doc.setCursorPos(1, COORD{ 2, 2 });
+	doc.predict(msg::Erase{ msg::Type::erase, msg::currentVersion, "", 3 });
+	doc.predict(msg::MoveHorizontal{ msg::Type::moveHorizontal, msg::currentVersion, "", msg::MoveSide::left, 1 });
+	doc.predict(msg::MoveHorizontal{ msg::Type::moveHorizontal, msg::currentVersion, "", msg::MoveSide::left, 1 });
+	doc.predict(msg::Write{ msg::Type::write, msg::currentVersion, "", "X\nY" });
+	EXPECT_EQ(doc.getText(), "abX\nYf");
+
+	doc.reconcile(false, [](ClientSiteDocument& confirmed) {
+		EXPECT_EQ(confirmed.getText(), "ab\ncd\nef");
+		EXPECT_EQ(confirmed.getCursorPos(0), (COORD{ 1, 2 }));
+		EXPECT_EQ(confirmed.getCursorPos(1), (COORD{ 2, 2 }));
+		confirmed.write(1, "!");
+		return true;
+	});
+	EXPECT_EQ(doc.getText(), "abX\nYf!");
+	EXPECT_EQ(doc.getCursorPos(0), (COORD{ 1, 1 }));
+
+	EXPECT_TRUE(doc.rejectPrediction(4));
+	EXPECT_EQ(doc.getText(), "ab\ncf!");
+	doc.discardPredictions();
+	EXPECT_EQ(doc.getText(), "ab\ncd\nef!");
+	EXPECT_EQ(doc.getCursorPos(0), (COORD{ 1, 2 }));
+	EXPECT_EQ(doc.getCursorPos(1), (COORD{ 3, 2 }));
+}
+
+TEST(DocumentTests, RebaseSkipsOwnEditsAndMovesPastConcurrentOnesTest) {
+	ServerSiteDocument doc{ "abcdef\nghi", 2, 0, "" };
+	msg::Buffer op{ 8 };
+	doc.setCursorPos(1, COORD{ 1, 0 });
+	doc.write(1, "XY\nZ");
+	doc.recordOp(op);
+	doc.setCursorPos(0, COORD{ 3, 2 });
+	doc.write(0, "own");
+	doc.recordOp(op);
+	doc.setCursorPos(1, COORD{ 3, 1 });
+	doc.erase(1, 2);
+	doc.recordOp(op);
+	EXPECT_EQ(doc.getText(), "aXY\nZdef\nghiown");
+
+	// Positions from older versions are moved by edits of other users only
+	EXPECT_EQ(doc.rebase(0, 0, COORD{ 5, 0 }), (COORD{ 3, 1 }));
+	EXPECT_EQ(doc.rebase(0, 0, COORD{ 0, 0 }), (COORD{ 0, 0 }));
+	EXPECT_EQ(doc.rebase(0, 2, COORD{ 5, 1 }), (COORD{ 3, 1 }));
+	EXPECT_EQ(doc.rebase(0, 2, COORD{ 2, 1 }), (COORD{ 1, 1 }));
+	EXPECT_EQ(doc.rebase(1, 1, COORD{ 3, 2 }), (COORD{ 6, 2 }));
+	EXPECT_FALSE(doc.rebase(0, 4, COORD{ 0, 0 }).has_value());
+
+	// Pipelined own edits: "x" at 2 and then "y" at 3 are sent on the same base, "QQ" of the other user comes first
+	ServerSiteDocument pipelined{ "abcdef", 2, 0, "" };
+	pipelined.setCursorPos(1, COORD{ 3, 0 });
+	pipelined.write(1, "QQ");
+	pipelined.recordOp(op);
+	auto xPos = pipelined.rebase(0, 0, COORD{ 2, 0 });
+	ASSERT_TRUE(xPos.has_value());
+	pipelined.setCursorPos(0, xPos.value());
+	pipelined.write(0, "x");
+	pipelined.recordOp(op);
+	auto yPos = pipelined.rebase(0, 0, COORD{ 3, 0 });
+	ASSERT_TRUE(yPos.has_value());
+	EXPECT_EQ(yPos.value(), (COORD{ 3, 0 }));
+	pipelined.setCursorPos(0, yPos.value());
+	pipelined.write(0, "y");
+	EXPECT_EQ(pipelined.getText(), "abxycQQdef");
+}
+
+TEST(DocumentTests, RgaReplicasConvergeOnConcurrentEditsTest) {
+	RgaDocument first{ "abc\ndef", 2, 0, 1 };
+	RgaDocument second{ "abc\ndef", 2, 1, 2 };
+	first.setCursorPos(0, COORD{ 1, 0 });
+	first.write(0, "XY\nZ");
+	second.setCursorPos(1, COORD{ 1, 0 });
+	second.write(1, "Q");
+	second.setCursorPos(1, COORD{ 2, 1 });
+	second.erase(1, 2);
+
+	auto firstOps = first.takeOps();
+	auto secondOps = second.takeOps();
+	for (const auto& op : secondOps) {
+		EXPECT_TRUE(first.apply(op));
+	}
+	for (const auto& op : firstOps) {
+		EXPECT_TRUE(second.apply(op));
+	}
+	EXPECT_EQ(first.getText(), second.getText());
+	EXPECT_EQ(first.getText(), "aQXY\nZbc\nf");
+	EXPECT_EQ(first.getCursorPos(0), (COORD{ 1, 1 }));
+	EXPECT_EQ(second.getCursorPos(1), (COORD{ 0, 2 }));
+}
+
+TEST(DocumentTests, RgaCollectsOnlyStableTombstonesTest) {
+	RgaDocument doc{ "abcdef", 1, 0, 1 };
+	doc.setCursorPos(0, COORD{ 4, 0 });
+	doc.erase(0, 2);
+	EXPECT_EQ(doc.getTombstoneCount(), 2);
+	doc.acknowledge(2, 6);
+	EXPECT_EQ(doc.collectGarbage(), 0);
+	doc.acknowledge(2, 8);
+	EXPECT_EQ(doc.collectGarbage(), 2);
+	EXPECT_EQ(doc.getTombstoneCount(), 0);
+	EXPECT_EQ(doc.getText(), "abef");
+
+	doc.write(0, "X");
+	RgaDocument other{ "abcdef", 1, 0, 2 };
+	for (const auto& op : doc.takeOps()) {
+		EXPECT_TRUE(other.apply(op));
+	}
+	EXPECT_EQ(other.getText(), "abXef");
+}
+
+TEST(DocumentTests, RgaKeepsTombstoneUntilConcurrentInsertIsAcknowledgedTest) {
+	RgaDocument first{ "abcdef", 2, 0, 1 };
+	RgaDocument second{ "abcdef", 2, 1, 2 };
+	first.setCursorPos(0, COORD{ 3, 0 });
+	first.erase(0, 1);
+	second.setCursorPos(1, COORD{ 3, 0 });
+	second.write(1, "X");
+	auto eraseOps = first.takeOps();
+	auto insertOps = second.takeOps();
+	for (const auto& op : eraseOps) {
+		EXPECT_TRUE(second.apply(op));
+	}
+	first.acknowledge(2, 6); // Second joined with the initial text
+
+	// Insert after the erased 'c' is still in flight, second acknowledges the erase only after sending it
+	EXPECT_EQ(first.collectGarbage(), 0);
+	for (const auto& op : insertOps) {
+		EXPECT_TRUE(first.apply(op));
+	}
+	first.acknowledge(2, second.getClock());
+	EXPECT_EQ(first.collectGarbage(), 1);
+	EXPECT_EQ(first.getTombstoneCount(), 0);
+	EXPECT_EQ(first.getText(), "abXdef");
+	EXPECT_EQ(first.getText(), second.getText());
 }
\ No newline at end of file
@@ -178,4 +178,27 @@ TEST(FramerTests, ContinousExtractionTest) {
 		head += nSymbols;
 	} while (remainingSymbols);
 	EXPECT_EQ(nMsgs, expectedNMsgs);
+}
+
+TEST(FramerTests, ExtractingMessagesWithStreamsTest) {
+	Framer framer{ 128 };
+	msg::Buffer msg{16};
+	msg::serializeTo(msg, 0, testStr);
+	auto firstStreamMsg = msg::enrich(msg, 0);
+	auto secondStreamMsg = msg::enrich(msg, 3);
+	msg::Buffer bigBuffer{48};
+	msg::serializeTo(bigBuffer, 0, firstStreamMsg, secondStreamMsg, firstStreamMsg);
+
+	std::vector<msg::OneByteInt> streams;
+	auto msgs = framer.extractMessages(bigBuffer, streams);
+	ASSERT_EQ(msgs.size(), 3);
+	ASSERT_EQ(streams.size(), 3);
+	EXPECT_EQ(streams[0], 0);
+	EXPECT_EQ(streams[1], 3);
+	EXPECT_EQ(streams[2], 0);
+	for (const auto& message : msgs) {
+		std::string parsedStr;
+		msg::parse(message, 0, parsedStr);
+		EXPECT_EQ(parsedStr, testStr);
+	}
 }
\ No newline at end of file
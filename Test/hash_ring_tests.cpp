@@ -0,0 +1,82 @@
+#include "pch.h"
+#include "hash_ring.h"
+
+#include <unordered_map>
+
+std::vector<std::string> makeRingKeys(const int count) {
+	std::vector<std::string> keys;
+	for (int i = 0; i < count; i++) {
+		keys.push_back("doc" + std::to_string(i));
+	}
+	return keys;
+}
+
+TEST(HashRingTests, EmptyRingHasNoOwnerTest) {
+	server::HashRing ring;
+	EXPECT_FALSE(ring.owner("doc").has_value());
+	ring.add("127.0.0.1:8081");
+	ring.remove("127.0.0.1:8081");
+	EXPECT_FALSE(ring.owner("doc").has_value());
+	EXPECT_EQ(ring.size(), 0);
+}
+
+TEST(HashRingTests, OwnerDoesNotDependOnInsertionOrderTest) {
+	server::HashRing ring1;
+	ring1.add("127.0.0.1:8081");
+	ring1.add("127.0.0.1:8082");
+	ring1.add("127.0.0.1:8083");
+	server::HashRing ring2;
+	ring2.add("127.0.0.1:8083");
+	ring2.add("127.0.0.1:8081");
+	ring2.add("127.0.0.1:8082");
+	ring2.add("127.0.0.1:8081");
+	EXPECT_EQ(ring2.size(), 3);
+	for (const auto& key : makeRingKeys(500)) {
+		EXPECT_EQ(ring1.owner(key), ring2.owner(key));
+	}
+}
+
+TEST(HashRingTests, KeysAreSpreadOverBackendsTest) {
+	server::HashRing ring;
+	ring.add("127.0.0.1:8081");
+	ring.add("127.0.0.1:8082");
+	ring.add("127.0.0.1:8083");
+	std::unordered_map<std::string, int> owned;
+	for (const auto& key : makeRingKeys(3000)) {
+		owned[ring.owner(key).value()]++;
+	}
+	ASSERT_EQ(owned.size(), 3);
+	for (const auto& [backend, count] : owned) {
+		EXPECT_GT(count, 500) << backend;
+		EXPECT_LT(count, 1500) << backend;
+	}
+}
+
+TEST(HashRingTests, AddedBackendTakesKeysOnlyFromOthersTest) {
+	server::HashRing ring;
+	ring.add("127.0.0.1:8081");
+	ring.add("127.0.0.1:8082");
+	ring.add("127.0.0.1:8083");
+	auto keys = makeRingKeys(3000);
+	std::vector<std::string> before;
+	for (const auto& key : keys) {
+		before.push_back(ring.owner(key).value());
+	}
+	ring.add("127.0.0.1:8084");
+	int moved = 0;
+	for (int i = 0; i < keys.size(); i++) {
+		auto owner = ring.owner(keys[i]).value();
+		if (owner != before[i]) {
+			EXPECT_EQ(owner, "127.0.0.1:8084");
+			moved++;
+		}
+	}
+	// New backend takes about a quarter of keys
+	EXPECT_GT(moved, 300);
+	EXPECT_LT(moved, 1200);
+
+	ring.remove("127.0.0.1:8084");
+	for (int i = 0; i < keys.size(); i++) {
+		EXPECT_EQ(ring.owner(keys[i]).value(), before[i]);
+	}
+}
\ No newline at end of file
@@ -229,6 +229,16 @@ TEST(BufferTests, EnrichBufferTest) {
 	EXPECT_EQ(enriched.get()[4], oneByteInt);
 }
 
+TEST(BufferTests, EnrichRefusesPayloadOverFrameLimitTest) {
+	msg::Buffer buffer{ static_cast<int>(msg::frameLengthMask) + 1 };
+	buffer.size = buffer.capacity;
+	EXPECT_FALSE(msg::fitsFrame(buffer));
+	EXPECT_TRUE(msg::enrich(buffer, 2).empty());
+	buffer.size--;
+	EXPECT_TRUE(msg::fitsFrame(buffer));
+	EXPECT_EQ(msg::enrich(buffer, 2).size, buffer.size + 4);
+}
+
 TEST(BufferTests, ReserveMemoryTest) {
 	msg::Buffer buffer{1};
 	msg::serializeTo(buffer, 0, oneByteInt);
@@ -253,3 +263,84 @@ TEST(BufferTests, SerializeWriteMsg) {
 	EXPECT_EQ(buffer.get()[3], key);
 	EXPECT_EQ(buffer.get()[4], 0);
 }
+
+TEST(BufferTests, SerializeVarIntTest) {
+	msg::Buffer buffer{8};
+	msg::serializeTo(buffer, 0, msg::VarInt{ 5 }, msg::VarInt{ 300 });
+	EXPECT_EQ(buffer.size, 3);
+	EXPECT_EQ(static_cast<msg::OneByteInt>(buffer.get()[0]), 5);
+	EXPECT_EQ(static_cast<msg::OneByteInt>(buffer.get()[1]), 0xAC);
+	EXPECT_EQ(static_cast<msg::OneByteInt>(buffer.get()[2]), 0x02);
+}
+
+TEST(BufferTests, ParseVarIntTest) {
+	std::vector<unsigned int> values = { 0, 127, 128, 16384, 4294967295 };
+	msg::Buffer buffer{32};
+	for (const auto value : values) {
+		msg::serializeTo(buffer, 0, msg::VarInt{ value });
+	}
+	int pos = 0;
+	for (const auto value : values) {
+		msg::VarInt parsed;
+		pos = msg::parse(buffer, pos, parsed);
+		EXPECT_EQ(parsed.value, value);
+	}
+	EXPECT_EQ(pos, buffer.size);
+}
+
+TEST(BufferTests, ZigZagTest) {
+	EXPECT_EQ(msg::zigZagEncode(0), 0);
+	EXPECT_EQ(msg::zigZagEncode(-1), 1);
+	EXPECT_EQ(msg::zigZagEncode(1), 2);
+	EXPECT_EQ(msg::zigZagEncode(-64), 127);
+	std::vector<int> values = { 0, -1, 1, -64, 63, -32768, 32767 };
+	msg::Buffer buffer{32};
+	for (const auto value : values) {
+		msg::serializeTo(buffer, 0, msg::ZigZag{ value });
+	}
+	int pos = 0;
+	for (const auto value : values) {
+		msg::ZigZag parsed;
+		pos = msg::parse(buffer, pos, parsed);
+		EXPECT_EQ(parsed.value, value);
+	}
+}
+
+TEST(BufferTests, ParseFieldsAfterVectorTest) {
+	msg::Buffer buffer{32};
+	std::vector<unsigned int> values = { 2, 5 };
+	std::vector<msg::VarInt> compactValues = { msg::VarInt{ 200 } };
+	msg::serializeTo(buffer, 0, values, compactValues, oneByteInt);
+	std::vector<unsigned int> parsed;
+	std::vector<msg::VarInt> parsedCompact;
+	msg::OneByteInt parsedByte = 0;
+	int pos = msg::parse(buffer, 0, parsed, parsedCompact, parsedByte);
+	EXPECT_EQ(pos, buffer.size);
+	EXPECT_EQ(parsed, values);
+	ASSERT_EQ(parsedCompact.size(), 1);
+	EXPECT_EQ(parsedCompact[0].value, 200);
+	EXPECT_EQ(parsedByte, oneByteInt);
+}
+
+TEST(BufferTests, PooledStorageIsReusedTest) {
+	char* firstBlock = nullptr;
+	{
+		msg::Buffer buffer{100};
+		firstBlock = buffer.get();
+	}
+	msg::Buffer sameClass{120};
+	EXPECT_EQ(sameClass.get(), firstBlock);
+	EXPECT_EQ(sameClass.capacity, 120);
+}
+
+TEST(BufferTests, ReserveWithinBlockKeepsStorageTest) {
+	msg::Buffer buffer{70};
+	msg::serializeTo(buffer, 0, str);
+	char* block = buffer.get();
+	buffer.reserve(128);
+	EXPECT_EQ(buffer.get(), block);
+	EXPECT_EQ(buffer.capacity, 128);
+	buffer.reserve(129);
+	EXPECT_NE(buffer.get(), block);
+	EXPECT_EQ(buffer.get()[0], 't');
+}
@@ -0,0 +1,110 @@
+#include "pch.h"
+#include "outbound_queue.h"
+
+#include <algorithm>
+
+using namespace server;
+
+// Socket buffer of the stubbed connection, takes at most `room` bytes until more is freed
+struct TestConnection {
+	int room = 0;
+	std::string sent;
+};
+
+static OutboundQueue makeTestQueue(TestConnection& connection, const size_t highBytes, const size_t highFrames) {
+	OutboundQueue::Watermarks watermarks{ highBytes, highFrames };
+	return OutboundQueue{ 1, watermarks, [&connection](const char* data, const int size) {
+		int sendBytes = (std::min)(size, connection.room);
+		if (sendBytes == 0) {
+			WSASetLastError(WSAEWOULDBLOCK);
+			return SOCKET_ERROR;
+		}
+		connection.room -= sendBytes;
+		connection.sent.append(data, sendBytes);
+		return sendBytes;
+	} };
+}
+
+static msg::Buffer makeTestFrame(const char value, const int size) {
+	std::string text(size - 1, value);
+	msg::Buffer frame{ size };
+	frame.add(&text);
+	return frame;
+}
+
+static std::string getTestFrameBytes(const char value, const int size) {
+	auto frame = makeTestFrame(value, size);
+	return std::string(frame.get(), frame.size);
+}
+
+TEST(OutboundQueueTests, OverflowKeepsPartiallySentDroppableHeadTest) {
+	TestConnection connection{ 30 };
+	auto queue = makeTestQueue(connection, 100, 10);
+	EXPECT_TRUE(queue.push(makeTestFrame('a', 50), true));
+	EXPECT_TRUE(queue.push(makeTestFrame('b', 50), true));
+	EXPECT_FALSE(queue.push(makeTestFrame('c', 50), true));
+	EXPECT_EQ(queue.size(), 1);
+	EXPECT_FALSE(queue.push(makeTestFrame('d', 10), true));
+
+	// Client gets the rest of the started frame, so it does not lose framing
+	connection.room = 1000;
+	EXPECT_TRUE(queue.flush());
+	EXPECT_TRUE(queue.empty());
+	EXPECT_EQ(connection.sent, getTestFrameBytes('a', 50));
+	EXPECT_TRUE(queue.needsResync());
+}
+
+TEST(OutboundQueueTests, FlushedBytesFreeDroppableRoomTest) {
+	TestConnection connection;
+	auto queue = makeTestQueue(connection, 100, 10);
+	EXPECT_TRUE(queue.push(makeTestFrame('a', 60), true));
+	connection.room = 40;
+	EXPECT_TRUE(queue.flush());
+	EXPECT_EQ(queue.size(), 1);
+
+	// Only 20 bytes of the first frame are still queued
+	EXPECT_TRUE(queue.push(makeTestFrame('b', 60), true));
+	EXPECT_EQ(queue.size(), 2);
+	connection.room = 1000;
+	EXPECT_TRUE(queue.flush());
+	EXPECT_EQ(connection.sent, getTestFrameBytes('a', 60) + getTestFrameBytes('b', 60));
+	EXPECT_FALSE(queue.needsResync());
+}
+
+TEST(OutboundQueueTests, FlushedFramesFreeDroppableRoomTest) {
+	TestConnection connection;
+	auto queue = makeTestQueue(connection, 1000, 2);
+	EXPECT_TRUE(queue.push(makeTestFrame('a', 10), true));
+	EXPECT_TRUE(queue.push(makeTestFrame('b', 10), true));
+	connection.room = 10;
+	EXPECT_TRUE(queue.flush());
+	EXPECT_EQ(queue.size(), 1);
+
+	EXPECT_TRUE(queue.push(makeTestFrame('c', 10), true));
+	EXPECT_EQ(queue.size(), 2);
+	EXPECT_FALSE(queue.push(makeTestFrame('d', 10), true));
+	EXPECT_TRUE(queue.empty());
+}
+
+TEST(OutboundQueueTests, OverflowRejectsOnlyDroppableFramesTest) {
+	TestConnection connection;
+	auto queue = makeTestQueue(connection, 1000, 1);
+	EXPECT_TRUE(queue.push(makeTestFrame('a', 10), true));
+	EXPECT_FALSE(queue.push(makeTestFrame('b', 10), true));
+	EXPECT_TRUE(queue.empty());
+	EXPECT_TRUE(queue.push(makeTestFrame('c', 10), false));
+	EXPECT_EQ(queue.size(), 1);
+	EXPECT_FALSE(queue.push(makeTestFrame('d', 10), true));
+
+	// Resync waits for the frames which were not dropped
+	EXPECT_FALSE(queue.needsResync());
+	connection.room = 1000;
+	EXPECT_TRUE(queue.flush());
+	EXPECT_TRUE(queue.needsResync());
+	EXPECT_EQ(connection.sent, getTestFrameBytes('c', 10));
+
+	queue.resynced();
+	EXPECT_FALSE(queue.needsResync());
+	EXPECT_TRUE(queue.push(makeTestFrame('e', 10), true));
+	EXPECT_EQ(connection.sent, getTestFrameBytes('c', 10) + getTestFrameBytes('e', 10));
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "pool_scaler.h"
+
+using ScalerClock = server::PoolScaler::Clock;
+
+server::WorkerLoad makeUtilizationLoad(const double utilization, const ScalerClock::time_point now) {
+	server::WorkerLoad load;
+	load.utilization = utilization;
+	load.utilizationSampledAt = now;
+	return load;
+}
+
+server::PoolScaler::Thresholds makePoolThresholds() {
+	server::PoolScaler::Thresholds thresholds;
+	thresholds.minWorkers = 1;
+	thresholds.maxWorkers = 4;
+	thresholds.sustain = std::chrono::seconds{ 10 };
+	thresholds.cooldown = std::chrono::seconds{ 30 };
+	return thresholds;
+}
+
+TEST(PoolScalerTests, GrowsOnlyAfterSustainedHighUtilizationTest) {
+	server::PoolScaler scaler{ makePoolThresholds() };
+	auto now = ScalerClock::now();
+	std::vector<server::WorkerLoad> loads{ makeUtilizationLoad(0.9, now), makeUtilizationLoad(0.8, now) };
+	EXPECT_EQ(scaler.decide(loads, now), server::PoolScaler::Decision::keep);
+	now += std::chrono::seconds{ 5 };
+	loads = { makeUtilizationLoad(0.9, now), makeUtilizationLoad(0.8, now) };
+	EXPECT_EQ(scaler.decide(loads, now), server::PoolScaler::Decision::keep);
+	now += std::chrono::seconds{ 5 };
+	loads = { makeUtilizationLoad(0.9, now), makeUtilizationLoad(0.8, now) };
+	EXPECT_EQ(scaler.decide(loads, now), server::PoolScaler::Decision::grow);
+}
+
+TEST(PoolScalerTests, DipResetsSustainedUtilizationTest) {
+	server::PoolScaler scaler{ makePoolThresholds() };
+	auto now = ScalerClock::now();
+	EXPECT_EQ(scaler.decide({ makeUtilizationLoad(0.9, now) }, now), server::PoolScaler::Decision::keep);
+	now += std::chrono::seconds{ 8 };
+	EXPECT_EQ(scaler.decide({ makeUtilizationLoad(0.5, now) }, now), server::PoolScaler::Decision::keep);
+	now += std::chrono::seconds{ 8 };
+	EXPECT_EQ(scaler.decide({ makeUtilizationLoad(0.9, now) }, now), server::PoolScaler::Decision::keep);
+}
+
+TEST(PoolScalerTests, RespectsPoolLimitsAndCooldownTest) {
+	auto thresholds = makePoolThresholds();
+	server::PoolScaler scaler{ thresholds };
+	auto now = ScalerClock::now();
+	std::vector<server::WorkerLoad> full(thresholds.maxWorkers, makeUtilizationLoad(1.0, now));
+	scaler.decide(full, now);
+	EXPECT_EQ(scaler.decide(full, now + thresholds.sustain), server::PoolScaler::Decision::keep);
+
+	scaler.changed(now);
+	now += thresholds.sustain;
+	std::vector<server::WorkerLoad> busy{ makeUtilizationLoad(1.0, now) };
+	scaler.decide(busy, now);
+	now += thresholds.sustain;
+	busy = { makeUtilizationLoad(1.0, now) };
+	EXPECT_EQ(scaler.decide(busy, now), server::PoolScaler::Decision::keep);
+	now += thresholds.cooldown;
+	busy = { makeUtilizationLoad(1.0, now) };
+	EXPECT_EQ(scaler.decide(busy, now), server::PoolScaler::Decision::grow);
+}
+
+TEST(PoolScalerTests, ShrinksIdlePoolWithoutOverloadingTheRestTest) {
+	server::PoolScaler scaler{ makePoolThresholds() };
+	auto now = ScalerClock::now();
+	auto later = now + std::chrono::seconds{ 10 };
+	// Stale samples are idle workers blocked in select
+	std::vector<server::WorkerLoad> idle{ makeUtilizationLoad(0.9, now - std::chrono::minutes{ 1 }), makeUtilizationLoad(0.1, now) };
+	scaler.decide(idle, now);
+	idle[1].utilizationSampledAt = later;
+	EXPECT_EQ(scaler.decide(idle, later), server::PoolScaler::Decision::shrink);
+	EXPECT_EQ(scaler.selectRetired(idle, later), 0);
+
+	// Average is low, but the remaining worker would be over the grow threshold
+	auto thresholds = makePoolThresholds();
+	thresholds.shrinkUtilization = 0.5;
+	thresholds.growUtilization = 0.6;
+	server::PoolScaler guarded{ thresholds };
+	std::vector<server::WorkerLoad> uneven{ makeUtilizationLoad(0.8, now), makeUtilizationLoad(0.0, now) };
+	guarded.decide(uneven, now);
+	uneven = { makeUtilizationLoad(0.8, later), makeUtilizationLoad(0.0, later) };
+	EXPECT_EQ(guarded.decide(uneven, later), server::PoolScaler::Decision::keep);
+}
+
+TEST(PoolScalerTests, GrowsBelowMinimumRightAwayTest) {
+	auto thresholds = makePoolThresholds();
+	thresholds.minWorkers = 2;
+	server::PoolScaler scaler{ thresholds };
+	auto now = ScalerClock::now();
+	EXPECT_EQ(scaler.decide({ makeUtilizationLoad(0.0, now) }, now), server::PoolScaler::Decision::grow);
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "pch.h"
+#include "messages.h"
+#include "schema.h"
+#include "rate_limiter.h"
+
+msg::Buffer makeMoveTo(const unsigned int x) {
+	return msg::serialize(msg::MoveTo{ msg::Type::moveTo, msg::currentVersion, "", x, 0 });
+}
+
+msg::Buffer makeWrite(const std::string& text) {
+	return msg::serialize(msg::Write{ msg::Type::write, msg::currentVersion, "", text });
+}
+
+server::RateLimiter::Limits makeLimits(const double connectionMessages, const size_t maxDelayed) {
+	server::RateLimiter::Limits limits;
+	limits.connectionMessages = connectionMessages;
+	limits.connectionBytes = 0;
+	limits.sessionMessages = 0;
+	limits.sessionBytes = 0;
+	limits.burstSeconds = 1.0;
+	limits.maxDelayed = maxDelayed;
+	return limits;
+}
+
+TEST(RateLimiterTests, UnlimitedRateAdmitsEverythingTest) {
+	server::RateLimiter limiter{ makeLimits(0, 8) };
+	for (int i = 0; i < 1000; i++) {
+		EXPECT_TRUE(limiter.admit(1, "session", makeWrite("a")));
+	}
+	EXPECT_FALSE(limiter.hasDelayed());
+}
+
+TEST(RateLimiterTests, MessagesOverBurstAreDelayedInOrderTest) {
+	server::RateLimiter limiter{ makeLimits(0.001, 8) };
+	EXPECT_TRUE(limiter.admit(1, "session", makeWrite("a")));
+	EXPECT_FALSE(limiter.admit(1, "session", makeWrite("b")));
+	limiter.delay(1, "session", makeWrite("b"));
+	// Later messages wait behind the delayed ones, other connections are not affected
+	EXPECT_FALSE(limiter.admit(1, "session", makeWrite("c")));
+	EXPECT_TRUE(limiter.admit(2, "session", makeWrite("d")));
+	EXPECT_TRUE(limiter.takeReady().empty());
+	EXPECT_TRUE(limiter.hasDelayed());
+	EXPECT_EQ(limiter.getCounters().delayed, 1);
+}
+
+TEST(RateLimiterTests, WaitingJumpsAreCoalescedTest) {
+	server::RateLimiter limiter{ makeLimits(0.001, 8) };
+	EXPECT_TRUE(limiter.admit(1, "", makeWrite("a")));
+	limiter.delay(1, "", makeMoveTo(1));
+	limiter.delay(1, "", makeMoveTo(2));
+	limiter.delay(1, "", makeMoveTo(3));
+	EXPECT_EQ(limiter.getCounters().coalesced, 2);
+	EXPECT_EQ(limiter.getCounters().delayed, 3);
+	// Coalesced jumps are answered right away, the last one still waits for tokens
+	auto ready = limiter.takeReady();
+	ASSERT_EQ(ready.size(), 2);
+	EXPECT_TRUE(ready[0].rejected);
+	EXPECT_TRUE(ready[1].rejected);
+	EXPECT_TRUE(limiter.hasDelayed());
+}
+
+TEST(RateLimiterTests, MessagesOverMaxDelayedAreRejectedTest) {
+	server::RateLimiter limiter{ makeLimits(0.001, 4) };
+	EXPECT_TRUE(limiter.admit(1, "", makeWrite("a")));
+	limiter.delay(1, "", makeWrite("b"));
+	EXPECT_FALSE(limiter.isSaturated(1));
+	limiter.delay(1, "", makeWrite("c"));
+	EXPECT_TRUE(limiter.isSaturated(1));
+	limiter.delay(1, "", makeWrite("d"));
+	limiter.delay(1, "", makeWrite("e"));
+	limiter.delay(1, "", makeWrite("f"));
+	EXPECT_EQ(limiter.getCounters().delayed, 4);
+	EXPECT_EQ(limiter.getCounters().rejected, 1);
+	limiter.erase(1);
+	EXPECT_FALSE(limiter.hasDelayed());
+}
\ No newline at end of file
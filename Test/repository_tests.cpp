@@ -0,0 +1,157 @@
+#include "pch.h"
+#include "repository.h"
+#include "authenticator.h"
+#include "client_id.h"
+#include "schema.h"
+#include "engine.h"
+
+using namespace server;
+
+static SOCKET loginTestUser(Authenticator& auth, const SOCKET connection) {
+	auto username = random::Engine::get().getRandomString(12);
+	auto registration = msg::serialize(msg::Register{ msg::Type::registration, msg::currentVersion, username, "password" });
+	auth.process(connection, registration);
+	auto login = msg::serialize(msg::Login{ msg::Type::login, msg::currentVersion, username, "password" });
+	auth.process(connection, login);
+	return makeClientId(connection, 1);
+}
+
+static SOCKET openTestSession(Authenticator& auth, Repository& repo, const SOCKET connection) {
+	auto client = loginTestUser(auth, connection);
+	auto create = msg::serialize(msg::ConnectCreateDoc{ msg::Type::create, msg::currentVersion, static_cast<unsigned int>(client), "file" });
+	repo.process(client, create);
+	return client;
+}
+
+static unsigned int rejectTestWrite(Repository& repo, const SOCKET client) {
+	auto write = msg::serialize(msg::Write{ msg::Type::write, msg::currentVersion, "", "a" });
+	auto response = repo.reject(client, write);
+	EXPECT_EQ(response.msgType, msg::Type::reject);
+	return msg::deserialize<msg::Reject>(response.buffer).value().seq;
+}
+
+TEST(RepositoryTests, ResyncRestartsRejectSequenceTest) {
+	Authenticator auth;
+	Repository repo{ &auth };
+	auto client = openTestSession(auth, repo, 5);
+	EXPECT_EQ(rejectTestWrite(repo, client), 1);
+	EXPECT_EQ(rejectTestWrite(repo, client), 2);
+
+	auto response = repo.resync(client);
+	EXPECT_EQ(response.msgType, msg::Type::join);
+	EXPECT_EQ(rejectTestWrite(repo, client), 1);
+}
+
+TEST(RepositoryTests, UpdateIsEncodedForEveryClientVersionTest) {
+	Authenticator auth;
+	Repository repo{ &auth };
+	auto client = openTestSession(auth, repo, 6);
+	auto legacyClient = loginTestUser(auth, 7);
+	auto join = msg::serialize(msg::ConnectJoinDoc{ msg::Type::join, msg::sessionAuthVersion, static_cast<unsigned int>(legacyClient), repo.getAcCode(client) });
+	repo.process(legacyClient, join);
+
+	auto write = msg::serialize(msg::Write{ msg::Type::write, msg::currentVersion, "", "abc" });
+	auto response = repo.process(client, write);
+	ASSERT_EQ(response.msgType, msg::Type::write);
+	EXPECT_EQ(response.destinations, std::vector<SOCKET>{ client });
+	ASSERT_EQ(response.variants.size(), 1);
+	EXPECT_EQ(response.variants[0].destinations, std::vector<SOCKET>{ legacyClient });
+	auto legacy = msg::deserialize<msg::WriteResponse>(response.variants[0].buffer).value();
+	EXPECT_EQ(legacy.version, msg::sessionAuthVersion);
+	EXPECT_EQ(legacy.text, "abc");
+}
+
+TEST(RepositoryTests, OlderClientsGetCursorMovesAsMoveResponsesTest) {
+	Authenticator auth;
+	Repository repo{ &auth };
+	auto client = openTestSession(auth, repo, 8);
+	auto write = msg::serialize(msg::Write{ msg::Type::write, msg::currentVersion, "", "abc" });
+	repo.process(client, write);
+	auto legacyClient = loginTestUser(auth, 9);
+	auto join = msg::serialize(msg::ConnectJoinDoc{ msg::Type::join, msg::sessionAuthVersion, static_cast<unsigned int>(legacyClient), repo.getAcCode(client) });
+	repo.process(legacyClient, join);
+
+	auto move = msg::serialize(msg::MoveTo{ msg::Type::moveTo, msg::currentVersion, "", 1, 0 });
+	repo.process(client, move);
+	auto legacyWrite = msg::serialize(msg::Write{ msg::Type::write, msg::sessionAuthVersion, "", "x" });
+	repo.process(legacyClient, legacyWrite);
+	auto frames = repo.takePresenceFrames();
+	ASSERT_EQ(frames.size(), 2);
+	EXPECT_EQ(frames[0].msgType, msg::Type::moveTo);
+	EXPECT_EQ(frames[0].destinations, std::vector<SOCKET>{ legacyClient });
+	auto legacyMove = msg::deserialize<msg::MoveResponse>(frames[0].buffer).value();
+	EXPECT_EQ(legacyMove.user, 0);
+	EXPECT_EQ(legacyMove.X, 1);
+	EXPECT_EQ(frames[1].msgType, msg::Type::presence);
+	EXPECT_EQ(frames[1].destinations, std::vector<SOCKET>{ client });
+}
+
+TEST(RepositoryTests, ReopenedDocumentHasTextOfItsPendingSaveTest) {
+	Authenticator auth;
+	Repository repo{ &auth };
+	auto client = openTestSession(auth, repo, 10);
+	auto write = msg::serialize(msg::Write{ msg::Type::write, msg::currentVersion, "", "abc" });
+	repo.process(client, write);
+	auto disconnect = msg::serialize(msg::Disconnect{ msg::Type::disconnect, msg::currentVersion, "" });
+	repo.process(client, disconnect);
+
+	// Document is saved in chunks by the worker loop, its save is still queued
+	auto load = msg::serialize(msg::ConnectCreateDoc{ msg::Type::load, msg::currentVersion, static_cast<unsigned int>(client), "file" });
+	auto response = repo.process(client, load);
+	ASSERT_EQ(response.msgType, msg::Type::load);
+	auto connected = msg::deserialize<msg::ConnectResponse>(response.buffer).value();
+	EXPECT_TRUE(connected.error.empty());
+	EXPECT_EQ(connected.text, "abc");
+}
+
+TEST(RepositoryTests, ClosedDocumentWithPendingSaveIsReusedTest) {
+	Authenticator auth;
+	Repository repo{ &auth };
+	auto client = openTestSession(auth, repo, 12);
+	auto write = msg::serialize(msg::Write{ msg::Type::write, msg::currentVersion, "", "abc" });
+	repo.process(client, write);
+	auto disconnect = msg::serialize(msg::Disconnect{ msg::Type::disconnect, msg::currentVersion, "" });
+	repo.process(client, disconnect);
+
+	// Document loaded again from disk would start counting versions anew, the cached one goes on after the write and disconnect
+	auto load = msg::serialize(msg::ConnectCreateDoc{ msg::Type::load, msg::currentVersion, static_cast<unsigned int>(client), "file" });
+	auto response = repo.process(client, load);
+	ASSERT_EQ(response.msgType, msg::Type::load);
+	auto connected = msg::deserialize<msg::ConnectResponse>(response.buffer).value();
+	EXPECT_EQ(connected.text, "abc");
+	EXPECT_GT(connected.snapshotVersion, 2);
+}
+
+TEST(RepositoryTests, DocumentOverInlineLimitIsRefusedToClientsWithoutSnapshotStreamingTest) {
+	Authenticator auth;
+	Repository repo{ &auth };
+	auto client = openTestSession(auth, repo, 13);
+	auto tooBigWrite = msg::serialize(msg::Write{ msg::Type::write, msg::rejectVersion, "", std::string(msg::maxInlineText + 1, 'a') });
+	EXPECT_EQ(repo.process(client, tooBigWrite).msgType, msg::Type::reject);
+	auto write = msg::serialize(msg::Write{ msg::Type::write, msg::rejectVersion, "", std::string(msg::maxInlineText / 2 + 1, 'a') });
+	EXPECT_EQ(repo.process(client, write).msgType, msg::Type::write);
+	EXPECT_EQ(repo.process(client, write).msgType, msg::Type::write);
+
+	auto legacyClient = loginTestUser(auth, 14);
+	auto join = msg::serialize(msg::ConnectJoinDoc{ msg::Type::join, msg::sessionAuthVersion, static_cast<unsigned int>(legacyClient), repo.getAcCode(client) });
+	auto response = repo.process(legacyClient, join);
+	EXPECT_EQ(response.destinations, std::vector<SOCKET>{ legacyClient });
+	EXPECT_FALSE(msg::deserialize<msg::ConnectResponse>(response.buffer).value().error.empty());
+	EXPECT_TRUE(repo.getAcCode(legacyClient).empty());
+}
+
+TEST(RepositoryTests, MalformedMessagesAreRefusedTest) {
+	Authenticator auth;
+	Repository repo{ &auth };
+	auto client = openTestSession(auth, repo, 31);
+	auto erase = msg::serialize(msg::Erase{ msg::Type::erase, msg::currentVersion, "", 1 });
+	erase.size -= 1;
+	auto response = repo.process(client, erase);
+	EXPECT_EQ(response.msgType, msg::Type::reject);
+
+	auto join = msg::serialize(msg::ConnectJoinDoc{ msg::Type::join, msg::currentVersion, static_cast<unsigned int>(client), repo.getAcCode(client) });
+	join.size -= 1;
+	auto joinResponse = repo.process(client, join);
+	EXPECT_EQ(joinResponse.destinations, std::vector<SOCKET>{ client });
+	EXPECT_FALSE(msg::deserialize<msg::ConnectResponse>(joinResponse.buffer).value().error.empty());
+}
\ No newline at end of file
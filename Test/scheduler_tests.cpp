@@ -0,0 +1,48 @@
+#include "pch.h"
+#include "messages.h"
+#include "schema.h"
+#include "scheduler.h"
+
+msg::Buffer makeTypedText(const std::string& text) {
+	return msg::serialize(msg::Write{ msg::Type::write, msg::currentVersion, "", text });
+}
+
+TEST(SchedulerTests, BigMessagesAreBulkTest) {
+	server::Scheduler scheduler{ server::Scheduler::Budget{} };
+	EXPECT_EQ(scheduler.classify(makeTypedText("a")), server::Scheduler::Priority::interactive);
+	EXPECT_EQ(scheduler.classify(makeTypedText(std::string(4096, 'a'))), server::Scheduler::Priority::bulk);
+	msg::Buffer join = msg::serialize(msg::ConnectJoinDoc{ msg::Type::join, msg::currentVersion, 0, "abcdef" });
+	EXPECT_EQ(scheduler.classify(join), server::Scheduler::Priority::bulk);
+}
+
+TEST(SchedulerTests, InteractiveMessagesGoAheadOfOtherSessionsBulkTest) {
+	server::Scheduler scheduler{ server::Scheduler::Budget{} };
+	scheduler.push(1, "bulky", makeTypedText(std::string(4096, 'a')), false);
+	scheduler.push(2, "typing", makeTypedText("b"), false);
+	auto interactive = scheduler.takeInteractive();
+	ASSERT_EQ(interactive.size(), 1);
+	EXPECT_EQ(interactive[0].client, 2);
+	auto bulk = scheduler.takeBulk([](const std::string&) { return false; });
+	ASSERT_TRUE(bulk.has_value());
+	EXPECT_EQ(bulk->client, 1);
+	EXPECT_FALSE(scheduler.hasBulk());
+}
+
+TEST(SchedulerTests, SessionKeepsOrderBehindBulkMessageTest) {
+	server::Scheduler scheduler{ server::Scheduler::Budget{} };
+	scheduler.push(1, "session", makeTypedText(std::string(4096, 'a')), false);
+	scheduler.push(1, "session", makeTypedText("b"), false);
+	scheduler.push(3, "busy", makeTypedText("c"), true);
+	scheduler.push(2, "other", makeTypedText(std::string(4096, 'd')), false);
+	EXPECT_TRUE(scheduler.takeInteractive().empty());
+
+	auto isBusy = [](const std::string& session) { return session == "busy"; };
+	std::vector<SOCKET> order;
+	while (auto task = scheduler.takeBulk(isBusy)) {
+		order.push_back(task->client);
+	}
+	EXPECT_EQ(order, (std::vector<SOCKET>{ 1, 1, 2 }));
+	EXPECT_TRUE(scheduler.hasBulk());
+	EXPECT_EQ(scheduler.takeConnection(3).size(), 1);
+	EXPECT_EQ(scheduler.size(), 0);
+}
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include "pch.h"
+#include "messages.h"
+#include "schema.h"
+#include "deserializer.h"
+#include "serializer.h"
+
+const std::string authToken = "0123456789abcdef";
+
+TEST(DeserializerTests, ParseLegacyWriteTest) {
+	msg::Buffer buffer{64};
+	msg::serializeTo(buffer, 0, msg::Type::write, msg::legacyVersion, authToken, std::string{"abc"});
+	auto msg = Deserializer::parseWrite(buffer).value();
+	EXPECT_EQ(msg.type, msg::Type::write);
+	EXPECT_EQ(msg.version, msg::legacyVersion);
+	EXPECT_EQ(msg.authToken, authToken);
+	EXPECT_EQ(msg.text, "abc");
+}
+
+TEST(DeserializerTests, ParseSessionAuthWriteTest) {
+	msg::Buffer buffer{64};
+	msg::serializeTo(buffer, 0, msg::Type::write, msg::sessionAuthVersion, std::string{"abc"});
+	auto msg = Deserializer::parseWrite(buffer).value();
+	EXPECT_EQ(msg.type, msg::Type::write);
+	EXPECT_EQ(msg.version, msg::sessionAuthVersion);
+	EXPECT_TRUE(msg.authToken.empty());
+	EXPECT_EQ(msg.text, "abc");
+	EXPECT_EQ(buffer.size, 6);
+}
+
+TEST(DeserializerTests, ParseSessionAuthEraseTest) {
+	msg::Buffer buffer{64};
+	unsigned int eraseSize = 3;
+	msg::serializeTo(buffer, 0, msg::Type::erase, msg::sessionAuthVersion, eraseSize);
+	auto msg = Deserializer::parseErase(buffer).value();
+	EXPECT_TRUE(msg.authToken.empty());
+	EXPECT_EQ(msg.eraseSize, eraseSize);
+}
+
+TEST(DeserializerTests, TruncatedMessageIsNotParsedTest) {
+	auto buffer = msg::serialize(msg::Erase{ msg::Type::erase, msg::currentVersion, "", 3, 0, 1, 1 });
+	EXPECT_TRUE(Deserializer::parseErase(buffer).has_value());
+	buffer.size -= 1;
+	EXPECT_FALSE(Deserializer::parseErase(buffer).has_value());
+}
+
+TEST(DeserializerTests, ParseBothVersionsOfMoveVerticalTest) {
+	unsigned int clientWidth = 80;
+	msg::OneByteInt withSelect = 1;
+	msg::Buffer legacy{64};
+	msg::serializeTo(legacy, 0, msg::Type::moveVertical, msg::legacyVersion, authToken, msg::MoveSide::down, clientWidth, withSelect);
+	msg::Buffer sessionAuth{64};
+	msg::serializeTo(sessionAuth, 0, msg::Type::moveVertical, msg::sessionAuthVersion, msg::MoveSide::down, clientWidth, withSelect);
+
+	auto legacyMsg = Deserializer::parseMoveVertical(legacy).value();
+	auto sessionAuthMsg = Deserializer::parseMoveVertical(sessionAuth).value();
+	EXPECT_EQ(legacyMsg.authToken, authToken);
+	EXPECT_TRUE(sessionAuthMsg.authToken.empty());
+	for (const auto& msg : { legacyMsg, sessionAuthMsg }) {
+		EXPECT_EQ(msg.side, msg::MoveSide::down);
+		EXPECT_EQ(msg.clientWidth, clientWidth);
+		EXPECT_EQ(msg.withSelect, withSelect);
+	}
+}
+
+TEST(DeserializerTests, ParseSessionAuthControlMessageTest) {
+	msg::Buffer buffer{8};
+	msg::serializeTo(buffer, 0, msg::Type::undo, msg::sessionAuthVersion);
+	auto msg = Deserializer::parseControlMessage(buffer).value();
+	EXPECT_EQ(msg.type, msg::Type::undo);
+	EXPECT_EQ(msg.version, msg::sessionAuthVersion);
+	EXPECT_TRUE(msg.authToken.empty());
+}
+
+TEST(SerializerTests, CompactWriteResponseTest) {
+	msg::WriteView msg{ msg::Type::write, msg::compactVersion, "", "a" };
+	auto buffer = Serializer::makeWriteResponse(COORD{ 6, 3 }, { COORD{ 5, 3 } }, 0, msg);
+	EXPECT_EQ(buffer.size, 7);
+
+	msg::WriteResponse parsed;
+	msg::ZigZag deltaX, deltaY;
+	msg::parse(buffer, 0, parsed.type, parsed.version, parsed.user, parsed.text, deltaX, deltaY);
+	EXPECT_EQ(parsed.text, "a");
+	EXPECT_EQ(deltaX.value, 1);
+	EXPECT_EQ(deltaY.value, 0);
+}
+
+TEST(SerializerTests, CompactEraseResponseWithNegativeDeltaTest) {
+	msg::Erase msg{ msg::Type::erase, msg::compactVersion, "", 1 };
+	auto buffer = Serializer::makeEraseResponse(COORD{ 0, 2 }, { COORD{ 0, 0 }, COORD{ 12, 3 } }, 1, msg);
+	EXPECT_EQ(buffer.size, 6);
+
+	msg::EraseResponse parsed;
+	msg::VarInt eraseSize;
+	msg::ZigZag deltaX, deltaY;
+	msg::parse(buffer, 0, parsed.type, parsed.version, parsed.user, eraseSize, deltaX, deltaY);
+	EXPECT_EQ(parsed.user, 1);
+	EXPECT_EQ(eraseSize.value, 1);
+	EXPECT_EQ(deltaX.value, -12);
+	EXPECT_EQ(deltaY.value, -1);
+}
+
+TEST(SerializerTests, LegacyWriteResponseKeepsAbsolutePositionTest) {
+	msg::WriteView msg{ msg::Type::write, msg::sessionAuthVersion, "", "a" };
+	auto buffer = Serializer::makeWriteResponse(COORD{ 6, 3 }, { COORD{ 5, 3 } }, 0, msg);
+	msg::WriteResponse parsed;
+	msg::parse(buffer, 0, parsed.type, parsed.version, parsed.user, parsed.text, parsed.X, parsed.Y);
+	EXPECT_EQ(parsed.X, 6);
+	EXPECT_EQ(parsed.Y, 3);
+}
+
+TEST(SerializerTests, LoggedUpdateIsEncodedForOtherVersionsTest) {
+	ServerSiteDocument doc{ "abc\ndef", 2, 0, "id" };
+	msg::WriteView msg{ msg::Type::write, msg::currentVersion, "", "a" };
+	doc.recordOp(Serializer::makeWriteResponse(COORD{ 1, 1 }, doc.getEditAnchors(), 1, msg));
+	const auto& op = doc.recordOp(Serializer::makeWriteResponse(COORD{ 3, 1 }, doc.getEditAnchors(), 1, msg));
+	EXPECT_EQ(op.editBase, (COORD{ 1, 1 }));
+	EXPECT_EQ(doc.getEditAnchors()[1], (COORD{ 3, 1 }));
+
+	auto legacy = Serializer::makeUpdateFor(msg::sessionAuthVersion, op);
+	msg::WriteResponse parsed;
+	msg::parse(legacy, 0, parsed.type, parsed.version, parsed.user, parsed.text, parsed.X, parsed.Y);
+	EXPECT_EQ(parsed.version, msg::sessionAuthVersion);
+	EXPECT_EQ(parsed.user, 1);
+	EXPECT_EQ(parsed.X, 3);
+	EXPECT_EQ(parsed.Y, 1);
+
+	auto compact = msg::deserialize<msg::WriteResponse>(Serializer::makeUpdateFor(msg::compactVersion, op), { COORD{ 0, 0 }, COORD{ 1, 1 } }).value();
+	EXPECT_EQ(compact.version, msg::compactVersion);
+	EXPECT_EQ(compact.X, 3);
+	EXPECT_EQ(compact.Y, 1);
+}
+
+TEST(DeserializerTests, ParseCompactEraseAndMoveToTest) {
+	msg::Buffer erase{16};
+	msg::serializeTo(erase, 0, msg::Type::erase, msg::compactVersion, msg::VarInt{ 300 });
+	EXPECT_EQ(Deserializer::parseErase(erase).value().eraseSize, 300);
+
+	msg::Buffer moveTo{16};
+	msg::serializeTo(moveTo, 0, msg::Type::moveTo, msg::compactVersion, msg::VarInt{ 4 }, msg::VarInt{ 1000 });
+	auto msg = Deserializer::parseMoveTo(moveTo).value();
+	EXPECT_EQ(msg.X, 4);
+	EXPECT_EQ(msg.Y, 1000);
+}
+
+TEST(SchemaTests, EncodedSizeIsExactTest) {
+	msg::ConnectResponse msg{ msg::Type::join, msg::compactVersion, 1, "", "acCode", "some text\nin document", { 0, 0, 300, 2 }, { 5, 1, 0, 0 } };
+	EXPECT_EQ(msg::encodedSize(msg), msg::serialize(msg).size);
+	msg.version = msg::legacyVersion;
+	EXPECT_EQ(msg::encodedSize(msg), msg::serialize(msg).size);
+
+	msg::Replace replace{ msg::Type::replace, msg::compactVersion, "", "new", { { COORD{ 1, 2 }, COORD{ 200, 2 } } } };
+	auto buffer = msg::serialize(replace);
+	EXPECT_EQ(buffer.size, buffer.capacity);
+	EXPECT_EQ(buffer.size, 2 + 4 + 1 + 1 + 1 + 2 + 1);
+}
+
+TEST(SchemaTests, RoundTripBothEncodingsTest) {
+	for (auto version : { msg::legacyVersion, msg::sessionAuthVersion, msg::compactVersion }) {
+		msg::MoveVertical msg{ msg::Type::moveVertical, version, authToken, msg::MoveSide::up, 1000, 1 };
+		auto parsed = msg::deserialize<msg::MoveVertical>(msg::serialize(msg)).value();
+		EXPECT_EQ(parsed.authToken, msg::carriesAuthToken(version) ? authToken : "");
+		EXPECT_EQ(parsed.side, msg.side);
+		EXPECT_EQ(parsed.clientWidth, msg.clientWidth);
+		EXPECT_EQ(parsed.withSelect, msg.withSelect);
+
+		msg::Replace replace{ msg::Type::replace, version, "", "txt", { { COORD{ 1, 2 }, COORD{ 4, 2 } }, { COORD{ 0, 7 }, COORD{ 3, 7 } } } };
+		auto parsedReplace = msg::deserialize<msg::Replace>(msg::serialize(replace)).value();
+		EXPECT_EQ(parsedReplace.text, replace.text);
+		ASSERT_EQ(parsedReplace.segments.size(), 2);
+		EXPECT_EQ(parsedReplace.segments[1].first.Y, 7);
+		EXPECT_EQ(parsedReplace.segments[1].second.X, 3);
+	}
+}
+
+TEST(SchemaTests, EditPosRoundTripTest) {
+	msg::EditAnchors editAnchors{ COORD{ 3, 1 }, COORD{ 40, 9 } };
+	msg::EraseResponse msg{ msg::Type::erase, msg::compactVersion, 1, 2, 38, 10 };
+	auto buffer = msg::serialize(msg, editAnchors);
+	EXPECT_EQ(buffer.size, 6);
+	auto parsed = msg::deserialize<msg::EraseResponse>(buffer, editAnchors).value();
+	EXPECT_EQ(parsed.user, 1);
+	EXPECT_EQ(parsed.eraseSize, 2);
+	EXPECT_EQ(parsed.X, 38);
+	EXPECT_EQ(parsed.Y, 10);
+}
+
+TEST(SchemaTests, CompactMoveResponseSkipsUnusedAnchorTest) {
+	msg::MoveResponse msg{ msg::Type::moveTo, msg::compactVersion, 0, 5, 6, 0, 7, 8 };
+	EXPECT_EQ(msg::serialize(msg).size, 6);
+	msg.withSelect = 1;
+	auto parsed = msg::deserialize<msg::MoveResponse>(msg::serialize(msg)).value();
+	EXPECT_EQ(parsed.anchorX, 7);
+	EXPECT_EQ(parsed.anchorY, 8);
+}
+
+TEST(SchemaTests, SocketFieldStaysFixedSizeTest) {
+	msg::ConnectJoinDoc msg{ msg::Type::join, msg::compactVersion, 0, "code" };
+	auto buffer = msg::serialize(msg);
+	buffer.replace(2, 123456);
+	auto parsed = msg::deserialize<msg::ConnectJoinDoc>(buffer).value();
+	EXPECT_EQ(parsed.socket, 123456);
+	EXPECT_EQ(parsed.acCode, "code");
+}
+
+TEST(SchemaTests, WriteViewPointsIntoBufferTest) {
+	msg::Buffer buffer = msg::serialize(msg::Write{ msg::Type::write, msg::compactVersion, "", "some text" });
+	auto view = msg::view<msg::WriteView>(buffer);
+	ASSERT_TRUE(view.has_value());
+	EXPECT_EQ(view->text, "some text");
+	EXPECT_EQ(view->text.data(), buffer.get() + 2);
+}
+
+TEST(SchemaTests, TruncatedFrameIsRejectedTest) {
+	msg::Buffer buffer = msg::serialize(msg::Write{ msg::Type::write, msg::compactVersion, "", "text" });
+	buffer.size -= 1;
+	EXPECT_FALSE(msg::view<msg::WriteView>(buffer).has_value());
+
+	msg::WriteResponse response{ msg::Type::write, msg::legacyVersion, 0, "a", 300, 4 };
+	msg::Buffer responseBuffer = msg::serialize(response);
+	responseBuffer.size -= 2;
+	EXPECT_FALSE(msg::view<msg::WriteResponseView>(responseBuffer).has_value());
+}
+
+TEST(SchemaTests, OversizedVectorCountIsRejectedTest) {
+	msg::Buffer buffer{16};
+	msg::serializeTo(buffer, 0, msg::Type::replace, msg::compactVersion, std::string{ "x" }, msg::VarInt{ 100000 });
+	msg::Replace msg;
+	EXPECT_LT(msg::schema::layoutRead(msg::Schema<msg::Replace>::Layout{}, msg, buffer, msg::noEditAnchors), 0);
+}
+
+
+TEST(SchemaTests, SnapshotFieldsOnlyInStreamedVersionTest) {
+	msg::ConnectResponse msg{ msg::Type::join, msg::compactVersion, 0, "", "code", "", { 0, 0 }, { 0, 0 }, 7, 100000 };
+	auto parsed = msg::deserialize<msg::ConnectResponse>(msg::serialize(msg)).value();
+	EXPECT_EQ(parsed.snapshotVersion, 0);
+	EXPECT_EQ(parsed.snapshotSize, 0);
+
+	msg.version = msg::streamedSnapshotVersion;
+	parsed = msg::deserialize<msg::ConnectResponse>(msg::serialize(msg)).value();
+	EXPECT_EQ(parsed.snapshotVersion, 7);
+	EXPECT_EQ(parsed.snapshotSize, 100000);
+}
+
+TEST(SerializerTests, SnapshotChunkRoundTripTest) {
+	auto buffer = Serializer::makeSnapshotChunk(msg::streamedSnapshotVersion, 3, 16384, std::string(100, 'x'));
+	auto parsed = msg::deserialize<msg::SnapshotChunk>(buffer).value();
+	EXPECT_EQ(parsed.type, msg::Type::snapshotChunk);
+	EXPECT_EQ(parsed.snapshotVersion, 3);
+	EXPECT_EQ(parsed.offset, 16384);
+	EXPECT_EQ(parsed.text, std::string(100, 'x'));
+}
+
+TEST(SchemaTests, JoinCarriesLastVersionFromResumeVersionTest) {
+	msg::ConnectJoinDoc msg{ msg::Type::join, msg::streamedSnapshotVersion, 0, "code", 42 };
+	EXPECT_EQ(msg::deserialize<msg::ConnectJoinDoc>(msg::serialize(msg)).value().lastVersion, 0);
+	msg.version = msg::resumeVersion;
+	auto parsed = msg::deserialize<msg::ConnectJoinDoc>(msg::serialize(msg)).value();
+	EXPECT_EQ(parsed.acCode, "code");
+	EXPECT_EQ(parsed.lastVersion, 42);
+}
+
+TEST(SchemaTests, EditsCarryBaseVersionFromRebaseVersionTest) {
+	msg::Write write{ msg::Type::write, msg::rejectVersion, "", "text", 7, 3, 1 };
+	EXPECT_EQ(msg::deserialize<msg::Write>(msg::serialize(write)).value().baseVersion, 0);
+	write.version = msg::rebaseVersion;
+	auto buffer = msg::serialize(write);
+	auto parsedWrite = msg::view<msg::WriteView>(buffer);
+	ASSERT_TRUE(parsedWrite);
+	EXPECT_EQ(parsedWrite->baseVersion, 7);
+	EXPECT_EQ(parsedWrite->X, 3);
+	EXPECT_EQ(parsedWrite->Y, 1);
+
+	msg::Erase erase{ msg::Type::erase, msg::rebaseVersion, "", 2, 9, 4, 0 };
+	auto parsedErase = msg::deserialize<msg::Erase>(msg::serialize(erase)).value();
+	EXPECT_EQ(parsedErase.eraseSize, 2);
+	EXPECT_EQ(parsedErase.baseVersion, 9);
+	EXPECT_EQ(parsedErase.X, 4);
+}
+
+TEST(SerializerTests, PresenceCarriesOnlyMovedCursorsTest) {
+	ServerSiteDocument doc{ "abc\ndef", 3, 0, "id" };
+	doc.setCursorPos(1, COORD{ 2, 0 });
+	doc.setCursorPos(2, COORD{ 1, 1 });
+	doc.setCursorAnchor(2, COORD{ 3, 1 });
+	EXPECT_FALSE(doc.hasMovedCursors());
+	doc.markCursorMoved(2);
+	doc.markCursorMoved(1);
+	EXPECT_TRUE(doc.hasMovedCursors());
+	auto moved = doc.takeMovedCursors();
+	EXPECT_FALSE(doc.hasMovedCursors());
+
+	auto msg = msg::deserialize<msg::Presence>(Serializer::makePresenceResponse(msg::presenceVersion, doc, moved, 1)).value();
+	EXPECT_EQ(msg.type, msg::Type::presence);
+	std::vector<unsigned int> expected{ 1, 2, 0, 0, 0, 0, 2, 1, 1, 1, 3, 1 };
+	EXPECT_EQ(msg.cursors, expected);
+}
+
+TEST(SchemaTests, PresenceDatagramFieldsFromDatagramPresenceVersionTest) {
+	msg::ConnectJoinDoc join{ msg::Type::join, msg::presenceVersion, 0, "code", 42, 50000 };
+	EXPECT_EQ(msg::deserialize<msg::ConnectJoinDoc>(msg::serialize(join)).value().presencePort, 0);
+	join.version = msg::datagramPresenceVersion;
+	EXPECT_EQ(msg::deserialize<msg::ConnectJoinDoc>(msg::serialize(join)).value().presencePort, 50000);
+	msg::ConnectCreateDoc create{ msg::Type::create, msg::datagramPresenceVersion, 0, "file.txt", 50001 };
+	EXPECT_EQ(msg::deserialize<msg::ConnectCreateDoc>(msg::serialize(create)).value().presencePort, 50001);
+
+	msg::Presence presence{ msg::Type::presence, msg::presenceVersion, { 1, 2, 3, 0, 0, 0 }, 7, 12 };
+	auto legacy = msg::deserialize<msg::Presence>(msg::serialize(presence)).value();
+	EXPECT_EQ(legacy.seq, 0);
+	EXPECT_EQ(legacy.docVersion, 0);
+	presence.version = msg::datagramPresenceVersion;
+	auto parsed = msg::deserialize<msg::Presence>(msg::serialize(presence)).value();
+	EXPECT_EQ(parsed.cursors, presence.cursors);
+	EXPECT_EQ(parsed.seq, 7);
+	EXPECT_EQ(parsed.docVersion, 12);
+}
\ No newline at end of file
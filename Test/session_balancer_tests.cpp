@@ -0,0 +1,64 @@
+#include "pch.h"
+#include "session_balancer.h"
+
+using BalancerClock = server::SessionBalancer::Clock;
+
+server::SessionBalancer::Thresholds makeBalancerThresholds() {
+	server::SessionBalancer::Thresholds thresholds;
+	thresholds.sustain = std::chrono::seconds{ 10 };
+	thresholds.cooldown = std::chrono::seconds{ 30 };
+	return thresholds;
+}
+
+std::vector<server::SessionBalancer::WorkerSessions> makeHotspot() {
+	// First worker is busy with one big session and a few small ones, the second one is almost idle
+	return {
+		server::SessionBalancer::WorkerSessions{ 0.9, { { "big", 600.0 }, { "medium", 250.0 }, { "small", 50.0 } } },
+		server::SessionBalancer::WorkerSessions{ 0.1, { { "other", 20.0 } } }
+	};
+}
+
+TEST(SessionBalancerTests, MovesSessionWhichEvensOutWorkersTest) {
+	server::SessionBalancer balancer{ makeBalancerThresholds() };
+	auto now = BalancerClock::now();
+	auto workers = makeHotspot();
+	EXPECT_FALSE(balancer.decide(workers, now).has_value());
+	auto migration = balancer.decide(workers, now + std::chrono::seconds{ 10 });
+	ASSERT_TRUE(migration.has_value());
+	EXPECT_EQ(migration->source, 0);
+	EXPECT_EQ(migration->target, 1);
+	// Moving the big one leaves the workers at 0.3 and 0.7, the medium one at 0.65 and 0.35
+	EXPECT_EQ(migration->acCode, "medium");
+}
+
+TEST(SessionBalancerTests, WaitsForCooldownAfterMigrationTest) {
+	auto thresholds = makeBalancerThresholds();
+	server::SessionBalancer balancer{ thresholds };
+	auto now = BalancerClock::now();
+	auto workers = makeHotspot();
+	balancer.migrated(now);
+	balancer.decide(workers, now);
+	EXPECT_FALSE(balancer.decide(workers, now + thresholds.sustain).has_value());
+	EXPECT_TRUE(balancer.decide(workers, now + thresholds.cooldown).has_value());
+}
+
+TEST(SessionBalancerTests, KeepsBalancedOrSingleSessionWorkersTest) {
+	server::SessionBalancer balancer{ makeBalancerThresholds() };
+	auto now = BalancerClock::now();
+	std::vector<server::SessionBalancer::WorkerSessions> balanced{
+		server::SessionBalancer::WorkerSessions{ 0.8, { { "first", 100.0 }, { "second", 100.0 } } },
+		server::SessionBalancer::WorkerSessions{ 0.7, { { "third", 100.0 } } }
+	};
+	balancer.decide(balanced, now);
+	EXPECT_FALSE(balancer.decide(balanced, now + std::chrono::minutes{ 1 }).has_value());
+
+	// Moving the only session of a hot worker would only move the hotspot
+	std::vector<server::SessionBalancer::WorkerSessions> single{
+		server::SessionBalancer::WorkerSessions{ 0.9, { { "only", 500.0 } } },
+		server::SessionBalancer::WorkerSessions{ 0.0, {} }
+	};
+	server::SessionBalancer singleBalancer{ makeBalancerThresholds() };
+	singleBalancer.decide(single, now);
+	EXPECT_FALSE(singleBalancer.decide(single, now + std::chrono::minutes{ 1 }).has_value());
+	EXPECT_FALSE(singleBalancer.decide({ single[0] }, now + std::chrono::minutes{ 2 }).has_value());
+}
\ No newline at end of file
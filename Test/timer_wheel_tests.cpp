@@ -0,0 +1,62 @@
+#include "pch.h"
+#include "timer_wheel.h"
+
+using namespace std::chrono_literals;
+using WheelClock = std::chrono::steady_clock;
+
+TEST(TimerWheelTests, TimersFireInDeadlineOrderTest) {
+	auto start = WheelClock::now();
+	server::TimerWheel<int> wheel{ 100ms, start };
+	wheel.schedule(300ms, 3);
+	wheel.schedule(100ms, 1);
+	wheel.schedule(200ms, 2);
+	EXPECT_TRUE(wheel.advance(start + 50ms).empty());
+	auto expired = wheel.advance(start + 300ms);
+	ASSERT_EQ(expired.size(), 3);
+	EXPECT_EQ(expired[0].event, 1);
+	EXPECT_EQ(expired[1].event, 2);
+	EXPECT_EQ(expired[2].event, 3);
+	EXPECT_EQ(wheel.size(), 0);
+	EXPECT_FALSE(wheel.untilNext(start + 300ms).has_value());
+}
+
+TEST(TimerWheelTests, CancelledTimerDoesNotFireTest) {
+	auto start = WheelClock::now();
+	server::TimerWheel<int> wheel{ 100ms, start };
+	auto cancelled = wheel.schedule(200ms, 1);
+	wheel.schedule(200ms, 2);
+	EXPECT_TRUE(wheel.cancel(cancelled));
+	EXPECT_FALSE(wheel.cancel(cancelled));
+	auto expired = wheel.advance(start + 1s);
+	ASSERT_EQ(expired.size(), 1);
+	EXPECT_EQ(expired[0].event, 2);
+}
+
+TEST(TimerWheelTests, LongTimersAreMovedDownLevelsTest) {
+	auto start = WheelClock::now();
+	server::TimerWheel<int> wheel{ 100ms, start };
+	// 10 s is in the second level, 10 min in the third one
+	wheel.schedule(10s, 1);
+	wheel.schedule(10min, 2);
+	EXPECT_TRUE(wheel.advance(start + 9900ms).empty());
+	auto expired = wheel.advance(start + 10s);
+	ASSERT_EQ(expired.size(), 1);
+	EXPECT_EQ(expired[0].event, 1);
+	EXPECT_TRUE(wheel.advance(start + 10min - 100ms).empty());
+	expired = wheel.advance(start + 10min);
+	ASSERT_EQ(expired.size(), 1);
+	EXPECT_EQ(expired[0].event, 2);
+}
+
+TEST(TimerWheelTests, UntilNextPointsAtNearestTimerTest) {
+	auto start = WheelClock::now();
+	server::TimerWheel<int> wheel{ 100ms, start };
+	wheel.schedule(500ms, 1);
+	EXPECT_EQ(wheel.untilNext(start), WheelClock::duration{ 500ms });
+	wheel.schedule(1h, 2);
+	wheel.advance(start + 500ms);
+	// Nothing is due in the first level, the wheel wakes up when the next level moves down
+	auto untilNext = wheel.untilNext(start + 500ms);
+	ASSERT_TRUE(untilNext.has_value());
+	EXPECT_LE(*untilNext, WheelClock::duration{ 6400ms });
+}
\ No newline at end of file